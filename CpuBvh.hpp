@@ -0,0 +1,1102 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#include "CpuParallel.hpp"
+#include "bvh.h"
+
+// CPU side port of bvh_traverse.hlsl. It reads the same BvhNode layout, so the GPU build result can be used as is.
+#define CPU_BVH_STACK_SIZE 64
+
+// the deepest branch node buildBvh() emits, the root is 0. A traversal then holds at most CPU_BVH_MAX_DEPTH + 1 nodes on its stack
+#define CPU_BVH_MAX_DEPTH ( CPU_BVH_STACK_SIZE - 2 )
+
+namespace cpu
+{
+const uint32_t kInvalidPrimitive = 0xFFFFFFFF;
+
+struct Ray
+{
+	glm::vec3 ro;
+	float tmin = 0.0f;
+	glm::vec3 rd;
+	float tmax = FLT_MAX;
+};
+
+/*
+	t      : intersected t. FLT_MAX is no-intersected
+	primID : index of the primitive ( see Bvh::primitiveType() ). kInvalidPrimitive is no-intersected
+	u, v   : barycentric, p = v0 * (1 - u - v) + v1 * u + v2 * v. always 0 for spheres
+	Ng     : normalized geometric normal
+*/
+struct Hit
+{
+	float t = FLT_MAX;
+	uint32_t primID = kInvalidPrimitive;
+	float u = 0.0f;
+	float v = 0.0f;
+	glm::vec3 Ng = glm::vec3( 0.0f );
+
+	bool isHit() const { return primID != kInvalidPrimitive; }
+};
+
+inline glm::vec3 homogeneous( glm::vec4 p )
+{
+	return glm::vec3( p.x, p.y, p.z ) / p.w;
+}
+inline void shoot( glm::vec3* ro, glm::vec3* rd, int imageWidth, int imageHeight, float x, float y, const glm::mat4& inverseVP )
+{
+	float xf = 2.0f * ( x - (float)imageWidth * 0.5f ) / (float)imageWidth;
+	float yf = -2.0f * ( y - (float)imageHeight * 0.5f ) / (float)imageHeight;
+	*ro = homogeneous( inverseVP * glm::vec4( xf, yf, -1.0f /*near*/, 1.0f ) );
+	*rd = homogeneous( inverseVP * glm::vec4( xf, yf, +1.0f /*far */, 1.0f ) ) - *ro;
+	*rd = glm::normalize( *rd );
+}
+
+/*
+ tmin must be initialized.
+*/
+inline bool intersect_ray_triangle( glm::vec3 ro, glm::vec3 rd, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, float* tmin, float* u_out, float* v_out )
+{
+	const float kEpsilon = 1.0e-8f;
+
+	glm::vec3 v0v1 = v1 - v0;
+	glm::vec3 v0v2 = v2 - v0;
+	glm::vec3 pvec = glm::cross( rd, v0v2 );
+	float det = glm::dot( v0v1, pvec );
+
+	if ( std::abs( det ) < kEpsilon )
+	{
+		return false;
+	}
+
+	float invDet = 1.0f / det;
+
+	glm::vec3 tvec = ro - v0;
+	float u = glm::dot( tvec, pvec ) * invDet;
+	if ( u < 0.0f || u > 1.0f )
+	{
+		return false;
+	}
+
+	glm::vec3 qvec = glm::cross( tvec, v0v1 );
+	float v = glm::dot( rd, qvec ) * invDet;
+	if ( v < 0.0f || u + v > 1.0f )
+	{
+		return false;
+	}
+
+	float t = glm::dot( v0v2, qvec ) * invDet;
+
+	if ( t < 0.0f )
+	{
+		return false;
+	}
+	if ( *tmin < t )
+	{
+		return false;
+	}
+	*tmin = t;
+	*u_out = u;
+	*v_out = v;
+	return true;
+}
+
+/*
+ tmin must be initialized. The same as intersect_sphere() in bvh_traverse.hlsl
+ except that the nearest root in [tnear, tmin] is taken.
+*/
+inline bool intersect_ray_sphere( glm::vec3 ro, glm::vec3 rd, glm::vec3 o, float r, float tnear, float* tmin )
+{
+	float A = glm::dot( rd, rd );
+	glm::vec3 S = ro - o;
+	glm::vec3 SxRD = glm::cross( S, rd );
+	float D = A * r * r - glm::dot( SxRD, SxRD );
+
+	if ( D < 0.0f )
+	{
+		return false;
+	}
+
+	float B = glm::dot( S, rd );
+	float sqrt_d = std::sqrt( D );
+	float t0 = ( -B - sqrt_d ) / A;
+	float t1 = ( -B + sqrt_d ) / A;
+	float t = tnear <= t0 ? t0 : t1;
+	if ( t < tnear || *tmin < t )
+	{
+		return false;
+	}
+	*tmin = t;
+	return true;
+}
+
+/*
+	Woop's unit triangle test. The triangle is given as the world to triangle space affine transform,
+	where v0, v1, v2 go to (0, 0, 0), (1, 0, 0), (0, 1, 0). Edges are not recomputed per test.
+	rows[i].xyz is the i-th row of the 3x3 part and rows[i].w is the translation.
+*/
+struct WoopTriangle
+{
+	glm::vec4 rows[3];
+};
+
+inline WoopTriangle woopTriangle( glm::vec3 v0, glm::vec3 v1, glm::vec3 v2 )
+{
+	WoopTriangle w;
+	glm::vec3 e1 = v1 - v0;
+	glm::vec3 e2 = v2 - v0;
+	glm::vec3 n = glm::cross( e1, e2 );
+	if ( glm::dot( n, n ) == 0.0f )
+	{
+		// degenerated. Oz = 1 and Dz = 0 never pass
+		w.rows[0] = glm::vec4( 0.0f );
+		w.rows[1] = glm::vec4( 0.0f );
+		w.rows[2] = glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f );
+		return w;
+	}
+	glm::mat4 toWorld( glm::vec4( e1, 0.0f ), glm::vec4( e2, 0.0f ), glm::vec4( n, 0.0f ), glm::vec4( v0, 1.0f ) );
+	glm::mat4 toLocal = glm::inverse( toWorld );
+	for ( int i = 0; i < 3; ++i )
+	{
+		w.rows[i] = glm::vec4( toLocal[0][i], toLocal[1][i], toLocal[2][i], toLocal[3][i] );
+	}
+	return w;
+}
+
+/*
+ tmin must be initialized.
+*/
+inline bool intersect_ray_woop( glm::vec3 ro, glm::vec3 rd, const WoopTriangle& tri, float* tmin, float* u_out, float* v_out )
+{
+	const glm::vec4& r0 = tri.rows[0];
+	const glm::vec4& r1 = tri.rows[1];
+	const glm::vec4& r2 = tri.rows[2];
+	float Oz = r2.x * ro.x + r2.y * ro.y + r2.z * ro.z + r2.w;
+	float Dz = r2.x * rd.x + r2.y * rd.y + r2.z * rd.z;
+	float t = -Oz / Dz;
+
+	// also rejects NaN
+	if ( !( 0.0f <= t && t <= *tmin ) )
+	{
+		return false;
+	}
+
+	glm::vec3 p = ro + rd * t;
+	float u = r0.x * p.x + r0.y * p.y + r0.z * p.z + r0.w;
+	if ( u < 0.0f || u > 1.0f )
+	{
+		return false;
+	}
+	float v = r1.x * p.x + r1.y * p.y + r1.z * p.z + r1.w;
+	if ( v < 0.0f || u + v > 1.0f )
+	{
+		return false;
+	}
+	*tmin = t;
+	*u_out = u;
+	*v_out = v;
+	return true;
+}
+
+/*
+	Watertight Ray/Triangle Intersection [Woop, Benthin, Wald 2013].
+	The per-ray part: permute axes so that z is the dominant direction, and the shear to make the ray +z.
+*/
+struct WatertightRay
+{
+	int kx, ky, kz;
+	float Sx, Sy, Sz;
+};
+inline WatertightRay watertightRay( glm::vec3 rd )
+{
+	glm::vec3 a = glm::abs( rd );
+	WatertightRay r;
+	r.kz = a.x < a.y ? ( a.y < a.z ? 2 : 1 ) : ( a.x < a.z ? 2 : 0 );
+	r.kx = ( r.kz + 1 ) % 3;
+	r.ky = ( r.kx + 1 ) % 3;
+
+	// keep the winding
+	if ( rd[r.kz] < 0.0f )
+	{
+		std::swap( r.kx, r.ky );
+	}
+	r.Sx = rd[r.kx] / rd[r.kz];
+	r.Sy = rd[r.ky] / rd[r.kz];
+	r.Sz = 1.0f / rd[r.kz];
+	return r;
+}
+
+/*
+ tmin must be initialized. Rays through a shared edge or vertex always hit at least one of the triangles.
+*/
+inline bool intersect_ray_triangle_watertight( glm::vec3 ro, const WatertightRay& r, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, float* tmin, float* u_out, float* v_out )
+{
+	glm::vec3 A = v0 - ro;
+	glm::vec3 B = v1 - ro;
+	glm::vec3 C = v2 - ro;
+
+	float Ax = A[r.kx] - r.Sx * A[r.kz];
+	float Ay = A[r.ky] - r.Sy * A[r.kz];
+	float Bx = B[r.kx] - r.Sx * B[r.kz];
+	float By = B[r.ky] - r.Sy * B[r.kz];
+	float Cx = C[r.kx] - r.Sx * C[r.kz];
+	float Cy = C[r.ky] - r.Sy * C[r.kz];
+
+	float U = Cx * By - Cy * Bx;
+	float V = Ax * Cy - Ay * Cx;
+	float W = Bx * Ay - By * Ax;
+
+	// fall back to double on the edges
+	if ( U == 0.0f || V == 0.0f || W == 0.0f )
+	{
+		U = (float)( (double)Cx * By - (double)Cy * Bx );
+		V = (float)( (double)Ax * Cy - (double)Ay * Cx );
+		W = (float)( (double)Bx * Ay - (double)By * Ax );
+	}
+
+	// both faces
+	if ( ( U < 0.0f || V < 0.0f || W < 0.0f ) && ( U > 0.0f || V > 0.0f || W > 0.0f ) )
+	{
+		return false;
+	}
+
+	float det = U + V + W;
+	if ( det == 0.0f )
+	{
+		return false;
+	}
+
+	float Az = r.Sz * A[r.kz];
+	float Bz = r.Sz * B[r.kz];
+	float Cz = r.Sz * C[r.kz];
+	float T = U * Az + V * Bz + W * Cz;
+
+	float rcpDet = 1.0f / det;
+	float t = T * rcpDet;
+	if ( t < 0.0f || *tmin < t )
+	{
+		return false;
+	}
+	*tmin = t;
+	*u_out = V * rcpDet;
+	*v_out = W * rcpDet;
+	return true;
+}
+
+inline float compMin( glm::vec3 v )
+{
+	return std::min( std::min( v.x, v.y ), v.z );
+}
+inline float compMax( glm::vec3 v )
+{
+	return std::max( std::max( v.x, v.y ), v.z );
+}
+inline bool slabs( glm::vec3 p0, glm::vec3 p1, glm::vec3 ro, glm::vec3 one_over_rd, float knownT, float* hitT )
+{
+	glm::vec3 t0 = ( p0 - ro ) * one_over_rd;
+	glm::vec3 t1 = ( p1 - ro ) * one_over_rd;
+
+	glm::vec3 tmin = glm::min( t0, t1 ), tmax = glm::max( t0, t1 );
+	float region_min = compMax( tmin );
+	float region_max = compMin( tmax );
+
+	region_max = std::min( region_max, knownT );
+	*hitT = region_min;
+
+	return region_min <= region_max && 0.0f <= region_max;
+}
+
+/*
+	slabs() with the far distance pushed out by 2 gamma(3) [Ize 2013, Robust BVH Ray Traversal],
+	so that rounding errors don't cull a box the ray touches. Needed for the watertight test.
+*/
+inline bool slabsConservative( glm::vec3 p0, glm::vec3 p1, glm::vec3 ro, glm::vec3 one_over_rd, float knownT, float* hitT )
+{
+	const float kEps = FLT_EPSILON * 0.5f;
+	const float kGamma3 = 3.0f * kEps / ( 1.0f - 3.0f * kEps );
+
+	glm::vec3 t0 = ( p0 - ro ) * one_over_rd;
+	glm::vec3 t1 = ( p1 - ro ) * one_over_rd;
+
+	glm::vec3 tmin = glm::min( t0, t1 ), tmax = glm::max( t0, t1 );
+	float region_min = compMax( tmin );
+	float region_max = compMin( tmax ) * ( 1.0f + 2.0f * kGamma3 );
+
+	region_max = std::min( region_max, knownT );
+	*hitT = region_min;
+
+	return region_min <= region_max && 0.0f <= region_max;
+}
+
+inline bool isLeaf( uint32_t index0 )
+{
+	return ( index0 & 0x80000000 ) != 0;
+}
+
+/*
+	How triangles are read in leaves. See precomputeTriangles()
+		Indexed    : through the index buffer, Moller-Trumbore ( the same as bvh_traverse.hlsl )
+		Woop       : WoopTriangle per element, 48 bytes, no edge computation
+		Watertight : vertices copied in the leaf order, 36 bytes, watertight test
+*/
+enum class TriangleLayout
+{
+	Indexed,
+	Woop,
+	Watertight,
+};
+
+/*
+	primitive id of a mixed bvh
+		[0, triangleCount())                               : triangles
+		[triangleCount(), triangleCount() + sphereCount()) : spheres
+	The type is given by the range, so no extra storage is needed per primitive.
+*/
+struct Bvh
+{
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> elementIndices; // bvhElementIndices
+
+	// triangles
+	std::vector<glm::vec3> P;
+	std::vector<uint32_t> indices;
+
+	// spheres. xyz: center, w: radius
+	std::vector<glm::vec4> spheres;
+
+	// precomputed triangles in the order of elementIndices. Only the one for triangleLayout is filled.
+	TriangleLayout triangleLayout = TriangleLayout::Indexed;
+	std::vector<WoopTriangle> woopTriangles;
+	std::vector<glm::vec3> leafVertices; // [i * 3 + k]
+
+	uint32_t triangleCount() const { return (uint32_t)( indices.size() / 3 ); }
+	uint32_t sphereCount() const { return (uint32_t)spheres.size(); }
+	uint32_t primitiveCount() const { return triangleCount() + sphereCount(); }
+
+	int primitiveType( uint32_t iPrim ) const
+	{
+		return iPrim < triangleCount() ? BVH_PRIMITIVE_TRIANGLE : BVH_PRIMITIVE_SPHERE;
+	}
+
+	void triangle( uint32_t iPrim, glm::vec3* v0, glm::vec3* v1, glm::vec3* v2 ) const
+	{
+		uint32_t index = iPrim * 3;
+		*v0 = P[indices[index]];
+		*v1 = P[indices[index + 1]];
+		*v2 = P[indices[index + 2]];
+	}
+	glm::vec4 sphere( uint32_t iPrim ) const
+	{
+		return spheres[iPrim - triangleCount()];
+	}
+
+	void bounds( uint32_t iPrim, glm::vec3* lower, glm::vec3* upper, glm::vec3* centeroid ) const
+	{
+		if ( primitiveType( iPrim ) == BVH_PRIMITIVE_TRIANGLE )
+		{
+			glm::vec3 v0, v1, v2;
+			triangle( iPrim, &v0, &v1, &v2 );
+			*lower = glm::min( glm::min( v0, v1 ), v2 );
+			*upper = glm::max( glm::max( v0, v1 ), v2 );
+			*centeroid = ( v0 + v1 + v2 ) / 3.0f;
+		}
+		else
+		{
+			glm::vec4 s = sphere( iPrim );
+			glm::vec3 o = glm::vec3( s.x, s.y, s.z );
+			*lower = o - glm::vec3( s.w );
+			*upper = o + glm::vec3( s.w );
+			*centeroid = o;
+		}
+	}
+};
+
+/*
+	Child slot, a subtree or a leaf together with its AABB in the parent.
+	( node << 1 ) | 0 is L and ( node << 1 ) | 1 is R. The whole tree is the slots 0 and 1.
+*/
+inline const uint32_t* slotIndex( const Bvh& bvh, uint32_t slot )
+{
+	const BvhNode& node = bvh.nodes[slot >> 1];
+	return ( slot & 1 ) ? node.indexR : node.indexL;
+}
+inline void slotBounds( const Bvh& bvh, uint32_t slot, glm::vec3* lower, glm::vec3* upper )
+{
+	const BvhNode& node = bvh.nodes[slot >> 1];
+	const float* l = ( slot & 1 ) ? node.lowerR : node.lowerL;
+	const float* u = ( slot & 1 ) ? node.upperR : node.upperL;
+	*lower = glm::vec3( l[0], l[1], l[2] );
+	*upper = glm::vec3( u[0], u[1], u[2] );
+}
+// R of the root when the root is not split
+inline bool isEmptySlot( const Bvh& bvh, uint32_t slot )
+{
+	const uint32_t* index = slotIndex( bvh, slot );
+	return isLeaf( index[0] ) && ( index[0] & 0x7FFFFFFF ) == index[1];
+}
+
+/*
+	Binned SAH builder running on CPU. It makes the same decisions as bvh_selectBin.hlsl
+	( BIN_COUNT bins over the task AABB, SAH_AABB_COST, SAH_ELEM_COST ) and emits nodes in the same layout.
+	Use it where no device is available. Results from GPUBvhBuilder can also be assigned to Bvh directly.
+	spheres can be nullptr if sphereCount is 0.
+	A split that could push a subtree past CPU_BVH_MAX_DEPTH is replaced by a median split, which halves the elements,
+	so degenerate inputs still fit the traversal stack. Only then the tree differs from the GPU builder's.
+*/
+inline void buildBvh( Bvh* bvh, const glm::vec3* P, uint32_t pointCount, const uint32_t* indices, uint32_t triangleCount, const glm::vec4* spheres, uint32_t sphereCount )
+{
+	bvh->P.assign( P, P + pointCount );
+	bvh->indices.assign( indices, indices + triangleCount * 3 );
+	bvh->spheres.assign( spheres, spheres + sphereCount );
+	bvh->nodes.clear();
+	bvh->triangleLayout = TriangleLayout::Indexed;
+	bvh->woopTriangles.clear();
+	bvh->leafVertices.clear();
+
+	uint32_t primitiveCount = bvh->primitiveCount();
+	bvh->elementIndices.resize( primitiveCount );
+	if ( primitiveCount == 0 )
+	{
+		return;
+	}
+
+	struct Element
+	{
+		glm::vec3 lower;
+		glm::vec3 upper;
+		glm::vec3 centeroid;
+	};
+	struct Task
+	{
+		glm::vec3 lower;
+		glm::vec3 upper;
+		int geomBeg;
+		int geomEnd;
+		int parentNode;
+		int childOrder;
+		int depth;
+	};
+	struct CpuBin
+	{
+		glm::vec3 lower = glm::vec3( +FLT_MAX );
+		glm::vec3 upper = glm::vec3( -FLT_MAX );
+		int nElem = 0;
+		void expand( const CpuBin& b )
+		{
+			lower = glm::min( lower, b.lower );
+			upper = glm::max( upper, b.upper );
+			nElem += b.nElem;
+		}
+	};
+	auto surfaceArea = []( glm::vec3 lower, glm::vec3 upper ) {
+		glm::vec3 size = upper - lower;
+		return ( size.x * size.y + size.y * size.z + size.z * size.x ) * 2.0f;
+	};
+
+	std::vector<Element> elements( primitiveCount );
+	Task first;
+	first.lower = glm::vec3( +FLT_MAX );
+	first.upper = glm::vec3( -FLT_MAX );
+	first.geomBeg = 0;
+	first.geomEnd = primitiveCount;
+	first.parentNode = -1;
+	first.childOrder = 0;
+	first.depth = 0;
+	for ( uint32_t i = 0; i < primitiveCount; ++i )
+	{
+		bvh->bounds( i, &elements[i].lower, &elements[i].upper, &elements[i].centeroid );
+		first.lower = glm::min( first.lower, elements[i].lower );
+		first.upper = glm::max( first.upper, elements[i].upper );
+		bvh->elementIndices[i] = i;
+	}
+
+	std::vector<BvhNode>& nodes = bvh->nodes;
+	nodes.reserve( std::max( (int)primitiveCount - 1, 1 ) );
+
+	auto binIndex = [&]( const Task& task, uint32_t iPrim, int axis ) {
+		float extent = task.upper[axis] - task.lower[axis];
+		if ( extent <= 0.0f )
+		{
+			return 0;
+		}
+		float location_f = ( elements[iPrim].centeroid[axis] - task.lower[axis] ) / extent;
+		return glm::clamp( (int)( location_f * (float)BIN_COUNT ), 0, BIN_COUNT - 1 );
+	};
+
+	// median splits from depth can finish nElem elements within CPU_BVH_MAX_DEPTH
+	auto fitsDepth = []( int depth, int nElem ) {
+		int levels = 0;
+		while ( ( 1u << levels ) < (uint32_t)nElem )
+		{
+			levels++;
+		}
+		return depth + levels <= CPU_BVH_MAX_DEPTH + 1;
+	};
+
+	// FIFO, so node indices are assigned level by level like the GPU builder does
+	std::vector<Task> tasks;
+	tasks.push_back( first );
+	std::vector<uint32_t> scratch;
+	for ( size_t iTask = 0; iTask < tasks.size(); ++iTask )
+	{
+		Task task = tasks[iTask];
+
+		CpuBin bins[3][BIN_COUNT];
+		for ( int i = task.geomBeg; i < task.geomEnd; ++i )
+		{
+			uint32_t iPrim = bvh->elementIndices[i];
+			const Element& e = elements[iPrim];
+			for ( int axis = 0; axis < 3; ++axis )
+			{
+				CpuBin& b = bins[axis][binIndex( task, iPrim, axis )];
+				b.lower = glm::min( b.lower, e.lower );
+				b.upper = glm::max( b.upper, e.upper );
+				b.nElem++;
+			}
+		}
+
+		float splitSahMin = SAH_ELEM_COST * ( task.geomEnd - task.geomBeg ); // non split SAH
+		int splitAxis = -1;
+		int splitBinIndexBorder = 0;
+		CpuBin splitBinL;
+		CpuBin splitBinR;
+		float saP = surfaceArea( task.lower, task.upper );
+		for ( int axis = 0; axis < 3; ++axis )
+		{
+			CpuBin summedBinsL[BIN_COUNT];
+			CpuBin summedBinsR[BIN_COUNT];
+			CpuBin b;
+			for ( int i = 0; i < BIN_COUNT; ++i )
+			{
+				b.expand( bins[axis][i] );
+				summedBinsL[i] = b;
+			}
+			b = CpuBin();
+			for ( int i = BIN_COUNT - 1; 0 <= i; --i )
+			{
+				b.expand( bins[axis][i] );
+				summedBinsR[i] = b;
+			}
+
+			// L [x---]
+			// R [-xxx]
+			for ( int i = 0; i < BIN_COUNT - 1; ++i )
+			{
+				const CpuBin& L = summedBinsL[i];
+				const CpuBin& R = summedBinsR[i + 1];
+				if ( 0 == L.nElem || 0 == R.nElem )
+				{
+					continue;
+				}
+				float saL = surfaceArea( L.lower, L.upper );
+				float saR = surfaceArea( R.lower, R.upper );
+				float sah =
+					SAH_AABB_COST * 2.0f + ( saL / saP ) * SAH_ELEM_COST * L.nElem + ( saR / saP ) * SAH_ELEM_COST * R.nElem;
+				if ( sah < splitSahMin )
+				{
+					splitSahMin = sah;
+					splitAxis = axis;
+					splitBinIndexBorder = i + 1;
+					splitBinL = L;
+					splitBinR = R;
+				}
+			}
+		}
+
+		if ( splitAxis < 0 || task.geomEnd - task.geomBeg <= 1 )
+		{
+			if ( task.parentNode < 0 )
+			{
+				// Root no split case
+				BvhNode node;
+				node.indexL[0] = 0x80000000 | (uint32_t)task.geomBeg;
+				node.indexL[1] = (uint32_t)task.geomEnd;
+				node.indexR[0] = 0x80000000;
+				node.indexR[1] = 0;
+				for ( int axis = 0; axis < 3; ++axis )
+				{
+					node.lowerL[axis] = task.lower[axis];
+					node.upperL[axis] = task.upper[axis];
+					node.lowerR[axis] = +FLT_MAX;
+					node.upperR[axis] = -FLT_MAX;
+				}
+				nodes.push_back( node );
+			}
+			else
+			{
+				uint32_t* index = task.childOrder == 0 ? nodes[task.parentNode].indexL : nodes[task.parentNode].indexR;
+				index[0] = 0x80000000 | (uint32_t)task.geomBeg;
+				index[1] = (uint32_t)task.geomEnd;
+			}
+			continue;
+		}
+
+		// median split on the longest axis of the task
+		bool medianSplit = fitsDepth( task.depth + 1, splitBinL.nElem ) == false || fitsDepth( task.depth + 1, splitBinR.nElem ) == false;
+		if ( medianSplit )
+		{
+			glm::vec3 extent = task.upper - task.lower;
+			int axis = extent.x < extent.y ? ( extent.y < extent.z ? 2 : 1 ) : ( extent.x < extent.z ? 2 : 0 );
+			int mid = task.geomBeg + ( task.geomEnd - task.geomBeg ) / 2;
+			std::nth_element( bvh->elementIndices.begin() + task.geomBeg, bvh->elementIndices.begin() + mid, bvh->elementIndices.begin() + task.geomEnd, [&]( uint32_t a, uint32_t b ) {
+				return elements[a].centeroid[axis] < elements[b].centeroid[axis];
+			} );
+
+			splitBinL = CpuBin();
+			splitBinR = CpuBin();
+			for ( int i = task.geomBeg; i < task.geomEnd; ++i )
+			{
+				const Element& e = elements[bvh->elementIndices[i]];
+				CpuBin& b = i < mid ? splitBinL : splitBinR;
+				b.lower = glm::min( b.lower, e.lower );
+				b.upper = glm::max( b.upper, e.upper );
+				b.nElem++;
+			}
+		}
+
+		// do split
+		uint32_t currentNode = (uint32_t)nodes.size();
+		nodes.push_back( BvhNode() );
+		if ( 0 <= task.parentNode )
+		{
+			uint32_t* index = task.childOrder == 0 ? nodes[task.parentNode].indexL : nodes[task.parentNode].indexR;
+			index[0] = currentNode;
+			index[1] = 0;
+		}
+		for ( int axis = 0; axis < 3; ++axis )
+		{
+			nodes[currentNode].lowerL[axis] = splitBinL.lower[axis];
+			nodes[currentNode].upperL[axis] = splitBinL.upper[axis];
+			nodes[currentNode].lowerR[axis] = splitBinR.lower[axis];
+			nodes[currentNode].upperR[axis] = splitBinR.upper[axis];
+		}
+
+		// stable partition by bin index
+		if ( medianSplit == false )
+		{
+			scratch.clear();
+			int head = task.geomBeg;
+			for ( int i = task.geomBeg; i < task.geomEnd; ++i )
+			{
+				uint32_t iPrim = bvh->elementIndices[i];
+				if ( binIndex( task, iPrim, splitAxis ) < splitBinIndexBorder )
+				{
+					bvh->elementIndices[head++] = iPrim;
+				}
+				else
+				{
+					scratch.push_back( iPrim );
+				}
+			}
+			std::copy( scratch.begin(), scratch.end(), bvh->elementIndices.begin() + head );
+		}
+
+		Task lTask;
+		lTask.lower = splitBinL.lower;
+		lTask.upper = splitBinL.upper;
+		lTask.geomBeg = task.geomBeg;
+		lTask.geomEnd = task.geomBeg + splitBinL.nElem;
+		lTask.parentNode = currentNode;
+		lTask.childOrder = 0;
+		lTask.depth = task.depth + 1;
+		tasks.push_back( lTask );
+
+		Task rTask;
+		rTask.lower = splitBinR.lower;
+		rTask.upper = splitBinR.upper;
+		rTask.geomBeg = task.geomBeg + splitBinL.nElem;
+		rTask.geomEnd = task.geomEnd;
+		rTask.parentNode = currentNode;
+		rTask.childOrder = 1;
+		rTask.depth = task.depth + 1;
+		tasks.push_back( rTask );
+	}
+}
+
+inline void buildBvh( Bvh* bvh, const glm::vec3* P, uint32_t pointCount, const uint32_t* indices, uint32_t primitiveCount )
+{
+	buildBvh( bvh, P, pointCount, indices, primitiveCount, nullptr, 0 );
+}
+
+/*
+	Preprocess after the build. It has to be done again when the bvh is rebuilt.
+	Entries for spheres are left zero.
+*/
+inline void precomputeTriangles( Bvh* bvh, TriangleLayout layout )
+{
+	bvh->triangleLayout = layout;
+	bvh->woopTriangles.clear();
+	bvh->leafVertices.clear();
+
+	size_t n = bvh->elementIndices.size();
+	if ( layout == TriangleLayout::Woop )
+	{
+		bvh->woopTriangles.resize( n );
+	}
+	else if ( layout == TriangleLayout::Watertight )
+	{
+		bvh->leafVertices.resize( n * 3 );
+	}
+	else
+	{
+		return;
+	}
+
+	for ( size_t i = 0; i < n; ++i )
+	{
+		uint32_t iPrim = bvh->elementIndices[i];
+		if ( bvh->primitiveType( iPrim ) != BVH_PRIMITIVE_TRIANGLE )
+		{
+			continue;
+		}
+		glm::vec3 v0, v1, v2;
+		bvh->triangle( iPrim, &v0, &v1, &v2 );
+		if ( layout == TriangleLayout::Woop )
+		{
+			bvh->woopTriangles[i] = woopTriangle( v0, v1, v2 );
+		}
+		else
+		{
+			bvh->leafVertices[i * 3] = v0;
+			bvh->leafVertices[i * 3 + 1] = v1;
+			bvh->leafVertices[i * 3 + 2] = v2;
+		}
+	}
+}
+
+/*
+	Traversal counters. intersect() takes one of these as a template argument;
+	NoTraversalStats has empty members so the counting is compiled out of the hot loop.
+*/
+struct NoTraversalStats
+{
+	void nodeVisit() {}
+	void boxTest( int /*n*/ ) {}
+	void triangleTest() {}
+	void sphereTest() {}
+};
+struct TraversalStats
+{
+	uint32_t nodeVisits = 0;
+	uint32_t boxTests = 0;
+	uint32_t triangleTests = 0;
+	uint32_t sphereTests = 0;
+
+	void nodeVisit() { nodeVisits++; }
+	void boxTest( int n ) { boxTests += n; }
+	void triangleTest() { triangleTests++; }
+	void sphereTest() { sphereTests++; }
+};
+
+/*
+	triangle tests per layout. i is the position in elementIndices
+*/
+template <TriangleLayout Layout>
+struct TriangleTest;
+
+template <>
+struct TriangleTest<TriangleLayout::Indexed>
+{
+	static const bool kConservativeBounds = false;
+
+	TriangleTest( const Ray& /*ray*/ ) {}
+	bool operator()( const Bvh& bvh, const Ray& ray, uint32_t /*i*/, uint32_t iPrim, float* t, float* u, float* v ) const
+	{
+		glm::vec3 v0, v1, v2;
+		bvh.triangle( iPrim, &v0, &v1, &v2 );
+		return intersect_ray_triangle( ray.ro, ray.rd, v0, v1, v2, t, u, v );
+	}
+};
+template <>
+struct TriangleTest<TriangleLayout::Woop>
+{
+	static const bool kConservativeBounds = false;
+
+	TriangleTest( const Ray& /*ray*/ ) {}
+	bool operator()( const Bvh& bvh, const Ray& ray, uint32_t i, uint32_t /*iPrim*/, float* t, float* u, float* v ) const
+	{
+		return intersect_ray_woop( ray.ro, ray.rd, bvh.woopTriangles[i], t, u, v );
+	}
+};
+template <>
+struct TriangleTest<TriangleLayout::Watertight>
+{
+	static const bool kConservativeBounds = true;
+	WatertightRay wr;
+
+	TriangleTest( const Ray& ray ) : wr( watertightRay( ray.rd ) ) {}
+	bool operator()( const Bvh& bvh, const Ray& ray, uint32_t i, uint32_t /*iPrim*/, float* t, float* u, float* v ) const
+	{
+		const glm::vec3* vs = &bvh.leafVertices[i * 3];
+		return intersect_ray_triangle_watertight( ray.ro, wr, vs[0], vs[1], vs[2], t, u, v );
+	}
+};
+
+/*
+	closest hit state of a single ray. Traversals over any node layout feed their boxes and leaves to it.
+*/
+template <TriangleLayout Layout, class Stats>
+class ClosestHitQuery
+{
+public:
+	ClosestHitQuery( const Bvh& bvh, const Ray& ray, Stats* stats )
+		: _bvh( bvh ), _ray( ray ), _one_over_rd( glm::vec3( 1.0f ) / ray.rd ), _tmin( ray.tmax ), _triangleTest( ray ), _stats( stats )
+	{
+	}
+
+	bool boxTest( glm::vec3 lower, glm::vec3 upper, float* hitT ) const
+	{
+		if ( TriangleTest<Layout>::kConservativeBounds )
+		{
+			return slabsConservative( lower, upper, _ray.ro, _one_over_rd, _tmin, hitT );
+		}
+		return slabs( lower, upper, _ray.ro, _one_over_rd, _tmin, hitT );
+	}
+
+	// elementIndices[geomBeg, geomEnd)
+	void intersectLeaf( uint32_t geomBeg, uint32_t geomEnd )
+	{
+		for ( uint32_t i = geomBeg; i < geomEnd; i++ )
+		{
+			uint32_t iPrim = _bvh.elementIndices[i];
+			if ( _bvh.primitiveType( iPrim ) == BVH_PRIMITIVE_SPHERE )
+			{
+				glm::vec4 s = _bvh.sphere( iPrim );
+				_stats->sphereTest();
+
+				float t = _tmin;
+				if ( intersect_ray_sphere( _ray.ro, _ray.rd, glm::vec3( s.x, s.y, s.z ), s.w, _ray.tmin, &t ) )
+				{
+					_tmin = t;
+					_hitPrim = iPrim;
+					_hitU = 0.0f;
+					_hitV = 0.0f;
+				}
+				continue;
+			}
+
+			_stats->triangleTest();
+
+			float u, v;
+			float t = _tmin;
+			if ( _triangleTest( _bvh, _ray, i, iPrim, &t, &u, &v ) && _ray.tmin <= t )
+			{
+				_tmin = t;
+				_hitPrim = iPrim;
+				_hitU = u;
+				_hitV = v;
+			}
+		}
+	}
+	void intersectLeaf( const uint32_t index[2] )
+	{
+		intersectLeaf( index[0] & 0x7FFFFFFF, index[1] & 0x7FFFFFFF );
+	}
+
+	void result( Hit* hit ) const
+	{
+		*hit = Hit();
+		if ( _hitPrim == kInvalidPrimitive )
+		{
+			return;
+		}
+		glm::vec3 ro = _ray.ro;
+		glm::vec3 rd = _ray.rd;
+		hit->t = _tmin;
+		hit->primID = _hitPrim;
+		hit->u = _hitU;
+		hit->v = _hitV;
+		if ( _bvh.primitiveType( _hitPrim ) == BVH_PRIMITIVE_SPHERE )
+		{
+			glm::vec4 s = _bvh.sphere( _hitPrim );
+			hit->Ng = glm::normalize( ro + rd * _tmin - glm::vec3( s.x, s.y, s.z ) );
+			return;
+		}
+		glm::vec3 v0, v1, v2;
+		_bvh.triangle( _hitPrim, &v0, &v1, &v2 );
+		hit->Ng = glm::normalize( -glm::cross( v1 - v0, v2 - v0 ) /* index buffer stored as CW */ );
+	}
+
+private:
+	const Bvh& _bvh;
+	const Ray& _ray;
+	glm::vec3 _one_over_rd;
+	float _tmin;
+	uint32_t _hitPrim = kInvalidPrimitive;
+	float _hitU = 0.0f;
+	float _hitV = 0.0f;
+	TriangleTest<Layout> _triangleTest;
+	Stats* _stats;
+};
+
+/*
+	closest hit of a single ray. Same traversal as bvh_traverse.hlsl.
+	entries: child slots to start from instead of the root, in front to back order if possible. nullptr is the root.
+*/
+template <TriangleLayout Layout, class Stats>
+inline void intersectWith( const Bvh& bvh, const Ray& ray, const uint32_t* entries, int nEntries, Hit* hit, Stats* stats )
+{
+	*hit = Hit();
+	if ( bvh.nodes.empty() )
+	{
+		return;
+	}
+
+	ClosestHitQuery<Layout, Stats> query( bvh, ray, stats );
+
+	uint32_t stack[CPU_BVH_STACK_SIZE];
+	int stackcount = 0;
+	auto traverse = [&]( uint32_t root ) {
+		stack[stackcount++] = root;
+		while ( 0 < stackcount )
+		{
+			const BvhNode& node = bvh.nodes[stack[--stackcount]];
+			stats->nodeVisit();
+
+			glm::vec3 lowerL( node.lowerL[0], node.lowerL[1], node.lowerL[2] );
+			glm::vec3 upperL( node.upperL[0], node.upperL[1], node.upperL[2] );
+			glm::vec3 lowerR( node.lowerR[0], node.lowerR[1], node.lowerR[2] );
+			glm::vec3 upperR( node.upperR[0], node.upperR[1], node.upperR[2] );
+
+			float hitTL;
+			float hitTR;
+			bool hitL = query.boxTest( lowerL, upperL, &hitTL );
+			bool hitR = query.boxTest( lowerR, upperR, &hitTR );
+			stats->boxTest( 2 );
+			bool isLeafL = isLeaf( node.indexL[0] );
+			bool isLeafR = isLeaf( node.indexR[0] );
+
+			if ( hitL && isLeafL )
+			{
+				query.intersectLeaf( node.indexL );
+			}
+			if ( hitR && isLeafR )
+			{
+				query.intersectLeaf( node.indexR );
+			}
+
+			bool continueL = hitL && isLeafL == false;
+			bool continueR = hitR && isLeafR == false;
+			uint32_t childL = node.indexL[0];
+			uint32_t childR = node.indexR[0];
+
+			if ( continueL && continueR )
+			{
+				if ( hitTL < hitTR )
+				{
+					stack[stackcount++] = childR;
+					stack[stackcount++] = childL;
+				}
+				else
+				{
+					stack[stackcount++] = childL;
+					stack[stackcount++] = childR;
+				}
+			}
+			else if ( continueL )
+			{
+				stack[stackcount++] = childL;
+			}
+			else if ( continueR )
+			{
+				stack[stackcount++] = childR;
+			}
+		}
+	};
+
+	if ( entries == nullptr )
+	{
+		traverse( 0 );
+	}
+	else
+	{
+		for ( int i = 0; i < nEntries; ++i )
+		{
+			if ( isEmptySlot( bvh, entries[i] ) )
+			{
+				continue;
+			}
+			glm::vec3 lower, upper;
+			slotBounds( bvh, entries[i], &lower, &upper );
+
+			float hitT;
+			bool hitEntry = query.boxTest( lower, upper, &hitT );
+			stats->boxTest( 1 );
+			if ( hitEntry == false )
+			{
+				continue;
+			}
+
+			const uint32_t* index = slotIndex( bvh, entries[i] );
+			if ( isLeaf( index[0] ) )
+			{
+				query.intersectLeaf( index );
+			}
+			else
+			{
+				traverse( index[0] );
+			}
+		}
+	}
+
+	query.result( hit );
+}
+template <class Stats>
+inline void intersect( const Bvh& bvh, const Ray& ray, const uint32_t* entries, int nEntries, Hit* hit, Stats* stats )
+{
+	switch ( bvh.triangleLayout )
+	{
+	case TriangleLayout::Indexed:
+		intersectWith<TriangleLayout::Indexed>( bvh, ray, entries, nEntries, hit, stats );
+		break;
+	case TriangleLayout::Woop:
+		intersectWith<TriangleLayout::Woop>( bvh, ray, entries, nEntries, hit, stats );
+		break;
+	case TriangleLayout::Watertight:
+		intersectWith<TriangleLayout::Watertight>( bvh, ray, entries, nEntries, hit, stats );
+		break;
+	}
+}
+template <class Stats>
+inline void intersect( const Bvh& bvh, const Ray& ray, Hit* hit, Stats* stats )
+{
+	intersect( bvh, ray, nullptr, 0, hit, stats );
+}
+inline void intersect( const Bvh& bvh, const Ray& ray, Hit* hit )
+{
+	NoTraversalStats stats;
+	intersect( bvh, ray, hit, &stats );
+}
+
+/*
+	batch query. hits[i] receives the closest hit of rays[i].
+	The work is split into chunks on the thread pool, nothing is allocated per call.
+*/
+inline void intersect( const Bvh& bvh, const Ray* rays, Hit* hits, size_t n, ThreadPool& pool = ThreadPool::global() )
+{
+	pool.parallelFor( (int64_t)n, 256, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t i = beg; i < end; ++i )
+		{
+			intersect( bvh, rays[i], &hits[i] );
+		}
+	} );
+}
+
+// instrumented batch query. stats[i] receives the counters of rays[i]
+inline void intersect( const Bvh& bvh, const Ray* rays, Hit* hits, TraversalStats* stats, size_t n, ThreadPool& pool = ThreadPool::global() )
+{
+	pool.parallelFor( (int64_t)n, 256, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t i = beg; i < end; ++i )
+		{
+			stats[i] = TraversalStats();
+			intersect( bvh, rays[i], &hits[i], &stats[i] );
+		}
+	} );
+}
+} // namespace cpu
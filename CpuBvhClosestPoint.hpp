@@ -0,0 +1,240 @@
+#pragma once
+
+#include "CpuBvh.hpp"
+#include <math.h>
+
+// Nearest surface point queries over the same BvhNode tree as cpu::intersect()
+namespace cpu
+{
+/*
+	p        : the closest point on the surface
+	primID   : kInvalidPrimitive if nothing is found within maxDistance
+	distance : |p - query|
+	u, v     : barycentric of p, p = v0 * (1 - u - v) + v1 * u + v2 * v. always 0 for spheres
+*/
+struct ClosestPoint
+{
+	glm::vec3 p = glm::vec3( 0.0f );
+	uint32_t primID = kInvalidPrimitive;
+	float distance = FLT_MAX;
+	float u = 0.0f;
+	float v = 0.0f;
+
+	bool isFound() const { return primID != kInvalidPrimitive; }
+};
+
+// Real-Time Collision Detection 5.1.5
+inline glm::vec3 closestPointOnTriangle( glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c, float* u_out, float* v_out )
+{
+	glm::vec3 ab = b - a;
+	glm::vec3 ac = c - a;
+	glm::vec3 ap = p - a;
+	float d1 = glm::dot( ab, ap );
+	float d2 = glm::dot( ac, ap );
+	if ( d1 <= 0.0f && d2 <= 0.0f )
+	{
+		*u_out = 0.0f;
+		*v_out = 0.0f;
+		return a;
+	}
+
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot( ab, bp );
+	float d4 = glm::dot( ac, bp );
+	if ( 0.0f <= d3 && d4 <= d3 )
+	{
+		*u_out = 1.0f;
+		*v_out = 0.0f;
+		return b;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if ( vc <= 0.0f && 0.0f <= d1 && d3 <= 0.0f )
+	{
+		float v = d1 / ( d1 - d3 );
+		*u_out = v;
+		*v_out = 0.0f;
+		return a + ab * v;
+	}
+
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot( ab, cp );
+	float d6 = glm::dot( ac, cp );
+	if ( 0.0f <= d6 && d5 <= d6 )
+	{
+		*u_out = 0.0f;
+		*v_out = 1.0f;
+		return c;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if ( vb <= 0.0f && 0.0f <= d2 && d6 <= 0.0f )
+	{
+		float w = d2 / ( d2 - d6 );
+		*u_out = 0.0f;
+		*v_out = w;
+		return a + ac * w;
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if ( va <= 0.0f && 0.0f <= ( d4 - d3 ) && 0.0f <= ( d5 - d6 ) )
+	{
+		float w = ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) );
+		*u_out = 1.0f - w;
+		*v_out = w;
+		return b + ( c - b ) * w;
+	}
+
+	float denom = 1.0f / ( va + vb + vc );
+	float v = vb * denom;
+	float w = vc * denom;
+	*u_out = v;
+	*v_out = w;
+	return a + ab * v + ac * w;
+}
+
+inline glm::vec3 closestPointOnSphere( glm::vec3 p, glm::vec3 o, float r )
+{
+	glm::vec3 d = p - o;
+	float l = glm::length( d );
+	if ( l == 0.0f )
+	{
+		// every point on the sphere is the closest
+		return o + glm::vec3( r, 0.0f, 0.0f );
+	}
+	return o + d * ( r / l );
+}
+
+inline float distanceSquaredToAABB( glm::vec3 p, glm::vec3 lower, glm::vec3 upper )
+{
+	glm::vec3 d = glm::max( glm::max( lower - p, p - upper ), glm::vec3( 0.0f ) );
+	return glm::dot( d, d );
+}
+
+/*
+	Best-first traversal. Children are pushed into a priority queue keyed by the distance to their AABB,
+	and the search ends when the nearest entry is farther than the best primitive found so far.
+	query() keeps the capacity of the priority queue for the next call. A query isn't thread safe, so each thread has its own.
+*/
+class ClosestPointQuery
+{
+public:
+	void query( const Bvh& bvh, glm::vec3 q, float maxDistance, ClosestPoint* result )
+	{
+		*result = ClosestPoint();
+		if ( bvh.nodes.empty() )
+		{
+			return;
+		}
+
+		float best = maxDistance == FLT_MAX ? FLT_MAX : maxDistance * maxDistance;
+
+		_queue.clear();
+		push( {0.0f, 0, 0} );
+		while ( _queue.empty() == false )
+		{
+			Entry e = _queue.front();
+			std::pop_heap( _queue.begin(), _queue.end() );
+			_queue.pop_back();
+
+			if ( best <= e.d2 )
+			{
+				break;
+			}
+
+			if ( isLeaf( e.index0 ) )
+			{
+				uint32_t geomBeg = e.index0 & 0x7FFFFFFF;
+				uint32_t geomEnd = e.index1 & 0x7FFFFFFF;
+				for ( uint32_t i = geomBeg; i < geomEnd; i++ )
+				{
+					uint32_t iPrim = bvh.elementIndices[i];
+					float u = 0.0f;
+					float v = 0.0f;
+					glm::vec3 p;
+					if ( bvh.primitiveType( iPrim ) == BVH_PRIMITIVE_SPHERE )
+					{
+						glm::vec4 s = bvh.sphere( iPrim );
+						p = closestPointOnSphere( q, glm::vec3( s.x, s.y, s.z ), s.w );
+					}
+					else
+					{
+						glm::vec3 v0, v1, v2;
+						bvh.triangle( iPrim, &v0, &v1, &v2 );
+						p = closestPointOnTriangle( q, v0, v1, v2, &u, &v );
+					}
+					glm::vec3 d = p - q;
+					float d2 = glm::dot( d, d );
+					if ( d2 < best )
+					{
+						best = d2;
+						result->p = p;
+						result->primID = iPrim;
+						result->u = u;
+						result->v = v;
+					}
+				}
+				continue;
+			}
+
+			const BvhNode& node = bvh.nodes[e.index0];
+			glm::vec3 lowerL( node.lowerL[0], node.lowerL[1], node.lowerL[2] );
+			glm::vec3 upperL( node.upperL[0], node.upperL[1], node.upperL[2] );
+			glm::vec3 lowerR( node.lowerR[0], node.lowerR[1], node.lowerR[2] );
+			glm::vec3 upperR( node.upperR[0], node.upperR[1], node.upperR[2] );
+
+			float d2L = distanceSquaredToAABB( q, lowerL, upperL );
+			float d2R = distanceSquaredToAABB( q, lowerR, upperR );
+			if ( d2L < best )
+			{
+				push( {d2L, node.indexL[0], node.indexL[1]} );
+			}
+			if ( d2R < best )
+			{
+				push( {d2R, node.indexR[0], node.indexR[1]} );
+			}
+		}
+
+		if ( result->isFound() )
+		{
+			result->distance = std::sqrt( best );
+		}
+	}
+
+private:
+	// node: index0 is the node index. leaf: index0, index1 are geomBeg, geomEnd with the leaf bit
+	struct Entry
+	{
+		float d2;
+		uint32_t index0;
+		uint32_t index1;
+
+		// std heap is a max heap
+		bool operator<( const Entry& rhs ) const { return rhs.d2 < d2; }
+	};
+	void push( Entry e )
+	{
+		_queue.push_back( e );
+		std::push_heap( _queue.begin(), _queue.end() );
+	}
+	std::vector<Entry> _queue;
+};
+
+inline void closestPoint( const Bvh& bvh, glm::vec3 q, ClosestPoint* result, float maxDistance = FLT_MAX )
+{
+	ClosestPointQuery query;
+	query.query( bvh, q, maxDistance, result );
+}
+
+// batch query. results[i] receives the closest point to points[i]
+inline void closestPoint( const Bvh& bvh, const glm::vec3* points, ClosestPoint* results, size_t n, float maxDistance = FLT_MAX, ThreadPool& pool = ThreadPool::global() )
+{
+	std::vector<ClosestPointQuery> queries( pool.threadCount() );
+	pool.parallelFor( (int64_t)n, 64, [&]( int64_t beg, int64_t end, int iThread ) {
+		for ( int64_t i = beg; i < end; ++i )
+		{
+			queries[iThread].query( bvh, points[i], maxDistance, &results[i] );
+		}
+	} );
+}
+} // namespace cpu
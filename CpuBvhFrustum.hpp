@@ -0,0 +1,199 @@
+#pragma once
+
+#include "CpuBvh.hpp"
+
+// Tile frustum culling for primary rays made by shoot()
+namespace cpu
+{
+/*
+	4 side planes of the rays through a screen rectangle.
+	p is inside of a plane when dot( planes[i].xyz, p ) + planes[i].w >= 0
+*/
+struct Frustum
+{
+	glm::vec4 planes[4];
+};
+
+enum class FrustumTest
+{
+	Outside,
+	Intersect,
+	Inside,
+};
+
+/*
+	The frustum of every ray shoot() makes for x in [x0, x1], y in [y0, y1].
+	x0 < x1 and y0 < y1 are required.
+*/
+inline Frustum tileFrustum( int imageWidth, int imageHeight, float x0, float y0, float x1, float y1, const glm::mat4& inverseVP )
+{
+	auto ndcX = [&]( float x ) { return 2.0f * ( x - (float)imageWidth * 0.5f ) / (float)imageWidth; };
+	auto ndcY = [&]( float y ) { return -2.0f * ( y - (float)imageHeight * 0.5f ) / (float)imageHeight; };
+	glm::vec2 corners[4] = {
+		{ndcX( x0 ), ndcY( y0 )},
+		{ndcX( x1 ), ndcY( y0 )},
+		{ndcX( x1 ), ndcY( y1 )},
+		{ndcX( x0 ), ndcY( y1 )},
+	};
+
+	glm::vec3 nears[4];
+	glm::vec3 fars[4];
+	glm::vec3 center = glm::vec3( 0.0f );
+	for ( int i = 0; i < 4; ++i )
+	{
+		nears[i] = homogeneous( inverseVP * glm::vec4( corners[i].x, corners[i].y, -1.0f /*near*/, 1.0f ) );
+		fars[i] = homogeneous( inverseVP * glm::vec4( corners[i].x, corners[i].y, +1.0f /*far */, 1.0f ) );
+		center += ( nears[i] + fars[i] ) * 0.125f;
+	}
+
+	Frustum f;
+	for ( int i = 0; i < 4; ++i )
+	{
+		glm::vec3 a = nears[i];
+		glm::vec3 b = nears[( i + 1 ) % 4];
+		glm::vec3 n = glm::normalize( glm::cross( b - a, fars[i] - a ) );
+		if ( glm::dot( n, center - a ) < 0.0f )
+		{
+			n = -n;
+		}
+		f.planes[i] = glm::vec4( n, -glm::dot( n, a ) );
+	}
+	return f;
+}
+
+inline FrustumTest testAABB( const Frustum& f, glm::vec3 lower, glm::vec3 upper )
+{
+	FrustumTest result = FrustumTest::Inside;
+	for ( int i = 0; i < 4; ++i )
+	{
+		glm::vec3 n( f.planes[i].x, f.planes[i].y, f.planes[i].z );
+
+		// the farthest and the nearest corners along n
+		glm::vec3 p( 0.0f < n.x ? upper.x : lower.x, 0.0f < n.y ? upper.y : lower.y, 0.0f < n.z ? upper.z : lower.z );
+		glm::vec3 q( 0.0f < n.x ? lower.x : upper.x, 0.0f < n.y ? lower.y : upper.y, 0.0f < n.z ? lower.z : upper.z );
+		if ( glm::dot( n, p ) + f.planes[i].w < 0.0f )
+		{
+			return FrustumTest::Outside;
+		}
+		if ( glm::dot( n, q ) + f.planes[i].w < 0.0f )
+		{
+			result = FrustumTest::Intersect;
+		}
+	}
+	return result;
+}
+
+/*
+	Child slots ( see slotIndex() ) which survive the frustum, roughly front to back from eye.
+	A subtree is refined while it intersects the frustum and is shallower than maxDepth,
+	otherwise it is handed to the per ray traversal as a whole.
+*/
+inline void cullBvh( const Bvh& bvh, const Frustum& frustum, glm::vec3 eye, std::vector<uint32_t>* entries, int maxDepth = 8 )
+{
+	entries->clear();
+	if ( bvh.nodes.empty() )
+	{
+		return;
+	}
+
+	auto distance = [&]( uint32_t slot ) {
+		glm::vec3 lower, upper;
+		slotBounds( bvh, slot, &lower, &upper );
+		glm::vec3 d = ( lower + upper ) * 0.5f - eye;
+		return glm::dot( d, d );
+	};
+
+	struct Item
+	{
+		uint32_t slot;
+		int depth;
+	};
+	Item stack[CPU_BVH_STACK_SIZE];
+	int stackcount = 0;
+	auto pushChildren = [&]( uint32_t node, int depth ) {
+		uint32_t slotL = node << 1;
+		uint32_t slotR = slotL | 1;
+		if ( isEmptySlot( bvh, slotR ) || distance( slotL ) < distance( slotR ) )
+		{
+			stack[stackcount++] = {slotR, depth};
+			stack[stackcount++] = {slotL, depth};
+		}
+		else
+		{
+			stack[stackcount++] = {slotL, depth};
+			stack[stackcount++] = {slotR, depth};
+		}
+	};
+
+	pushChildren( 0, 0 );
+	while ( 0 < stackcount )
+	{
+		Item item = stack[--stackcount];
+		if ( isEmptySlot( bvh, item.slot ) )
+		{
+			continue;
+		}
+
+		glm::vec3 lower, upper;
+		slotBounds( bvh, item.slot, &lower, &upper );
+		FrustumTest test = testAABB( frustum, lower, upper );
+		if ( test == FrustumTest::Outside )
+		{
+			continue;
+		}
+
+		const uint32_t* index = slotIndex( bvh, item.slot );
+		if ( test == FrustumTest::Inside || isLeaf( index[0] ) || maxDepth <= item.depth || CPU_BVH_STACK_SIZE < stackcount + 2 )
+		{
+			entries->push_back( item.slot );
+			continue;
+		}
+		pushChildren( index[0], item.depth + 1 );
+	}
+}
+
+/*
+	closest hits of the primary rays shoot() makes for every pixel, hits[y * width + x].
+	The bvh is culled once per tile, then each ray of the tile starts from the surviving subtrees.
+*/
+inline void intersectPrimaryRays( const Bvh& bvh, int width, int height, const glm::mat4& inverseVP, Hit* hits, int tileSize = 16, ThreadPool& pool = ThreadPool::global() )
+{
+	int nTileX = ( width + tileSize - 1 ) / tileSize;
+	int nTileY = ( height + tileSize - 1 ) / tileSize;
+
+	std::vector<std::vector<uint32_t>> entries( pool.threadCount() );
+	pool.parallelFor( (int64_t)nTileX * nTileY, 1, [&]( int64_t beg, int64_t end, int iThread ) {
+		std::vector<uint32_t>& tileEntries = entries[iThread];
+		NoTraversalStats stats;
+		for ( int64_t iTile = beg; iTile < end; ++iTile )
+		{
+			int x0 = (int)( iTile % nTileX ) * tileSize;
+			int y0 = (int)( iTile / nTileX ) * tileSize;
+			int x1 = std::min( x0 + tileSize, width );
+			int y1 = std::min( y0 + tileSize, height );
+
+			Frustum frustum = tileFrustum( width, height, (float)x0, (float)y0, (float)x1, (float)y1, inverseVP );
+			float cx = 2.0f * ( ( x0 + x1 ) * 0.5f - (float)width * 0.5f ) / (float)width;
+			float cy = -2.0f * ( ( y0 + y1 ) * 0.5f - (float)height * 0.5f ) / (float)height;
+			glm::vec3 eye = homogeneous( inverseVP * glm::vec4( cx, cy, -1.0f /*near*/, 1.0f ) );
+			cullBvh( bvh, frustum, eye, &tileEntries );
+
+			for ( int y = y0; y < y1; ++y )
+			{
+				for ( int x = x0; x < x1; ++x )
+				{
+					Hit* hit = &hits[y * width + x];
+					if ( tileEntries.empty() )
+					{
+						*hit = Hit();
+						continue;
+					}
+					Ray ray;
+					shoot( &ray.ro, &ray.rd, width, height, (float)x, (float)y, inverseVP );
+					intersect( bvh, ray, tileEntries.data(), (int)tileEntries.size(), hit, &stats );
+				}
+			}
+		}
+	} );
+}
+} // namespace cpu
@@ -0,0 +1,381 @@
+#pragma once
+
+#include "CpuBvh.hpp"
+#include "CpuBvhClosestPoint.hpp"
+#include <atomic>
+
+// Overlap queries between two BvhNode trees, each with its own transform
+namespace cpu
+{
+struct OverlapPair
+{
+	uint32_t primA;
+	uint32_t primB;
+};
+
+/*
+	Separating axis test. Touching triangles are treated as overlapped.
+	The edge x normal axes are included so that coplanar triangles are handled as well.
+*/
+inline bool overlapTriangleTriangle( const glm::vec3 a[3], const glm::vec3 b[3] )
+{
+	glm::vec3 eA[3] = {a[1] - a[0], a[2] - a[1], a[0] - a[2]};
+	glm::vec3 eB[3] = {b[1] - b[0], b[2] - b[1], b[0] - b[2]};
+	glm::vec3 nA = glm::cross( eA[0], eA[1] );
+	glm::vec3 nB = glm::cross( eB[0], eB[1] );
+
+	auto separated = [&]( glm::vec3 axis ) {
+		if ( glm::dot( axis, axis ) < 1.0e-20f )
+		{
+			return false;
+		}
+		float minA = +FLT_MAX, maxA = -FLT_MAX;
+		float minB = +FLT_MAX, maxB = -FLT_MAX;
+		for ( int i = 0; i < 3; ++i )
+		{
+			float pA = glm::dot( axis, a[i] );
+			float pB = glm::dot( axis, b[i] );
+			minA = std::min( minA, pA );
+			maxA = std::max( maxA, pA );
+			minB = std::min( minB, pB );
+			maxB = std::max( maxB, pB );
+		}
+		return maxA < minB || maxB < minA;
+	};
+
+	if ( separated( nA ) || separated( nB ) )
+	{
+		return false;
+	}
+	for ( int i = 0; i < 3; ++i )
+	{
+		for ( int j = 0; j < 3; ++j )
+		{
+			if ( separated( glm::cross( eA[i], eB[j] ) ) )
+			{
+				return false;
+			}
+		}
+	}
+	for ( int i = 0; i < 3; ++i )
+	{
+		if ( separated( glm::cross( nA, eA[i] ) ) || separated( glm::cross( nB, eB[i] ) ) )
+		{
+			return false;
+		}
+	}
+
+	// a degenerate triangle is a segment or a point without a normal, so the axes above can all vanish.
+	// The segment is separated by the direction between the triangles, its own direction, the normal toward the other and the in-plane normal of the other
+	if ( glm::dot( nA, nA ) < 1.0e-20f || glm::dot( nB, nB ) < 1.0e-20f )
+	{
+		glm::vec3 d = ( b[0] + b[1] + b[2] ) - ( a[0] + a[1] + a[2] );
+		if ( separated( d ) )
+		{
+			return false;
+		}
+		for ( int i = 0; i < 3; ++i )
+		{
+			for ( glm::vec3 e : {eA[i], eB[i]} )
+			{
+				if ( separated( e ) || separated( glm::cross( e, glm::cross( e, d ) ) ) )
+				{
+					return false;
+				}
+			}
+			if ( separated( glm::cross( nB, eA[i] ) ) || separated( glm::cross( nA, eB[i] ) ) )
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+inline bool overlapSphereTriangle( glm::vec3 o, float r, const glm::vec3 t[3] )
+{
+	float u, v;
+	glm::vec3 d = closestPointOnTriangle( o, t[0], t[1], t[2], &u, &v ) - o;
+	return glm::dot( d, d ) <= r * r;
+}
+
+/*
+	Simultaneous traversal of bvhA and bvhB.
+	Everything is tested in the space of A. Child boxes of B are transformed as conservative AABBs,
+	and sphere radii of B are scaled by the largest axis scale, so use uniform scale for spheres.
+*/
+class OverlapQuery
+{
+public:
+	OverlapQuery( const Bvh& bvhA, const glm::mat4& xformA, const Bvh& bvhB, const glm::mat4& xformB )
+		: _bvhA( bvhA ), _bvhB( bvhB )
+	{
+		_BtoA = glm::inverse( xformA ) * xformB;
+		glm::mat3 m = glm::mat3( _BtoA );
+		_absBtoA = glm::mat3( glm::abs( m[0] ), glm::abs( m[1] ), glm::abs( m[2] ) );
+		_radiusScaleB = std::max( std::max( glm::length( m[0] ), glm::length( m[1] ) ), glm::length( m[2] ) );
+	}
+
+	// every overlapping pair. the order is not deterministic
+	void pairs( std::vector<OverlapPair>* result, ThreadPool& pool = ThreadPool::global() )
+	{
+		result->clear();
+		std::vector<std::vector<OverlapPair>> found( pool.threadCount() );
+		run( pool, [&]( const OverlapPair& pair, int iThread ) {
+			found[iThread].push_back( pair );
+			return true;
+		} );
+		for ( const std::vector<OverlapPair>& f : found )
+		{
+			result->insert( result->end(), f.begin(), f.end() );
+		}
+	}
+
+	// the first pair found, which is not necessarily the deepest one. contact can be nullptr
+	bool firstContact( OverlapPair* contact, ThreadPool& pool = ThreadPool::global() )
+	{
+		std::atomic<bool> found( false );
+		run( pool, [&]( const OverlapPair& pair, int /*iThread*/ ) {
+			bool expected = false;
+			if ( found.compare_exchange_strong( expected, true ) && contact )
+			{
+				*contact = pair;
+			}
+			return false;
+		} );
+		return found.load();
+	}
+
+	bool overlaps( ThreadPool& pool = ThreadPool::global() )
+	{
+		return firstContact( nullptr, pool );
+	}
+
+private:
+	// see slotIndex()
+	using Slot = uint32_t;
+	struct SlotPair
+	{
+		Slot a;
+		Slot b;
+	};
+
+	bool overlapSlots( SlotPair p ) const
+	{
+		glm::vec3 lowerA, upperA, lowerB, upperB;
+		slotBounds( _bvhA, p.a, &lowerA, &upperA );
+		slotBounds( _bvhB, p.b, &lowerB, &upperB );
+
+		// Arvo, transform an AABB
+		glm::vec3 center = glm::vec3( _BtoA * glm::vec4( ( lowerB + upperB ) * 0.5f, 1.0f ) );
+		glm::vec3 extent = _absBtoA * ( ( upperB - lowerB ) * 0.5f );
+		lowerB = center - extent;
+		upperB = center + extent;
+		return lowerA.x <= upperB.x && lowerB.x <= upperA.x &&
+			   lowerA.y <= upperB.y && lowerB.y <= upperA.y &&
+			   lowerA.z <= upperB.z && lowerB.z <= upperA.z;
+	}
+	float slotArea( const Bvh& bvh, Slot s ) const
+	{
+		glm::vec3 lower, upper;
+		slotBounds( bvh, s, &lower, &upper );
+		glm::vec3 size = upper - lower;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	bool overlapPrimitives( uint32_t iPrimA, const glm::vec3 triB[3], glm::vec4 sphereB, bool isSphereB ) const
+	{
+		if ( _bvhA.primitiveType( iPrimA ) == BVH_PRIMITIVE_SPHERE )
+		{
+			glm::vec4 sA = _bvhA.sphere( iPrimA );
+			glm::vec3 oA( sA.x, sA.y, sA.z );
+			if ( isSphereB )
+			{
+				glm::vec3 d = glm::vec3( sphereB.x, sphereB.y, sphereB.z ) - oA;
+				float r = sA.w + sphereB.w;
+				return glm::dot( d, d ) <= r * r;
+			}
+			return overlapSphereTriangle( oA, sA.w, triB );
+		}
+
+		glm::vec3 triA[3];
+		_bvhA.triangle( iPrimA, &triA[0], &triA[1], &triA[2] );
+		if ( isSphereB )
+		{
+			return overlapSphereTriangle( glm::vec3( sphereB.x, sphereB.y, sphereB.z ), sphereB.w, triA );
+		}
+		return overlapTriangleTriangle( triA, triB );
+	}
+
+	// returns false if the traversal should stop
+	template <class F>
+	bool leafLeaf( SlotPair p, int iThread, F& onPair ) const
+	{
+		const uint32_t* indexA = slotIndex( _bvhA, p.a );
+		const uint32_t* indexB = slotIndex( _bvhB, p.b );
+		for ( uint32_t j = indexB[0] & 0x7FFFFFFF; j < indexB[1]; ++j )
+		{
+			uint32_t iPrimB = _bvhB.elementIndices[j];
+
+			// B into the space of A once, then against every primitive in the leaf of A
+			glm::vec3 triB[3];
+			glm::vec4 sphereB;
+			bool isSphereB = _bvhB.primitiveType( iPrimB ) == BVH_PRIMITIVE_SPHERE;
+			if ( isSphereB )
+			{
+				glm::vec4 s = _bvhB.sphere( iPrimB );
+				sphereB = glm::vec4( glm::vec3( _BtoA * glm::vec4( s.x, s.y, s.z, 1.0f ) ), s.w * _radiusScaleB );
+			}
+			else
+			{
+				_bvhB.triangle( iPrimB, &triB[0], &triB[1], &triB[2] );
+				for ( int k = 0; k < 3; ++k )
+				{
+					triB[k] = glm::vec3( _BtoA * glm::vec4( triB[k], 1.0f ) );
+				}
+			}
+
+			for ( uint32_t i = indexA[0] & 0x7FFFFFFF; i < indexA[1]; ++i )
+			{
+				uint32_t iPrimA = _bvhA.elementIndices[i];
+				if ( overlapPrimitives( iPrimA, triB, sphereB, isSphereB ) && onPair( OverlapPair{iPrimA, iPrimB}, iThread ) == false )
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// push children of the pair. the larger side is descended first, leaves are never split
+	template <class Push>
+	void split( SlotPair p, Push push ) const
+	{
+		bool leafA = isLeaf( slotIndex( _bvhA, p.a )[0] );
+		bool leafB = isLeaf( slotIndex( _bvhB, p.b )[0] );
+		bool descendA = leafB || ( leafA == false && slotArea( _bvhB, p.b ) <= slotArea( _bvhA, p.a ) );
+		if ( descendA )
+		{
+			Slot child = slotIndex( _bvhA, p.a )[0] << 1;
+			push( SlotPair{child, p.b} );
+			push( SlotPair{child | 1, p.b} );
+		}
+		else
+		{
+			Slot child = slotIndex( _bvhB, p.b )[0] << 1;
+			push( SlotPair{p.a, child} );
+			push( SlotPair{p.a, child | 1} );
+		}
+	}
+
+	/*
+		The top levels are expanded breadth first on the calling thread until there are enough pairs,
+		then each pair is traversed depth first as an independent task.
+		onPair( pair, iThread ) returns false to stop the whole query.
+	*/
+	template <class F>
+	void run( ThreadPool& pool, F onPair )
+	{
+		if ( _bvhA.nodes.empty() || _bvhB.nodes.empty() )
+		{
+			return;
+		}
+
+		std::vector<SlotPair> tasks;
+		for ( Slot a = 0; a < 2; ++a )
+		{
+			for ( Slot b = 0; b < 2; ++b )
+			{
+				if ( isEmptySlot( _bvhA, a ) == false && isEmptySlot( _bvhB, b ) == false && overlapSlots( {a, b} ) )
+				{
+					tasks.push_back( {a, b} );
+				}
+			}
+		}
+
+		const size_t nTasksEnough = (size_t)pool.threadCount() * 16;
+		std::vector<SlotPair> next;
+		for ( int level = 0; level < 16 && tasks.size() < nTasksEnough; ++level )
+		{
+			next.clear();
+			bool expanded = false;
+			for ( SlotPair p : tasks )
+			{
+				if ( isLeaf( slotIndex( _bvhA, p.a )[0] ) && isLeaf( slotIndex( _bvhB, p.b )[0] ) )
+				{
+					next.push_back( p );
+					continue;
+				}
+				split( p, [&]( SlotPair c ) {
+					if ( overlapSlots( c ) )
+					{
+						next.push_back( c );
+					}
+				} );
+				expanded = true;
+			}
+			std::swap( tasks, next );
+			if ( expanded == false )
+			{
+				break;
+			}
+		}
+
+		std::atomic<bool> stop( false );
+		std::vector<std::vector<SlotPair>> stacks( pool.threadCount() );
+		pool.parallelFor( (int64_t)tasks.size(), 1, [&]( int64_t beg, int64_t end, int iThread ) {
+			std::vector<SlotPair>& stack = stacks[iThread];
+			for ( int64_t iTask = beg; iTask < end; ++iTask )
+			{
+				stack.clear();
+				stack.push_back( tasks[iTask] );
+				while ( stack.empty() == false )
+				{
+					if ( stop.load( std::memory_order_relaxed ) )
+					{
+						return;
+					}
+
+					SlotPair p = stack.back();
+					stack.pop_back();
+
+					if ( isLeaf( slotIndex( _bvhA, p.a )[0] ) && isLeaf( slotIndex( _bvhB, p.b )[0] ) )
+					{
+						if ( leafLeaf( p, iThread, onPair ) == false )
+						{
+							stop = true;
+							return;
+						}
+						continue;
+					}
+					split( p, [&]( SlotPair c ) {
+						if ( overlapSlots( c ) )
+						{
+							stack.push_back( c );
+						}
+					} );
+				}
+			}
+		} );
+	}
+
+	const Bvh& _bvhA;
+	const Bvh& _bvhB;
+	glm::mat4 _BtoA;
+	glm::mat3 _absBtoA;
+	float _radiusScaleB;
+};
+
+inline void overlapPairs( const Bvh& bvhA, const glm::mat4& xformA, const Bvh& bvhB, const glm::mat4& xformB, std::vector<OverlapPair>* pairs, ThreadPool& pool = ThreadPool::global() )
+{
+	OverlapQuery( bvhA, xformA, bvhB, xformB ).pairs( pairs, pool );
+}
+inline bool firstContact( const Bvh& bvhA, const glm::mat4& xformA, const Bvh& bvhB, const glm::mat4& xformB, OverlapPair* contact, ThreadPool& pool = ThreadPool::global() )
+{
+	return OverlapQuery( bvhA, xformA, bvhB, xformB ).firstContact( contact, pool );
+}
+inline bool overlaps( const Bvh& bvhA, const glm::mat4& xformA, const Bvh& bvhB, const glm::mat4& xformB, ThreadPool& pool = ThreadPool::global() )
+{
+	return OverlapQuery( bvhA, xformA, bvhB, xformB ).overlaps( pool );
+}
+} // namespace cpu
@@ -0,0 +1,411 @@
+#pragma once
+
+#include "CpuBvh.hpp"
+#include <limits>
+#include <string.h>
+
+// Compressed BvhNode layout with child bounds quantized to the parent box
+namespace cpu
+{
+/*
+	Child AABBs are integer codes on a power of two grid over the parent box, rounded outward.
+	The parent box itself is the decoded box of this node in its parent, so no origin is stored per node.
+		QuantizedBvhNode<uint16_t> : 32 bytes ( BvhNode is 64 )
+		QuantizedBvhNode<uint8_t>  : 20 bytes
+
+	indexL, indexR 0x80000000 bit
+		0: branch, the value is the child node
+		1: leaf, geomBeg << 5 | geomCount. geomCount is up to CPU_QBVH_MAX_LEAF_COUNT and geomBeg up to CPU_QBVH_MAX_LEAF_BEG
+*/
+template <class T>
+struct QuantizedBvhNode
+{
+	T lowerL[3];
+	T upperL[3];
+	T lowerR[3];
+	T upperR[3];
+	uint32_t indexL;
+	uint32_t indexR;
+};
+
+#define CPU_QBVH_LEAF_COUNT_BITS 5
+#define CPU_QBVH_MAX_LEAF_COUNT ( ( 1u << CPU_QBVH_LEAF_COUNT_BITS ) - 1 )
+#define CPU_QBVH_MAX_LEAF_BEG ( ( 1u << ( 31 - CPU_QBVH_LEAF_COUNT_BITS ) ) - 1 )
+
+inline uint32_t quantizedLeaf( uint32_t geomBeg, uint32_t geomEnd )
+{
+	return 0x80000000 | ( geomBeg << CPU_QBVH_LEAF_COUNT_BITS ) | ( geomEnd - geomBeg );
+}
+inline uint32_t quantizedLeafBeg( uint32_t index )
+{
+	return ( index & 0x7FFFFFFF ) >> CPU_QBVH_LEAF_COUNT_BITS;
+}
+inline uint32_t quantizedLeafEnd( uint32_t index )
+{
+	return quantizedLeafBeg( index ) + ( index & CPU_QBVH_MAX_LEAF_COUNT );
+}
+
+/*
+	Grid spacing of a box. The smallest power of two with ( maxCode - 1 ) steps covering the box,
+	so there is a spare code for rounding, and not finer than a few ulps of the coordinates.
+	q * step is exact for a power of two step, so decoding rounds once with or without fma.
+*/
+inline float quantizationStep( float lower, float upper, uint32_t maxCode )
+{
+	float r = ( upper - lower ) / (float)( maxCode - 1 );
+	float ulps = std::max( std::abs( lower ), std::abs( upper ) ) * ( 1.0f / 4194304.0f /* 2^-22 */ );
+	r = std::max( std::max( r, ulps ), FLT_MIN );
+
+	uint32_t bits;
+	memcpy( &bits, &r, 4 );
+	if ( bits & 0x7FFFFF )
+	{
+		bits = ( bits + 0x800000 ) & 0xFF800000; // round the mantissa up
+	}
+	memcpy( &r, &bits, 4 );
+	return r;
+}
+template <class T>
+inline glm::vec3 quantizationStep( glm::vec3 lower, glm::vec3 upper )
+{
+	const uint32_t maxCode = std::numeric_limits<T>::max();
+	return glm::vec3(
+		quantizationStep( lower.x, upper.x, maxCode ),
+		quantizationStep( lower.y, upper.y, maxCode ),
+		quantizationStep( lower.z, upper.z, maxCode ) );
+}
+template <class T>
+inline glm::vec3 dequantize( glm::vec3 origin, glm::vec3 step, const T q[3] )
+{
+	return origin + glm::vec3( (float)q[0], (float)q[1], (float)q[2] ) * step;
+}
+
+template <class T>
+struct QuantizedBvh
+{
+	std::vector<QuantizedBvhNode<T>> nodes;
+
+	// the box of the root node
+	glm::vec3 lower;
+	glm::vec3 upper;
+
+	size_t bytes() const { return nodes.size() * sizeof( QuantizedBvhNode<T> ); }
+};
+
+/*
+	Encode the nodes of bvh. Primitives stay in bvh, the quantized tree refers to the same elementIndices.
+	Leaves larger than CPU_QBVH_MAX_LEAF_COUNT are split in the middle of their ranges,
+	so there can be a few more nodes than bvh has.
+	Returns false with an empty qbvh if a leaf starts past CPU_QBVH_MAX_LEAF_BEG, which the leaf index can't hold,
+	or if the split leaves put a node deeper than CPU_BVH_MAX_DEPTH, past the traversal stack.
+*/
+template <class T>
+inline bool encodeQuantizedBvh( const Bvh& bvh, QuantizedBvh<T>* qbvh )
+{
+	const uint32_t maxCode = std::numeric_limits<T>::max();
+
+	qbvh->nodes.clear();
+	qbvh->lower = glm::vec3( +FLT_MAX );
+	qbvh->upper = glm::vec3( -FLT_MAX );
+	if ( bvh.nodes.empty() )
+	{
+		return true;
+	}
+
+	// a subtree, a leaf range or an empty leaf of the source, with its exact box
+	struct Child
+	{
+		glm::vec3 lower;
+		glm::vec3 upper;
+		int node;
+		uint32_t geomBeg;
+		uint32_t geomEnd;
+	};
+	// a node to encode. srcNode < 0 splits the range [geomBeg, geomEnd)
+	struct Task
+	{
+		int srcNode;
+		uint32_t geomBeg;
+		uint32_t geomEnd;
+		uint32_t dstNode;
+		int depth;
+		glm::vec3 origin;
+		glm::vec3 step;
+	};
+
+	auto sourceChild = [&]( uint32_t slot ) {
+		Child c;
+		slotBounds( bvh, slot, &c.lower, &c.upper );
+		const uint32_t* index = slotIndex( bvh, slot );
+		c.node = isLeaf( index[0] ) ? -1 : (int)index[0];
+		c.geomBeg = index[0] & 0x7FFFFFFF;
+		c.geomEnd = index[1] & 0x7FFFFFFF;
+		return c;
+	};
+	auto rangeChild = [&]( uint32_t geomBeg, uint32_t geomEnd ) {
+		Child c;
+		c.lower = glm::vec3( +FLT_MAX );
+		c.upper = glm::vec3( -FLT_MAX );
+		c.node = -1;
+		c.geomBeg = geomBeg;
+		c.geomEnd = geomEnd;
+		for ( uint32_t i = geomBeg; i < geomEnd; ++i )
+		{
+			glm::vec3 lower, upper, centeroid;
+			bvh.bounds( bvh.elementIndices[i], &lower, &upper, &centeroid );
+			c.lower = glm::min( c.lower, lower );
+			c.upper = glm::max( c.upper, upper );
+		}
+		return c;
+	};
+
+	// outward rounding against the exact decoder
+	auto quantize = [&]( const Child& c, glm::vec3 origin, glm::vec3 step, T* lowerQ, T* upperQ ) {
+		for ( int axis = 0; axis < 3; ++axis )
+		{
+			auto decode = [&]( int64_t q ) { return origin[axis] + (float)q * step[axis]; };
+			int64_t lo = (int64_t)std::floor( ( c.lower[axis] - origin[axis] ) / step[axis] );
+			int64_t hi = (int64_t)std::ceil( ( c.upper[axis] - origin[axis] ) / step[axis] );
+			lo = glm::clamp<int64_t>( lo, 0, maxCode );
+			hi = glm::clamp<int64_t>( hi, 0, maxCode );
+			while ( 0 < lo && c.lower[axis] < decode( lo ) )
+			{
+				lo--;
+			}
+			while ( hi < maxCode && decode( hi ) < c.upper[axis] )
+			{
+				hi++;
+			}
+			lowerQ[axis] = (T)lo;
+			upperQ[axis] = (T)hi;
+		}
+	};
+
+	Child rootL = sourceChild( 0 );
+	Child rootR = sourceChild( 1 );
+	for ( const Child& c : {rootL, rootR} )
+	{
+		if ( c.node < 0 && c.geomBeg == c.geomEnd )
+		{
+			continue;
+		}
+		qbvh->lower = glm::min( qbvh->lower, c.lower );
+		qbvh->upper = glm::max( qbvh->upper, c.upper );
+	}
+
+	Task first;
+	first.srcNode = 0;
+	first.geomBeg = 0;
+	first.geomEnd = 0;
+	first.dstNode = 0;
+	first.depth = 0;
+	first.origin = qbvh->lower;
+	first.step = quantizationStep<T>( qbvh->lower, qbvh->upper );
+	qbvh->nodes.push_back( QuantizedBvhNode<T>() );
+
+	// FIFO, the same node order as the builders
+	std::vector<Task> tasks;
+	tasks.push_back( first );
+	for ( size_t iTask = 0; iTask < tasks.size(); ++iTask )
+	{
+		Task task = tasks[iTask];
+
+		Child children[2];
+		if ( 0 <= task.srcNode )
+		{
+			children[0] = sourceChild( (uint32_t)task.srcNode << 1 );
+			children[1] = sourceChild( (uint32_t)task.srcNode << 1 | 1 );
+		}
+		else
+		{
+			uint32_t mid = task.geomBeg + ( task.geomEnd - task.geomBeg ) / 2;
+			children[0] = rangeChild( task.geomBeg, mid );
+			children[1] = rangeChild( mid, task.geomEnd );
+		}
+
+		for ( int k = 0; k < 2; ++k )
+		{
+			const Child& c = children[k];
+			T* lowerQ = k == 0 ? qbvh->nodes[task.dstNode].lowerL : qbvh->nodes[task.dstNode].lowerR;
+			T* upperQ = k == 0 ? qbvh->nodes[task.dstNode].upperL : qbvh->nodes[task.dstNode].upperR;
+			uint32_t index;
+
+			if ( c.node < 0 && c.geomBeg == c.geomEnd )
+			{
+				// empty leaf
+				for ( int axis = 0; axis < 3; ++axis )
+				{
+					lowerQ[axis] = 0;
+					upperQ[axis] = 0;
+				}
+				index = quantizedLeaf( 0, 0 );
+			}
+			else
+			{
+				quantize( c, task.origin, task.step, lowerQ, upperQ );
+
+				if ( c.node < 0 && c.geomEnd - c.geomBeg <= CPU_QBVH_MAX_LEAF_COUNT )
+				{
+					if ( CPU_QBVH_MAX_LEAF_BEG < c.geomBeg )
+					{
+						qbvh->nodes.clear();
+						return false;
+					}
+					index = quantizedLeaf( c.geomBeg, c.geomEnd );
+				}
+				else
+				{
+					if ( CPU_BVH_MAX_DEPTH < task.depth + 1 )
+					{
+						qbvh->nodes.clear();
+						return false;
+					}
+					glm::vec3 lower = dequantize( task.origin, task.step, lowerQ );
+					glm::vec3 upper = dequantize( task.origin, task.step, upperQ );
+
+					Task child;
+					child.srcNode = c.node;
+					child.geomBeg = c.geomBeg;
+					child.geomEnd = c.geomEnd;
+					child.dstNode = (uint32_t)qbvh->nodes.size();
+					child.depth = task.depth + 1;
+					child.origin = lower;
+					child.step = quantizationStep<T>( lower, upper );
+					tasks.push_back( child );
+					qbvh->nodes.push_back( QuantizedBvhNode<T>() );
+
+					index = child.dstNode;
+				}
+			}
+
+			if ( k == 0 )
+			{
+				qbvh->nodes[task.dstNode].indexL = index;
+			}
+			else
+			{
+				qbvh->nodes[task.dstNode].indexR = index;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+	closest hit over a quantized tree. bvh provides the primitives and the triangle layout.
+	Boxes are decoded on the way down, a stack entry carries the decoded box origin and step of its node.
+*/
+template <TriangleLayout Layout, class T, class Stats>
+inline void intersectWith( const QuantizedBvh<T>& qbvh, const Bvh& bvh, const Ray& ray, Hit* hit, Stats* stats )
+{
+	*hit = Hit();
+	if ( qbvh.nodes.empty() )
+	{
+		return;
+	}
+
+	ClosestHitQuery<Layout, Stats> query( bvh, ray, stats );
+
+	struct Entry
+	{
+		uint32_t node;
+		glm::vec3 origin;
+		glm::vec3 step;
+	};
+	Entry stack[CPU_BVH_STACK_SIZE];
+	int stackcount = 0;
+	stack[stackcount++] = {0, qbvh.lower, quantizationStep<T>( qbvh.lower, qbvh.upper )};
+
+	while ( 0 < stackcount )
+	{
+		Entry e = stack[--stackcount];
+		const QuantizedBvhNode<T>& node = qbvh.nodes[e.node];
+		stats->nodeVisit();
+
+		glm::vec3 lowerL = dequantize( e.origin, e.step, node.lowerL );
+		glm::vec3 upperL = dequantize( e.origin, e.step, node.upperL );
+		glm::vec3 lowerR = dequantize( e.origin, e.step, node.lowerR );
+		glm::vec3 upperR = dequantize( e.origin, e.step, node.upperR );
+
+		float hitTL;
+		float hitTR;
+		bool hitL = query.boxTest( lowerL, upperL, &hitTL );
+		bool hitR = query.boxTest( lowerR, upperR, &hitTR );
+		stats->boxTest( 2 );
+		bool isLeafL = isLeaf( node.indexL );
+		bool isLeafR = isLeaf( node.indexR );
+
+		if ( hitL && isLeafL )
+		{
+			query.intersectLeaf( quantizedLeafBeg( node.indexL ), quantizedLeafEnd( node.indexL ) );
+		}
+		if ( hitR && isLeafR )
+		{
+			query.intersectLeaf( quantizedLeafBeg( node.indexR ), quantizedLeafEnd( node.indexR ) );
+		}
+
+		bool continueL = hitL && isLeafL == false;
+		bool continueR = hitR && isLeafR == false;
+		Entry childL = {node.indexL, lowerL, continueL ? quantizationStep<T>( lowerL, upperL ) : glm::vec3()};
+		Entry childR = {node.indexR, lowerR, continueR ? quantizationStep<T>( lowerR, upperR ) : glm::vec3()};
+
+		if ( continueL && continueR )
+		{
+			if ( hitTL < hitTR )
+			{
+				stack[stackcount++] = childR;
+				stack[stackcount++] = childL;
+			}
+			else
+			{
+				stack[stackcount++] = childL;
+				stack[stackcount++] = childR;
+			}
+		}
+		else if ( continueL )
+		{
+			stack[stackcount++] = childL;
+		}
+		else if ( continueR )
+		{
+			stack[stackcount++] = childR;
+		}
+	}
+
+	query.result( hit );
+}
+template <class T, class Stats>
+inline void intersect( const QuantizedBvh<T>& qbvh, const Bvh& bvh, const Ray& ray, Hit* hit, Stats* stats )
+{
+	switch ( bvh.triangleLayout )
+	{
+	case TriangleLayout::Indexed:
+		intersectWith<TriangleLayout::Indexed>( qbvh, bvh, ray, hit, stats );
+		break;
+	case TriangleLayout::Woop:
+		intersectWith<TriangleLayout::Woop>( qbvh, bvh, ray, hit, stats );
+		break;
+	case TriangleLayout::Watertight:
+		intersectWith<TriangleLayout::Watertight>( qbvh, bvh, ray, hit, stats );
+		break;
+	}
+}
+template <class T>
+inline void intersect( const QuantizedBvh<T>& qbvh, const Bvh& bvh, const Ray& ray, Hit* hit )
+{
+	NoTraversalStats stats;
+	intersect( qbvh, bvh, ray, hit, &stats );
+}
+
+// batch query. hits[i] receives the closest hit of rays[i]
+template <class T>
+inline void intersect( const QuantizedBvh<T>& qbvh, const Bvh& bvh, const Ray* rays, Hit* hits, size_t n, ThreadPool& pool = ThreadPool::global() )
+{
+	pool.parallelFor( (int64_t)n, 256, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t i = beg; i < end; ++i )
+		{
+			intersect( qbvh, bvh, rays[i], &hits[i] );
+		}
+	} );
+}
+} // namespace cpu
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "CpuBvh.hpp"
+
+// Post-build relayout of the BvhNode array for cache locality
+namespace cpu
+{
+/*
+	Order of the nodes below the breadth-first top levels.
+		BreadthFirst : level by level to the bottom
+		DepthFirst   : pre-order
+		VanEmdeBoas  : the top half of the levels, then each subtree below it, recursively
+
+	The unit of every order is a sibling pair, the inner children of one node,
+	so the two children of a node are always next to each other.
+*/
+enum class NodeOrder
+{
+	BreadthFirst,
+	DepthFirst,
+	VanEmdeBoas,
+};
+
+class NodeReorder
+{
+public:
+	NodeReorder( const Bvh& bvh ) : _bvh( bvh )
+	{
+		// heights from the bottom. children are always found after their parent in breadth-first order
+		uint32_t nNodes = (uint32_t)bvh.nodes.size();
+		_heights.resize( nNodes, 1 );
+		std::vector<uint32_t> bfs;
+		bfs.reserve( nNodes );
+		bfs.push_back( 0 );
+		for ( size_t i = 0; i < bfs.size(); ++i )
+		{
+			const BvhNode& node = bvh.nodes[bfs[i]];
+			for ( uint32_t index0 : {node.indexL[0], node.indexR[0]} )
+			{
+				if ( isLeaf( index0 ) == false )
+				{
+					bfs.push_back( index0 );
+				}
+			}
+		}
+		for ( size_t i = bfs.size(); 0 < i--; )
+		{
+			const BvhNode& node = bvh.nodes[bfs[i]];
+			for ( uint32_t index0 : {node.indexL[0], node.indexR[0]} )
+			{
+				if ( isLeaf( index0 ) == false )
+				{
+					_heights[bfs[i]] = std::max( _heights[bfs[i]], _heights[index0] + 1 );
+				}
+			}
+		}
+		_order.reserve( nNodes );
+	}
+
+	// new position to old node index. The root stays at 0
+	std::vector<uint32_t> order( NodeOrder nodeOrder, int breadthFirstLevels )
+	{
+		_order.clear();
+
+		Unit root = {{0, 0}, 1};
+		std::vector<Unit> level = {root};
+		for ( int depth = 0; level.empty() == false && ( nodeOrder == NodeOrder::BreadthFirst || depth < breadthFirstLevels ); ++depth )
+		{
+			std::vector<Unit> next;
+			for ( const Unit& unit : level )
+			{
+				emit( unit );
+				pushChildren( unit, &next );
+			}
+			level.swap( next );
+		}
+
+		for ( const Unit& unit : level )
+		{
+			if ( nodeOrder == NodeOrder::DepthFirst )
+			{
+				depthFirst( unit );
+			}
+			else
+			{
+				vanEmdeBoas( unit, height( unit ) );
+			}
+		}
+		return _order;
+	}
+
+private:
+	// 1 or 2 sibling nodes
+	struct Unit
+	{
+		uint32_t nodes[2];
+		int count;
+	};
+
+	void emit( const Unit& unit )
+	{
+		for ( int i = 0; i < unit.count; ++i )
+		{
+			_order.push_back( unit.nodes[i] );
+		}
+	}
+	int height( const Unit& unit ) const
+	{
+		int h = 0;
+		for ( int i = 0; i < unit.count; ++i )
+		{
+			h = std::max( h, _heights[unit.nodes[i]] );
+		}
+		return h;
+	}
+	void pushChildren( const Unit& unit, std::vector<Unit>* children ) const
+	{
+		for ( int i = 0; i < unit.count; ++i )
+		{
+			const BvhNode& node = _bvh.nodes[unit.nodes[i]];
+			Unit child = {{0, 0}, 0};
+			for ( uint32_t index0 : {node.indexL[0], node.indexR[0]} )
+			{
+				if ( isLeaf( index0 ) == false )
+				{
+					child.nodes[child.count++] = index0;
+				}
+			}
+			if ( 0 < child.count )
+			{
+				children->push_back( child );
+			}
+		}
+	}
+
+	void depthFirst( const Unit& unit )
+	{
+		emit( unit );
+
+		std::vector<Unit> children;
+		pushChildren( unit, &children );
+		for ( const Unit& child : children )
+		{
+			depthFirst( child );
+		}
+	}
+
+	// the subtree of unit cut at depth levels
+	void vanEmdeBoas( const Unit& unit, int depth )
+	{
+		if ( depth <= 1 )
+		{
+			emit( unit );
+			return;
+		}
+
+		int top = depth / 2;
+		vanEmdeBoas( unit, top );
+
+		std::vector<Unit> bottoms;
+		collect( unit, top, &bottoms );
+		for ( const Unit& bottom : bottoms )
+		{
+			vanEmdeBoas( bottom, depth - top );
+		}
+	}
+	// units right below the top levels of unit
+	void collect( const Unit& unit, int levels, std::vector<Unit>* units ) const
+	{
+		if ( levels == 0 )
+		{
+			units->push_back( unit );
+			return;
+		}
+		std::vector<Unit> children;
+		pushChildren( unit, &children );
+		for ( const Unit& child : children )
+		{
+			collect( child, levels - 1, units );
+		}
+	}
+
+	const Bvh& _bvh;
+	std::vector<int> _heights;
+	std::vector<uint32_t> _order;
+};
+
+/*
+	Relayout bvh->nodes. The top breadthFirstLevels levels are breadth-first so they stay cache hot,
+	nodes below follow nodeOrder. Child indices are rewritten, primitives and elementIndices don't change.
+	Works on trees from GPUBvhBuilder too, whose node order comes from the atomic node counter.
+*/
+inline void reorderNodes( Bvh* bvh, NodeOrder nodeOrder, int breadthFirstLevels = 4 )
+{
+	if ( bvh->nodes.empty() )
+	{
+		return;
+	}
+
+	std::vector<uint32_t> order = NodeReorder( *bvh ).order( nodeOrder, breadthFirstLevels );
+	std::vector<uint32_t> newIndices( bvh->nodes.size() );
+	for ( uint32_t i = 0; i < (uint32_t)order.size(); ++i )
+	{
+		newIndices[order[i]] = i;
+	}
+
+	std::vector<BvhNode> nodes( order.size() );
+	for ( uint32_t i = 0; i < (uint32_t)order.size(); ++i )
+	{
+		BvhNode node = bvh->nodes[order[i]];
+		if ( isLeaf( node.indexL[0] ) == false )
+		{
+			node.indexL[0] = newIndices[node.indexL[0]];
+		}
+		if ( isLeaf( node.indexR[0] ) == false )
+		{
+			node.indexR[0] = newIndices[node.indexR[0]];
+		}
+		nodes[i] = node;
+	}
+	bvh->nodes.swap( nodes );
+}
+} // namespace cpu
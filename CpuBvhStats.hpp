@@ -0,0 +1,180 @@
+#pragma once
+
+#include "CpuBvh.hpp"
+#include <string>
+
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+
+// Heatmaps and histograms of TraversalStats taken by the instrumented cpu::intersect()
+namespace cpu
+{
+enum class TraversalCounter
+{
+	NodeVisits,
+	BoxTests,
+	TriangleTests,
+	SphereTests,
+};
+
+inline uint32_t counterValue( const TraversalStats& stats, TraversalCounter counter )
+{
+	switch ( counter )
+	{
+	case TraversalCounter::NodeVisits:
+		return stats.nodeVisits;
+	case TraversalCounter::BoxTests:
+		return stats.boxTests;
+	case TraversalCounter::TriangleTests:
+		return stats.triangleTests;
+	case TraversalCounter::SphereTests:
+		return stats.sphereTests;
+	}
+	return 0;
+}
+inline const char* counterName( TraversalCounter counter )
+{
+	switch ( counter )
+	{
+	case TraversalCounter::NodeVisits:
+		return "nodeVisits";
+	case TraversalCounter::BoxTests:
+		return "boxTests";
+	case TraversalCounter::TriangleTests:
+		return "triangleTests";
+	case TraversalCounter::SphereTests:
+		return "sphereTests";
+	}
+	return "";
+}
+
+struct CounterHistogram
+{
+	uint32_t minValue = 0;
+	uint32_t maxValue = 0;
+	double mean = 0.0;
+	uint64_t total = 0;
+	uint32_t p50 = 0;
+	uint32_t p90 = 0;
+	uint32_t p99 = 0;
+
+	// bins[i] counts rays whose value is in [i * binWidth, (i + 1) * binWidth)
+	uint32_t binWidth = 1;
+	std::vector<uint32_t> bins;
+};
+
+inline CounterHistogram histogram( const TraversalStats* stats, size_t n, TraversalCounter counter, int nBins = 32 )
+{
+	CounterHistogram h;
+	if ( n == 0 )
+	{
+		return h;
+	}
+
+	std::vector<uint32_t> values( n );
+	for ( size_t i = 0; i < n; ++i )
+	{
+		values[i] = counterValue( stats[i], counter );
+		h.total += values[i];
+	}
+	h.mean = (double)h.total / n;
+
+	std::sort( values.begin(), values.end() );
+	h.minValue = values.front();
+	h.maxValue = values.back();
+	h.p50 = values[( n - 1 ) * 50 / 100];
+	h.p90 = values[( n - 1 ) * 90 / 100];
+	h.p99 = values[( n - 1 ) * 99 / 100];
+
+	h.binWidth = std::max( ( h.maxValue + nBins ) / nBins, 1u );
+	h.bins.resize( h.maxValue / h.binWidth + 1 );
+	for ( uint32_t v : values )
+	{
+		h.bins[v / h.binWidth]++;
+	}
+	return h;
+}
+
+// black -> blue -> cyan -> green -> yellow -> red
+inline glm::u8vec4 heatColor( float x )
+{
+	static const glm::vec3 colors[] = {
+		{0.0f, 0.0f, 0.0f},
+		{0.0f, 0.0f, 1.0f},
+		{0.0f, 1.0f, 1.0f},
+		{0.0f, 1.0f, 0.0f},
+		{1.0f, 1.0f, 0.0f},
+		{1.0f, 0.0f, 0.0f},
+	};
+	const int nColors = sizeof( colors ) / sizeof( colors[0] );
+
+	x = glm::clamp( x, 0.0f, 1.0f ) * ( nColors - 1 );
+	int i = std::min( (int)x, nColors - 2 );
+	glm::vec3 c = glm::mix( colors[i], colors[i + 1], x - i );
+	return glm::u8vec4( glm::ivec4( glm::vec4( c, 1.0f ) * 255.0f + glm::vec4( 0.5f ) ) );
+}
+
+/*
+	one pixel per ray. the value is normalized by scale, 0 means the maximum in this image.
+	Use the same scale to compare builders side by side.
+*/
+inline void heatmap( const TraversalStats* stats, size_t n, TraversalCounter counter, uint32_t scale, glm::u8vec4* image )
+{
+	if ( scale == 0 )
+	{
+		for ( size_t i = 0; i < n; ++i )
+		{
+			scale = std::max( scale, counterValue( stats[i], counter ) );
+		}
+		scale = std::max( scale, 1u );
+	}
+	for ( size_t i = 0; i < n; ++i )
+	{
+		image[i] = heatColor( (float)counterValue( stats[i], counter ) / scale );
+	}
+}
+
+inline std::string traversalStatsJson( const TraversalStats* stats, size_t n, int nBins = 32 )
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer( buffer );
+
+	writer.StartObject();
+	writer.Key( "rays" );
+	writer.Uint64( n );
+	for ( TraversalCounter counter : {TraversalCounter::NodeVisits, TraversalCounter::BoxTests, TraversalCounter::TriangleTests, TraversalCounter::SphereTests} )
+	{
+		CounterHistogram h = histogram( stats, n, counter, nBins );
+
+		writer.Key( counterName( counter ) );
+		writer.StartObject();
+		writer.Key( "total" );
+		writer.Uint64( h.total );
+		writer.Key( "mean" );
+		writer.Double( h.mean );
+		writer.Key( "min" );
+		writer.Uint( h.minValue );
+		writer.Key( "max" );
+		writer.Uint( h.maxValue );
+		writer.Key( "p50" );
+		writer.Uint( h.p50 );
+		writer.Key( "p90" );
+		writer.Uint( h.p90 );
+		writer.Key( "p99" );
+		writer.Uint( h.p99 );
+		writer.Key( "binWidth" );
+		writer.Uint( h.binWidth );
+		writer.Key( "histogram" );
+		writer.StartArray();
+		for ( uint32_t c : h.bins )
+		{
+			writer.Uint( c );
+		}
+		writer.EndArray();
+		writer.EndObject();
+	}
+	writer.EndObject();
+
+	return buffer.GetString();
+}
+} // namespace cpu
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "CpuBvh.hpp"
+
+// GBufferTexel ( see bvh.h ) from hits, and passes that read it back instead of tracing again
+namespace cpu
+{
+// [Cigolle 2014, A Survey of Efficient Representations for Independent Unit Vectors]
+inline uint32_t encodeOctahedral( glm::vec3 n )
+{
+	n /= std::abs( n.x ) + std::abs( n.y ) + std::abs( n.z );
+	glm::vec2 e( n.x, n.y );
+	if ( n.z < 0.0f )
+	{
+		e = ( glm::vec2( 1.0f ) - glm::abs( glm::vec2( n.y, n.x ) ) ) * glm::vec2( 0.0f <= n.x ? 1.0f : -1.0f, 0.0f <= n.y ? 1.0f : -1.0f );
+	}
+	int qx = (int)std::round( glm::clamp( e.x, -1.0f, 1.0f ) * 32767.0f );
+	int qy = (int)std::round( glm::clamp( e.y, -1.0f, 1.0f ) * 32767.0f );
+	return ( (uint32_t)qx & 0xFFFF ) | ( (uint32_t)qy << 16 );
+}
+inline glm::vec3 decodeOctahedral( uint32_t encoded )
+{
+	glm::vec2 e( (float)(int16_t)( encoded & 0xFFFF ) / 32767.0f, (float)(int16_t)( encoded >> 16 ) / 32767.0f );
+	glm::vec3 n( e.x, e.y, 1.0f - std::abs( e.x ) - std::abs( e.y ) );
+	if ( n.z < 0.0f )
+	{
+		float x = ( 1.0f - std::abs( n.y ) ) * ( 0.0f <= n.x ? 1.0f : -1.0f );
+		float y = ( 1.0f - std::abs( n.x ) ) * ( 0.0f <= n.y ? 1.0f : -1.0f );
+		n.x = x;
+		n.y = y;
+	}
+	return glm::normalize( n );
+}
+
+inline uint32_t packBarycentrics( float u, float v )
+{
+	uint32_t qu = (uint32_t)std::round( glm::clamp( u, 0.0f, 1.0f ) * 65535.0f );
+	uint32_t qv = (uint32_t)std::round( glm::clamp( v, 0.0f, 1.0f ) * 65535.0f );
+	return qu | ( qv << 16 );
+}
+inline glm::vec2 unpackBarycentrics( uint32_t packed )
+{
+	return glm::vec2( (float)( packed & 0xFFFF ), (float)( packed >> 16 ) ) / 65535.0f;
+}
+
+inline bool isHit( const GBufferTexel& texel )
+{
+	return texel.primID != kInvalidPrimitive;
+}
+
+// the same texel bvh_traverse.hlsl writes with BVH_OUTPUT_GBUFFER
+inline GBufferTexel gbufferTexel( const Hit& hit )
+{
+	GBufferTexel texel;
+	texel.depth = hit.isHit() ? hit.t : FLT_MAX;
+	texel.normal = hit.isHit() ? encodeOctahedral( hit.Ng ) : 0;
+	texel.primID = hit.primID;
+	texel.barycentrics = packBarycentrics( hit.u, hit.v );
+	return texel;
+}
+inline void writeGBuffer( const Hit* hits, GBufferTexel* texels, size_t n, ThreadPool& pool = ThreadPool::global() )
+{
+	pool.parallelFor( (int64_t)n, 4096, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t i = beg; i < end; ++i )
+		{
+			texels[i] = gbufferTexel( hits[i] );
+		}
+	} );
+}
+
+enum class GBufferChannel
+{
+	Depth,
+	Normal,
+	PrimID,
+	Barycentrics,
+};
+inline const char* gbufferChannelName( GBufferChannel channel )
+{
+	switch ( channel )
+	{
+	case GBufferChannel::Depth:
+		return "depth";
+	case GBufferChannel::Normal:
+		return "normal";
+	case GBufferChannel::PrimID:
+		return "primID";
+	case GBufferChannel::Barycentrics:
+		return "barycentrics";
+	}
+	return "";
+}
+
+/*
+	A view of one channel. depth is normalized by the nearest and the farthest hit in the buffer,
+	primitive ids get hashed colors. Misses are black.
+*/
+inline void visualizeGBuffer( const GBufferTexel* texels, size_t n, GBufferChannel channel, glm::u8vec4* image, ThreadPool& pool = ThreadPool::global() )
+{
+	float depthMin = FLT_MAX;
+	float depthMax = 0.0f;
+	if ( channel == GBufferChannel::Depth )
+	{
+		for ( size_t i = 0; i < n; ++i )
+		{
+			if ( isHit( texels[i] ) )
+			{
+				depthMin = std::min( depthMin, texels[i].depth );
+				depthMax = std::max( depthMax, texels[i].depth );
+			}
+		}
+	}
+
+	pool.parallelFor( (int64_t)n, 4096, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t i = beg; i < end; ++i )
+		{
+			const GBufferTexel& texel = texels[i];
+			glm::vec3 color = glm::vec3( 0.0f );
+			if ( isHit( texel ) )
+			{
+				switch ( channel )
+				{
+				case GBufferChannel::Depth:
+				{
+					float d = depthMin < depthMax ? ( texel.depth - depthMin ) / ( depthMax - depthMin ) : 0.0f;
+					color = glm::vec3( 1.0f - d );
+					break;
+				}
+				case GBufferChannel::Normal:
+					color = ( decodeOctahedral( texel.normal ) + glm::vec3( 1.0f ) ) * 0.5f;
+					break;
+				case GBufferChannel::PrimID:
+				{
+					uint32_t h = texel.primID * 2654435761u;
+					color = glm::vec3( (float)( h & 0xFF ), (float)( ( h >> 8 ) & 0xFF ), (float)( ( h >> 16 ) & 0xFF ) ) / 255.0f;
+					break;
+				}
+				case GBufferChannel::Barycentrics:
+				{
+					glm::vec2 uv = unpackBarycentrics( texel.barycentrics );
+					color = glm::vec3( 1.0f - uv.x - uv.y, uv.x, uv.y );
+					break;
+				}
+				}
+			}
+			glm::ivec4 quantized = glm::ivec4( glm::vec4( color, 1.0f ) * 255.0f + glm::vec4( 0.5f ) );
+			quantized = glm::clamp( quantized, glm::ivec4( 0 ), glm::ivec4( 255 ) );
+			image[i] = glm::u8vec4( quantized );
+		}
+	} );
+}
+} // namespace cpu
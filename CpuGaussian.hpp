@@ -0,0 +1,713 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <complex>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <xmmintrin.h>
+
+#include "CpuParallel.hpp"
+
+// CPU port of the pipeline of main_gaussian.cpp: gaussian_degamma.hlsl, gaussian.hlsl horizontally and vertically, gaussian_gamma.hlsl
+namespace cpu
+{
+// the vertical pass works on tiles of a strip of columns and a band of rows. The rows of a strip under the kernel stay in L2
+#define CPU_GAUSSIAN_STRIP_PIXELS 64
+#define CPU_GAUSSIAN_BAND_ROWS 32
+
+// from this sigma the recursive filter is faster than the direct kernel of about 3.5 * sigma folded taps
+#define CPU_GAUSSIAN_RECURSIVE_MIN_SIGMA 3.0f
+
+/*
+	the weights of main_gaussian.cpp. kernel[0] is the center and kernel[i] is for both -i and +i.
+	It ends at an odd i where the weight is below 1 / 512, and the weights of all taps sum to 1
+*/
+inline std::vector<float> gaussianKernel( float sigma )
+{
+	float sum = 0.0f;
+	std::vector<float> kernel;
+	for ( int i = 0;; ++i )
+	{
+		float g = std::exp( -i * i / ( 2.0f * sigma * sigma ) );
+		sum += g;
+		kernel.push_back( g );
+		if ( ( i % 2 == 1 ) && g < ( 1.0f / 512.0f ) )
+		{
+			break;
+		}
+	}
+
+	// the center is counted once
+	sum = sum * 2.0f - 1.0f;
+	for ( float& w : kernel )
+	{
+		w /= sum;
+	}
+	return kernel;
+}
+
+/*
+	Deriche's 4th order recursive gaussian ( "Recursively implementing the gaussian and its derivatives", 1993 ).
+	The response is within 0.05% of the peak of the true gaussian from sigma 1 up, and it doesn't end at a weight of 1 / 512 like gaussianKernel().
+	It is run as the sum of 2 complex one pole filters each way:
+		causal     s[i] = p s[i - 1] + x[i]
+		anticausal t[i] = p ( t[i + 1] + x[i + 1] )
+		y[i] = sum of Re( w ( s[i] + t[i] ) ) over the 2 poles
+	That is 12 multiplies a pixel each way whatever sigma is. The poles get close to 1 with a large sigma,
+	and the 4th order recursion in float loses its gain there while the rotation of the complex state doesn't
+*/
+struct RecursiveGaussian
+{
+	float pRe[2];
+	float pIm[2];
+	float wRe[2]; // the weights are scaled so that the gain is 1
+	float wIm[2];
+
+	// s and t of a constant 1, 1 / ( 1 - p ) and p / ( 1 - p ). As the edges are clamped, the filters start from these times the edge pixel
+	float causalRe[2];
+	float causalIm[2];
+	float anticausalRe[2];
+	float anticausalIm[2];
+};
+
+inline RecursiveGaussian recursiveGaussian( float sigma )
+{
+	// ( a cos( omega x / sigma ) + c sin( omega x / sigma ) ) exp( -b x / sigma ) for x >= 0 is Re( ( a - ic ) p^x ) with p = exp( ( -b + i omega ) / sigma )
+	const double a[2] = {1.680, -0.6803};
+	const double b[2] = {1.783, 1.723};
+	const double c[2] = {3.735, -0.2598};
+	const double omega[2] = {0.6318, 1.997};
+
+	RecursiveGaussian g;
+	std::complex<double> p[2];
+	std::complex<double> w[2];
+	double gain = 0.0;
+	for ( int i = 0; i < 2; ++i )
+	{
+		// the gain is of the pole rounded to float, the one that runs
+		std::complex<double> pole = std::polar( std::exp( -b[i] / sigma ), omega[i] / sigma );
+		g.pRe[i] = (float)pole.real();
+		g.pIm[i] = (float)pole.imag();
+		p[i] = std::complex<double>( g.pRe[i], g.pIm[i] );
+		w[i] = std::complex<double>( a[i], -c[i] );
+		gain += ( w[i] * ( 1.0 + p[i] ) / ( 1.0 - p[i] ) ).real();
+	}
+	for ( int i = 0; i < 2; ++i )
+	{
+		std::complex<double> causal = 1.0 / ( 1.0 - p[i] );
+		std::complex<double> anticausal = p[i] / ( 1.0 - p[i] );
+		g.wRe[i] = (float)( w[i].real() / gain );
+		g.wIm[i] = (float)( w[i].imag() / gain );
+		g.causalRe[i] = (float)causal.real();
+		g.causalIm[i] = (float)causal.imag();
+		g.anticausalRe[i] = (float)anticausal.real();
+		g.anticausalIm[i] = (float)anticausal.imag();
+	}
+	return g;
+}
+
+// GaussianBlur::blur( ..., sigma ) picks the recursive filter for this sigma
+inline bool useRecursiveGaussian( float sigma )
+{
+	return CPU_GAUSSIAN_RECURSIVE_MIN_SIGMA <= sigma;
+}
+
+/*
+	Separable gaussian blur of RGBA8 images in linear space. A pixel is a float4 in a SSE register.
+	The 2 float4 working images keep the capacity of the largest image so far, and the per thread rows and taps of the largest radius.
+	The edges are clamped like gaussian.hlsl
+*/
+class GaussianBlur
+{
+public:
+	// degamma -> horizontal -> vertical -> gamma, fused by blurFused()
+	void blur( const glm::u8vec4* src, glm::u8vec4* dst, int width, int height, const std::vector<float>& kernel, ThreadPool& pool = ThreadPool::global() )
+	{
+		blurFused( src, dst, width, height, kernel, pool );
+	}
+
+	// the direct kernel of gaussianKernel( sigma ) or the recursive filter, whichever useRecursiveGaussian() says
+	void blur( const glm::u8vec4* src, glm::u8vec4* dst, int width, int height, float sigma, ThreadPool& pool = ThreadPool::global() )
+	{
+		if ( useRecursiveGaussian( sigma ) )
+		{
+			RecursiveGaussian filter = recursiveGaussian( sigma );
+			degamma( src, width, height, pool );
+			horizontal( filter, pool );
+			vertical( filter, pool );
+			gamma( dst, pool );
+		}
+		else
+		{
+			blur( src, dst, width, height, gaussianKernel( sigma ), pool );
+		}
+	}
+
+	// gaussian_degamma.hlsl into the working image. The 256 values of a channel are a table
+	void degamma( const glm::u8vec4* src, int width, int height, ThreadPool& pool = ThreadPool::global() )
+	{
+		_width = width;
+		_height = height;
+		_image0.resize( (size_t)width * height );
+		_image1.resize( (size_t)width * height );
+
+		float linear[256];
+		degammaTable( linear );
+		pool.parallelFor( (int64_t)_image0.size(), 1 << 14, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+			for ( int64_t i = beg; i < end; ++i )
+			{
+				_image0[i] = degammaPixel( linear, src[i] );
+			}
+		} );
+	}
+
+	// gaussian.hlsl with ( sample_dx, sample_dy ) = ( 1, 0 ). A row is copied with the clamped edges first, so the taps don't clamp
+	void horizontal( const std::vector<float>& kernel, ThreadPool& pool = ThreadPool::global() )
+	{
+		int radius = (int)kernel.size() - 1;
+		int paddedWidth = _width + radius * 2;
+		_pads.resize( (size_t)pool.threadCount() * paddedWidth );
+		const glm::vec4* src = _image0.data();
+		glm::vec4* dst = _image1.data();
+
+		pool.parallelFor( _height, 1, [&]( int64_t beg, int64_t end, int iThread ) {
+			glm::vec4* pad = &_pads[(size_t)iThread * paddedWidth];
+			for ( int64_t y = beg; y < end; ++y )
+			{
+				const glm::vec4* row = src + y * _width;
+				for ( int x = 0; x < paddedWidth; ++x )
+				{
+					pad[x] = row[std::min( std::max( x - radius, 0 ), _width - 1 )];
+				}
+				convolveRow( kernel, &pad[radius].x, &dst[y * _width].x, _width );
+			}
+		} );
+	}
+
+	/*
+		gaussian.hlsl with ( sample_dx, sample_dy ) = ( 0, 1 ), a tile at a time.
+		A tile reads its strip row by row, CPU_GAUSSIAN_STRIP_PIXELS * 16 bytes each, instead of a column with a stride of the image width
+	*/
+	void vertical( const std::vector<float>& kernel, ThreadPool& pool = ThreadPool::global() )
+	{
+		int radius = (int)kernel.size() - 1;
+		int nStrips = ( _width + CPU_GAUSSIAN_STRIP_PIXELS - 1 ) / CPU_GAUSSIAN_STRIP_PIXELS;
+		int nBands = ( _height + CPU_GAUSSIAN_BAND_ROWS - 1 ) / CPU_GAUSSIAN_BAND_ROWS;
+		const glm::vec4* src = _image1.data();
+		glm::vec4* dst = _image0.data();
+		_taps.resize( (size_t)pool.threadCount() * ( radius * 2 + 2 ) );
+
+		// the bands of a strip are next to each other in the order of the tiles, as they share most of the rows
+		pool.parallelFor( (int64_t)nStrips * nBands, 1, [&]( int64_t beg, int64_t end, int iThread ) {
+			const float** taps = &_taps[(size_t)iThread * ( radius * 2 + 2 )];
+			for ( int64_t tile = beg; tile < end; ++tile )
+			{
+				int x0 = (int)( tile / nBands ) * CPU_GAUSSIAN_STRIP_PIXELS;
+				int x1 = std::min( x0 + CPU_GAUSSIAN_STRIP_PIXELS, _width );
+				int y0 = (int)( tile % nBands ) * CPU_GAUSSIAN_BAND_ROWS;
+				int y1 = std::min( y0 + CPU_GAUSSIAN_BAND_ROWS, _height );
+
+				// 2 rows at a time, and the last one of an odd band alone
+				for ( int y = y0; y < y1; y += 2 )
+				{
+					for ( int i = -radius; i <= radius + 1; ++i )
+					{
+						taps[radius + i] = &src[(size_t)std::min( std::max( y + i, 0 ), _height - 1 ) * _width + x0].x;
+					}
+					if ( y + 1 < y1 )
+					{
+						convolveRowPair( kernel, taps, &dst[(size_t)y * _width + x0].x, &dst[(size_t)( y + 1 ) * _width + x0].x, x1 - x0 );
+					}
+					else
+					{
+						convolveRows( kernel, taps, &dst[(size_t)y * _width + x0].x, x1 - x0 );
+					}
+				}
+			}
+		} );
+	}
+
+	/*
+		degamma -> horizontal -> vertical -> gamma in one pass from RGBA8 to RGBA8, without the working images.
+		A thread goes down a strip of CPU_GAUSSIAN_STRIP_PIXELS columns over a band of rows. A row of the strip is degammaed with its halo
+		and blurred horizontally into a ring of the last 2 * radius + 2 rows, which blurs the 2 rows radius above it vertically to gamma.
+		A pixel is 4 bytes in and 4 bytes out, where the separate passes read and write the 16 byte working images 3 times
+	*/
+	void blurFused( const glm::u8vec4* src, glm::u8vec4* dst, int width, int height, const std::vector<float>& kernel, ThreadPool& pool = ThreadPool::global() )
+	{
+		int radius = (int)kernel.size() - 1;
+		int ringRows = radius * 2 + 2;
+		int nStrips = ( width + CPU_GAUSSIAN_STRIP_PIXELS - 1 ) / CPU_GAUSSIAN_STRIP_PIXELS;
+
+		// a band blurs 2 * radius rows horizontally more than it outputs, so it is split only to keep the threads busy, and not below 4 * radius rows
+		int nBands = std::max( std::min( ( pool.threadCount() * 4 + nStrips - 1 ) / nStrips, height / std::max( radius * 4, 1 ) ), 1 );
+		int bandRows = ( height + nBands - 1 ) / nBands;
+
+		float linear[256];
+		float thresholds[256];
+		degammaTable( linear );
+		gammaTable( thresholds );
+
+		// [thread][the padded row, the ring, the 2 output rows]
+		int paddedWidth = CPU_GAUSSIAN_STRIP_PIXELS + radius * 2;
+		size_t scratch = paddedWidth + (size_t)( ringRows + 2 ) * CPU_GAUSSIAN_STRIP_PIXELS;
+		_pads.resize( (size_t)pool.threadCount() * scratch );
+		_taps.resize( (size_t)pool.threadCount() * ringRows );
+
+		pool.parallelFor( (int64_t)nStrips * nBands, 1, [&]( int64_t beg, int64_t end, int iThread ) {
+			glm::vec4* pad = &_pads[(size_t)iThread * scratch];
+			glm::vec4* ring = pad + paddedWidth;
+			glm::vec4* out = ring + (size_t)ringRows * CPU_GAUSSIAN_STRIP_PIXELS;
+			const float** taps = &_taps[(size_t)iThread * ringRows];
+			for ( int64_t tile = beg; tile < end; ++tile )
+			{
+				int x0 = (int)( tile / nBands ) * CPU_GAUSSIAN_STRIP_PIXELS;
+				int nPixels = std::min( CPU_GAUSSIAN_STRIP_PIXELS, width - x0 );
+				int y0 = (int)( tile % nBands ) * bandRows;
+				int y1 = std::min( y0 + bandRows, height );
+
+				// the v-th row from y0 - radius, clamped, is in the ring at v % ringRows
+				int previous = -1;
+				int nVirtualRows = y1 - y0 + radius * 2;
+				for ( int v = 0; v < nVirtualRows; ++v )
+				{
+					int y = std::min( std::max( y0 - radius + v, 0 ), height - 1 );
+					glm::vec4* slot = ring + (size_t)( v % ringRows ) * CPU_GAUSSIAN_STRIP_PIXELS;
+					if ( y == previous )
+					{
+						memcpy( slot, ring + (size_t)( ( v - 1 ) % ringRows ) * CPU_GAUSSIAN_STRIP_PIXELS, nPixels * sizeof( glm::vec4 ) );
+					}
+					else
+					{
+						const glm::u8vec4* row = src + (size_t)y * width;
+						for ( int x = 0; x < nPixels + radius * 2; ++x )
+						{
+							pad[x] = degammaPixel( linear, row[std::min( std::max( x0 - radius + x, 0 ), width - 1 )] );
+						}
+						convolveRow( kernel, &pad[radius].x, &slot->x, nPixels );
+					}
+					previous = y;
+
+					// the row v - 2 * radius is ready. The rows go out in pairs, and the last one of an odd band alone
+					int o = v - radius * 2;
+					int nOut = 0;
+					if ( 0 <= o && o % 2 == 1 )
+					{
+						for ( int i = 0; i < ringRows; ++i )
+						{
+							taps[i] = &ring[(size_t)( ( o - 1 + i ) % ringRows ) * CPU_GAUSSIAN_STRIP_PIXELS].x;
+						}
+						convolveRowPair( kernel, taps, &out->x, &out[CPU_GAUSSIAN_STRIP_PIXELS].x, nPixels );
+						o--;
+						nOut = 2;
+					}
+					else if ( 0 <= o && v == nVirtualRows - 1 )
+					{
+						for ( int i = 0; i < ringRows - 1; ++i )
+						{
+							taps[i] = &ring[(size_t)( ( o + i ) % ringRows ) * CPU_GAUSSIAN_STRIP_PIXELS].x;
+						}
+						convolveRows( kernel, taps, &out->x, nPixels );
+						nOut = 1;
+					}
+
+					for ( int r = 0; r < nOut; ++r )
+					{
+						glm::u8vec4* outRow = dst + (size_t)( y0 + o + r ) * width + x0;
+						const glm::vec4* outPixels = out + (size_t)r * CPU_GAUSSIAN_STRIP_PIXELS;
+						for ( int x = 0; x < nPixels; ++x )
+						{
+							outRow[x] = gammaPixel( thresholds, outPixels[x] );
+						}
+					}
+				}
+			}
+		} );
+	}
+
+	// the recursive filter along rows. The causal filters run to the right and the anticausal ones back to the left, adding to them
+	void horizontal( const RecursiveGaussian& filter, ThreadPool& pool = ThreadPool::global() )
+	{
+		const glm::vec4* src = _image0.data();
+		glm::vec4* dst = _image1.data();
+
+		pool.parallelFor( _height, 1, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+			RecursiveGaussianSSE f( filter );
+			for ( int64_t y = beg; y < end; ++y )
+			{
+				const float* row = &src[y * _width].x;
+				float* out = &dst[y * _width].x;
+
+				__m128 re0, im0, re1, im1;
+				f.causalEdge( _mm_loadu_ps( row ), re0, im0, re1, im1 );
+				for ( int x = 0; x < _width; ++x )
+				{
+					_mm_storeu_ps( out + x * 4, f.causal( _mm_loadu_ps( row + x * 4 ), re0, im0, re1, im1 ) );
+				}
+
+				f.anticausalEdge( _mm_loadu_ps( row + ( _width - 1 ) * 4 ), re0, im0, re1, im1 );
+				for ( int x = _width - 1; 0 <= x; --x )
+				{
+					__m128 v = f.anticausal( _mm_loadu_ps( row + x * 4 ), re0, im0, re1, im1 );
+					_mm_storeu_ps( out + x * 4, _mm_add_ps( _mm_loadu_ps( out + x * 4 ), v ) );
+				}
+			}
+		} );
+	}
+
+	/*
+		the recursive filter along columns, a strip of CPU_GAUSSIAN_STRIP_PIXELS columns at a time.
+		The rows step through the strip together, so the states of the filters are rows of the strip in L1 instead of registers
+	*/
+	void vertical( const RecursiveGaussian& filter, ThreadPool& pool = ThreadPool::global() )
+	{
+		int nStrips = ( _width + CPU_GAUSSIAN_STRIP_PIXELS - 1 ) / CPU_GAUSSIAN_STRIP_PIXELS;
+		const glm::vec4* src = _image1.data();
+		glm::vec4* dst = _image0.data();
+
+		// [thread][the real and imaginary parts of the states of the 2 poles]
+		_pads.resize( (size_t)pool.threadCount() * CPU_GAUSSIAN_STRIP_PIXELS * 4 );
+
+		pool.parallelFor( nStrips, 1, [&]( int64_t beg, int64_t end, int iThread ) {
+			RecursiveGaussianSSE f( filter );
+			float* re0 = &_pads[(size_t)iThread * CPU_GAUSSIAN_STRIP_PIXELS * 4].x;
+			float* im0 = re0 + CPU_GAUSSIAN_STRIP_PIXELS * 4;
+			float* re1 = im0 + CPU_GAUSSIAN_STRIP_PIXELS * 4;
+			float* im1 = re1 + CPU_GAUSSIAN_STRIP_PIXELS * 4;
+			for ( int64_t strip = beg; strip < end; ++strip )
+			{
+				int x0 = (int)strip * CPU_GAUSSIAN_STRIP_PIXELS;
+				int n = std::min( CPU_GAUSSIAN_STRIP_PIXELS, _width - x0 ) * 4;
+
+				const float* top = &src[x0].x;
+				for ( int j = 0; j < n; j += 4 )
+				{
+					__m128 r0, i0, r1, i1;
+					f.causalEdge( _mm_loadu_ps( top + j ), r0, i0, r1, i1 );
+					f.store( re0 + j, im0 + j, re1 + j, im1 + j, r0, i0, r1, i1 );
+				}
+				for ( int y = 0; y < _height; ++y )
+				{
+					const float* row = &src[(size_t)y * _width + x0].x;
+					float* out = &dst[(size_t)y * _width + x0].x;
+					for ( int j = 0; j < n; j += 4 )
+					{
+						__m128 r0 = _mm_loadu_ps( re0 + j ), i0 = _mm_loadu_ps( im0 + j ), r1 = _mm_loadu_ps( re1 + j ), i1 = _mm_loadu_ps( im1 + j );
+						_mm_storeu_ps( out + j, f.causal( _mm_loadu_ps( row + j ), r0, i0, r1, i1 ) );
+						f.store( re0 + j, im0 + j, re1 + j, im1 + j, r0, i0, r1, i1 );
+					}
+				}
+
+				const float* bottom = &src[(size_t)( _height - 1 ) * _width + x0].x;
+				for ( int j = 0; j < n; j += 4 )
+				{
+					__m128 r0, i0, r1, i1;
+					f.anticausalEdge( _mm_loadu_ps( bottom + j ), r0, i0, r1, i1 );
+					f.store( re0 + j, im0 + j, re1 + j, im1 + j, r0, i0, r1, i1 );
+				}
+				for ( int y = _height - 1; 0 <= y; --y )
+				{
+					const float* row = &src[(size_t)y * _width + x0].x;
+					float* out = &dst[(size_t)y * _width + x0].x;
+					for ( int j = 0; j < n; j += 4 )
+					{
+						__m128 r0 = _mm_loadu_ps( re0 + j ), i0 = _mm_loadu_ps( im0 + j ), r1 = _mm_loadu_ps( re1 + j ), i1 = _mm_loadu_ps( im1 + j );
+						__m128 v = f.anticausal( _mm_loadu_ps( row + j ), r0, i0, r1, i1 );
+						_mm_storeu_ps( out + j, _mm_add_ps( _mm_loadu_ps( out + j ), v ) );
+						f.store( re0 + j, im0 + j, re1 + j, im1 + j, r0, i0, r1, i1 );
+					}
+				}
+			}
+		} );
+	}
+
+	// gaussian_gamma.hlsl from the working image
+	void gamma( glm::u8vec4* dst, ThreadPool& pool = ThreadPool::global() )
+	{
+		float thresholds[256];
+		gammaTable( thresholds );
+		pool.parallelFor( (int64_t)_image0.size(), 1 << 14, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+			for ( int64_t i = beg; i < end; ++i )
+			{
+				dst[i] = gammaPixel( thresholds, _image0[i] );
+			}
+		} );
+	}
+
+private:
+	static void degammaTable( float* linear )
+	{
+		for ( int i = 0; i < 256; ++i )
+		{
+			linear[i] = std::pow( (float)i / 255.0f, 2.2f );
+		}
+	}
+	static glm::vec4 degammaPixel( const float* linear, glm::u8vec4 c )
+	{
+		return glm::vec4( linear[c.x], linear[c.y], linear[c.z], (float)c.w / 255.0f );
+	}
+
+	/*
+		Instead of pow() per channel, the level is the number of the thresholds ( ( q - 0.5 ) / 255 ) ^ 2.2 at or below the value,
+		the same rounding as int( pow( v, 1 / 2.2 ) * 255 + 0.5 ) of gaussian_gamma.hlsl
+	*/
+	static void gammaTable( float* thresholds )
+	{
+		thresholds[0] = 0.0f;
+		for ( int q = 1; q < 256; ++q )
+		{
+			thresholds[q] = std::pow( ( q - 0.5f ) / 255.0f, 2.2f );
+		}
+	}
+	static uint8_t gammaLevel( const float* thresholds, float v )
+	{
+		int q = 0;
+		for ( int step = 128; 0 < step; step >>= 1 )
+		{
+			if ( thresholds[q + step] <= v )
+			{
+				q += step;
+			}
+		}
+		return (uint8_t)q;
+	}
+	static glm::u8vec4 gammaPixel( const float* thresholds, glm::vec4 c )
+	{
+		int a = (int)( c.w * 255.0f + 0.5f );
+		return glm::u8vec4( gammaLevel( thresholds, c.x ), gammaLevel( thresholds, c.y ), gammaLevel( thresholds, c.z ), (uint8_t)std::min( std::max( a, 0 ), 255 ) );
+	}
+
+	// out[0, n) of the kernel over a row of pixels. center is the pixel of out[0], and the row has radius pixels more on both sides
+	static void convolveRow( const std::vector<float>& kernel, const float* center, float* out, int n )
+	{
+		int radius = (int)kernel.size() - 1;
+		int x = 0;
+		for ( ; x + 4 <= n; x += 4 )
+		{
+			const float* c = center + x * 4;
+			__m128 w = _mm_set1_ps( kernel[0] );
+			__m128 a0 = _mm_mul_ps( w, _mm_loadu_ps( c ) );
+			__m128 a1 = _mm_mul_ps( w, _mm_loadu_ps( c + 4 ) );
+			__m128 a2 = _mm_mul_ps( w, _mm_loadu_ps( c + 8 ) );
+			__m128 a3 = _mm_mul_ps( w, _mm_loadu_ps( c + 12 ) );
+			for ( int i = 1; i <= radius; ++i )
+			{
+				const float* l = c - i * 4;
+				const float* r = c + i * 4;
+				w = _mm_set1_ps( kernel[i] );
+				a0 = _mm_add_ps( a0, _mm_mul_ps( w, _mm_add_ps( _mm_loadu_ps( l ), _mm_loadu_ps( r ) ) ) );
+				a1 = _mm_add_ps( a1, _mm_mul_ps( w, _mm_add_ps( _mm_loadu_ps( l + 4 ), _mm_loadu_ps( r + 4 ) ) ) );
+				a2 = _mm_add_ps( a2, _mm_mul_ps( w, _mm_add_ps( _mm_loadu_ps( l + 8 ), _mm_loadu_ps( r + 8 ) ) ) );
+				a3 = _mm_add_ps( a3, _mm_mul_ps( w, _mm_add_ps( _mm_loadu_ps( l + 12 ), _mm_loadu_ps( r + 12 ) ) ) );
+			}
+			_mm_storeu_ps( out + x * 4, a0 );
+			_mm_storeu_ps( out + x * 4 + 4, a1 );
+			_mm_storeu_ps( out + x * 4 + 8, a2 );
+			_mm_storeu_ps( out + x * 4 + 12, a3 );
+		}
+		for ( ; x < n; ++x )
+		{
+			const float* c = center + x * 4;
+			__m128 a = _mm_mul_ps( _mm_set1_ps( kernel[0] ), _mm_loadu_ps( c ) );
+			for ( int i = 1; i <= radius; ++i )
+			{
+				a = _mm_add_ps( a, _mm_mul_ps( _mm_set1_ps( kernel[i] ), _mm_add_ps( _mm_loadu_ps( c - i * 4 ), _mm_loadu_ps( c + i * 4 ) ) ) );
+			}
+			_mm_storeu_ps( out + x * 4, a );
+		}
+	}
+
+	// out[0, n) of the kernel across rows. rows[radius + i] is the row of the tap i
+	static void convolveRows( const std::vector<float>& kernel, const float* const* rows, float* out, int n )
+	{
+		int radius = (int)kernel.size() - 1;
+		const float* const* center = rows + radius;
+		int x = 0;
+		for ( ; x + 4 <= n; x += 4 )
+		{
+			int j = x * 4;
+			__m128 w = _mm_set1_ps( kernel[0] );
+			__m128 a0 = _mm_mul_ps( w, _mm_loadu_ps( center[0] + j ) );
+			__m128 a1 = _mm_mul_ps( w, _mm_loadu_ps( center[0] + j + 4 ) );
+			__m128 a2 = _mm_mul_ps( w, _mm_loadu_ps( center[0] + j + 8 ) );
+			__m128 a3 = _mm_mul_ps( w, _mm_loadu_ps( center[0] + j + 12 ) );
+			for ( int i = 1; i <= radius; ++i )
+			{
+				const float* u = center[-i] + j;
+				const float* d = center[i] + j;
+				w = _mm_set1_ps( kernel[i] );
+				a0 = _mm_add_ps( a0, _mm_mul_ps( w, _mm_add_ps( _mm_loadu_ps( u ), _mm_loadu_ps( d ) ) ) );
+				a1 = _mm_add_ps( a1, _mm_mul_ps( w, _mm_add_ps( _mm_loadu_ps( u + 4 ), _mm_loadu_ps( d + 4 ) ) ) );
+				a2 = _mm_add_ps( a2, _mm_mul_ps( w, _mm_add_ps( _mm_loadu_ps( u + 8 ), _mm_loadu_ps( d + 8 ) ) ) );
+				a3 = _mm_add_ps( a3, _mm_mul_ps( w, _mm_add_ps( _mm_loadu_ps( u + 12 ), _mm_loadu_ps( d + 12 ) ) ) );
+			}
+			_mm_storeu_ps( out + j, a0 );
+			_mm_storeu_ps( out + j + 4, a1 );
+			_mm_storeu_ps( out + j + 8, a2 );
+			_mm_storeu_ps( out + j + 12, a3 );
+		}
+		for ( ; x < n; ++x )
+		{
+			int j = x * 4;
+			__m128 a = _mm_mul_ps( _mm_set1_ps( kernel[0] ), _mm_loadu_ps( center[0] + j ) );
+			for ( int i = 1; i <= radius; ++i )
+			{
+				a = _mm_add_ps( a, _mm_mul_ps( _mm_set1_ps( kernel[i] ), _mm_add_ps( _mm_loadu_ps( center[-i] + j ), _mm_loadu_ps( center[i] + j ) ) ) );
+			}
+			_mm_storeu_ps( out + j, a );
+		}
+	}
+
+	/*
+		out0 and out1[0, n) of the kernel across rows, for 2 neighboring rows at once. rows[radius + i] is the row of the tap i of out0, up to rows[radius * 2 + 1].
+		The tap i of out0 is the tap i - 1 of out1, so a row is loaded once for both, in the same order of the sums as convolveRows()
+	*/
+	static void convolveRowPair( const std::vector<float>& kernel, const float* const* rows, float* out0, float* out1, int n )
+	{
+		int radius = (int)kernel.size() - 1;
+		const float* const* center = rows + radius;
+		int x = 0;
+		for ( ; x + 2 <= n; x += 2 )
+		{
+			int j = x * 4;
+			__m128 w = _mm_set1_ps( kernel[0] );
+
+			// l is the row above out1 and r the row below out0, as the taps move out
+			__m128 l0 = _mm_loadu_ps( center[0] + j );
+			__m128 l1 = _mm_loadu_ps( center[0] + j + 4 );
+			__m128 r0 = _mm_loadu_ps( center[1] + j );
+			__m128 r1 = _mm_loadu_ps( center[1] + j + 4 );
+			__m128 a0 = _mm_mul_ps( w, l0 );
+			__m128 a1 = _mm_mul_ps( w, l1 );
+			__m128 b0 = _mm_mul_ps( w, r0 );
+			__m128 b1 = _mm_mul_ps( w, r1 );
+			for ( int i = 1; i <= radius; ++i )
+			{
+				const float* u = center[-i] + j;
+				const float* d = center[1 + i] + j;
+				w = _mm_set1_ps( kernel[i] );
+				__m128 u0 = _mm_loadu_ps( u );
+				__m128 u1 = _mm_loadu_ps( u + 4 );
+				__m128 d0 = _mm_loadu_ps( d );
+				__m128 d1 = _mm_loadu_ps( d + 4 );
+				a0 = _mm_add_ps( a0, _mm_mul_ps( w, _mm_add_ps( u0, r0 ) ) );
+				a1 = _mm_add_ps( a1, _mm_mul_ps( w, _mm_add_ps( u1, r1 ) ) );
+				b0 = _mm_add_ps( b0, _mm_mul_ps( w, _mm_add_ps( l0, d0 ) ) );
+				b1 = _mm_add_ps( b1, _mm_mul_ps( w, _mm_add_ps( l1, d1 ) ) );
+				l0 = u0;
+				l1 = u1;
+				r0 = d0;
+				r1 = d1;
+			}
+			_mm_storeu_ps( out0 + j, a0 );
+			_mm_storeu_ps( out0 + j + 4, a1 );
+			_mm_storeu_ps( out1 + j, b0 );
+			_mm_storeu_ps( out1 + j + 4, b1 );
+		}
+		for ( ; x < n; ++x )
+		{
+			int j = x * 4;
+			__m128 w = _mm_set1_ps( kernel[0] );
+			__m128 l = _mm_loadu_ps( center[0] + j );
+			__m128 r = _mm_loadu_ps( center[1] + j );
+			__m128 a = _mm_mul_ps( w, l );
+			__m128 b = _mm_mul_ps( w, r );
+			for ( int i = 1; i <= radius; ++i )
+			{
+				w = _mm_set1_ps( kernel[i] );
+				__m128 u = _mm_loadu_ps( center[-i] + j );
+				__m128 d = _mm_loadu_ps( center[1 + i] + j );
+				a = _mm_add_ps( a, _mm_mul_ps( w, _mm_add_ps( u, r ) ) );
+				b = _mm_add_ps( b, _mm_mul_ps( w, _mm_add_ps( l, d ) ) );
+				l = u;
+				r = d;
+			}
+			_mm_storeu_ps( out0 + j, a );
+			_mm_storeu_ps( out1 + j, b );
+		}
+	}
+
+	// a step of the 2 poles of RecursiveGaussian over the 4 channels of a pixel. The state of a pole is ( re, im )
+	struct RecursiveGaussianSSE
+	{
+		__m128 pRe[2], pIm[2], wRe[2], wIm[2];
+		__m128 causalRe[2], causalIm[2], anticausalRe[2], anticausalIm[2];
+
+		RecursiveGaussianSSE( const RecursiveGaussian& filter )
+		{
+			for ( int i = 0; i < 2; ++i )
+			{
+				pRe[i] = _mm_set1_ps( filter.pRe[i] );
+				pIm[i] = _mm_set1_ps( filter.pIm[i] );
+				wRe[i] = _mm_set1_ps( filter.wRe[i] );
+				wIm[i] = _mm_set1_ps( filter.wIm[i] );
+				causalRe[i] = _mm_set1_ps( filter.causalRe[i] );
+				causalIm[i] = _mm_set1_ps( filter.causalIm[i] );
+				anticausalRe[i] = _mm_set1_ps( filter.anticausalRe[i] );
+				anticausalIm[i] = _mm_set1_ps( filter.anticausalIm[i] );
+			}
+		}
+		void causalEdge( __m128 edge, __m128& re0, __m128& im0, __m128& re1, __m128& im1 ) const
+		{
+			re0 = _mm_mul_ps( causalRe[0], edge );
+			im0 = _mm_mul_ps( causalIm[0], edge );
+			re1 = _mm_mul_ps( causalRe[1], edge );
+			im1 = _mm_mul_ps( causalIm[1], edge );
+		}
+		void anticausalEdge( __m128 edge, __m128& re0, __m128& im0, __m128& re1, __m128& im1 ) const
+		{
+			re0 = _mm_mul_ps( anticausalRe[0], edge );
+			im0 = _mm_mul_ps( anticausalIm[0], edge );
+			re1 = _mm_mul_ps( anticausalRe[1], edge );
+			im1 = _mm_mul_ps( anticausalIm[1], edge );
+		}
+
+		// s = p s + x, returns the output of s
+		__m128 causal( __m128 x, __m128& re0, __m128& im0, __m128& re1, __m128& im1 ) const
+		{
+			rotate( 0, re0, im0, re0, im0 );
+			rotate( 1, re1, im1, re1, im1 );
+			re0 = _mm_add_ps( re0, x );
+			re1 = _mm_add_ps( re1, x );
+			return output( re0, im0, re1, im1 );
+		}
+
+		// returns the output of t, then t = p ( t + x )
+		__m128 anticausal( __m128 x, __m128& re0, __m128& im0, __m128& re1, __m128& im1 ) const
+		{
+			__m128 v = output( re0, im0, re1, im1 );
+			rotate( 0, _mm_add_ps( re0, x ), im0, re0, im0 );
+			rotate( 1, _mm_add_ps( re1, x ), im1, re1, im1 );
+			return v;
+		}
+
+		void rotate( int i, __m128 re, __m128 im, __m128& outRe, __m128& outIm ) const
+		{
+			outRe = _mm_sub_ps( _mm_mul_ps( pRe[i], re ), _mm_mul_ps( pIm[i], im ) );
+			outIm = _mm_add_ps( _mm_mul_ps( pRe[i], im ), _mm_mul_ps( pIm[i], re ) );
+		}
+		__m128 output( __m128 re0, __m128 im0, __m128 re1, __m128 im1 ) const
+		{
+			__m128 v0 = _mm_sub_ps( _mm_mul_ps( wRe[0], re0 ), _mm_mul_ps( wIm[0], im0 ) );
+			__m128 v1 = _mm_sub_ps( _mm_mul_ps( wRe[1], re1 ), _mm_mul_ps( wIm[1], im1 ) );
+			return _mm_add_ps( v0, v1 );
+		}
+		static void store( float* re0, float* im0, float* re1, float* im1, __m128 r0, __m128 i0, __m128 r1, __m128 i1 )
+		{
+			_mm_storeu_ps( re0, r0 );
+			_mm_storeu_ps( im0, i0 );
+			_mm_storeu_ps( re1, r1 );
+			_mm_storeu_ps( im1, i1 );
+		}
+	};
+
+	int _width = 0;
+	int _height = 0;
+	std::vector<glm::vec4> _image0;
+	std::vector<glm::vec4> _image1;
+	std::vector<glm::vec4> _pads;	  // [thread][scratch rows]
+	std::vector<const float*> _taps; // [thread][the rows of the taps]
+};
+} // namespace cpu
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "CpuBvh.hpp"
+#include <emmintrin.h>
+
+// Brute force ray caster without a tree, the CPU version of linear_rt.hlsl
+namespace cpu
+{
+/*
+	Triangles per chunk. The counterpart of a wave in linear_rt.hlsl,
+	a ray skips the whole chunk when it misses the chunk AABB.
+*/
+#define CPU_LINEAR_CHUNK_SIZE 32
+#define CPU_LINEAR_PACKET_SIZE 4
+
+// 4 triangles in SoA, v0 and the two edges. Padding triangles have zero edges and never hit.
+struct LinearPacket
+{
+	__m128 v0[3];
+	__m128 e1[3];
+	__m128 e2[3];
+};
+
+/*
+	Triangles in the order of the index buffer with their chunk AABBs.
+	The preprocess is a single linear pass, suitable for meshes changing every frame.
+*/
+struct LinearTriangles
+{
+	std::vector<LinearPacket> packets; // CPU_LINEAR_CHUNK_SIZE / CPU_LINEAR_PACKET_SIZE per chunk
+	std::vector<glm::vec3> chunkLowers;
+	std::vector<glm::vec3> chunkUppers;
+	uint32_t triangleCount = 0;
+
+	uint32_t chunkCount() const { return (uint32_t)chunkLowers.size(); }
+};
+
+inline void buildLinearTriangles( LinearTriangles* linear, const glm::vec3* P, const uint32_t* indices, uint32_t triangleCount, ThreadPool& pool = ThreadPool::global() )
+{
+	const uint32_t kPacketsPerChunk = CPU_LINEAR_CHUNK_SIZE / CPU_LINEAR_PACKET_SIZE;
+
+	uint32_t nChunks = ( triangleCount + CPU_LINEAR_CHUNK_SIZE - 1 ) / CPU_LINEAR_CHUNK_SIZE;
+	linear->triangleCount = triangleCount;
+	linear->packets.resize( nChunks * kPacketsPerChunk );
+	linear->chunkLowers.resize( nChunks );
+	linear->chunkUppers.resize( nChunks );
+
+	pool.parallelFor( (int64_t)nChunks, 64, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t iChunk = beg; iChunk < end; ++iChunk )
+		{
+			glm::vec3 lower = glm::vec3( +FLT_MAX );
+			glm::vec3 upper = glm::vec3( -FLT_MAX );
+			for ( uint32_t j = 0; j < kPacketsPerChunk; ++j )
+			{
+				float v0[3][4] = {};
+				float e1[3][4] = {};
+				float e2[3][4] = {};
+				for ( uint32_t lane = 0; lane < CPU_LINEAR_PACKET_SIZE; ++lane )
+				{
+					uint32_t iPrim = (uint32_t)iChunk * CPU_LINEAR_CHUNK_SIZE + j * CPU_LINEAR_PACKET_SIZE + lane;
+					if ( triangleCount <= iPrim )
+					{
+						break;
+					}
+					glm::vec3 a = P[indices[iPrim * 3]];
+					glm::vec3 b = P[indices[iPrim * 3 + 1]];
+					glm::vec3 c = P[indices[iPrim * 3 + 2]];
+					for ( int axis = 0; axis < 3; ++axis )
+					{
+						v0[axis][lane] = a[axis];
+						e1[axis][lane] = b[axis] - a[axis];
+						e2[axis][lane] = c[axis] - a[axis];
+					}
+					lower = glm::min( glm::min( glm::min( lower, a ), b ), c );
+					upper = glm::max( glm::max( glm::max( upper, a ), b ), c );
+				}
+
+				LinearPacket& packet = linear->packets[iChunk * kPacketsPerChunk + j];
+				for ( int axis = 0; axis < 3; ++axis )
+				{
+					packet.v0[axis] = _mm_loadu_ps( v0[axis] );
+					packet.e1[axis] = _mm_loadu_ps( e1[axis] );
+					packet.e2[axis] = _mm_loadu_ps( e2[axis] );
+				}
+			}
+			linear->chunkLowers[iChunk] = lower;
+			linear->chunkUppers[iChunk] = upper;
+		}
+	} );
+}
+
+/*
+	closest hit of a single ray. Moller-Trumbore on 4 triangles at once, same acceptance as intersect_ray_triangle()
+	Chunks are visited in the index order, so the skip rate depends on the spatial coherence of the index buffer.
+*/
+inline void intersect( const LinearTriangles& linear, const Ray& ray, Hit* hit )
+{
+	const uint32_t kPacketsPerChunk = CPU_LINEAR_CHUNK_SIZE / CPU_LINEAR_PACKET_SIZE;
+
+	*hit = Hit();
+
+	glm::vec3 one_over_rd = glm::vec3( 1.0f ) / ray.rd;
+	float tmin = ray.tmax;
+	uint32_t hitPrim = kInvalidPrimitive;
+	float hitU = 0.0f;
+	float hitV = 0.0f;
+
+	__m128 ro[3] = {_mm_set1_ps( ray.ro.x ), _mm_set1_ps( ray.ro.y ), _mm_set1_ps( ray.ro.z )};
+	__m128 rd[3] = {_mm_set1_ps( ray.rd.x ), _mm_set1_ps( ray.rd.y ), _mm_set1_ps( ray.rd.z )};
+	const __m128 kEpsilon = _mm_set1_ps( 1.0e-8f );
+	const __m128 kAbsMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7FFFFFFF ) );
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 rayTmin = _mm_set1_ps( ray.tmin );
+
+	uint32_t nChunks = linear.chunkCount();
+	for ( uint32_t iChunk = 0; iChunk < nChunks; ++iChunk )
+	{
+		float hitT;
+		if ( slabs( linear.chunkLowers[iChunk], linear.chunkUppers[iChunk], ray.ro, one_over_rd, tmin, &hitT ) == false )
+		{
+			continue;
+		}
+
+		for ( uint32_t j = 0; j < kPacketsPerChunk; ++j )
+		{
+			const LinearPacket& p = linear.packets[iChunk * kPacketsPerChunk + j];
+
+			// pvec = cross( rd, e2 )
+			__m128 pvec0 = _mm_sub_ps( _mm_mul_ps( rd[1], p.e2[2] ), _mm_mul_ps( rd[2], p.e2[1] ) );
+			__m128 pvec1 = _mm_sub_ps( _mm_mul_ps( rd[2], p.e2[0] ), _mm_mul_ps( rd[0], p.e2[2] ) );
+			__m128 pvec2 = _mm_sub_ps( _mm_mul_ps( rd[0], p.e2[1] ), _mm_mul_ps( rd[1], p.e2[0] ) );
+			__m128 det = _mm_add_ps( _mm_add_ps( _mm_mul_ps( p.e1[0], pvec0 ), _mm_mul_ps( p.e1[1], pvec1 ) ), _mm_mul_ps( p.e1[2], pvec2 ) );
+			__m128 invDet = _mm_div_ps( one, det );
+
+			__m128 tvec0 = _mm_sub_ps( ro[0], p.v0[0] );
+			__m128 tvec1 = _mm_sub_ps( ro[1], p.v0[1] );
+			__m128 tvec2 = _mm_sub_ps( ro[2], p.v0[2] );
+			__m128 u = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( tvec0, pvec0 ), _mm_mul_ps( tvec1, pvec1 ) ), _mm_mul_ps( tvec2, pvec2 ) ), invDet );
+
+			// qvec = cross( tvec, e1 )
+			__m128 qvec0 = _mm_sub_ps( _mm_mul_ps( tvec1, p.e1[2] ), _mm_mul_ps( tvec2, p.e1[1] ) );
+			__m128 qvec1 = _mm_sub_ps( _mm_mul_ps( tvec2, p.e1[0] ), _mm_mul_ps( tvec0, p.e1[2] ) );
+			__m128 qvec2 = _mm_sub_ps( _mm_mul_ps( tvec0, p.e1[1] ), _mm_mul_ps( tvec1, p.e1[0] ) );
+			__m128 v = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( rd[0], qvec0 ), _mm_mul_ps( rd[1], qvec1 ) ), _mm_mul_ps( rd[2], qvec2 ) ), invDet );
+			__m128 t = _mm_mul_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( p.e2[0], qvec0 ), _mm_mul_ps( p.e2[1], qvec1 ) ), _mm_mul_ps( p.e2[2], qvec2 ) ), invDet );
+
+			__m128 mask = _mm_cmpge_ps( _mm_and_ps( det, kAbsMask ), kEpsilon );
+			mask = _mm_and_ps( mask, _mm_cmpge_ps( u, zero ) );
+			mask = _mm_and_ps( mask, _mm_cmple_ps( u, one ) );
+			mask = _mm_and_ps( mask, _mm_cmpge_ps( v, zero ) );
+			mask = _mm_and_ps( mask, _mm_cmple_ps( _mm_add_ps( u, v ), one ) );
+			mask = _mm_and_ps( mask, _mm_cmpge_ps( t, zero ) );
+			mask = _mm_and_ps( mask, _mm_cmpge_ps( t, rayTmin ) );
+			mask = _mm_and_ps( mask, _mm_cmple_ps( t, _mm_set1_ps( tmin ) ) );
+
+			int bits = _mm_movemask_ps( mask );
+			if ( bits == 0 )
+			{
+				continue;
+			}
+
+			float ts[4], us[4], vs[4];
+			_mm_storeu_ps( ts, t );
+			_mm_storeu_ps( us, u );
+			_mm_storeu_ps( vs, v );
+			for ( int lane = 0; lane < CPU_LINEAR_PACKET_SIZE; ++lane )
+			{
+				if ( ( bits & ( 1 << lane ) ) && ts[lane] <= tmin )
+				{
+					tmin = ts[lane];
+					hitPrim = iChunk * CPU_LINEAR_CHUNK_SIZE + j * CPU_LINEAR_PACKET_SIZE + lane;
+					hitU = us[lane];
+					hitV = vs[lane];
+				}
+			}
+		}
+	}
+
+	if ( hitPrim == kInvalidPrimitive )
+	{
+		return;
+	}
+	const LinearPacket& p = linear.packets[hitPrim / CPU_LINEAR_PACKET_SIZE];
+	int lane = hitPrim % CPU_LINEAR_PACKET_SIZE;
+	glm::vec3 e1, e2;
+	for ( int axis = 0; axis < 3; ++axis )
+	{
+		float values[4];
+		_mm_storeu_ps( values, p.e1[axis] );
+		e1[axis] = values[lane];
+		_mm_storeu_ps( values, p.e2[axis] );
+		e2[axis] = values[lane];
+	}
+	hit->t = tmin;
+	hit->primID = hitPrim;
+	hit->u = hitU;
+	hit->v = hitV;
+	hit->Ng = glm::normalize( -glm::cross( e1, e2 ) /* index buffer stored as CW */ );
+}
+
+// batch query. hits[i] receives the closest hit of rays[i]
+inline void intersect( const LinearTriangles& linear, const Ray* rays, Hit* hits, size_t n, ThreadPool& pool = ThreadPool::global() )
+{
+	pool.parallelFor( (int64_t)n, 256, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t i = beg; i < end; ++i )
+		{
+			intersect( linear, rays[i], &hits[i] );
+		}
+	} );
+}
+} // namespace cpu
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace cpu
+{
+/*
+	Persistent worker pool. The calling thread joins the work too, so threadCount() includes it.
+	parallelFor() does not allocate and is not reentrant ( don't call it from inside a task ).
+
+	f( int64_t beg, int64_t end, int iThread )
+	iThread is in [0, threadCount()) and is stable during a task, so it can index per-thread scratch.
+*/
+class ThreadPool
+{
+public:
+	ThreadPool( int nThreads = 0 )
+	{
+		if ( nThreads <= 0 )
+		{
+			nThreads = std::max( (int)std::thread::hardware_concurrency(), 1 );
+		}
+		_nThreads = nThreads;
+		for ( int i = 1; i < _nThreads; ++i )
+		{
+			_workers.emplace_back( [this, i]() { workerLoop( i ); } );
+		}
+	}
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			_quit = true;
+		}
+		_wake.notify_all();
+		for ( std::thread& t : _workers )
+		{
+			t.join();
+		}
+	}
+	ThreadPool( const ThreadPool& ) = delete;
+	void operator=( const ThreadPool& ) = delete;
+
+	int threadCount() const { return _nThreads; }
+
+	template <class F>
+	void parallelFor( int64_t n, int64_t grain, F f )
+	{
+		if ( n <= 0 )
+		{
+			return;
+		}
+		grain = std::max( grain, (int64_t)1 );
+
+		// small enough to run on the caller
+		if ( _nThreads == 1 || n <= grain )
+		{
+			f( (int64_t)0, n, 0 );
+			return;
+		}
+
+		std::lock_guard<std::mutex> dispatchLock( _dispatch );
+
+		_task.invoke = []( void* ctx, int64_t beg, int64_t end, int iThread ) { ( *static_cast<F*>( ctx ) )( beg, end, iThread ); };
+		_task.ctx = &f;
+		_task.n = n;
+		_task.grain = grain;
+		_task.next.store( 0 );
+		_running.store( _nThreads - 1 );
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			_generation++;
+		}
+		_wake.notify_all();
+
+		consume( 0 );
+
+		std::unique_lock<std::mutex> lock( _mutex );
+		_done.wait( lock, [this]() { return _running.load() == 0; } );
+	}
+
+	/*
+		f( int i ) is called once for each i in [0, threadCount()), as a parallelFor() with a grain of 1, and returns after all of them.
+		The calls run concurrently on the calling thread and the workers, whichever takes i first, so a thread may run several of them and
+		another none. i is an index for per-thread data set up before the next parallelFor(), not the identity of the thread that runs f
+	*/
+	template <class F>
+	void forEachThread( F f )
+	{
+		parallelFor( _nThreads, 1, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+			for ( int64_t i = beg; i < end; ++i )
+			{
+				f( (int)i );
+			}
+		} );
+	}
+
+	static ThreadPool& global()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+private:
+	struct Task
+	{
+		void ( *invoke )( void* ctx, int64_t beg, int64_t end, int iThread ) = nullptr;
+		void* ctx = nullptr;
+		int64_t n = 0;
+		int64_t grain = 1;
+		std::atomic<int64_t> next;
+	};
+
+	void consume( int iThread )
+	{
+		for ( ;; )
+		{
+			int64_t beg = _task.next.fetch_add( _task.grain );
+			if ( _task.n <= beg )
+			{
+				break;
+			}
+			int64_t end = std::min( beg + _task.grain, _task.n );
+			_task.invoke( _task.ctx, beg, end, iThread );
+		}
+	}
+	void workerLoop( int iThread )
+	{
+		uint64_t seen = 0;
+		for ( ;; )
+		{
+			{
+				std::unique_lock<std::mutex> lock( _mutex );
+				_wake.wait( lock, [&]() { return _quit || _generation != seen; } );
+				if ( _quit )
+				{
+					return;
+				}
+				seen = _generation;
+			}
+
+			consume( iThread );
+
+			if ( _running.fetch_sub( 1 ) == 1 )
+			{
+				std::lock_guard<std::mutex> lock( _mutex );
+				_done.notify_one();
+			}
+		}
+	}
+
+	int _nThreads = 1;
+	std::vector<std::thread> _workers;
+
+	std::mutex _dispatch;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+	uint64_t _generation = 0;
+	bool _quit = false;
+
+	Task _task;
+	std::atomic<int> _running;
+};
+} // namespace cpu
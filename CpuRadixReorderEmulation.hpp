@@ -0,0 +1,289 @@
+#pragma once
+
+#include "CpuRadixSort.hpp"
+#include "radixsort.h"
+#include <assert.h>
+
+/*
+	CPU emulation of radixsort_reorder.hlsl, a group at a time. Every phase between two barriers is a loop over the lanes of the group,
+	so the output and the order of the work are the ones of the kernel. The kernel before the stable ranking ( thread 0 scatters the block alone ) is emulated too.
+	Both count the cost of a group in a lane model:
+		steps        : the longest lane of each phase, summed up. The time of a group when every lane runs in parallel
+		transactions : the 128 byte segments of xs1 written by each 32 lanes. A store of a single lane is a transaction by itself
+*/
+namespace cpu
+{
+#define RADIX_EMULATION_ELEMENTS_IN_BLOCK 512
+#define RADIX_EMULATION_WAVE_SIZE 32
+#define RADIX_EMULATION_SEGMENT_BYTES 128
+
+// the cbuffer of radixsort_count.hlsl and radixsort_reorder.hlsl
+struct RadixReorderArgument
+{
+	uint32_t numberOfBlock;
+	uint32_t elementsInBlock;
+	uint32_t shift;
+	uint32_t keyType;
+	uint32_t hasValues;
+	uint32_t digitMask;
+};
+
+struct ReorderEmulationStats
+{
+	uint64_t steps = 0;
+	uint64_t transactions = 0;
+
+	void operator+=( const ReorderEmulationStats& o )
+	{
+		steps += o.steps;
+		transactions += o.transactions;
+	}
+};
+
+class RadixReorderEmulation
+{
+public:
+	RadixReorderEmulation( const uint32_t* xs0, uint32_t* xs1, const uint32_t* offsetTable, const uint32_t* values0, uint32_t* values1, uint32_t numberOfKey, const RadixReorderArgument& arg )
+		: _xs0( xs0 ), _xs1( xs1 ), _offsetTable( offsetTable ), _values0( values0 ), _values1( values1 ), _numberOfKey( numberOfKey ), _arg( arg )
+	{
+	}
+
+	// the digit of the key at index, with the same radixsort.h functions as the kernels
+	uint32_t getSortKey( uint32_t index ) const
+	{
+		if ( _arg.keyType == RADIX_KEY_UINT64 )
+		{
+			return radixDigit( _xs0[index * 2], _xs0[index * 2 + 1], _arg.shift, _arg.digitMask );
+		}
+		return radixDigit( radixSortWord( _arg.keyType, _xs0[index] ), 0, _arg.shift, _arg.digitMask );
+	}
+
+	// thread 0 scatters the block in order
+	ReorderEmulationStats serialBlock( uint32_t blockIndex ) const
+	{
+		ReorderEmulationStats stats;
+		uint32_t counters[RADIX_DIGITS] = {};
+		uint32_t blockHead = blockIndex * _arg.elementsInBlock;
+		uint32_t blockTail = std::min( blockHead + _arg.elementsInBlock, _numberOfKey );
+		for ( uint32_t valueIndex = blockHead; valueIndex < blockTail; ++valueIndex )
+		{
+			uint32_t key = getSortKey( valueIndex );
+			uint32_t toIndex = _offsetTable[_arg.numberOfBlock * key + blockIndex] + counters[key]++;
+			move( valueIndex, toIndex );
+			stats.steps++;
+			stats.transactions++;
+		}
+		return stats;
+	}
+
+	// the stable ranking of radixsort_reorder.hlsl. Each loop over lane is a phase of the kernel
+	ReorderEmulationStats rankedBlock( uint32_t blockIndex ) const
+	{
+		const int kLanes = RADIX_REORDER_THREADS;
+		const int kWords = RADIX_REORDER_MASK_WORDS;
+
+		ReorderEmulationStats stats;
+		uint32_t digitMasks[RADIX_DIGITS * kWords] = {};
+		uint32_t digitStarts[RADIX_DIGITS];
+		uint32_t digitOffsets[RADIX_DIGITS];
+		uint32_t counts[RADIX_DIGITS];
+		uint32_t digits[kLanes];
+		uint32_t tileIndices[kLanes]; // the source of each slot. The kernel copies keys and values to groupshared memory instead
+		uint32_t tileDigits[kLanes];
+
+		for ( int lane = 0; lane < kLanes; ++lane )
+		{
+			digitOffsets[lane] = lane <= (int)_arg.digitMask ? _offsetTable[_arg.numberOfBlock * lane + blockIndex] : 0;
+		}
+		stats.steps += 1 + kWords;
+
+		uint32_t blockHead = blockIndex * _arg.elementsInBlock;
+		uint32_t blockTail = std::min( blockHead + _arg.elementsInBlock, _numberOfKey );
+		for ( uint32_t tileHead = blockHead; tileHead < blockTail; tileHead += kLanes )
+		{
+			int tileCount = (int)std::min( blockTail - tileHead, (uint32_t)kLanes );
+
+			// 1. ballot
+			for ( int lane = 0; lane < tileCount; ++lane )
+			{
+				digits[lane] = getSortKey( tileHead + lane );
+				digitMasks[digits[lane] * kWords + lane / 32] |= 1u << ( lane % 32 );
+			}
+			stats.steps++;
+
+			// 2. count and scan. a lane per digit
+			for ( int lane = 0; lane < kLanes; ++lane )
+			{
+				uint32_t count = 0;
+				for ( int i = 0; i < kWords; ++i )
+				{
+					count += popcount( digitMasks[lane * kWords + i] );
+				}
+				counts[lane] = count;
+				digitStarts[lane] = count;
+			}
+			stats.steps += kWords;
+			for ( int offset = 1; offset < RADIX_DIGITS; offset *= 2 )
+			{
+				uint32_t s[RADIX_DIGITS];
+				for ( int lane = 0; lane < kLanes; ++lane )
+				{
+					s[lane] = offset <= lane ? digitStarts[lane - offset] + digitStarts[lane] : digitStarts[lane];
+				}
+				memcpy( digitStarts, s, sizeof( s ) );
+				stats.steps++;
+			}
+			for ( int lane = 0; lane < kLanes; ++lane )
+			{
+				digitStarts[lane] -= counts[lane];
+			}
+			stats.steps++;
+
+			// 3. rank, 4. place in digit order
+			int longestRank = 0;
+			for ( int lane = 0; lane < tileCount; ++lane )
+			{
+				uint32_t digit = digits[lane];
+				int word = lane / 32;
+				uint32_t rank = popcount( digitMasks[digit * kWords + word] & ( ( 1u << ( lane % 32 ) ) - 1 ) );
+				for ( int i = 0; i < word; ++i )
+				{
+					rank += popcount( digitMasks[digit * kWords + i] );
+				}
+				longestRank = std::max( longestRank, word + 1 );
+
+				uint32_t slot = digitStarts[digit] + rank;
+				tileIndices[slot] = tileHead + lane;
+				tileDigits[slot] = digit;
+			}
+			stats.steps += longestRank + 1;
+
+			// coalesced store
+			for ( int wave = 0; wave < tileCount; wave += RADIX_EMULATION_WAVE_SIZE )
+			{
+				uint64_t segments[RADIX_EMULATION_WAVE_SIZE];
+				int nSegments = 0;
+				for ( int lane = wave; lane < std::min( wave + RADIX_EMULATION_WAVE_SIZE, tileCount ); ++lane )
+				{
+					uint32_t d = tileDigits[lane];
+					uint32_t toIndex = digitOffsets[d] + lane - digitStarts[d];
+					move( tileIndices[lane], toIndex );
+
+					uint64_t segment = (uint64_t)toIndex * keyBytes() / RADIX_EMULATION_SEGMENT_BYTES;
+					if ( std::find( segments, segments + nSegments, segment ) == segments + nSegments )
+					{
+						segments[nSegments++] = segment;
+					}
+				}
+				stats.transactions += nSegments;
+			}
+			stats.steps++;
+
+			// the next tile
+			for ( int lane = 0; lane < kLanes; ++lane )
+			{
+				digitOffsets[lane] += counts[lane];
+				for ( int i = 0; i < kWords; ++i )
+				{
+					digitMasks[lane * kWords + i] = 0;
+				}
+			}
+			stats.steps += kWords;
+		}
+		return stats;
+	}
+
+private:
+	static uint32_t popcount( uint32_t x )
+	{
+		uint32_t c = 0;
+		for ( ; x; x &= x - 1 )
+		{
+			c++;
+		}
+		return c;
+	}
+	uint32_t keyBytes() const
+	{
+		return _arg.keyType == RADIX_KEY_UINT64 ? 8 : 4;
+	}
+	void move( uint32_t from, uint32_t to ) const
+	{
+		if ( _arg.keyType == RADIX_KEY_UINT64 )
+		{
+			_xs1[to * 2] = _xs0[from * 2];
+			_xs1[to * 2 + 1] = _xs0[from * 2 + 1];
+		}
+		else
+		{
+			_xs1[to] = _xs0[from];
+		}
+		if ( _arg.hasValues )
+		{
+			_values1[to] = _values0[from];
+		}
+	}
+
+	const uint32_t* _xs0;
+	uint32_t* _xs1;
+	const uint32_t* _offsetTable;
+	const uint32_t* _values0;
+	uint32_t* _values1;
+	uint32_t _numberOfKey;
+	RadixReorderArgument _arg;
+};
+
+/*
+	One pass of the GPU sort on CPU: radixsort_count, the exclusive scan of the counters, and radixsort_reorder with the stable ranking or the serial scatter.
+	xs are uint32 words like the GPU buffers ( 2 words per key for RADIX_KEY_UINT64 ). values may be empty.
+	pass.bits is up to 8 like the kernels, the digits of a group are in RADIX_DIGITS counters
+*/
+inline ReorderEmulationStats emulateRadixPass( const std::vector<uint32_t>& xs0, std::vector<uint32_t>& xs1, const std::vector<uint32_t>& values0, std::vector<uint32_t>& values1,
+											   uint32_t keyType, const RadixPass& pass, bool ranked, ThreadPool& pool = ThreadPool::global() )
+{
+	assert( ( 1 << pass.bits ) <= RADIX_DIGITS );
+
+	uint32_t numberOfKey = (uint32_t)( keyType == RADIX_KEY_UINT64 ? xs0.size() / 2 : xs0.size() );
+	RadixReorderArgument arg = {};
+	arg.numberOfBlock = ( numberOfKey + RADIX_EMULATION_ELEMENTS_IN_BLOCK - 1 ) / RADIX_EMULATION_ELEMENTS_IN_BLOCK;
+	arg.elementsInBlock = RADIX_EMULATION_ELEMENTS_IN_BLOCK;
+	arg.shift = pass.shift;
+	arg.keyType = keyType;
+	arg.hasValues = values0.empty() ? 0 : 1;
+	arg.digitMask = ( 1u << pass.bits ) - 1;
+
+	xs1.resize( xs0.size() );
+	values1.resize( values0.size() );
+
+	std::vector<uint32_t> offsetTable( (size_t)arg.numberOfBlock << pass.bits, 0 );
+	RadixReorderEmulation emulation( xs0.data(), xs1.data(), offsetTable.data(), values0.data(), values1.data(), numberOfKey, arg );
+
+	// radixsort_count.hlsl
+	pool.parallelFor( arg.numberOfBlock, 1, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t iBlock = beg; iBlock < end; ++iBlock )
+		{
+			uint32_t blockTail = std::min( ( (uint32_t)iBlock + 1 ) * arg.elementsInBlock, numberOfKey );
+			for ( uint32_t i = (uint32_t)iBlock * arg.elementsInBlock; i < blockTail; ++i )
+			{
+				offsetTable[arg.numberOfBlock * emulation.getSortKey( i ) + iBlock]++;
+			}
+		}
+	} );
+	exclusiveScan( offsetTable.data(), offsetTable.size(), ScanSum(), pool );
+
+	std::vector<ReorderEmulationStats> threadStats( pool.threadCount() );
+	pool.parallelFor( arg.numberOfBlock, 1, [&]( int64_t beg, int64_t end, int iThread ) {
+		for ( int64_t iBlock = beg; iBlock < end; ++iBlock )
+		{
+			threadStats[iThread] += ranked ? emulation.rankedBlock( (uint32_t)iBlock ) : emulation.serialBlock( (uint32_t)iBlock );
+		}
+	} );
+
+	ReorderEmulationStats stats;
+	for ( const ReorderEmulationStats& s : threadStats )
+	{
+		stats += s;
+	}
+	return stats;
+}
+} // namespace cpu
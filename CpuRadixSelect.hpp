@@ -0,0 +1,222 @@
+#pragma once
+
+#include "CpuRadixSort.hpp"
+
+// Radix select and top-k on CPU. The same digit histograms as RadixSort, but only the bucket holding the k-th key is followed
+namespace cpu
+{
+// digit width of the histograms
+#define CPU_RADIX_SELECT_BITS 11
+
+// candidates this few are finished by std::nth_element
+#define CPU_RADIX_SELECT_SMALL 4096
+
+/*
+	k-th smallest key and the k smallest keys of uint32_t, uint64_t, float or double keys.
+	A histogram of the highest digit finds the bucket of the k-th key, the keys below the bucket are taken as they are,
+	and only the keys in the bucket go on to the next digit. The keys are read about twice instead of the 3 passes per digit of a sort.
+	Equal keys are ordered by their index, so the result doesn't depend on the thread count.
+	The candidates of the digits, the taken keys and the per thread histograms and buffers stay allocated from one call to the next.
+*/
+template <class Key>
+class RadixSelect
+{
+public:
+	// the key that would be at keys[k] after sorting. k < n
+	Key select( const Key* keys, size_t n, size_t k, ThreadPool& pool = ThreadPool::global() )
+	{
+		run( keys, n, k, false, pool );
+		return _kthKey;
+	}
+
+	/*
+		the k smallest keys and their indices in keys. k <= n
+		sorted : in the order of a stable sort. Otherwise in no particular order
+	*/
+	void topK( const Key* keys, size_t n, size_t k, Key* outKeys, uint32_t* outIndices, bool sorted = true, ThreadPool& pool = ThreadPool::global() )
+	{
+		if ( k == 0 )
+		{
+			return;
+		}
+		run( keys, n, k - 1, true, pool );
+
+		size_t nLess = _lessKeys.size();
+		std::copy( _lessKeys.begin(), _lessKeys.end(), outKeys );
+		std::copy( _lessIndices.begin(), _lessIndices.end(), outIndices );
+		for ( size_t i = nLess; i < k; ++i )
+		{
+			outKeys[i] = _finals[i - nLess].key;
+			outIndices[i] = _finals[i - nLess].index;
+		}
+
+		if ( sorted )
+		{
+			_finals.resize( k );
+			for ( size_t i = 0; i < k; ++i )
+			{
+				_finals[i] = {RadixKey<Key>::bits( outKeys[i] ), outIndices[i], outKeys[i]};
+			}
+			std::sort( _finals.begin(), _finals.end() );
+			for ( size_t i = 0; i < k; ++i )
+			{
+				outKeys[i] = _finals[i].key;
+				outIndices[i] = _finals[i].index;
+			}
+		}
+	}
+
+private:
+	typedef typename RadixKey<Key>::Bits Bits;
+
+	struct Candidate
+	{
+		Bits bits;
+		uint32_t index;
+		Key key;
+
+		bool operator<( const Candidate& o ) const
+		{
+			return bits < o.bits || ( bits == o.bits && index < o.index );
+		}
+	};
+
+	/*
+		finds the key of the rank. With collectLess, the keys below its bucket go to _lessKeys
+		and _finals[0, rank - _lessKeys.size()] are the rest up to the rank, in no particular order
+	*/
+	void run( const Key* keys, size_t n, size_t rank, bool collectLess, ThreadPool& pool )
+	{
+		_lessKeys.clear();
+		_lessIndices.clear();
+
+		// the candidates. indices == nullptr means keys itself
+		const Key* xs = keys;
+		const uint32_t* is = nullptr;
+		size_t m = n;
+		int shift = sizeof( Bits ) * 8;
+		int iBuffer = 0;
+		while ( CPU_RADIX_SELECT_SMALL < m && 0 < shift )
+		{
+			int bits = std::min( CPU_RADIX_SELECT_BITS, shift );
+			shift -= bits;
+			uint32_t mask = ( 1u << bits ) - 1;
+
+			histogram( xs, m, shift, mask, pool );
+			uint32_t d = 0;
+			size_t below = 0;
+			while ( below + _counters[d] <= rank )
+			{
+				below += _counters[d++];
+			}
+			rank -= below;
+
+			split( xs, is, m, shift, mask, d, collectLess, _keys[iBuffer], _indices[iBuffer], pool );
+			xs = _keys[iBuffer].data();
+			is = _indices[iBuffer].data();
+			m = _keys[iBuffer].size();
+			iBuffer ^= 1;
+		}
+
+		// the candidates share all the digits so far
+		_finals.resize( m );
+		for ( size_t i = 0; i < m; ++i )
+		{
+			_finals[i] = {RadixKey<Key>::bits( xs[i] ), is ? is[i] : (uint32_t)i, xs[i]};
+		}
+		std::nth_element( _finals.begin(), _finals.begin() + rank, _finals.end() );
+		_kthKey = _finals[rank].key;
+	}
+
+	// _counters[digit] of xs[0, n)
+	void histogram( const Key* xs, size_t n, int shift, uint32_t mask, ThreadPool& pool )
+	{
+		int nCounters = mask + 1;
+		_threadCounters.assign( (size_t)pool.threadCount() << CPU_RADIX_SELECT_BITS, 0 );
+		pool.parallelFor( (int64_t)n, CPU_RADIX_MIN_ELEMENTS_IN_BLOCK, [&]( int64_t beg, int64_t end, int iThread ) {
+			uint32_t* counters = &_threadCounters[(size_t)iThread << CPU_RADIX_SELECT_BITS];
+			for ( int64_t i = beg; i < end; ++i )
+			{
+				counters[(uint32_t)( RadixKey<Key>::bits( xs[i] ) >> shift ) & mask]++;
+			}
+		} );
+		_counters.assign( nCounters, 0 );
+		for ( int i = 0; i < pool.threadCount(); ++i )
+		{
+			for ( int d = 0; d < nCounters; ++d )
+			{
+				_counters[d] += _threadCounters[( (size_t)i << CPU_RADIX_SELECT_BITS ) + d];
+			}
+		}
+	}
+
+	// the keys of the digit d go to equalKeys, and the keys below it to _lessKeys with collectLess
+	void split( const Key* xs, const uint32_t* is, size_t n, int shift, uint32_t mask, uint32_t d, bool collectLess,
+				std::vector<Key>& equalKeys, std::vector<uint32_t>& equalIndices, ThreadPool& pool )
+	{
+		// per thread appends. The blocks are in no particular order, and the order only matters for equal keys, which _finals sorts by index
+		_threadKeys.resize( pool.threadCount() * 2 );
+		_threadIndices.resize( pool.threadCount() * 2 );
+		for ( int i = 0; i < pool.threadCount() * 2; ++i )
+		{
+			_threadKeys[i].clear();
+			_threadIndices[i].clear();
+		}
+		pool.parallelFor( (int64_t)n, CPU_RADIX_MIN_ELEMENTS_IN_BLOCK, [&]( int64_t beg, int64_t end, int iThread ) {
+			std::vector<Key>& lessKeys = _threadKeys[iThread * 2];
+			std::vector<uint32_t>& lessIndices = _threadIndices[iThread * 2];
+			std::vector<Key>& keys = _threadKeys[iThread * 2 + 1];
+			std::vector<uint32_t>& indices = _threadIndices[iThread * 2 + 1];
+			for ( int64_t i = beg; i < end; ++i )
+			{
+				uint32_t digit = (uint32_t)( RadixKey<Key>::bits( xs[i] ) >> shift ) & mask;
+				uint32_t index = is ? is[i] : (uint32_t)i;
+				if ( digit == d )
+				{
+					keys.push_back( xs[i] );
+					indices.push_back( index );
+				}
+				else if ( collectLess && digit < d )
+				{
+					lessKeys.push_back( xs[i] );
+					lessIndices.push_back( index );
+				}
+			}
+		} );
+
+		equalKeys.clear();
+		equalIndices.clear();
+		for ( int i = 0; i < pool.threadCount(); ++i )
+		{
+			_lessKeys.insert( _lessKeys.end(), _threadKeys[i * 2].begin(), _threadKeys[i * 2].end() );
+			_lessIndices.insert( _lessIndices.end(), _threadIndices[i * 2].begin(), _threadIndices[i * 2].end() );
+			equalKeys.insert( equalKeys.end(), _threadKeys[i * 2 + 1].begin(), _threadKeys[i * 2 + 1].end() );
+			equalIndices.insert( equalIndices.end(), _threadIndices[i * 2 + 1].begin(), _threadIndices[i * 2 + 1].end() );
+		}
+	}
+
+	Key _kthKey = Key();
+	std::vector<uint32_t> _counters;
+	std::vector<uint32_t> _threadCounters;
+	std::vector<Key> _keys[2];
+	std::vector<uint32_t> _indices[2];
+	std::vector<std::vector<Key>> _threadKeys;			// [thread][less, equal]
+	std::vector<std::vector<uint32_t>> _threadIndices; // [thread][less, equal]
+	std::vector<Key> _lessKeys;
+	std::vector<uint32_t> _lessIndices;
+	std::vector<Candidate> _finals;
+};
+
+template <class Key>
+inline Key radixSelect( const Key* keys, size_t n, size_t k, ThreadPool& pool = ThreadPool::global() )
+{
+	RadixSelect<Key> selector;
+	return selector.select( keys, n, k, pool );
+}
+template <class Key>
+inline void topK( const Key* keys, size_t n, size_t k, Key* outKeys, uint32_t* outIndices, bool sorted = true, ThreadPool& pool = ThreadPool::global() )
+{
+	RadixSelect<Key> selector;
+	selector.topK( keys, n, k, outKeys, outIndices, sorted, pool );
+}
+} // namespace cpu
@@ -0,0 +1,776 @@
+#pragma once
+
+#include "CpuScan.hpp"
+#include <chrono>
+#include <string.h>
+
+// LSD radix sort on CPU. The same count / scan / reorder passes as radixsort_*.hlsl
+namespace cpu
+{
+// digit width range. The width of each sort is chosen by planRadixPasses()
+#define CPU_RADIX_MIN_BITS 4
+#define CPU_RADIX_MAX_BITS 11
+#define CPU_RADIX_COUNTERS ( 1 << CPU_RADIX_MAX_BITS )
+
+// elements per block. Each block is counted and reordered by one thread
+#define CPU_RADIX_MIN_ELEMENTS_IN_BLOCK 16384
+
+// sorts by a single thread ( small segments and in-cache sorts ) use up to CPU_RADIX_SERIAL_BITS bit digits, or a merge sort or an insertion sort when tiny
+#define CPU_RADIX_SERIAL_BITS 8
+#define CPU_RADIX_INSERTION_SORT_ELEMENTS 32
+
+// the in-cache sorts of sort() are tuned up to this many bytes of keys, values and their scratch ( about a L2 cache )
+#define CPU_RADIX_IN_CACHE_BYTES ( 256 * 1024 )
+
+// keys per measurement of the tuning
+#define CPU_RADIX_TUNING_ELEMENTS ( 1 << 16 )
+
+// software write combining. keys are staged per digit and written a cache line at a time
+#define CPU_RADIX_WC_BYTES 64
+
+// the same as to_ordered() in helper.hlsl. The signed order of the result is the order of f
+inline int32_t toOrdered( float f )
+{
+	uint32_t b;
+	memcpy( &b, &f, 4 );
+	uint32_t s = b & 0x80000000; // sign bit
+	int32_t x = b & 0x7FFFFFFF;  // expornent and significand
+	return s ? -x : x;
+}
+inline int64_t toOrdered( double f )
+{
+	uint64_t b;
+	memcpy( &b, &f, 8 );
+	uint64_t s = b & 0x8000000000000000ull;
+	int64_t x = b & 0x7FFFFFFFFFFFFFFFull;
+	return s ? -x : x;
+}
+
+/*
+	unsigned bits of a key in the sort order. Float keys are mapped on the fly,
+	so the stored values are untouched ( -0.0 and +0.0 compare equal and keep their order )
+*/
+template <class Key>
+struct RadixKey;
+
+template <>
+struct RadixKey<uint32_t>
+{
+	typedef uint32_t Bits;
+	static Bits bits( uint32_t x ) { return x; }
+};
+template <>
+struct RadixKey<uint64_t>
+{
+	typedef uint64_t Bits;
+	static Bits bits( uint64_t x ) { return x; }
+};
+template <>
+struct RadixKey<float>
+{
+	typedef uint32_t Bits;
+	static Bits bits( float x ) { return (uint32_t)toOrdered( x ) ^ 0x80000000; }
+};
+template <>
+struct RadixKey<double>
+{
+	typedef uint64_t Bits;
+	static Bits bits( double x ) { return (uint64_t)toOrdered( x ) ^ 0x8000000000000000ull; }
+};
+
+struct RadixPass
+{
+	int shift; // the lowest bit of the digit
+	int bits;
+};
+
+/*
+	Passes covering every bit in varying, the bits that differ among the keys. Bits equal in all keys never need a pass.
+	The width is the narrowest one in [CPU_RADIX_MIN_BITS, maxBits] with the fewest passes,
+	and narrower for small n so that the counters don't outnumber the keys.
+	Returns the number of passes written to passes ( at most 16 )
+*/
+inline int planRadixPasses( uint64_t varying, size_t n, int maxBits, RadixPass* passes )
+{
+	int nBits = 0;
+	while ( nBits < maxBits && ( (size_t)8 << nBits ) <= n )
+	{
+		nBits++;
+	}
+	maxBits = std::max( nBits, CPU_RADIX_MIN_BITS );
+
+	auto plan = [varying]( int bits, RadixPass* passes ) {
+		int nPasses = 0;
+		for ( int shift = 0; shift < 64; )
+		{
+			if ( ( varying >> shift ) == 0 )
+			{
+				break;
+			}
+			if ( ( ( varying >> shift ) & 1 ) == 0 )
+			{
+				shift++;
+				continue;
+			}
+			if ( passes )
+			{
+				passes[nPasses] = {shift, bits};
+			}
+			nPasses++;
+			shift += bits;
+		}
+		return nPasses;
+	};
+
+	int bestBits = maxBits;
+	int bestPasses = plan( maxBits, nullptr );
+	for ( int bits = maxBits - 1; CPU_RADIX_MIN_BITS <= bits; --bits )
+	{
+		int nPasses = plan( bits, nullptr );
+		if ( nPasses <= bestPasses )
+		{
+			bestBits = bits;
+			bestPasses = nPasses;
+		}
+	}
+	return plan( bestBits, passes );
+}
+
+/*
+	sizes up to which sorting by a single thread in cache wins over the parallel passes. Measured by RadixSort::tune()
+	mergeSortElements : a merge sort of insertion sorted runs instead of the serial radix passes
+	inCacheElements   : a single thread sorts the whole input, or each bucket after a pass on the highest digit
+*/
+struct RadixHybrid
+{
+	size_t mergeSortElements;
+	size_t inCacheElements;
+};
+
+/*
+	Stable LSD radix sort of uint32_t, uint64_t, float or double keys.
+	A pre-pass takes OR and AND of all keys, and the passes and the digit width follow from the bits that differ ( see planRadixPasses() ).
+	Hybrid for small inputs, where the fixed cost of a parallel pass dominates ( see RadixHybrid ):
+		n <= inCacheElements              : sorted in cache by a single thread
+		buckets of the highest digit fit  : an MSD pass on the highest digit, and then the buckets in cache like sortSegments()
+		otherwise                         : the LSD passes
+	values is an optional 32 bit payload ( e.g. primitive indices ) moved together with keys.
+	The ping-pong buffers of keys and values, the write-combining buffers and the counters grow to the largest sort so far and stay.
+
+	counters are stored column major like radixsort_count.hlsl, so one exclusive scan gives every block its offsets
+	+------> blocks
+	|(cnt=0, block 0), (cnt=0, block 1)
+	|(cnt=1, block 0), (cnt=1, block 1)
+	v
+	counters ( CPU_RADIX_COUNTERS )
+*/
+template <class Key>
+class RadixSort
+{
+public:
+	void sort( Key* keys, size_t n, ThreadPool& pool = ThreadPool::global() )
+	{
+		sortWith<false>( keys, nullptr, n, pool );
+	}
+	void sort( Key* keys, uint32_t* values, size_t n, ThreadPool& pool = ThreadPool::global() )
+	{
+		sortWith<true>( keys, values, n, pool );
+	}
+
+	/*
+		Sorts each segment on its own in one call. A segment starts at each of segmentOffsets[0, nSegments) like cpu::segmentedScan().
+		Segments larger than a thread's share are sorted one after another with all the threads.
+		The rest are sorted single threaded in parallel, largest first, so skewed sizes don't leave threads idle
+	*/
+	void sortSegments( Key* keys, size_t n, const uint32_t* segmentOffsets, size_t nSegments, ThreadPool& pool = ThreadPool::global() )
+	{
+		sortSegmentsWith<false>( keys, nullptr, n, segmentOffsets, nSegments, largeSegmentSize( n, pool ), pool );
+	}
+	void sortSegments( Key* keys, uint32_t* values, size_t n, const uint32_t* segmentOffsets, size_t nSegments, ThreadPool& pool = ThreadPool::global() )
+	{
+		sortSegmentsWith<true>( keys, values, n, segmentOffsets, nSegments, largeSegmentSize( n, pool ), pool );
+	}
+
+	// the number of passes over the keys in the last sort(), for the memory traffic of benchmarks. An in-cache sort counts as a pass
+	int passCount() const { return _passCount; }
+
+	/*
+		Measures the thresholds of the hybrid sort for this key type with parallelFor() on pool, and keeps them for every RadixSort<Key>.
+		Call it at startup before sorting, from outside of any task, as a task of pool can't run parallelFor() on it again
+		and the timings need the threads to be idle.
+	*/
+	static const RadixHybrid& tune( ThreadPool& pool = ThreadPool::global() )
+	{
+		thresholds() = tuneHybrid( pool );
+		return thresholds();
+	}
+
+	// the thresholds of the hybrid sort. Until tune(), up to a single block of the parallel passes is sorted in cache, without the merge sort
+	static const RadixHybrid& hybrid()
+	{
+		return thresholds();
+	}
+
+private:
+	static const uint32_t kWCKeys = CPU_RADIX_WC_BYTES / sizeof( Key );
+
+	// keys and values of the input and the scratch
+	static size_t maxInCacheElements()
+	{
+		return CPU_RADIX_IN_CACHE_BYTES / ( ( sizeof( Key ) + sizeof( uint32_t ) ) * 2 );
+	}
+	static RadixHybrid& thresholds()
+	{
+		static RadixHybrid h = {CPU_RADIX_INSERTION_SORT_ELEMENTS, std::min( (size_t)CPU_RADIX_MIN_ELEMENTS_IN_BLOCK, maxInCacheElements() )};
+		return h;
+	}
+
+	typedef typename RadixKey<Key>::Bits Bits;
+
+	// a thread's share of sortSegments()
+	static size_t largeSegmentSize( size_t n, ThreadPool& pool )
+	{
+		return std::max( n / pool.threadCount(), (size_t)CPU_RADIX_MIN_ELEMENTS_IN_BLOCK );
+	}
+
+	static uint32_t digit( Key x, int shift, uint32_t mask )
+	{
+		return (uint32_t)( RadixKey<Key>::bits( x ) >> shift ) & mask;
+	}
+
+	// bits that are not the same in all keys
+	Bits varyingBits( const Key* xs, size_t n, ThreadPool& pool ) const
+	{
+		std::vector<Bits> ors( pool.threadCount(), 0 );
+		std::vector<Bits> ands( pool.threadCount(), ~(Bits)0 );
+		pool.parallelFor( (int64_t)n, CPU_RADIX_MIN_ELEMENTS_IN_BLOCK, [&]( int64_t beg, int64_t end, int iThread ) {
+			Bits o = 0;
+			Bits a = ~(Bits)0;
+			for ( int64_t i = beg; i < end; ++i )
+			{
+				Bits b = RadixKey<Key>::bits( xs[i] );
+				o |= b;
+				a &= b;
+			}
+			ors[iThread] |= o;
+			ands[iThread] &= a;
+		} );
+		Bits o = 0;
+		Bits a = ~(Bits)0;
+		for ( int i = 0; i < pool.threadCount(); ++i )
+		{
+			o |= ors[i];
+			a &= ands[i];
+		}
+		return o ^ a;
+	}
+
+	template <bool HasValues>
+	void sortWith( Key* keys, uint32_t* values, size_t n, ThreadPool& pool )
+	{
+		_passCount = 0;
+		if ( n <= 1 )
+		{
+			return;
+		}
+
+		const RadixHybrid& h = hybrid();
+		if ( n <= h.inCacheElements )
+		{
+			_tmp.resize( n );
+			if ( HasValues )
+			{
+				_tmpValues.resize( n );
+			}
+			sortSerial<HasValues>( keys, values, n, _tmp.data(), _tmpValues.data(), h.mergeSortElements );
+			_passCount = 1;
+			return;
+		}
+
+		Bits varying = varyingBits( keys, n, pool );
+		RadixPass passes[16];
+		int nPasses = planRadixPasses( varying, n, CPU_RADIX_MAX_BITS, passes );
+		if ( nPasses == 0 )
+		{
+			return; // all keys are the same
+		}
+
+		// the narrowest digit below the highest varying bit whose buckets fit in cache on average
+		int topBit = 0;
+		while ( topBit < (int)sizeof( Bits ) * 8 && ( varying >> topBit ) != 0 )
+		{
+			topBit++;
+		}
+		int msdBits = CPU_RADIX_MIN_BITS;
+		while ( msdBits < CPU_RADIX_MAX_BITS && h.inCacheElements < ( n >> msdBits ) )
+		{
+			msdBits++;
+		}
+		if ( 1 < nPasses && ( n >> msdBits ) <= h.inCacheElements )
+		{
+			// the buckets are in [offsets[d], offsets[d + 1]). The ones still too large for the cache are sorted by sortWith() again
+			RadixPass msd = {std::max( topBit - msdBits, 0 ), msdBits};
+			sortPasses<HasValues>( keys, values, n, &msd, 1, pool );
+			std::vector<uint32_t> offsets( (size_t)1 << msdBits );
+			for ( size_t d = 0; d < offsets.size(); ++d )
+			{
+				offsets[d] = _counters[_numberOfBlock * d];
+			}
+			sortSegmentsWith<HasValues>( keys, values, n, offsets.data(), offsets.size(), h.inCacheElements + 1, pool );
+			_passCount = 2;
+			return;
+		}
+
+		sortPasses<HasValues>( keys, values, n, passes, nPasses, pool );
+		_passCount = nPasses;
+	}
+
+	// the LSD passes. _counters has the scanned counters of the last pass after that
+	template <bool HasValues>
+	void sortPasses( Key* keys, uint32_t* values, size_t n, const RadixPass* passes, int nPasses, ThreadPool& pool )
+	{
+		_tmp.resize( n );
+		_wc.resize( pool.threadCount() * CPU_RADIX_COUNTERS * kWCKeys );
+		if ( HasValues )
+		{
+			_tmpValues.resize( n );
+			_wcValues.resize( pool.threadCount() * CPU_RADIX_COUNTERS * kWCKeys );
+		}
+
+		size_t elementsInBlock = std::max( ( n + pool.threadCount() * 4 - 1 ) / ( pool.threadCount() * 4 ), (size_t)CPU_RADIX_MIN_ELEMENTS_IN_BLOCK );
+		size_t numberOfBlock = ( n + elementsInBlock - 1 ) / elementsInBlock;
+		_counters.resize( numberOfBlock << passes[0].bits );
+		_numberOfBlock = numberOfBlock;
+
+		Key* xs0 = keys;
+		Key* xs1 = _tmp.data();
+		uint32_t* vs0 = values;
+		uint32_t* vs1 = _tmpValues.data();
+		for ( int i = 0; i < nPasses; ++i )
+		{
+			const RadixPass& pass = passes[i];
+			count( xs0, n, pass, elementsInBlock, numberOfBlock, pool );
+			exclusiveScan( _counters.data(), _counters.size(), ScanSum(), pool );
+			reorder<HasValues>( xs0, xs1, vs0, vs1, n, pass, elementsInBlock, numberOfBlock, pool );
+			std::swap( xs0, xs1 );
+			std::swap( vs0, vs1 );
+		}
+
+		if ( xs0 != keys )
+		{
+			memcpy( keys, xs0, n * sizeof( Key ) );
+			if ( HasValues )
+			{
+				memcpy( values, vs0, n * sizeof( uint32_t ) );
+			}
+		}
+	}
+
+	// segments of largeSegment elements or more are sorted by sortWith(), the rest single threaded in parallel
+	template <bool HasValues>
+	void sortSegmentsWith( Key* keys, uint32_t* values, size_t n, const uint32_t* segmentOffsets, size_t nSegments, size_t largeSegment, ThreadPool& pool )
+	{
+		// range i in [0, nSegments] is [segmentOffsets[i - 1], segmentOffsets[i]). The range 0 is before the first segment
+		auto rangeBeg = [&]( size_t i ) { return i == 0 ? (size_t)0 : (size_t)segmentOffsets[i - 1]; };
+		auto rangeEnd = [&]( size_t i ) { return i == nSegments ? n : (size_t)segmentOffsets[i]; };
+
+		size_t mergeSortElements = hybrid().mergeSortElements;
+
+		std::vector<uint32_t> smalls;
+		std::vector<uint32_t> larges;
+		for ( size_t i = 0; i <= nSegments; ++i )
+		{
+			size_t size = rangeEnd( i ) - rangeBeg( i );
+			if ( size <= 1 )
+			{
+				continue;
+			}
+			( largeSegment <= size ? larges : smalls ).push_back( (uint32_t)i );
+		}
+		if ( 1 < pool.threadCount() )
+		{
+			// largest first. Ordering by the power of two of the size is enough for the balance and takes linear time
+			auto sizeClass = [&]( uint32_t i ) {
+				int c = 0;
+				for ( size_t size = rangeEnd( i ) - rangeBeg( i ); 1 < size; size >>= 1 )
+				{
+					c++;
+				}
+				return c;
+			};
+			uint32_t classOffsets[65] = {};
+			for ( uint32_t i : smalls )
+			{
+				classOffsets[64 - sizeClass( i )]++;
+			}
+			uint32_t sum = 0;
+			for ( uint32_t& c : classOffsets )
+			{
+				uint32_t count = c;
+				c = sum;
+				sum += count;
+			}
+			std::vector<uint32_t> ordered( smalls.size() );
+			for ( uint32_t i : smalls )
+			{
+				ordered[classOffsets[64 - sizeClass( i )]++] = i;
+			}
+			smalls.swap( ordered );
+		}
+
+		// the scratch of a segment is the same range of _tmp
+		_tmp.resize( n );
+		if ( HasValues )
+		{
+			_tmpValues.resize( n );
+		}
+		int64_t grain = std::max( (int64_t)smalls.size() / ( pool.threadCount() * 64 ), (int64_t)1 );
+		pool.parallelFor( (int64_t)smalls.size(), grain, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+			for ( int64_t i = beg; i < end; ++i )
+			{
+				size_t head = rangeBeg( smalls[i] );
+				size_t size = rangeEnd( smalls[i] ) - head;
+				sortSerial<HasValues>( keys + head, HasValues ? values + head : nullptr, size, _tmp.data() + head, HasValues ? _tmpValues.data() + head : nullptr, mergeSortElements );
+			}
+		} );
+
+		for ( uint32_t i : larges )
+		{
+			size_t head = rangeBeg( i );
+			sortWith<HasValues>( keys + head, HasValues ? values + head : nullptr, rangeEnd( i ) - head, pool );
+		}
+	}
+
+	template <bool HasValues>
+	static void insertionSort( Key* keys, uint32_t* values, size_t n )
+	{
+		for ( size_t i = 1; i < n; ++i )
+		{
+			Key x = keys[i];
+			uint32_t v = HasValues ? values[i] : 0;
+			Bits b = RadixKey<Key>::bits( x );
+			size_t j = i;
+			for ( ; 0 < j && b < RadixKey<Key>::bits( keys[j - 1] ); --j )
+			{
+				keys[j] = keys[j - 1];
+				if ( HasValues )
+				{
+					values[j] = values[j - 1];
+				}
+			}
+			keys[j] = x;
+			if ( HasValues )
+			{
+				values[j] = v;
+			}
+		}
+	}
+
+	// bottom-up merge sort of insertion sorted runs. Stable like the radix passes
+	template <bool HasValues>
+	static void mergeSort( Key* keys, uint32_t* values, size_t n, Key* tmp, uint32_t* tmpValues )
+	{
+		const size_t kRun = CPU_RADIX_INSERTION_SORT_ELEMENTS / 2;
+		for ( size_t i = 0; i < n; i += kRun )
+		{
+			insertionSort<HasValues>( keys + i, HasValues ? values + i : nullptr, std::min( kRun, n - i ) );
+		}
+
+		Key* xs0 = keys;
+		Key* xs1 = tmp;
+		uint32_t* vs0 = values;
+		uint32_t* vs1 = tmpValues;
+		for ( size_t width = kRun; width < n; width *= 2 )
+		{
+			for ( size_t head = 0; head < n; head += width * 2 )
+			{
+				size_t mid = std::min( head + width, n );
+				size_t tail = std::min( head + width * 2, n );
+				size_t i = head;
+				size_t j = mid;
+				size_t o = head;
+				while ( i < mid && j < tail )
+				{
+					// the right one only when strictly less
+					size_t src = RadixKey<Key>::bits( xs0[j] ) < RadixKey<Key>::bits( xs0[i] ) ? j++ : i++;
+					xs1[o] = xs0[src];
+					if ( HasValues )
+					{
+						vs1[o] = vs0[src];
+					}
+					o++;
+				}
+				memcpy( xs1 + o, xs0 + i, ( mid - i ) * sizeof( Key ) );
+				memcpy( xs1 + o + ( mid - i ), xs0 + j, ( tail - j ) * sizeof( Key ) );
+				if ( HasValues )
+				{
+					memcpy( vs1 + o, vs0 + i, ( mid - i ) * sizeof( uint32_t ) );
+					memcpy( vs1 + o + ( mid - i ), vs0 + j, ( tail - j ) * sizeof( uint32_t ) );
+				}
+			}
+			std::swap( xs0, xs1 );
+			std::swap( vs0, vs1 );
+		}
+
+		if ( xs0 != keys )
+		{
+			memcpy( keys, xs0, n * sizeof( Key ) );
+			if ( HasValues )
+			{
+				memcpy( values, vs0, n * sizeof( uint32_t ) );
+			}
+		}
+	}
+
+	// single threaded sort of a segment. tmp and tmpValues are the scratch of n elements
+	template <bool HasValues>
+	static void sortSerial( Key* keys, uint32_t* values, size_t n, Key* tmp, uint32_t* tmpValues, size_t mergeSortElements )
+	{
+		if ( n <= CPU_RADIX_INSERTION_SORT_ELEMENTS )
+		{
+			insertionSort<HasValues>( keys, values, n );
+			return;
+		}
+		if ( n <= mergeSortElements )
+		{
+			mergeSort<HasValues>( keys, values, n, tmp, tmpValues );
+			return;
+		}
+
+		Bits o = 0;
+		Bits a = ~(Bits)0;
+		for ( size_t i = 0; i < n; ++i )
+		{
+			Bits b = RadixKey<Key>::bits( keys[i] );
+			o |= b;
+			a &= b;
+		}
+		RadixPass passes[16];
+		int nPasses = planRadixPasses( o ^ a, n, CPU_RADIX_SERIAL_BITS, passes );
+
+		Key* xs0 = keys;
+		Key* xs1 = tmp;
+		uint32_t* vs0 = values;
+		uint32_t* vs1 = tmpValues;
+		for ( int i = 0; i < nPasses; ++i )
+		{
+			const RadixPass& pass = passes[i];
+			int nCounters = 1 << pass.bits;
+			uint32_t mask = nCounters - 1;
+			uint32_t offsets[1 << CPU_RADIX_SERIAL_BITS];
+			std::fill( offsets, offsets + nCounters, 0 );
+			for ( size_t j = 0; j < n; ++j )
+			{
+				offsets[digit( xs0[j], pass.shift, mask )]++;
+			}
+			uint32_t sum = 0;
+			for ( int d = 0; d < nCounters; ++d )
+			{
+				uint32_t c = offsets[d];
+				offsets[d] = sum;
+				sum += c;
+			}
+			for ( size_t j = 0; j < n; ++j )
+			{
+				uint32_t dst = offsets[digit( xs0[j], pass.shift, mask )]++;
+				xs1[dst] = xs0[j];
+				if ( HasValues )
+				{
+					vs1[dst] = vs0[j];
+				}
+			}
+			std::swap( xs0, xs1 );
+			std::swap( vs0, vs1 );
+		}
+
+		if ( xs0 != keys )
+		{
+			memcpy( keys, xs0, n * sizeof( Key ) );
+			if ( HasValues )
+			{
+				memcpy( values, vs0, n * sizeof( uint32_t ) );
+			}
+		}
+	}
+
+	/*
+		the largest power of two size where each method is faster, on uniform keys:
+		the merge sort against the serial radix passes, and the serial sort against the parallel LSD passes
+	*/
+	static RadixHybrid tuneHybrid( ThreadPool& pool )
+	{
+		size_t maxElements = maxInCacheElements();
+		std::vector<Key> input( CPU_RADIX_TUNING_ELEMENTS );
+		uint64_t x = 0x9E3779B97F4A7C15ull;
+		for ( Key& k : input )
+		{
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			k = (Key)( sizeof( Key ) == 4 ? x >> 32 : x );
+		}
+
+		RadixSort<Key> sorter;
+		std::vector<Key> xs;
+		std::vector<Key> tmp( maxElements );
+		// the best of 3 in seconds to sort the input in chunks of size. method 0 : merge sort, 1 : serial radix, 2 : parallel passes
+		auto measure = [&]( size_t size, int method ) {
+			double best = 1.0e9;
+			for ( int i = 0; i < 3; ++i )
+			{
+				xs = input;
+				auto beg = std::chrono::steady_clock::now();
+				for ( size_t head = 0; head + size <= xs.size(); head += size )
+				{
+					Key* keys = xs.data() + head;
+					if ( method == 0 )
+					{
+						mergeSort<false>( keys, nullptr, size, tmp.data(), nullptr );
+					}
+					else if ( method == 1 )
+					{
+						sortSerial<false>( keys, nullptr, size, tmp.data(), nullptr, 0 );
+					}
+					else
+					{
+						RadixPass passes[16];
+						int nPasses = planRadixPasses( sorter.varyingBits( keys, size, pool ), size, CPU_RADIX_MAX_BITS, passes );
+						sorter.sortPasses<false>( keys, nullptr, size, passes, nPasses, pool );
+					}
+				}
+				best = std::min( best, std::chrono::duration<double>( std::chrono::steady_clock::now() - beg ).count() );
+			}
+			return best;
+		};
+
+		RadixHybrid h = {CPU_RADIX_INSERTION_SORT_ELEMENTS, CPU_RADIX_INSERTION_SORT_ELEMENTS};
+		for ( size_t size = CPU_RADIX_INSERTION_SORT_ELEMENTS * 2; size <= maxElements; size *= 2 )
+		{
+			double serial = measure( size, 1 );
+			if ( h.mergeSortElements == size / 2 )
+			{
+				double merge = measure( size, 0 );
+				if ( merge < serial )
+				{
+					h.mergeSortElements = size;
+					serial = merge;
+				}
+			}
+			if ( serial < measure( size, 2 ) )
+			{
+				h.inCacheElements = size;
+			}
+		}
+		return h;
+	}
+
+	void count( const Key* xs, size_t n, const RadixPass& pass, size_t elementsInBlock, size_t numberOfBlock, ThreadPool& pool )
+	{
+		int nCounters = 1 << pass.bits;
+		uint32_t mask = nCounters - 1;
+		pool.parallelFor( (int64_t)numberOfBlock, 1, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+			for ( int64_t iBlock = beg; iBlock < end; ++iBlock )
+			{
+				uint32_t counters[CPU_RADIX_COUNTERS];
+				std::fill( counters, counters + nCounters, 0 );
+				size_t head = iBlock * elementsInBlock;
+				size_t tail = std::min( head + elementsInBlock, n );
+				for ( size_t i = head; i < tail; ++i )
+				{
+					counters[digit( xs[i], pass.shift, mask )]++;
+				}
+				for ( int i = 0; i < nCounters; ++i )
+				{
+					_counters[numberOfBlock * i + iBlock] = counters[i];
+				}
+			}
+		} );
+	}
+
+	template <bool HasValues>
+	void reorder( const Key* xs0, Key* xs1, const uint32_t* vs0, uint32_t* vs1, size_t n, const RadixPass& pass, size_t elementsInBlock, size_t numberOfBlock, ThreadPool& pool )
+	{
+		int nCounters = 1 << pass.bits;
+		uint32_t mask = nCounters - 1;
+		pool.parallelFor( (int64_t)numberOfBlock, 1, [&]( int64_t beg, int64_t end, int iThread ) {
+			Key* wc = &_wc[iThread * CPU_RADIX_COUNTERS * kWCKeys];
+			uint32_t* wcValues = HasValues ? &_wcValues[iThread * CPU_RADIX_COUNTERS * kWCKeys] : nullptr;
+			for ( int64_t iBlock = beg; iBlock < end; ++iBlock )
+			{
+				uint32_t offsets[CPU_RADIX_COUNTERS];
+				uint32_t fills[CPU_RADIX_COUNTERS];
+				std::fill( fills, fills + nCounters, 0 );
+				for ( int i = 0; i < nCounters; ++i )
+				{
+					offsets[i] = _counters[numberOfBlock * i + iBlock];
+				}
+
+				size_t head = iBlock * elementsInBlock;
+				size_t tail = std::min( head + elementsInBlock, n );
+				for ( size_t i = head; i < tail; ++i )
+				{
+					Key x = xs0[i];
+					uint32_t d = digit( x, pass.shift, mask );
+					Key* line = &wc[d * kWCKeys];
+					if ( HasValues )
+					{
+						wcValues[d * kWCKeys + fills[d]] = vs0[i];
+					}
+					line[fills[d]++] = x;
+					if ( fills[d] == kWCKeys )
+					{
+						memcpy( &xs1[offsets[d]], line, sizeof( Key ) * kWCKeys );
+						if ( HasValues )
+						{
+							memcpy( &vs1[offsets[d]], &wcValues[d * kWCKeys], sizeof( uint32_t ) * kWCKeys );
+						}
+						offsets[d] += kWCKeys;
+						fills[d] = 0;
+					}
+				}
+				for ( int d = 0; d < nCounters; ++d )
+				{
+					memcpy( &xs1[offsets[d]], &wc[d * kWCKeys], sizeof( Key ) * fills[d] );
+					if ( HasValues )
+					{
+						memcpy( &vs1[offsets[d]], &wcValues[d * kWCKeys], sizeof( uint32_t ) * fills[d] );
+					}
+				}
+			}
+		} );
+	}
+
+	std::vector<Key> _tmp;
+	std::vector<uint32_t> _counters;
+	size_t _numberOfBlock = 0;
+	std::vector<Key> _wc; // [thread][counter][kWCKeys]
+	std::vector<uint32_t> _tmpValues;
+	std::vector<uint32_t> _wcValues;
+	int _passCount = 0;
+};
+
+template <class Key>
+inline void radixSort( Key* keys, size_t n, ThreadPool& pool = ThreadPool::global() )
+{
+	RadixSort<Key> sorter;
+	sorter.sort( keys, n, pool );
+}
+template <class Key>
+inline void radixSort( Key* keys, uint32_t* values, size_t n, ThreadPool& pool = ThreadPool::global() )
+{
+	RadixSort<Key> sorter;
+	sorter.sort( keys, values, n, pool );
+}
+template <class Key>
+inline void segmentedRadixSort( Key* keys, size_t n, const uint32_t* segmentOffsets, size_t nSegments, ThreadPool& pool = ThreadPool::global() )
+{
+	RadixSort<Key> sorter;
+	sorter.sortSegments( keys, n, segmentOffsets, nSegments, pool );
+}
+template <class Key>
+inline void segmentedRadixSort( Key* keys, uint32_t* values, size_t n, const uint32_t* segmentOffsets, size_t nSegments, ThreadPool& pool = ThreadPool::global() )
+{
+	RadixSort<Key> sorter;
+	sorter.sortSegments( keys, values, n, segmentOffsets, nSegments, pool );
+}
+} // namespace cpu
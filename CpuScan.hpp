@@ -0,0 +1,329 @@
+#pragma once
+
+#include "CpuParallel.hpp"
+#include <emmintrin.h>
+#include <limits>
+
+// Prefix scan on CPU. The same reduce-then-scan as scan_reduce.hlsl and scan_downsweep.hlsl
+namespace cpu
+{
+// elements per chunk. Each chunk is reduced and scanned by one thread
+#define CPU_SCAN_CHUNK_SIZE 4096
+
+inline __m128i selectLanes( __m128i mask, __m128i a, __m128i b )
+{
+	return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) );
+}
+
+// 4 lanes of T. Types without a specialization take the scalar path
+template <class T>
+struct ScanLanes
+{
+	static const bool kEnabled = false;
+};
+
+template <>
+struct ScanLanes<uint32_t>
+{
+	static const bool kEnabled = true;
+	typedef __m128i V;
+	static V load( const uint32_t* p ) { return _mm_loadu_si128( (const __m128i*)p ); }
+	static void store( uint32_t* p, V v ) { _mm_storeu_si128( (__m128i*)p, v ); }
+	static V set1( uint32_t x ) { return _mm_set1_epi32( (int)x ); }
+	static uint32_t last( V v ) { return (uint32_t)_mm_cvtsi128_si32( _mm_shuffle_epi32( v, 0xFF ) ); }
+
+	// lanes move up by K, the lowest K lanes are taken from the highest K lanes of fill
+	template <int K>
+	static V shiftIn( V v, V fill ) { return _mm_or_si128( _mm_slli_si128( v, K * 4 ), _mm_srli_si128( fill, 16 - K * 4 ) ); }
+
+	static V sum( V a, V b ) { return _mm_add_epi32( a, b ); }
+	static V max( V a, V b )
+	{
+		__m128i bias = _mm_set1_epi32( (int)0x80000000 );
+		return selectLanes( _mm_cmpgt_epi32( _mm_xor_si128( a, bias ), _mm_xor_si128( b, bias ) ), a, b );
+	}
+	static V min( V a, V b )
+	{
+		__m128i bias = _mm_set1_epi32( (int)0x80000000 );
+		return selectLanes( _mm_cmplt_epi32( _mm_xor_si128( a, bias ), _mm_xor_si128( b, bias ) ), a, b );
+	}
+};
+
+template <>
+struct ScanLanes<int32_t>
+{
+	static const bool kEnabled = true;
+	typedef __m128i V;
+	static V load( const int32_t* p ) { return _mm_loadu_si128( (const __m128i*)p ); }
+	static void store( int32_t* p, V v ) { _mm_storeu_si128( (__m128i*)p, v ); }
+	static V set1( int32_t x ) { return _mm_set1_epi32( x ); }
+	static int32_t last( V v ) { return _mm_cvtsi128_si32( _mm_shuffle_epi32( v, 0xFF ) ); }
+
+	template <int K>
+	static V shiftIn( V v, V fill ) { return _mm_or_si128( _mm_slli_si128( v, K * 4 ), _mm_srli_si128( fill, 16 - K * 4 ) ); }
+
+	static V sum( V a, V b ) { return _mm_add_epi32( a, b ); }
+	static V max( V a, V b ) { return selectLanes( _mm_cmpgt_epi32( a, b ), a, b ); }
+	static V min( V a, V b ) { return selectLanes( _mm_cmplt_epi32( a, b ), a, b ); }
+};
+
+template <>
+struct ScanLanes<float>
+{
+	static const bool kEnabled = true;
+	typedef __m128 V;
+	static V load( const float* p ) { return _mm_loadu_ps( p ); }
+	static void store( float* p, V v ) { _mm_storeu_ps( p, v ); }
+	static V set1( float x ) { return _mm_set1_ps( x ); }
+	static float last( V v ) { return _mm_cvtss_f32( _mm_shuffle_ps( v, v, 0xFF ) ); }
+
+	template <int K>
+	static V shiftIn( V v, V fill )
+	{
+		return _mm_castsi128_ps( _mm_or_si128( _mm_slli_si128( _mm_castps_si128( v ), K * 4 ), _mm_srli_si128( _mm_castps_si128( fill ), 16 - K * 4 ) ) );
+	}
+
+	static V sum( V a, V b ) { return _mm_add_ps( a, b ); }
+	static V max( V a, V b ) { return _mm_max_ps( a, b ); }
+	static V min( V a, V b ) { return _mm_min_ps( a, b ); }
+};
+
+/*
+	Scan operators. identity() is the element x with op( identity, x ) == x
+	The same set as SCAN_OP_SUM, SCAN_OP_MAX and SCAN_OP_MIN in scan.h
+*/
+struct ScanSum
+{
+	template <class T>
+	static T identity() { return T( 0 ); }
+	template <class T>
+	T operator()( T a, T b ) const { return a + b; }
+	template <class T>
+	static typename ScanLanes<T>::V lanes( typename ScanLanes<T>::V a, typename ScanLanes<T>::V b ) { return ScanLanes<T>::sum( a, b ); }
+};
+struct ScanMax
+{
+	template <class T>
+	static T identity() { return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest(); }
+	template <class T>
+	T operator()( T a, T b ) const { return a < b ? b : a; }
+	template <class T>
+	static typename ScanLanes<T>::V lanes( typename ScanLanes<T>::V a, typename ScanLanes<T>::V b ) { return ScanLanes<T>::max( a, b ); }
+};
+struct ScanMin
+{
+	template <class T>
+	static T identity() { return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max(); }
+	template <class T>
+	T operator()( T a, T b ) const { return b < a ? b : a; }
+	template <class T>
+	static typename ScanLanes<T>::V lanes( typename ScanLanes<T>::V a, typename ScanLanes<T>::V b ) { return ScanLanes<T>::min( a, b ); }
+};
+
+/*
+	Scan of one chunk from carry, in place. Returns carry combined with all the elements.
+	inclusive  : xs[i] = carry op xs[0] op .. op xs[i]
+	exclusive  : xs[i] = carry op xs[0] op .. op xs[i - 1]
+*/
+template <class T, class Op>
+inline T scanChunk( T* xs, size_t n, T carry, Op op, bool inclusive, std::false_type /* lanes */ )
+{
+	for ( size_t i = 0; i < n; ++i )
+	{
+		T x = xs[i];
+		T next = op( carry, x );
+		xs[i] = inclusive ? next : carry;
+		carry = next;
+	}
+	return carry;
+}
+template <class T, class Op>
+inline T scanChunk( T* xs, size_t n, T carry, Op op, bool inclusive, std::true_type /* lanes */ )
+{
+	typedef ScanLanes<T> L;
+	typedef typename L::V V;
+
+	V identity = L::set1( Op::template identity<T>() );
+	V carries = L::set1( carry );
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 )
+	{
+		// in-register inclusive scan of 4 lanes, then the carry
+		V v = L::load( xs + i );
+		v = Op::template lanes<T>( v, L::template shiftIn<1>( v, identity ) );
+		v = Op::template lanes<T>( v, L::template shiftIn<2>( v, identity ) );
+		v = Op::template lanes<T>( carries, v );
+		L::store( xs + i, inclusive ? v : L::template shiftIn<1>( v, carries ) );
+		carries = L::set1( L::last( v ) );
+	}
+	return scanChunk( xs + i, n - i, L::last( carries ), op, inclusive, std::false_type() );
+}
+
+template <class T, class Op>
+inline T reduceChunk( const T* xs, size_t n, Op op, std::false_type /* lanes */ )
+{
+	T r = Op::template identity<T>();
+	for ( size_t i = 0; i < n; ++i )
+	{
+		r = op( r, xs[i] );
+	}
+	return r;
+}
+template <class T, class Op>
+inline T reduceChunk( const T* xs, size_t n, Op op, std::true_type /* lanes */ )
+{
+	typedef ScanLanes<T> L;
+	typedef typename L::V V;
+
+	V r4 = L::set1( Op::template identity<T>() );
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 )
+	{
+		r4 = Op::template lanes<T>( r4, L::load( xs + i ) );
+	}
+	T lanes[4];
+	L::store( lanes, r4 );
+	T r = op( op( lanes[0], lanes[1] ), op( lanes[2], lanes[3] ) );
+	return op( r, reduceChunk( xs + i, n - i, op, std::false_type() ) );
+}
+
+/*
+	prefix scan in place. reduce per chunk, scan the chunk reductions, then scan each chunk from its base.
+	Op is ScanSum, ScanMax or ScanMin. uint32_t, int32_t and float run 4 lanes at once
+*/
+template <class T, class Op>
+inline void scan( T* xs, size_t n, Op op, bool inclusive, ThreadPool& pool = ThreadPool::global() )
+{
+	typedef std::integral_constant<bool, ScanLanes<T>::kEnabled> Lanes;
+
+	// the reduce pass only pays off with more than one thread
+	int64_t nChunks = ( (int64_t)n + CPU_SCAN_CHUNK_SIZE - 1 ) / CPU_SCAN_CHUNK_SIZE;
+	if ( nChunks <= 1 || pool.threadCount() == 1 )
+	{
+		scanChunk( xs, n, Op::template identity<T>(), op, inclusive, Lanes() );
+		return;
+	}
+
+	std::vector<T> carries( nChunks );
+	pool.parallelFor( nChunks, 1, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t iChunk = beg; iChunk < end; ++iChunk )
+		{
+			size_t head = iChunk * CPU_SCAN_CHUNK_SIZE;
+			size_t tail = std::min( head + CPU_SCAN_CHUNK_SIZE, n );
+			carries[iChunk] = reduceChunk( xs + head, tail - head, op, Lanes() );
+		}
+	} );
+
+	scanChunk( carries.data(), carries.size(), Op::template identity<T>(), op, false, std::false_type() );
+
+	pool.parallelFor( nChunks, 1, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t iChunk = beg; iChunk < end; ++iChunk )
+		{
+			size_t head = iChunk * CPU_SCAN_CHUNK_SIZE;
+			size_t tail = std::min( head + CPU_SCAN_CHUNK_SIZE, n );
+			scanChunk( xs + head, tail - head, carries[iChunk], op, inclusive, Lanes() );
+		}
+	} );
+}
+
+// scan of xs[head, tail) from carry, restarting at every segment head in the range. Returns the running value at tail
+template <class T, class Op, class Lanes>
+inline T scanSegmentsInRange( T* xs, size_t head, size_t tail, const uint32_t* segmentOffsets, size_t nSegments, T carry, Op op, bool inclusive, Lanes lanes )
+{
+	const uint32_t* segmentEnd = segmentOffsets + nSegments;
+	const uint32_t* s = std::lower_bound( segmentOffsets, segmentEnd, (uint32_t)head );
+	size_t i = head;
+	for ( ;; )
+	{
+		size_t next = ( s != segmentEnd && *s < tail ) ? *s : tail;
+		carry = scanChunk( xs + i, next - i, carry, op, inclusive, lanes );
+		if ( next == tail )
+		{
+			break;
+		}
+		carry = Op::template identity<T>();
+		i = next;
+		while ( s != segmentEnd && *s <= i )
+		{
+			++s;
+		}
+	}
+	return carry;
+}
+
+/*
+	Segmented scan. A segment starts at each of segmentOffsets[0, nSegments), ascending ( duplicates are empty segments ),
+	and the scan restarts from identity there. Elements before segmentOffsets[0] are a segment too.
+	The chunks are split by the element count and not by segments, so any mix of segment sizes is balanced the same as scan()
+*/
+template <class T, class Op>
+inline void segmentedScan( T* xs, size_t n, const uint32_t* segmentOffsets, size_t nSegments, Op op, bool inclusive, ThreadPool& pool = ThreadPool::global() )
+{
+	typedef std::integral_constant<bool, ScanLanes<T>::kEnabled> Lanes;
+
+	int64_t nChunks = ( (int64_t)n + CPU_SCAN_CHUNK_SIZE - 1 ) / CPU_SCAN_CHUNK_SIZE;
+	if ( nChunks <= 1 || pool.threadCount() == 1 )
+	{
+		scanSegmentsInRange( xs, 0, n, segmentOffsets, nSegments, Op::template identity<T>(), op, inclusive, Lanes() );
+		return;
+	}
+
+	// the reduction of each chunk after its last segment head
+	std::vector<T> carries( nChunks );
+	std::vector<uint8_t> hasHead( nChunks );
+	pool.parallelFor( nChunks, 1, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t iChunk = beg; iChunk < end; ++iChunk )
+		{
+			size_t head = iChunk * CPU_SCAN_CHUNK_SIZE;
+			size_t tail = std::min( head + CPU_SCAN_CHUNK_SIZE, n );
+			const uint32_t* s = std::lower_bound( segmentOffsets, segmentOffsets + nSegments, (uint32_t)tail );
+			size_t lastHead = head;
+			hasHead[iChunk] = s != segmentOffsets && head <= s[-1];
+			if ( hasHead[iChunk] )
+			{
+				lastHead = s[-1];
+			}
+			carries[iChunk] = reduceChunk( xs + lastHead, tail - lastHead, op, Lanes() );
+		}
+	} );
+
+	// exclusive scan of the chunks. A chunk with a head restarts the running value from its own reduction
+	T running = Op::template identity<T>();
+	for ( int64_t iChunk = 0; iChunk < nChunks; ++iChunk )
+	{
+		T r = carries[iChunk];
+		carries[iChunk] = running;
+		running = hasHead[iChunk] ? r : op( running, r );
+	}
+
+	pool.parallelFor( nChunks, 1, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t iChunk = beg; iChunk < end; ++iChunk )
+		{
+			size_t head = iChunk * CPU_SCAN_CHUNK_SIZE;
+			size_t tail = std::min( head + CPU_SCAN_CHUNK_SIZE, n );
+			scanSegmentsInRange( xs, head, tail, segmentOffsets, nSegments, carries[iChunk], op, inclusive, Lanes() );
+		}
+	} );
+}
+
+template <class T, class Op = ScanSum>
+inline void exclusiveScan( T* xs, size_t n, Op op = Op(), ThreadPool& pool = ThreadPool::global() )
+{
+	scan( xs, n, op, false, pool );
+}
+template <class T, class Op = ScanSum>
+inline void inclusiveScan( T* xs, size_t n, Op op = Op(), ThreadPool& pool = ThreadPool::global() )
+{
+	scan( xs, n, op, true, pool );
+}
+template <class T, class Op = ScanSum>
+inline void segmentedExclusiveScan( T* xs, size_t n, const uint32_t* segmentOffsets, size_t nSegments, Op op = Op(), ThreadPool& pool = ThreadPool::global() )
+{
+	segmentedScan( xs, n, segmentOffsets, nSegments, op, false, pool );
+}
+template <class T, class Op = ScanSum>
+inline void segmentedInclusiveScan( T* xs, size_t n, const uint32_t* segmentOffsets, size_t nSegments, Op op = Op(), ThreadPool& pool = ThreadPool::global() )
+{
+	segmentedScan( xs, n, segmentOffsets, nSegments, op, true, pool );
+}
+} // namespace cpu
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "CpuParallel.hpp"
+#include <cmath>
+
+// Key distributions for sort benchmarks. Real keys are rarely uniform, and a sort that is only measured on uniform keys can collapse on them
+namespace cpu
+{
+enum class KeyDistribution
+{
+	Uniform,
+	Sorted,
+	ReverseSorted,
+	AllEqual,
+	FewUnique, // 16 distinct values
+	Zipf,	   // 1M distinct values, the k-th most frequent one with a probability proportional to 1 / k
+	Morton,	   // z-order codes of points in 64 clusters, like the keys of an LBVH build
+};
+
+inline const char* keyDistributionName( KeyDistribution distribution )
+{
+	switch ( distribution )
+	{
+	case KeyDistribution::Uniform:
+		return "uniform";
+	case KeyDistribution::Sorted:
+		return "sorted";
+	case KeyDistribution::ReverseSorted:
+		return "reverse-sorted";
+	case KeyDistribution::AllEqual:
+		return "all-equal";
+	case KeyDistribution::FewUnique:
+		return "few-unique";
+	case KeyDistribution::Zipf:
+		return "zipf";
+	case KeyDistribution::Morton:
+		return "morton";
+	}
+	return "";
+}
+
+// counter based, so the keys don't depend on the thread count
+inline uint64_t splitmix64( uint64_t x )
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = ( x ^ ( x >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+	x = ( x ^ ( x >> 27 ) ) * 0x94D049BB133111EBull;
+	return x ^ ( x >> 31 );
+}
+inline double uniform01( uint64_t x )
+{
+	return ( splitmix64( x ) >> 11 ) * ( 1.0 / ( 1ull << 53 ) );
+}
+
+// spreads the lowest bits so that there are 2 zero bits between every bit
+inline uint64_t expandBits3( uint64_t x, int bits )
+{
+	uint64_t r = 0;
+	for ( int i = 0; i < bits; ++i )
+	{
+		r |= ( ( x >> i ) & 1 ) << ( i * 3 );
+	}
+	return r;
+}
+
+/*
+	keys[0, n) of the distribution. The same seed gives the same keys.
+	Key is uint32_t or uint64_t. Morton codes are 30 bit for uint32_t and 63 bit for uint64_t
+*/
+template <class Key>
+inline void generateKeys( Key* keys, size_t n, KeyDistribution distribution, uint64_t seed, ThreadPool& pool = ThreadPool::global() )
+{
+	const int keyBits = sizeof( Key ) * 8;
+	const Key maxKey = ~(Key)0;
+
+	uint64_t base = splitmix64( seed );
+
+	Key fewUnique[16];
+	for ( int i = 0; i < 16; ++i )
+	{
+		fewUnique[i] = (Key)splitmix64( base ^ ( 0xF00 + i ) );
+	}
+
+	// the inverse cdf of zipf by a binary search
+	std::vector<double> zipfCdf;
+	if ( distribution == KeyDistribution::Zipf )
+	{
+		zipfCdf.resize( 1 << 20 );
+		double sum = 0.0;
+		for ( size_t k = 0; k < zipfCdf.size(); ++k )
+		{
+			sum += 1.0 / ( k + 1 );
+			zipfCdf[k] = sum;
+		}
+		for ( double& c : zipfCdf )
+		{
+			c /= sum;
+		}
+	}
+
+	int mortonBits = keyBits / 3;
+	double mortonScale = (double)( 1ull << mortonBits );
+
+	pool.parallelFor( (int64_t)n, 1 << 16, [&]( int64_t beg, int64_t end, int /*iThread*/ ) {
+		for ( int64_t i = beg; i < end; ++i )
+		{
+			uint64_t r = splitmix64( base + i );
+			Key k = 0;
+			switch ( distribution )
+			{
+			case KeyDistribution::Uniform:
+				k = (Key)( keyBits == 32 ? r >> 32 : r );
+				break;
+			case KeyDistribution::Sorted:
+				k = (Key)( i * ( maxKey / n ) );
+				break;
+			case KeyDistribution::ReverseSorted:
+				k = (Key)( ( n - 1 - i ) * ( maxKey / n ) );
+				break;
+			case KeyDistribution::AllEqual:
+				k = (Key)0x5A5A5A5A;
+				break;
+			case KeyDistribution::FewUnique:
+				k = fewUnique[r % 16];
+				break;
+			case KeyDistribution::Zipf:
+			{
+				double u = uniform01( r );
+				size_t rank = std::lower_bound( zipfCdf.begin(), zipfCdf.end(), u ) - zipfCdf.begin();
+				k = (Key)splitmix64( base ^ rank );
+				break;
+			}
+			case KeyDistribution::Morton:
+			{
+				// a cluster center and the sum of 3 uniforms around it in each axis
+				uint64_t cluster = splitmix64( base ^ ( 0xC000 + r % 64 ) );
+				uint64_t p[3];
+				for ( int axis = 0; axis < 3; ++axis )
+				{
+					double c = uniform01( cluster + axis );
+					double o = ( uniform01( r + 3 * axis ) + uniform01( r + 3 * axis + 1 ) + uniform01( r + 3 * axis + 2 ) - 1.5 ) * 0.02;
+					double x = std::min( std::max( c + o, 0.0 ), 1.0 - 1.0 / mortonScale );
+					p[axis] = (uint64_t)( x * mortonScale );
+				}
+				k = (Key)( expandBits3( p[0], mortonBits ) << 2 | expandBits3( p[1], mortonBits ) << 1 | expandBits3( p[2], mortonBits ) );
+				break;
+			}
+			}
+			keys[i] = k;
+		}
+	} );
+}
+} // namespace cpu
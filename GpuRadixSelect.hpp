@@ -0,0 +1,150 @@
+#pragma once
+
+#include "EzDx.hpp"
+#include "pr.hpp"
+#include "radixsort.h"
+
+/*
+	Radix select and top-k of RADIX_KEY_* keys. The GPU counterpart of cpu::RadixSelect
+	A pass per 8 bit digit from the highest, 4 for 32 bit keys and 8 for uint64:
+		radixselect_histogram : the histogram of the digit over the keys with the prefix found so far
+		radixselect_pick      : a single group picks the bucket of the k-th key and extends the prefix
+	topK() adds radixselect_gather, which appends the keys below the k-th and the ties up to k.
+	Unlike cpu::RadixSelect every pass reads all the keys, but it reads only keys and adds to 256 counters,
+	without the scan of the counter table and the reorder of every pass of a sort
+*/
+class GpuRadixSelect
+{
+public:
+	GpuRadixSelect( ID3D12Device* device )
+	{
+		_histogramCompute.u( 0 );
+		_histogramCompute.u( 1 );
+		_histogramCompute.u( 2 );
+		_histogramCompute.bRootConstant32( 0, 4 );
+		_histogramCompute.loadShaderAndBuild( device, pr::GetDataPath( "radixselect_histogram.cso" ).c_str() );
+
+		_pick.u( 0 );
+		_pick.u( 1 );
+		_pick.bRootConstant32( 0, 4 );
+		_pick.loadShaderAndBuild( device, pr::GetDataPath( "radixselect_pick.cso" ).c_str() );
+
+		_gather.u( 0 );
+		_gather.u( 1 );
+		_gather.u( 2 );
+		_gather.u( 3 );
+		_gather.bRootConstant32( 0, 4 );
+		_gather.loadShaderAndBuild( device, pr::GetDataPath( "radixselect_gather.cso" ).c_str() );
+
+		_histogram = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( device, sizeof( uint32_t ) * RADIX_DIGITS, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+		_histogram->setName( L"radixSelectHistogram" );
+		_state = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( device, sizeof( uint32_t ) * RADIX_SELECT_STATE_WORDS, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+		_state->setName( L"radixSelectState" );
+
+		_zeroUploader = std::unique_ptr<UploaderObject>( new UploaderObject( device, sizeof( uint32_t ) * RADIX_DIGITS ) );
+		_zeroUploader->map( []( void* p ) { memset( p, 0, sizeof( uint32_t ) * RADIX_DIGITS ); } );
+	}
+
+	/*
+		records the selection of the key that would be at k after sorting xs[0, n). k < n
+		state()[RADIX_SELECT_STATE_PREFIX_LO, RADIX_SELECT_STATE_PREFIX_HI] is the key in the sort order after that
+	*/
+	void select( ID3D12GraphicsCommandList* commandList, ID3D12Device* device, StackDescriptorHeapObject* heap, BufferObjectUAV* xs, uint32_t n, uint32_t keyType, uint32_t k )
+	{
+		DX_ASSERT( k < n, "out of range" );
+		DX_ASSERT( dispatchsize( n, RADIX_SELECT_BLOCK_SIZE ) <= D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION, "too many elements" );
+
+		// Clear
+		resourceBarrier( commandList, {
+										  _histogram->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST ),
+										  _state->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST ),
+									  } );
+		_histogram->copyFrom( commandList, _zeroUploader.get() );
+		_state->copyFrom( commandList, _zeroUploader->resource(), 0, 0, sizeof( uint32_t ) * RADIX_SELECT_STATE_WORDS );
+		resourceBarrier( commandList, {
+										  _histogram->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
+										  _state->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
+									  } );
+
+		int keyBits = keyType == RADIX_KEY_UINT64 ? 64 : 32;
+		for ( int shift = keyBits - 8; 0 <= shift; shift -= 8 )
+		{
+			RadixSelectArgument arg = {n, keyType, (uint32_t)shift, k};
+
+			// Histogram
+			_histogramCompute.setPipelineState( commandList );
+			_histogramCompute.setComputeRootSignature( commandList );
+			heap->startNextHeapAndAssign( commandList, _histogramCompute.descriptorMap() );
+			heap->bRootConstant32( commandList, 0, 4, &arg );
+			heap->u( device, 0, xs->resource(), xs->UAVDescription() );
+			heap->u( device, 1, _histogram->resource(), _histogram->UAVDescription() );
+			heap->u( device, 2, _state->resource(), _state->UAVDescription() );
+			_histogramCompute.dispatch( commandList, dispatchsize( n, RADIX_SELECT_BLOCK_SIZE ), 1, 1 );
+
+			resourceBarrier( commandList, {_histogram->resourceBarrierUAV()} );
+
+			// Pick
+			_pick.setPipelineState( commandList );
+			_pick.setComputeRootSignature( commandList );
+			heap->startNextHeapAndAssign( commandList, _pick.descriptorMap() );
+			heap->bRootConstant32( commandList, 0, 4, &arg );
+			heap->u( device, 0, _histogram->resource(), _histogram->UAVDescription() );
+			heap->u( device, 1, _state->resource(), _state->UAVDescription() );
+			_pick.dispatch( commandList, 1, 1, 1 );
+
+			resourceBarrier( commandList, {
+											  _histogram->resourceBarrierUAV(),
+											  _state->resourceBarrierUAV(),
+										  } );
+		}
+	}
+
+	/*
+		records the k smallest keys of xs[0, n) to outKeys and their indices to outIndices, in no particular order. 0 < k <= n
+		outKeys has the words of k keys ( 2 per key for RADIX_KEY_UINT64 ) and outIndices k uints.
+		Which of the keys equal to the k-th are taken is unspecified
+	*/
+	void topK( ID3D12GraphicsCommandList* commandList, ID3D12Device* device, StackDescriptorHeapObject* heap, BufferObjectUAV* xs, uint32_t n, uint32_t keyType, uint32_t k, BufferObjectUAV* outKeys, BufferObjectUAV* outIndices )
+	{
+		select( commandList, device, heap, xs, n, keyType, k - 1 );
+
+		// Gather
+		RadixSelectArgument arg = {n, keyType, 0, k - 1};
+		_gather.setPipelineState( commandList );
+		_gather.setComputeRootSignature( commandList );
+		heap->startNextHeapAndAssign( commandList, _gather.descriptorMap() );
+		heap->bRootConstant32( commandList, 0, 4, &arg );
+		heap->u( device, 0, xs->resource(), xs->UAVDescription() );
+		heap->u( device, 1, _state->resource(), _state->UAVDescription() );
+		heap->u( device, 2, outKeys->resource(), outKeys->UAVDescription() );
+		heap->u( device, 3, outIndices->resource(), outIndices->UAVDescription() );
+		_gather.dispatch( commandList, dispatchsize( n, RADIX_SELECT_BLOCK_SIZE ), 1, 1 );
+
+		resourceBarrier( commandList, {
+										  outKeys->resourceBarrierUAV(),
+										  outIndices->resourceBarrierUAV(),
+									  } );
+	}
+
+	BufferObjectUAV* state()
+	{
+		return _state.get();
+	}
+
+private:
+	// the root constants of radixselect_*.hlsl
+	struct RadixSelectArgument
+	{
+		uint32_t numberOfKey;
+		uint32_t keyType;
+		uint32_t shift;
+		uint32_t rank;
+	};
+
+	ComputeObject _histogramCompute;
+	ComputeObject _pick;
+	ComputeObject _gather;
+	std::unique_ptr<BufferObjectUAV> _histogram;
+	std::unique_ptr<BufferObjectUAV> _state;
+	std::unique_ptr<UploaderObject> _zeroUploader;
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "EzDx.hpp"
+#include "pr.hpp"
+#include "scan.h"
+
+/*
+	Work-efficient prefix scan of a uint, int or float buffer in place. The GPU counterpart of cpu::scan()
+	reduce-then-scan in 3 dispatches instead of a Hillis-Steele step per bit of n:
+		scan_reduce    : a reduction per block of SCAN_BLOCK_SIZE elements into blockSums
+		scan_downsweep : a single group scans blockSums
+		scan_downsweep : a group per block scans the block from its entry of blockSums
+	segmentedScan() runs scan_segmentHeads first, and every segment restarts the scan in the same 3 dispatches.
+	The blocks don't follow the segments, so the work doesn't depend on how the segment sizes are skewed
+*/
+class GpuScan
+{
+public:
+	GpuScan( ID3D12Device* device, uint32_t maxElements )
+	{
+		_reduce.u( 0 );
+		_reduce.u( 1 );
+		_reduce.u( 2 );
+		_reduce.bRootConstant32( 0, 6 );
+		_reduce.loadShaderAndBuild( device, pr::GetDataPath( "scan_reduce.cso" ).c_str() );
+
+		_downsweep.u( 0 );
+		_downsweep.u( 1 );
+		_downsweep.u( 2 );
+		_downsweep.bRootConstant32( 0, 6 );
+		_downsweep.loadShaderAndBuild( device, pr::GetDataPath( "scan_downsweep.cso" ).c_str() );
+
+		_segmentHeadsCompute.u( 0 );
+		_segmentHeadsCompute.u( 1 );
+		_segmentHeadsCompute.bRootConstant32( 0, 6 );
+		_segmentHeadsCompute.loadShaderAndBuild( device, pr::GetDataPath( "scan_segmentHeads.cso" ).c_str() );
+
+		uint64_t nBlocks = std::max( blockCount( maxElements ), (uint64_t)1 );
+		DX_ASSERT( nBlocks <= D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION, "too many elements" );
+		_blockSums = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( device, sizeof( uint32_t ) * nBlocks, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+		_blockSums->setName( L"scanBlockSums" );
+
+		// a bit per element
+		_segmentHeads = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( device, nBlocks * SCAN_BLOCK_SIZE / 8, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+		_segmentHeads->setName( L"scanSegmentHeads" );
+	}
+
+	static uint64_t blockCount( uint64_t n )
+	{
+		return dispatchsize( n, SCAN_BLOCK_SIZE );
+	}
+
+	// records the scan of xs[0, n). scanType is SCAN_TYPE_*, scanOp is SCAN_OP_*
+	void scan( ID3D12GraphicsCommandList* commandList, ID3D12Device* device, StackDescriptorHeapObject* heap, BufferObjectUAV* xs, uint32_t n, uint32_t scanType, uint32_t scanOp, bool inclusive )
+	{
+		record( commandList, device, heap, xs, n, nullptr, 0, scanType, scanOp, inclusive );
+	}
+
+	/*
+		records the segmented scan of xs[0, n). A segment starts at each of segmentOffsets[0, segmentCount), ascending,
+		and the scan restarts from the identity there. The same as cpu::segmentedScan()
+	*/
+	void segmentedScan( ID3D12GraphicsCommandList* commandList, ID3D12Device* device, StackDescriptorHeapObject* heap, BufferObjectUAV* xs, uint32_t n, BufferObjectUAV* segmentOffsets, uint32_t segmentCount, uint32_t scanType, uint32_t scanOp, bool inclusive )
+	{
+		record( commandList, device, heap, xs, n, segmentOffsets, segmentCount, scanType, scanOp, inclusive );
+	}
+	void exclusiveScan( ID3D12GraphicsCommandList* commandList, ID3D12Device* device, StackDescriptorHeapObject* heap, BufferObjectUAV* xs, uint32_t n, uint32_t scanType = SCAN_TYPE_UINT, uint32_t scanOp = SCAN_OP_SUM )
+	{
+		scan( commandList, device, heap, xs, n, scanType, scanOp, false );
+	}
+	void inclusiveScan( ID3D12GraphicsCommandList* commandList, ID3D12Device* device, StackDescriptorHeapObject* heap, BufferObjectUAV* xs, uint32_t n, uint32_t scanType = SCAN_TYPE_UINT, uint32_t scanOp = SCAN_OP_SUM )
+	{
+		scan( commandList, device, heap, xs, n, scanType, scanOp, true );
+	}
+	void segmentedExclusiveScan( ID3D12GraphicsCommandList* commandList, ID3D12Device* device, StackDescriptorHeapObject* heap, BufferObjectUAV* xs, uint32_t n, BufferObjectUAV* segmentOffsets, uint32_t segmentCount, uint32_t scanType = SCAN_TYPE_UINT, uint32_t scanOp = SCAN_OP_SUM )
+	{
+		segmentedScan( commandList, device, heap, xs, n, segmentOffsets, segmentCount, scanType, scanOp, false );
+	}
+	void segmentedInclusiveScan( ID3D12GraphicsCommandList* commandList, ID3D12Device* device, StackDescriptorHeapObject* heap, BufferObjectUAV* xs, uint32_t n, BufferObjectUAV* segmentOffsets, uint32_t segmentCount, uint32_t scanType = SCAN_TYPE_UINT, uint32_t scanOp = SCAN_OP_SUM )
+	{
+		segmentedScan( commandList, device, heap, xs, n, segmentOffsets, segmentCount, scanType, scanOp, true );
+	}
+
+private:
+	// the root constants of scan_reduce.hlsl, scan_downsweep.hlsl and scan_segmentHeads.hlsl
+	struct ScanArgument
+	{
+		uint32_t scanCount;
+		uint32_t scanType;
+		uint32_t scanOp;
+		uint32_t inclusive;
+		uint32_t useBlockSums;
+		uint32_t segmentCount;
+	};
+
+	void record( ID3D12GraphicsCommandList* commandList, ID3D12Device* device, StackDescriptorHeapObject* heap, BufferObjectUAV* xs, uint32_t n, BufferObjectUAV* segmentOffsets, uint32_t segmentCount, uint32_t scanType, uint32_t scanOp, bool inclusive )
+	{
+		if ( n == 0 )
+		{
+			return;
+		}
+		uint32_t nBlocks = (uint32_t)blockCount( n );
+
+		// Segment heads
+		if ( segmentCount != 0 )
+		{
+			ScanArgument headsArg = {n, scanType, scanOp, 0, 0, segmentCount};
+			_segmentHeadsCompute.setPipelineState( commandList );
+			_segmentHeadsCompute.setComputeRootSignature( commandList );
+			heap->startNextHeapAndAssign( commandList, _segmentHeadsCompute.descriptorMap() );
+			heap->bRootConstant32( commandList, 0, 6, &headsArg );
+			heap->u( device, 0, segmentOffsets->resource(), segmentOffsets->UAVDescription() );
+			heap->u( device, 1, _segmentHeads->resource(), _segmentHeads->UAVDescription() );
+			_segmentHeadsCompute.dispatch( commandList, dispatchsize( nBlocks * ( SCAN_BLOCK_SIZE / 32 ), SCAN_THREADS ), 1, 1 );
+
+			resourceBarrier( commandList, {_segmentHeads->resourceBarrierUAV()} );
+		}
+
+		// Reduce
+		ScanArgument reduceArg = {n, scanType, scanOp, 0, 0, segmentCount};
+		_reduce.setPipelineState( commandList );
+		_reduce.setComputeRootSignature( commandList );
+		heap->startNextHeapAndAssign( commandList, _reduce.descriptorMap() );
+		heap->bRootConstant32( commandList, 0, 6, &reduceArg );
+		heap->u( device, 0, xs->resource(), xs->UAVDescription() );
+		heap->u( device, 1, _blockSums->resource(), _blockSums->UAVDescription() );
+		heap->u( device, 2, _segmentHeads->resource(), _segmentHeads->UAVDescription() );
+		_reduce.dispatch( commandList, nBlocks, 1, 1 );
+
+		resourceBarrier( commandList, {_blockSums->resourceBarrierUAV()} );
+
+		// Scan block sums
+		ScanArgument blockSumsArg = {nBlocks, scanType, scanOp, 0, 0, segmentCount};
+		_downsweep.setPipelineState( commandList );
+		_downsweep.setComputeRootSignature( commandList );
+		heap->startNextHeapAndAssign( commandList, _downsweep.descriptorMap() );
+		heap->bRootConstant32( commandList, 0, 6, &blockSumsArg );
+		heap->u( device, 0, _blockSums->resource(), _blockSums->UAVDescription() );
+		heap->u( device, 1, _blockSums->resource(), _blockSums->UAVDescription() );
+		heap->u( device, 2, _segmentHeads->resource(), _segmentHeads->UAVDescription() );
+		_downsweep.dispatch( commandList, 1, 1, 1 );
+
+		resourceBarrier( commandList, {_blockSums->resourceBarrierUAV()} );
+
+		// Downsweep
+		ScanArgument downsweepArg = {n, scanType, scanOp, inclusive ? 1u : 0u, 1, segmentCount};
+		_downsweep.setPipelineState( commandList );
+		_downsweep.setComputeRootSignature( commandList );
+		heap->startNextHeapAndAssign( commandList, _downsweep.descriptorMap() );
+		heap->bRootConstant32( commandList, 0, 6, &downsweepArg );
+		heap->u( device, 0, xs->resource(), xs->UAVDescription() );
+		heap->u( device, 1, _blockSums->resource(), _blockSums->UAVDescription() );
+		heap->u( device, 2, _segmentHeads->resource(), _segmentHeads->UAVDescription() );
+		_downsweep.dispatch( commandList, nBlocks, 1, 1 );
+
+		resourceBarrier( commandList, {xs->resourceBarrierUAV()} );
+	}
+
+	ComputeObject _reduce;
+	ComputeObject _downsweep;
+	ComputeObject _segmentHeadsCompute;
+	std::unique_ptr<BufferObjectUAV> _blockSums;
+	std::unique_ptr<BufferObjectUAV> _segmentHeads;
+};
@@ -22,6 +22,13 @@ struct BuildTask
     int parentNode;
     int childOrder;
 };
+/*
+ primitive types of a mixed bvh. The type is not stored per element;
+ primitive ids [0, triangleCount) are triangles and the rest are spheres.
+*/
+#define BVH_PRIMITIVE_TRIANGLE 0
+#define BVH_PRIMITIVE_SPHERE 1
+
 struct BvhElement 
 {
     int lower[3];
@@ -50,6 +57,27 @@ struct BvhNode
     uint indexR[2];
 };
 
+/*
+ output of bvh_traverse.hlsl, selected per dispatch by cb_outputMode
+*/
+#define BVH_OUTPUT_COLOR 0
+#define BVH_OUTPUT_GBUFFER 1
+
+/*
+ G-buffer texel, 16 bytes
+    depth        : t along the normalized primary ray. FLT_MAX when nothing is hit
+    normal       : geometric normal, octahedral encoded as 2 x 16 bit snorm
+    primID       : 0xFFFFFFFF when nothing is hit
+    barycentrics : u, v as 2 x 16 bit unorm. 0 for spheres
+*/
+struct GBufferTexel
+{
+    float depth;
+    uint normal;
+    uint primID;
+    uint barycentrics;
+};
+
 struct Bin {
     // bin AABB
     int lower[3];
@@ -14,9 +14,15 @@ uint numberOfElement(RWStructuredBuffer<BvhElement> xs)
 	return numStruct;
 }
 
+cbuffer BvhElementArgument : register(b0, space0)
+{
+	int triangleCount; // element [triangleCount, ) are spheres
+};
+
 RWStructuredBuffer<float3> vertexBuffer : register(u0);
 RWStructuredBuffer<uint> indexBuffer : register(u1);
 RWStructuredBuffer<BvhElement> bvhElements : register(u2);
+RWStructuredBuffer<float4> sphereBuffer : register(u3); // xyz: center, w: radius
 
 [numthreads(64, 1, 1)]
 void main( uint3 gID : SV_DispatchThreadID, uint3 localID: SV_GroupThreadID )
@@ -25,14 +31,27 @@ void main( uint3 gID : SV_DispatchThreadID, uint3 localID: SV_GroupThreadID )
 		return;
 	}
     uint iPrim = gID.x;
-    uint index = iPrim * 3;
-    float3 v0 = vertexBuffer[indexBuffer[index]];
-    float3 v1 = vertexBuffer[indexBuffer[index+1]];
-    float3 v2 = vertexBuffer[indexBuffer[index+2]];
+    float3 lower;
+    float3 upper;
+    float3 centeroid;
+    if(iPrim < triangleCount)
+    {
+        uint index = iPrim * 3;
+        float3 v0 = vertexBuffer[indexBuffer[index]];
+        float3 v1 = vertexBuffer[indexBuffer[index+1]];
+        float3 v2 = vertexBuffer[indexBuffer[index+2]];
 
-    float3 lower = min(min(v0, v1), v2);
-    float3 upper = max(max(v0, v1), v2);
-    float3 centeroid = (v0 + v1 + v2) / 3.0f;
+        lower = min(min(v0, v1), v2);
+        upper = max(max(v0, v1), v2);
+        centeroid = (v0 + v1 + v2) / 3.0f;
+    }
+    else
+    {
+        float4 sphere = sphereBuffer[iPrim - triangleCount];
+        lower = sphere.xyz - sphere.www;
+        upper = sphere.xyz + sphere.www;
+        centeroid = sphere.xyz;
+    }
 
     BvhElement e;
     e.lower[0] = to_ordered(lower.x);
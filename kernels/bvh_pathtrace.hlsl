@@ -0,0 +1,403 @@
+#include "helper.hlsl"
+#include "bvh.h"
+
+#define FLT_MAX         3.402823466e+38
+#define PI              3.14159265358979323846f
+
+cbuffer arguments : register(b0, space0)
+{
+	int cb_width;
+	int cb_height;
+	int cb_sampleIndex; // the number of samples since the last reset. 0 restarts accumulation
+	int cb_minSamples;
+	float4x4 cb_inverseVP;
+	float cb_threshold; // relative standard error of the luminance mean. <= 0 never stops
+	int cb_tileStop;    // 0: stop per pixel, 1: stop per tile ( thread group )
+	int cb_maxDepth;
+	int cb_triangleCount; // primitive ids [cb_triangleCount, ) are spheres
+};
+
+RWStructuredBuffer<uint> colorRGBXBuffer : register(u0);
+RWStructuredBuffer<float3> vertexBuffer : register(u1);
+RWStructuredBuffer<uint> indexBuffer : register(u2);
+
+RWStructuredBuffer<BvhNode> bvhNodes : register(u3);
+RWStructuredBuffer<uint> bvhElementIndices : register(u4);
+
+RWStructuredBuffer<float4> accumulationBuffer : register(u5); // rgb: sum of radiance, a: sample count
+RWStructuredBuffer<float> luminanceSqBuffer : register(u6);   // sum of luminance^2 for the variance estimate
+RWStructuredBuffer<uint> activePixelCounter : register(u7);   // pixels which took a sample in this dispatch
+RWStructuredBuffer<float4> sphereBuffer : register(u8);       // xyz: center, w: radius
+
+float3 homogeneous(float4 p)
+{
+	return float3(p.x, p.y, p.z) / p.w;
+}
+void shoot(out float3 ro, out float3 rd, int imageWidth, int imageHeight, float x, float y, float4x4 inverseVP)
+{
+	float xf = 2.0f * (x - (float)imageWidth * 0.5f) / (float)imageWidth;
+	float yf = -2.0f * (y - (float)imageHeight * 0.5f) / (float)imageHeight;
+	ro = homogeneous( mul( float4( xf, yf, -1.0f /*near*/, 1.0f ), inverseVP ) );
+	rd = homogeneous( mul( float4( xf, yf, +1.0f /*far */, 1.0f ), inverseVP ) ) - ro;
+	rd = normalize(rd);
+}
+
+// PCG hash
+uint pcg(inout uint state)
+{
+	state = state * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+float random01(inout uint state)
+{
+	return (float)(pcg(state) >> 8) / 16777216.0f;
+}
+
+/*
+    x  : intersected t. -1 is no-intersected
+    yzw: un-normalized normal
+*/
+float4 intersect_sphere(float3 ro, float3 rd, float3 o, float r)
+{
+	float A = dot(rd, rd);
+	float3 S = ro - o;
+	float3 SxRD = cross(S, rd);
+	float D = A * r * r - dot(SxRD, SxRD);
+
+	if (D < 0.0f) {
+		return float4(-1.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	float B = dot(S, rd);
+	float sqrt_d = sqrt(D);
+	float t0 = (-B - sqrt_d) / A;
+	if (0.0f < t0) {
+		return float4(t0, rd * t0 + S);
+	}
+
+	float t1 = (-B + sqrt_d) / A;
+	if (0.0f < t1) {
+		return float4(t1, rd * t1 + S);
+	}
+	return float4(-1.0f, 0.0f, 0.0f, 0.0f);
+}
+
+/*
+ tmin must be initialized.
+*/
+inline bool intersect_ray_triangle(float3 ro, float3 rd, float3 v0, float3 v1, float3 v2, inout float tmin, out float2 uv)
+{
+	const float kEpsilon = 1.0e-8;
+
+	float3 v0v1 = v1 - v0;
+	float3 v0v2 = v2 - v0;
+	float3 pvec = cross(rd, v0v2);
+	float det = dot(v0v1, pvec);
+
+	if (abs(det) < kEpsilon) {
+		return false;
+	}
+
+	float invDet = 1.0f / det;
+
+	float3 tvec = ro - v0;
+	float u = dot(tvec, pvec) * invDet;
+	if (u < 0.0f || u > 1.0f) {
+		return false;
+	}
+
+	float3 qvec = cross(tvec, v0v1);
+	float v = dot(rd, qvec) * invDet;
+	if (v < 0.0f || u + v > 1.0f) {
+		return false;
+	}
+
+	float t = dot(v0v2, qvec) * invDet;
+
+	if( t < 0.0f ) {
+		return false;
+	}
+	if( tmin < t) {
+		return false;
+	}
+	tmin = t;
+	uv = float2(u, v);
+	return true;
+}
+
+float compMin(float3 v){
+	return min(min(v.x, v.y), v.z);
+}
+float compMax(float3 v){
+	return max(max(v.x, v.y), v.z);
+}
+bool slabs(float3 p0, float3 p1, float3 ro, float3 one_over_rd, float knownT, out float hitT) {
+	float3 t0 = (p0 - ro) * one_over_rd;
+	float3 t1 = (p1 - ro) * one_over_rd;
+
+	float3 tmin = min(t0, t1), tmax = max(t0, t1);
+	float region_min = compMax(tmin);
+	float region_max = compMin(tmax);
+
+	region_max = min(region_max, knownT);
+	hitT = region_min;
+
+	return region_min <= region_max && 0.0f <= region_max;
+}
+
+void intersectLeaf(float3 ro, float3 rd, uint index0, uint index1, inout float tmin, inout int hitPrim)
+{
+	uint geomBeg = index0 & 0x7FFFFFFF;
+	uint geomEnd = index1 & 0x7FFFFFFF;
+	for(uint i = geomBeg ; i < geomEnd ; i++)
+	{
+		int iPrim = bvhElementIndices[i];
+		if(cb_triangleCount <= iPrim)
+		{
+			float4 sphere = sphereBuffer[iPrim - cb_triangleCount];
+			float4 s = intersect_sphere(ro, rd, sphere.xyz, sphere.w);
+			if(0.0f < s.x && s.x < tmin)
+			{
+				tmin = s.x;
+				hitPrim = iPrim;
+			}
+			continue;
+		}
+
+		int index = iPrim * 3;
+		float3 v0 = vertexBuffer[indexBuffer[index]];
+		float3 v1 = vertexBuffer[indexBuffer[index+1]];
+		float3 v2 = vertexBuffer[indexBuffer[index+2]];
+
+		float2 uv;
+		if(intersect_ray_triangle(ro, rd, v0, v1, v2, tmin, uv))
+		{
+			hitPrim = iPrim;
+		}
+	}
+}
+
+/*
+	closest hit. the same traversal as bvh_traverse.hlsl
+	returns -1 if no-intersected
+*/
+int closestHit(float3 ro, float3 rd, inout float tmin)
+{
+	int hitPrim = -1;
+	float3 one_over_rd = float3(1.0f, 1.0f, 1.0f) / rd;
+
+	uint stack[32];
+	uint stackcount = 1;
+	stack[0] = 0;
+	while(0 < stackcount)
+	{
+		uint node = stack[stackcount - 1];
+		stackcount--;
+
+		float3 lowerL = float3(bvhNodes[node].lowerL[0], bvhNodes[node].lowerL[1], bvhNodes[node].lowerL[2]);
+		float3 upperL = float3(bvhNodes[node].upperL[0], bvhNodes[node].upperL[1], bvhNodes[node].upperL[2]);
+		float3 lowerR = float3(bvhNodes[node].lowerR[0], bvhNodes[node].lowerR[1], bvhNodes[node].lowerR[2]);
+		float3 upperR = float3(bvhNodes[node].upperR[0], bvhNodes[node].upperR[1], bvhNodes[node].upperR[2]);
+
+		float hitTL;
+		float hitTR;
+		bool hitL = slabs(lowerL, upperL, ro, one_over_rd, tmin, hitTL);
+		bool hitR = slabs(lowerR, upperR, ro, one_over_rd, tmin, hitTR);
+		uint isLeafL = bvhNodes[node].indexL[0] & 0x80000000;
+		uint isLeafR = bvhNodes[node].indexR[0] & 0x80000000;
+
+		if( hitL && isLeafL )
+		{
+			intersectLeaf(ro, rd, bvhNodes[node].indexL[0], bvhNodes[node].indexL[1], tmin, hitPrim);
+		}
+		if( hitR && isLeafR )
+		{
+			intersectLeaf(ro, rd, bvhNodes[node].indexR[0], bvhNodes[node].indexR[1], tmin, hitPrim);
+		}
+
+		bool continueL = hitL && isLeafL == 0;
+		bool continueR = hitR && isLeafR == 0;
+		uint childL = bvhNodes[node].indexL[0];
+		uint childR = bvhNodes[node].indexR[0];
+
+		if(continueL && continueR) {
+			if(hitTL < hitTR) {
+				stack[stackcount++] = childR;
+				stack[stackcount++] = childL;
+			}
+			else
+			{
+				stack[stackcount++] = childL;
+				stack[stackcount++] = childR;
+			}
+		}
+		else if(continueL) {
+			stack[stackcount++] = childL;
+		}
+		else if(continueR) {
+			stack[stackcount++] = childR;
+		}
+	}
+	return hitPrim;
+}
+
+float3 sky(float3 rd)
+{
+	float k = 0.5f * (rd.y + 1.0f);
+	return lerp(float3(1.0f, 1.0f, 1.0f), float3(0.5f, 0.7f, 1.0f), k);
+}
+float luminance(float3 c)
+{
+	return dot(c, float3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// cosine weighted direction around n
+float3 sampleCosine(float3 n, inout uint state)
+{
+	float3 t = abs(n.x) < 0.9f ? float3(1.0f, 0.0f, 0.0f) : float3(0.0f, 1.0f, 0.0f);
+	float3 b = normalize(cross(n, t));
+	t = cross(b, n);
+
+	float r = sqrt(random01(state));
+	float theta = 2.0f * PI * random01(state);
+	float x = r * cos(theta);
+	float y = r * sin(theta);
+	float z = sqrt(max(1.0f - x * x - y * y, 0.0f));
+	return t * x + b * y + n * z;
+}
+
+/*
+	Every surface is a white-ish lambertian lit by the sky.
+	throughput is multiplied by albedo only because cosine / pdf cancel each other.
+*/
+float3 radiance(float3 ro, float3 rd, inout uint state)
+{
+	const float albedo = 0.75f;
+
+	float3 L = float3(0.0f, 0.0f, 0.0f);
+	float3 throughput = float3(1.0f, 1.0f, 1.0f);
+	for(int depth = 0 ; depth < cb_maxDepth ; ++depth)
+	{
+		float tmin = FLT_MAX;
+		int iPrim = closestHit(ro, rd, tmin);
+		if(iPrim < 0)
+		{
+			L += throughput * sky(rd);
+			break;
+		}
+
+		float3 n;
+		if(cb_triangleCount <= iPrim)
+		{
+			float4 sphere = sphereBuffer[iPrim - cb_triangleCount];
+			n = normalize(ro + rd * tmin - sphere.xyz);
+		}
+		else
+		{
+			int index = iPrim * 3;
+			float3 v0 = vertexBuffer[indexBuffer[index]];
+			float3 v1 = vertexBuffer[indexBuffer[index+1]];
+			float3 v2 = vertexBuffer[indexBuffer[index+2]];
+			n = normalize(-cross(v1 - v0, v2 - v0) /* index buffer stored as CW */);
+		}
+		if(0.0f < dot(n, rd))
+		{
+			n = -n;
+		}
+
+		throughput *= albedo;
+		ro = ro + rd * tmin + n * 1.0e-4f;
+		rd = sampleCosine(n, state);
+	}
+	return L;
+}
+
+bool isConverged(float4 acc, float lumSq)
+{
+	float n = acc.w;
+	if(cb_threshold <= 0.0f || n < (float)max(cb_minSamples, 2))
+	{
+		return false;
+	}
+	float mean = luminance(acc.xyz) / n;
+	float variance = max(lumSq / n - mean * mean, 0.0f) * n / (n - 1.0f);
+	float standardError = sqrt(variance / n);
+	return standardError <= cb_threshold * max(mean, 1.0e-3f);
+}
+
+groupshared uint s_activeInTile;
+
+#define NUM_THREAD 64
+[numthreads(NUM_THREAD, 1, 1)]
+void main( uint3 gID : SV_DispatchThreadID, uint3 localID: SV_GroupThreadID )
+{
+	uint nPixels = cb_width * cb_height;
+	bool inside = gID.x < nPixels;
+
+	float4 acc = float4(0.0f, 0.0f, 0.0f, 0.0f);
+	float lumSq = 0.0f;
+	if(inside && cb_sampleIndex != 0)
+	{
+		acc = accumulationBuffer[gID.x];
+		lumSq = luminanceSqBuffer[gID.x];
+	}
+
+	// the variance estimate decides whether this pixel still needs samples
+	bool needSample = inside && isConverged(acc, lumSq) == false;
+
+	if(cb_tileStop)
+	{
+		// a tile stops only when all pixels in the tile have converged
+		if(localID.x == 0)
+		{
+			s_activeInTile = 0;
+		}
+		GroupMemoryBarrierWithGroupSync();
+		if(needSample)
+		{
+			InterlockedAdd(s_activeInTile, 1);
+		}
+		GroupMemoryBarrierWithGroupSync();
+		needSample = inside && s_activeInTile != 0;
+	}
+
+	if(inside == false) {
+		return;
+	}
+
+	if(needSample)
+	{
+		int x = gID.x % cb_width;
+		int y = gID.x / cb_width;
+
+		uint state = gID.x * 9781u + (uint)cb_sampleIndex * 6271u;
+		pcg(state);
+
+		float3 ro;
+		float3 rd;
+		shoot(ro, rd, cb_width, cb_height, x + random01(state), y + random01(state), cb_inverseVP);
+
+		float3 L = radiance(ro, rd, state);
+		float lum = luminance(L);
+
+		acc += float4(L, 1.0f);
+		lumSq += lum * lum;
+		accumulationBuffer[gID.x] = acc;
+		luminanceSqBuffer[gID.x] = lumSq;
+
+		InterlockedAdd(activePixelCounter[0], 1);
+	}
+
+	float3 mean = acc.xyz / max(acc.w, 1.0f);
+	float4 color = float4(pow(mean, 1.0f / 2.2f), 1.0f);
+
+	int4 quantized = int4(color * 255.0f + float4(0.5f, 0.5f, 0.5f, 0.5f));
+	quantized = clamp( quantized, int4(0, 0, 0, 0), int4( 255, 255, 255, 255) );
+	uint value =
+		quantized.r       |
+		quantized.g << 8  |
+		quantized.b << 16 |
+		quantized.a << 24;
+	colorRGBXBuffer[gID.x] = value;
+}
@@ -7,7 +7,8 @@ cbuffer arguments : register(b0, space0)
 {
 	int cb_width;
 	int cb_height;
-	int cb_pad0; int cb_pad1;
+	int cb_triangleCount; // primitive ids [cb_triangleCount, ) are spheres
+	int cb_outputMode; // BVH_OUTPUT_COLOR or BVH_OUTPUT_GBUFFER
 	float4x4 cb_inverseVP;
 };
 
@@ -17,6 +18,8 @@ RWStructuredBuffer<uint> indexBuffer : register(u2);
 
 RWStructuredBuffer<BvhNode> bvhNodes : register(u3);
 RWStructuredBuffer<uint> bvhElementIndices : register(u4);
+RWStructuredBuffer<float4> sphereBuffer : register(u5); // xyz: center, w: radius
+RWStructuredBuffer<GBufferTexel> gbufferBuffer : register(u6);
 
 float3 homogeneous(float4 p)
 {
@@ -151,6 +154,60 @@ bool slabs(float3 p0, float3 p1, float3 ro, float3 one_over_rd, float knownT, ou
 	return region_min <= region_max && 0.0f <= region_max;
 }
 
+/*
+ the same encoding as cpu::encodeOctahedral()
+*/
+uint encodeOctahedral(float3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	float2 e = n.xy;
+	if(n.z < 0.0f)
+	{
+		e = (1.0f - abs(n.yx)) * float2(0.0f <= n.x ? 1.0f : -1.0f, 0.0f <= n.y ? 1.0f : -1.0f);
+	}
+	int2 q = int2(round(clamp(e, -1.0f, 1.0f) * 32767.0f));
+	return (uint(q.x) & 0xFFFF) | (uint(q.y) << 16);
+}
+uint packBarycentrics(float2 uv)
+{
+	uint2 q = uint2(round(saturate(uv) * 65535.0f));
+	return q.x | (q.y << 16);
+}
+
+/*
+ triangle or sphere. isect, hitPrim and hitUV are updated if it is closer than tmin
+*/
+void intersectPrimitive(float3 ro, float3 rd, int iPrim, inout float tmin, inout float4 isect, inout uint hitPrim, inout float2 hitUV)
+{
+	if(cb_triangleCount <= iPrim)
+	{
+		float4 sphere = sphereBuffer[iPrim - cb_triangleCount];
+		float4 s = intersect_sphere(ro, rd, sphere.xyz, sphere.w);
+		if(0.0f < s.x && s.x < tmin)
+		{
+			tmin = s.x;
+			isect = s;
+			hitPrim = iPrim;
+			hitUV = float2(0.0f, 0.0f);
+		}
+		return;
+	}
+
+	int index = iPrim * 3;
+	float3 v0 = vertexBuffer[indexBuffer[index]];
+	float3 v1 = vertexBuffer[indexBuffer[index+1]];
+	float3 v2 = vertexBuffer[indexBuffer[index+2]];
+
+	float2 uv;
+	if(intersect_ray_triangle(ro, rd, v0, v1, v2, tmin, uv))
+	{
+		float3 n = cross(v1 - v0, v2 - v0);
+		isect = float4(tmin, -n /* index buffer stored as CW */);
+		hitPrim = iPrim;
+		hitUV = uv;
+	}
+}
+
 #define NUM_THREAD 64
 [numthreads(NUM_THREAD, 1, 1)]
 void main( uint3 gID : SV_DispatchThreadID, uint3 localID: SV_GroupThreadID )
@@ -169,7 +226,8 @@ void main( uint3 gID : SV_DispatchThreadID, uint3 localID: SV_GroupThreadID )
 	int primCount = indexCount / 3;
 
 	float tmin = isect.x < 0.0f ? FLT_MAX : isect.x;
-	float2 uv;
+	uint hitPrim = 0xFFFFFFFF;
+	float2 hitUV = float2(0.0f, 0.0f);
 
 	float3 one_over_rd = float3(1.0f, 1.0f, 1.0f) / rd;
 
@@ -200,16 +258,7 @@ void main( uint3 gID : SV_DispatchThreadID, uint3 localID: SV_GroupThreadID )
 			for(int i = geomBeg ; i < geomEnd ; i++)
 			{
 				int iPrim = bvhElementIndices[i];
-				int index = iPrim * 3;
-				float3 v0 = vertexBuffer[indexBuffer[index]];
-				float3 v1 = vertexBuffer[indexBuffer[index+1]];
-				float3 v2 = vertexBuffer[indexBuffer[index+2]];
-
-				if(intersect_ray_triangle(ro, rd, v0, v1, v2, tmin, uv))
-				{
-					float3 n = cross(v1 - v0, v2 - v0);
-					isect = float4(tmin, -n /* index buffer stored as CW */);
-				}
+				intersectPrimitive(ro, rd, iPrim, tmin, isect, hitPrim, hitUV);
 			}
 		}
 		if( hitR && isLeafR )
@@ -219,16 +268,7 @@ void main( uint3 gID : SV_DispatchThreadID, uint3 localID: SV_GroupThreadID )
 			for(int i = geomBeg ; i < geomEnd ; i++)
 			{
 				int iPrim = bvhElementIndices[i];
-				int index = iPrim * 3;
-				float3 v0 = vertexBuffer[indexBuffer[index]];
-				float3 v1 = vertexBuffer[indexBuffer[index+1]];
-				float3 v2 = vertexBuffer[indexBuffer[index+2]];
-
-				if(intersect_ray_triangle(ro, rd, v0, v1, v2, tmin, uv))
-				{
-					float3 n = cross(v1 - v0, v2 - v0);
-					isect = float4(tmin, -n /* index buffer stored as CW */);
-				}
+				intersectPrimitive(ro, rd, iPrim, tmin, isect, hitPrim, hitUV);
 			}
 		}
 		
@@ -306,6 +346,20 @@ void main( uint3 gID : SV_DispatchThreadID, uint3 localID: SV_GroupThreadID )
 		// }
 	}
 
+	if(cb_outputMode == BVH_OUTPUT_GBUFFER)
+	{
+		if(cb_width * cb_height <= gID.x) {
+			return;
+		}
+		GBufferTexel texel;
+		texel.depth = 0.0f < isect.x ? isect.x : FLT_MAX;
+		texel.normal = 0.0f < isect.x ? encodeOctahedral(normalize(isect.yzw)) : 0;
+		texel.primID = hitPrim;
+		texel.barycentrics = packBarycentrics(hitUV);
+		gbufferBuffer[gID.x] = texel;
+		return;
+	}
+
 	if(numberOfElement(colorRGBXBuffer) <= gID.x) {
 		return;
 	}
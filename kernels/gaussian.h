@@ -0,0 +1,13 @@
+#ifndef __GAUSSIAN_H__
+#define __GAUSSIAN_H__
+
+/*
+ gaussian_fused_h.hlsl and gaussian_fused_v.hlsl, the pipeline of main_gaussian.cpp in 2 passes, degamma -> horizontal and vertical -> gamma.
+ The image between them is RGBA of half floats in a uint2, 8 bytes a pixel.
+ A group of gaussian_fused_h.hlsl blurs GAUSSIAN_FUSED_THREADS pixels of a row from the degammaed pixels and their halo in groupshared memory,
+ which holds a kernel up to GAUSSIAN_FUSED_MAX_RADIUS
+*/
+#define GAUSSIAN_FUSED_THREADS 64
+#define GAUSSIAN_FUSED_MAX_RADIUS 512
+
+#endif
@@ -12,27 +12,51 @@ cbuffer arguments : register(b0, space0)
 	int sample_dy;
 };
 
+float4 fetch(int x, int y)
+{
+	int sx = clamp(x, 0, width - 1);
+	int sy = clamp(y, 0, height - 1);
+	return src[sy * width + sx];
+}
+
+// 2 neighboring pixels along ( sample_dx, sample_dy ) a thread. The tap i of the first is the tap i - 1 of the second,
+// so a tap is read once for both, and the symmetric taps are added before the weight, ( a + b ) * w
 [numthreads(64, 1, 1)]
 void main(uint3 gID : SV_DispatchThreadID)
 {
-	if(numberOfElement(src) <= gID.x)
+	int pairsX = sample_dx ? (width + 1) / 2 : width;
+	int pairsY = sample_dy ? (height + 1) / 2 : height;
+	if(pairsX * pairsY <= (int)gID.x)
 	{
 		return;
 	}
 
-	uint x = gID.x % width;
-	uint y = gID.x / width;
+	int x = (gID.x % pairsX) * (1 + sample_dx);
+	int y = (gID.x / pairsX) * (1 + sample_dy);
 
 	int kn = numberOfElement(kernel);
-	     
-	float4 value = float4(0.0f, 0.0f, 0.0f, 0.0f);
-	for(int i = -kn + 1 ; i < kn ; ++i)
+
+	// left is the pixel before the second and right the one after the first, as the taps move out
+	float4 left = fetch(x, y);
+	float4 right = fetch(x + sample_dx, y + sample_dy);
+	float4 value0 = kernel[0] * left;
+	float4 value1 = kernel[0] * right;
+	for(int i = 1 ; i < kn ; ++i)
 	{
-		float w = kernel[abs(i)];
+		float w = kernel[i];
+		float4 l = fetch(x - sample_dx * i, y - sample_dy * i);
+		float4 r = fetch(x + sample_dx * (i + 1), y + sample_dy * (i + 1));
+		value0 += w * (l + right);
+		value1 += w * (left + r);
+		left = l;
+		right = r;
+	}
+	dst[y * width + x] = value0;
 
-		int sx = clamp(x + sample_dx * i, 0, width - 1);
-		int sy = clamp(y + sample_dy * i, 0, height - 1);
-		value += w * src[sy * width + sx];
+	int x1 = x + sample_dx;
+	int y1 = y + sample_dy;
+	if(x1 < width && y1 < height)
+	{
+		dst[y1 * width + x1] = value1;
 	}
-	dst[gID.x] = value;
 }
@@ -0,0 +1,71 @@
+#include "helper.hlsl"
+#include "gaussian.h"
+
+RWStructuredBuffer<uint> src : register(u0);
+RWStructuredBuffer<uint2> dst : register(u1);
+RWStructuredBuffer<float> kernel : register(u2);
+
+cbuffer arguments : register(b0, space0)
+{
+	int width;
+	int height;
+	int sample_dx;
+	int sample_dy;
+};
+
+groupshared float4 pixels[GAUSSIAN_FUSED_THREADS + GAUSSIAN_FUSED_MAX_RADIUS * 2];
+
+// gaussian_degamma.hlsl
+float4 degamma(uint value)
+{
+	uint r = (value & 0x000000FF);
+	uint g = (value & 0x0000FF00) >> 8;
+	uint b = (value & 0x00FF0000) >> 16;
+	uint a = (value & 0xFF000000) >> 24;
+	return float4(
+		pow( (float)r / 255.0f, 2.2f ),
+		pow( (float)g / 255.0f, 2.2f ),
+		pow( (float)b / 255.0f, 2.2f ),
+		(float)a / 255.0f
+	);
+}
+
+uint2 packHalf(float4 value)
+{
+	return uint2(
+		f32tof16(value.x) | (f32tof16(value.y) << 16),
+		f32tof16(value.z) | (f32tof16(value.w) << 16)
+	);
+}
+
+// a group per GAUSSIAN_FUSED_THREADS pixels of a row, ( dispatchsize( width, GAUSSIAN_FUSED_THREADS ), height ) groups
+[numthreads(GAUSSIAN_FUSED_THREADS, 1, 1)]
+void main(uint3 groupID : SV_GroupID, uint3 localID : SV_GroupThreadID)
+{
+	int kn = numberOfElement(kernel);
+	int radius = kn - 1;
+	int x0 = groupID.x * GAUSSIAN_FUSED_THREADS;
+	int y = groupID.y;
+
+	// each pixel under the kernels of the group is degammaed once
+	for(int i = localID.x ; i < GAUSSIAN_FUSED_THREADS + radius * 2 ; i += GAUSSIAN_FUSED_THREADS)
+	{
+		int sx = clamp(x0 - radius + i, 0, width - 1);
+		pixels[i] = degamma(src[y * width + sx]);
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	int x = x0 + localID.x;
+	if(width <= x)
+	{
+		return;
+	}
+
+	int center = localID.x + radius;
+	float4 value = kernel[0] * pixels[center];
+	for(int j = 1 ; j < kn ; ++j)
+	{
+		value += kernel[j] * (pixels[center - j] + pixels[center + j]);
+	}
+	dst[y * width + x] = packHalf(value);
+}
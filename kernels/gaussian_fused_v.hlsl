@@ -0,0 +1,65 @@
+#include "helper.hlsl"
+#include "gaussian.h"
+
+RWStructuredBuffer<uint2> src : register(u0);
+RWStructuredBuffer<uint> dst : register(u1);
+RWStructuredBuffer<float> kernel : register(u2);
+
+cbuffer arguments : register(b0, space0)
+{
+	int width;
+	int height;
+	int sample_dx;
+	int sample_dy;
+};
+
+float4 unpackHalf(uint2 value)
+{
+	return float4(
+		f16tof32(value.x),
+		f16tof32(value.x >> 16),
+		f16tof32(value.y),
+		f16tof32(value.y >> 16)
+	);
+}
+
+// gaussian_gamma.hlsl
+uint gamma(float4 color)
+{
+	float4 appliedGamma = float4(
+		pow( (float)color.r, 1.0f / 2.2f ),
+		pow( (float)color.g, 1.0f / 2.2f ),
+		pow( (float)color.b, 1.0f / 2.2f ),
+		color.a
+	);
+	int4 quantized = int4(appliedGamma * 255.0f + float4(0.5f, 0.5f, 0.5f, 0.5f));
+	quantized = clamp( quantized, int4( 0, 0, 0, 0), int4( 255, 255, 255, 255) );
+	return
+		quantized.r       |
+		quantized.g << 8  |
+		quantized.b << 16 |
+		quantized.a << 24;
+}
+
+// the neighboring threads read the neighboring pixels of the rows under the kernel
+[numthreads(GAUSSIAN_FUSED_THREADS, 1, 1)]
+void main(uint3 gID : SV_DispatchThreadID)
+{
+	if(numberOfElement(dst) <= gID.x)
+	{
+		return;
+	}
+
+	int x = gID.x % width;
+	int y = gID.x / width;
+
+	int kn = numberOfElement(kernel);
+	float4 value = kernel[0] * unpackHalf(src[gID.x]);
+	for(int i = 1 ; i < kn ; ++i)
+	{
+		int up = max(y - i, 0);
+		int down = min(y + i, height - 1);
+		value += kernel[i] * (unpackHalf(src[up * width + x]) + unpackHalf(src[down * width + x]));
+	}
+	dst[gID.x] = gamma(value);
+}
@@ -0,0 +1,81 @@
+#include "helper.hlsl"
+
+RWStructuredBuffer<float4> src : register(u0);
+RWStructuredBuffer<float4> dst : register(u1);
+
+// cpu::RecursiveGaussian. ( re, im ) of the 2 poles in xy and zw
+cbuffer arguments : register(b0, space0)
+{
+	int width;
+	int height;
+	int sample_dx;
+	int sample_dy;
+	float4 pole;
+	float4 weight;
+	float4 causalEdge;
+	float4 anticausalEdge;
+};
+
+// s = p s, in place
+void rotate(float2 p, inout float4 re, inout float4 im)
+{
+	float4 r = p.x * re - p.y * im;
+	im = p.x * im + p.y * re;
+	re = r;
+}
+
+float4 output(float4 re0, float4 im0, float4 re1, float4 im1)
+{
+	return weight.x * re0 - weight.y * im0 + weight.z * re1 - weight.w * im1;
+}
+
+// a row ( sample_dx, sample_dy ) = ( 1, 0 ) or a column ( 0, 1 ) a thread. The cost of a pixel doesn't depend on sigma
+[numthreads(64, 1, 1)]
+void main(uint3 gID : SV_DispatchThreadID)
+{
+	int n = sample_dx ? width : height;
+	int lines = sample_dx ? height : width;
+	if(lines <= (int)gID.x)
+	{
+		return;
+	}
+
+	// neighboring threads of the vertical pass read neighboring pixels
+	int head = sample_dx ? gID.x * width : gID.x;
+	int stride = sample_dx ? 1 : width;
+
+	// causal
+	float4 edge = src[head];
+	float4 re0 = causalEdge.x * edge;
+	float4 im0 = causalEdge.y * edge;
+	float4 re1 = causalEdge.z * edge;
+	float4 im1 = causalEdge.w * edge;
+	for(int i = 0 ; i < n ; ++i)
+	{
+		int index = head + i * stride;
+		float4 x = src[index];
+		rotate(pole.xy, re0, im0);
+		rotate(pole.zw, re1, im1);
+		re0 += x;
+		re1 += x;
+		dst[index] = output(re0, im0, re1, im1);
+	}
+
+	// anticausal
+	edge = src[head + (n - 1) * stride];
+	re0 = anticausalEdge.x * edge;
+	im0 = anticausalEdge.y * edge;
+	re1 = anticausalEdge.z * edge;
+	im1 = anticausalEdge.w * edge;
+	for(int j = n - 1 ; 0 <= j ; --j)
+	{
+		int index = head + j * stride;
+		dst[index] += output(re0, im0, re1, im1);
+
+		float4 x = src[index];
+		re0 += x;
+		re1 += x;
+		rotate(pole.xy, re0, im0);
+		rotate(pole.zw, re1, im1);
+	}
+}
@@ -1,6 +1,8 @@
 #ifndef __HELPER__
 #define __HELPER__
 
+#include "scan.h"
+
 uint numberOfElement(RWStructuredBuffer<uint> xs)
 {
 	uint numStruct;
@@ -39,4 +41,50 @@ float from_ordered(int ordered) {
 	return asfloat(ordered);
 }
 
+// identity and operator of scan_reduce.hlsl and scan_downsweep.hlsl. Every element type is stored as uint
+uint scanIdentity(uint scanType, uint scanOp)
+{
+	if(scanOp == SCAN_OP_MAX)
+	{
+		if(scanType == SCAN_TYPE_INT)
+		{
+			return 0x80000000; // INT_MIN
+		}
+		if(scanType == SCAN_TYPE_FLOAT)
+		{
+			return 0xFF800000; // -inf
+		}
+		return 0;
+	}
+	if(scanOp == SCAN_OP_MIN)
+	{
+		if(scanType == SCAN_TYPE_INT)
+		{
+			return 0x7FFFFFFF; // INT_MAX
+		}
+		if(scanType == SCAN_TYPE_FLOAT)
+		{
+			return 0x7F800000; // +inf
+		}
+		return 0xFFFFFFFF;
+	}
+	return 0; // 0 and 0.0f
+}
+uint scanCombine(uint a, uint b, uint scanType, uint scanOp)
+{
+	if(scanType == SCAN_TYPE_FLOAT)
+	{
+		float x = asfloat(a);
+		float y = asfloat(b);
+		return asuint(scanOp == SCAN_OP_SUM ? x + y : (scanOp == SCAN_OP_MAX ? max(x, y) : min(x, y)));
+	}
+	if(scanType == SCAN_TYPE_INT)
+	{
+		int x = asint(a);
+		int y = asint(b);
+		return asuint(scanOp == SCAN_OP_SUM ? x + y : (scanOp == SCAN_OP_MAX ? max(x, y) : min(x, y)));
+	}
+	return scanOp == SCAN_OP_SUM ? a + b : (scanOp == SCAN_OP_MAX ? max(a, b) : min(a, b));
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "helper.hlsl"
+#include "radixsort.h"
+
+/*
+ after the last radixselect_pick.hlsl, the prefix of state is the k-th key.
+ Writes the rank + 1 smallest keys and their indices to outKeys and outIndices, in no particular order:
+ the keys below the k-th from 0, and then the keys equal to it as many as the rank in state allows.
+ Which of the equal keys are taken is up to the order of the atomics
+*/
+cbuffer RadixSelectArgument : register(b0, space0)
+{
+	uint numberOfKey;
+	uint keyType;
+	uint shift;
+	uint rank; // the 0 based rank of the key to select
+};
+
+RWStructuredBuffer<uint> xs : register(u0); // keys
+RWStructuredBuffer<uint> state : register(u1);
+RWStructuredBuffer<uint> outKeys : register(u2);
+RWStructuredBuffer<uint> outIndices : register(u3);
+
+[numthreads(RADIX_SELECT_THREADS, 1, 1)]
+void main(uint3 blockIndex : SV_GroupID, uint3 localID : SV_GroupThreadID)
+{
+	uint2 kth = uint2(state[RADIX_SELECT_STATE_PREFIX_LO], state[RADIX_SELECT_STATE_PREFIX_HI]);
+	uint ties = state[RADIX_SELECT_STATE_RANK] + 1;
+	uint nLess = rank + 1 - ties;
+
+	for(uint i = 0 ; i < RADIX_SELECT_ELEMENTS_PER_THREAD ; ++i)
+	{
+		uint index = blockIndex.x * RADIX_SELECT_BLOCK_SIZE + i * RADIX_SELECT_THREADS + localID.x;
+		if(numberOfKey <= index)
+		{
+			break;
+		}
+		uint2 bits = getSortBits(xs, keyType, index);
+		bool less = bits.y < kth.y || (bits.y == kth.y && bits.x < kth.x);
+		bool equal = all(bits == kth);
+		if(!less && !equal)
+		{
+			continue;
+		}
+
+		uint slot;
+		if(less)
+		{
+			InterlockedAdd(state[RADIX_SELECT_STATE_LESS_COUNTER], 1, slot);
+		}
+		else
+		{
+			uint tie;
+			InterlockedAdd(state[RADIX_SELECT_STATE_TIE_COUNTER], 1, tie);
+			if(ties <= tie)
+			{
+				continue;
+			}
+			slot = nLess + tie;
+		}
+
+		if(keyType == RADIX_KEY_UINT64)
+		{
+			outKeys[slot * 2] = xs[index * 2];
+			outKeys[slot * 2 + 1] = xs[index * 2 + 1];
+		}
+		else
+		{
+			outKeys[slot] = xs[index];
+		}
+		outIndices[slot] = index;
+	}
+}
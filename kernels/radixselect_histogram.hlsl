@@ -0,0 +1,52 @@
+#include "helper.hlsl"
+#include "radixsort.h"
+
+/*
+ the histogram of the digit at shift over the keys that have the prefix of state.
+ histogram is cleared by radixselect_pick.hlsl
+*/
+cbuffer RadixSelectArgument : register(b0, space0)
+{
+	uint numberOfKey;
+	uint keyType;
+	uint shift; // the lowest bit of the 8 bit digit
+	uint rank;	// the 0 based rank of the key to select
+};
+
+RWStructuredBuffer<uint> xs : register(u0); // keys
+RWStructuredBuffer<uint> histogram : register(u1);
+RWStructuredBuffer<uint> state : register(u2);
+
+groupshared uint groupCounters[RADIX_DIGITS];
+
+[numthreads(RADIX_SELECT_THREADS, 1, 1)]
+void main(uint3 blockIndex : SV_GroupID, uint3 localID : SV_GroupThreadID)
+{
+	groupCounters[localID.x] = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	uint2 prefix = uint2(state[RADIX_SELECT_STATE_PREFIX_LO], state[RADIX_SELECT_STATE_PREFIX_HI]);
+	uint2 prefixMask = uint2(state[RADIX_SELECT_STATE_MASK_LO], state[RADIX_SELECT_STATE_MASK_HI]);
+	for(uint i = 0 ; i < RADIX_SELECT_ELEMENTS_PER_THREAD ; ++i)
+	{
+		uint index = blockIndex.x * RADIX_SELECT_BLOCK_SIZE + i * RADIX_SELECT_THREADS + localID.x;
+		if(numberOfKey <= index)
+		{
+			break;
+		}
+		uint2 bits = getSortBits(xs, keyType, index);
+		if(all((bits & prefixMask) == prefix))
+		{
+			uint digit = radixDigit(bits.x, bits.y, shift, 0xFF);
+			InterlockedAdd(groupCounters[digit], 1);
+		}
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	uint count = groupCounters[localID.x];
+	if(count != 0)
+	{
+		InterlockedAdd(histogram[localID.x], count);
+	}
+}
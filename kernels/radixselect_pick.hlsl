@@ -0,0 +1,63 @@
+#include "helper.hlsl"
+#include "radixsort.h"
+
+/*
+ a single group. Finds the digit of the k-th key in histogram, appends it to the prefix of state and clears histogram
+*/
+cbuffer RadixSelectArgument : register(b0, space0)
+{
+	uint numberOfKey;
+	uint keyType;
+	uint shift; // the lowest bit of the 8 bit digit
+	uint rank;	// the 0 based rank of the key to select
+};
+
+RWStructuredBuffer<uint> histogram : register(u0);
+RWStructuredBuffer<uint> state : register(u1);
+
+groupshared uint counts[RADIX_DIGITS];
+
+[numthreads(RADIX_DIGITS, 1, 1)]
+void main(uint3 localID : SV_GroupThreadID)
+{
+	uint digit = localID.x;
+
+	// read state before a thread writes it
+	uint2 prefixMask = uint2(state[RADIX_SELECT_STATE_MASK_LO], state[RADIX_SELECT_STATE_MASK_HI]);
+	uint remaining = all(prefixMask == 0) ? rank : state[RADIX_SELECT_STATE_RANK];
+
+	uint count = histogram[digit];
+	histogram[digit] = 0;
+	counts[digit] = count;
+	GroupMemoryBarrierWithGroupSync();
+
+	// inclusive scan
+	for(uint offset = 1 ; offset < RADIX_DIGITS ; offset *= 2)
+	{
+		uint s = offset <= digit ? counts[digit - offset] : 0;
+		GroupMemoryBarrierWithGroupSync();
+		counts[digit] += s;
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	uint below = counts[digit] - count;
+	if(below <= remaining && remaining < counts[digit])
+	{
+		uint2 prefix = uint2(state[RADIX_SELECT_STATE_PREFIX_LO], state[RADIX_SELECT_STATE_PREFIX_HI]);
+		if(shift < 32)
+		{
+			prefix.x |= digit << shift;
+			prefixMask.x |= 0xFFu << shift;
+		}
+		else
+		{
+			prefix.y |= digit << (shift - 32);
+			prefixMask.y |= 0xFFu << (shift - 32);
+		}
+		state[RADIX_SELECT_STATE_PREFIX_LO] = prefix.x;
+		state[RADIX_SELECT_STATE_PREFIX_HI] = prefix.y;
+		state[RADIX_SELECT_STATE_MASK_LO] = prefixMask.x;
+		state[RADIX_SELECT_STATE_MASK_HI] = prefixMask.y;
+		state[RADIX_SELECT_STATE_RANK] = remaining - below;
+	}
+}
@@ -0,0 +1,90 @@
+#ifndef __RADIXSORT_H__
+#define __RADIXSORT_H__
+
+/*
+ key types of radixsort_count.hlsl and radixsort_reorder.hlsl
+ RADIX_KEY_FLOAT32 is sorted in the order of to_ordered() without rewriting the keys.
+ RADIX_KEY_UINT64 stores 2 uints per key, ( lower 32 bit, upper 32 bit ), and takes 8 iterations.
+*/
+#define RADIX_KEY_UINT32 0
+#define RADIX_KEY_FLOAT32 1
+#define RADIX_KEY_UINT64 2
+
+#if defined(_MSC_VER)
+#include <stdint.h>
+using uint = uint32_t;
+#endif
+
+/*
+ the sort order of the keys, shared by the kernels and cpu::RadixReorderEmulation.
+ radixSortWord() : a word of a key as a uint in the sort order. RADIX_KEY_FLOAT32 is to_ordered() with the sign bit flipped, the others are as they are
+ radixDigit()    : the digit at shift of the key ( lower 32 bit, upper 32 bit ) in the sort order. A digit can cross the 2 words
+*/
+inline uint radixSortWord(uint keyType, uint word)
+{
+	if(keyType != RADIX_KEY_FLOAT32)
+	{
+		return word;
+	}
+	uint x = word & 0x7FFFFFFF;
+	return ((word & 0x80000000) ? 0u - x : x) ^ 0x80000000;
+}
+inline uint radixDigit(uint lo, uint hi, uint shift, uint digitMask)
+{
+	uint digit;
+	if(shift < 32)
+	{
+		digit = lo >> shift;
+		if(shift != 0)
+		{
+			digit |= hi << (32 - shift);
+		}
+	}
+	else
+	{
+		digit = hi >> (shift - 32);
+	}
+	return digit & digitMask;
+}
+
+#if !defined(__cplusplus)
+// the key at index of keys in the sort order, ( lower 32 bit, upper 32 bit ). RADIX_KEY_UINT64 has 2 words per key
+uint2 getSortBits(RWStructuredBuffer<uint> keys, uint keyType, uint index)
+{
+	if(keyType == RADIX_KEY_UINT64)
+	{
+		return uint2(keys[index * 2], keys[index * 2 + 1]);
+	}
+	return uint2(radixSortWord(keyType, keys[index]), 0);
+}
+#endif
+
+/*
+ radixsort_reorder.hlsl ranks a tile of RADIX_REORDER_THREADS keys at once, a thread per key.
+ Digits are up to 8 bit, and a digit has a bit per thread of the tile in RADIX_REORDER_MASK_WORDS words
+*/
+#define RADIX_REORDER_THREADS 256
+#define RADIX_DIGITS 256
+#define RADIX_REORDER_MASK_WORDS ( RADIX_REORDER_THREADS / 32 )
+
+/*
+ radixselect_*.hlsl. 8 bit digits from the highest, a group per RADIX_SELECT_BLOCK_SIZE keys.
+ The selection so far is RADIX_SELECT_STATE_WORDS uints:
+   PREFIX_LO, PREFIX_HI : the digits of the k-th key found so far, in the sort order of getSortBits()
+   MASK_LO, MASK_HI     : the bits of the prefix. Both 0 before the first pass
+   RANK                 : the rank of the k-th key among the keys with the prefix
+   LESS_COUNTER, TIE_COUNTER : the atomic counters of radixselect_gather.hlsl
+*/
+#define RADIX_SELECT_THREADS 256
+#define RADIX_SELECT_ELEMENTS_PER_THREAD 16
+#define RADIX_SELECT_BLOCK_SIZE ( RADIX_SELECT_THREADS * RADIX_SELECT_ELEMENTS_PER_THREAD )
+#define RADIX_SELECT_STATE_PREFIX_LO 0
+#define RADIX_SELECT_STATE_PREFIX_HI 1
+#define RADIX_SELECT_STATE_MASK_LO 2
+#define RADIX_SELECT_STATE_MASK_HI 3
+#define RADIX_SELECT_STATE_RANK 4
+#define RADIX_SELECT_STATE_LESS_COUNTER 5
+#define RADIX_SELECT_STATE_TIE_COUNTER 6
+#define RADIX_SELECT_STATE_WORDS 8
+
+#endif
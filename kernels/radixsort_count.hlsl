@@ -1,23 +1,27 @@
 #include "helper.hlsl"
+#include "radixsort.h"
 
 #define ELEMENTS_IN_BLOCK 512
 
-// 4 stages, uint = [8 bit] [8 bit] [8 bit] [8 bit]
+// digits are up to 8 bit ( the width and the passes come from cpu::planRadixPasses() )
 // so buckets wants 256 counters
 cbuffer arguments : register(b0, space0)
 {
 	uint numberOfBlock;
 	uint elementsInBlock;
-	uint iteration; // 0, 1, 2, 3
+	uint shift; // the lowest bit of the digit
+	uint keyType;
+	uint hasValues; // move values with keys
+	uint digitMask;
 };
 
-RWStructuredBuffer<uint> xs : register(u0);
+RWStructuredBuffer<uint> xs : register(u0); // keys
 RWStructuredBuffer<uint> counter : register(u1);
 
-uint getSortKey(uint x)
+uint numberOfKey()
 {
-	uint m = x & (0xFF << (8 * iteration));
-	return m >> (8 * iteration);
+	uint n = numberOfElement(xs);
+	return keyType == RADIX_KEY_UINT64 ? n / 2 : n;
 }
 
 groupshared uint groupCounters[256];
@@ -31,7 +35,7 @@ void main(uint3 gID : SV_DispatchThreadID, uint3 blockIndexSV: SV_GroupID, uint3
 	}
 	GroupMemoryBarrierWithGroupSync();
 
-	if(gID.x < numberOfElement(xs))
+	if(gID.x < numberOfKey())
 	{
 		/*
 		column major store
@@ -42,7 +46,8 @@ void main(uint3 gID : SV_DispatchThreadID, uint3 blockIndexSV: SV_GroupID, uint3
 		v
 		blocks ( numberOfBlock )
 		*/
-		uint value = getSortKey(xs[gID.x]);
+		uint2 bits = getSortBits(xs, keyType, gID.x);
+		uint value = radixDigit(bits.x, bits.y, shift, digitMask);
 		uint o;
 		InterlockedAdd(groupCounters[value], 1, o);
 	}
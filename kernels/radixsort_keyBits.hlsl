@@ -0,0 +1,37 @@
+#include "helper.hlsl"
+#include "radixsort.h"
+
+// OR and AND of all keys. The bits that differ between the two are the ones the sort needs passes for
+cbuffer arguments : register(b0, space0)
+{
+	uint keyType;
+};
+
+RWStructuredBuffer<uint> xs : register(u0);
+RWStructuredBuffer<uint> keyBits : register(u1); // OR lower, AND lower, OR upper, AND upper. Cleared to 0, 0xFFFFFFFF, 0, 0xFFFFFFFF
+
+uint numberOfKey()
+{
+	uint n = numberOfElement(xs);
+	return keyType == RADIX_KEY_UINT64 ? n / 2 : n;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 gID : SV_DispatchThreadID)
+{
+	if(numberOfKey() <= gID.x)
+	{
+		return;
+	}
+
+	uint2 x = getSortBits(xs, keyType, gID.x);
+	uint2 o = WaveActiveBitOr(x);
+	uint2 a = WaveActiveBitAnd(x);
+	if(WaveIsFirstLane())
+	{
+		InterlockedOr(keyBits[0], o.x);
+		InterlockedAnd(keyBits[1], a.x);
+		InterlockedOr(keyBits[2], o.y);
+		InterlockedAnd(keyBits[3], a.y);
+	}
+}
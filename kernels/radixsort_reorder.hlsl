@@ -1,102 +1,53 @@
 #include "helper.hlsl"
+#include "radixsort.h"
 
 #define ELEMENTS_IN_BLOCK 512
 
-// 4 stages, uint = [8 bit] [8 bit] [8 bit] [8 bit]
+// digits are up to 8 bit ( the width and the passes come from cpu::planRadixPasses() )
 // so buckets wants 256 counters
 cbuffer arguments : register(b0, space0)
 {
 	uint numberOfBlock;
 	uint elementsInBlock;
-	uint iteration; // 0, 1, 2, 3
+	uint shift; // the lowest bit of the digit
+	uint keyType;
+	uint hasValues; // move values with keys
+	uint digitMask;
 };
 
 RWStructuredBuffer<uint> xs0 : register(u0);
 RWStructuredBuffer<uint> xs1 : register(u1);
 RWStructuredBuffer<uint> offsetTable : register(u2);
+RWStructuredBuffer<uint> values0 : register(u3);
+RWStructuredBuffer<uint> values1 : register(u4);
 
-uint getSortKey(uint x)
+uint numberOfKey()
 {
-	uint m = x & (0xFF << (8 * iteration));
-	return m >> (8 * iteration);
+	uint n = numberOfElement(xs0);
+	return keyType == RADIX_KEY_UINT64 ? n / 2 : n;
 }
 
-// slow...
-// groupshared uint blockxs[256];  // [item id]
-// groupshared uint offsetxs[256]; // [item id]
-// groupshared uint counters[256]; // [key]
-
-// [numthreads(256, 1, 1)]
-// void main(uint3 gID : SV_DispatchThreadID, uint3 blockIndex: SV_GroupID, uint3 indexOnSubblock: SV_GroupThreadID)
-// {
-// 	uint n = numberOfElement(xs0);
-
-// 	counters[indexOnSubblock.x] = 0;
-
-// 	for(int i = 0 ; i < 4 ; ++i)
-// 	{
-// 		// load to shared memory
-// 		uint xsIndex = blockIndex.x * ELEMENTS_IN_BLOCK + 256 * i + indexOnSubblock.x;
-// 		if( xsIndex < n )
-// 		{
-// 			blockxs[indexOnSubblock.x] = xs0[xsIndex];
-// 		}
-		
-// 		GroupMemoryBarrierWithGroupSync();
-
-// 		// count. single thread
-// 		if(indexOnSubblock.x == 0)
-// 		{
-// 			// e.g. blockIndex.x == 2, i == 1
-// 			// 
-// 			// remove this offset
-// 			// < ------------------------------------------ > 
-// 			// < -------------------------------------------|-----n >
-// 			// [ELEMENTS_IN_BLOCK] [ELEMENTS_IN_BLOCK], [256], [256 / my sub block]
-// 			uint blockxsCount = min(n - (blockIndex.x * ELEMENTS_IN_BLOCK + i * 256), 256);
-
-// 			// calculate local offset per element
-// 			for(int j = 0 ; j < blockxsCount ; ++j)
-// 			{
-// 				uint value = blockxs[j];
-// 				uint key = getSortKey(value);
-// 				uint cnt = counters[key];
-// 				offsetxs[j] = cnt;
-// 				counters[key] = cnt + 1;
-// 			}
-// 		}
-
-// 		GroupMemoryBarrierWithGroupSync();
-
-// 		if( xsIndex < n )
-// 		{
-// 			uint value = blockxs[indexOnSubblock.x];
-// 			uint offsetTableIndex = numberOfBlock * getSortKey(value) + blockIndex.x;
-// 			uint offset = offsetTable[offsetTableIndex];
-
-// 			// combine block offset, local offset
-// 			uint toIndex = offset + offsetxs[indexOnSubblock.x];
-// 			xs1[toIndex] = value;
-// 		}
-// 	}
-// }
-
-groupshared uint counters[256]; // [key]
-
-[numthreads(64, 1, 1)]
+/*
+ stable ranking of a tile of RADIX_REORDER_THREADS keys, a thread per key:
+ 1. every thread sets its bit in the mask of its digit ( the ballot of the threads with the same digit )
+ 2. a thread per digit counts the bits, and the counts are scanned into the start of each digit in the tile
+ 3. the rank of a key is the number of bits below its thread in its digit mask, so equal keys keep their order
+ 4. keys are placed in digit order in groupshared memory, and the threads write them out in that order.
+    The keys of a digit go to consecutive addresses, so the stores are coalesced
+ The CPU emulation of this kernel is cpu::RadixReorderEmulation
+*/
+groupshared uint digitMasks[RADIX_DIGITS * RADIX_REORDER_MASK_WORDS]; // [digit][word]
+groupshared uint digitStarts[RADIX_DIGITS]; // the start of each digit in the tile
+groupshared uint digitOffsets[RADIX_DIGITS]; // the destination of the next key of each digit in this block
+groupshared uint tileKeys[RADIX_REORDER_THREADS * 2];
+groupshared uint tileValues[RADIX_REORDER_THREADS];
+groupshared uint tileDigits[RADIX_REORDER_THREADS];
+
+[numthreads(RADIX_REORDER_THREADS, 1, 1)]
 void main(uint3 blockIndexSV: SV_GroupID, uint3 indexOnGroup: SV_GroupThreadID)
 {
-	for(int j = 0 ; j < 4 ; ++j)
-	{
-		counters[64 * j + indexOnGroup.x] = 0;
-	}
-	GroupMemoryBarrierWithGroupSync();
-	
 	uint blockIndex = blockIndexSV.x;
-	if(indexOnGroup.x != 0)
-	{
-		return;
-	}
+	uint thread = indexOnGroup.x;
 
 	/*
 	column major store
@@ -107,26 +58,110 @@ void main(uint3 blockIndexSV: SV_GroupID, uint3 indexOnGroup: SV_GroupThreadID)
 	v
 	blocks ( numberOfBlock )
 	*/
-	uint n = numberOfElement(xs0);
-	
-	uint valueHead = blockIndex * elementsInBlock;
-	for(int i = 0 ; i < elementsInBlock ; ++i)
+	digitOffsets[thread] = thread <= digitMask ? offsetTable[numberOfBlock * thread + blockIndex] : 0;
+	for(int i = 0 ; i < RADIX_REORDER_MASK_WORDS ; ++i)
 	{
-		uint valueIndex = valueHead + i;
-		if( n <= valueIndex)
+		digitMasks[thread * RADIX_REORDER_MASK_WORDS + i] = 0;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	uint n = numberOfKey();
+	uint blockHead = blockIndex * elementsInBlock;
+	uint blockTail = min(blockHead + elementsInBlock, n);
+	for(uint tileHead = blockHead ; tileHead < blockTail ; tileHead += RADIX_REORDER_THREADS)
+	{
+		uint tileCount = min(blockTail - tileHead, RADIX_REORDER_THREADS);
+		uint valueIndex = tileHead + thread;
+		bool active = thread < tileCount;
+
+		// 1. ballot
+		uint digit = 0;
+		if(active)
 		{
-			return;
+			uint2 bits = getSortBits(xs0, keyType, valueIndex);
+			digit = radixDigit(bits.x, bits.y, shift, digitMask);
+			InterlockedOr(digitMasks[digit * RADIX_REORDER_MASK_WORDS + thread / 32], 1u << (thread % 32));
 		}
+		GroupMemoryBarrierWithGroupSync();
 
-		uint value = xs0[valueIndex];
-		uint key = getSortKey(value);
-		uint offsetTableIndex = numberOfBlock * key + blockIndex;
+		// 2. count and scan the digits. a thread per digit
+		uint count = 0;
+		for(int i = 0 ; i < RADIX_REORDER_MASK_WORDS ; ++i)
+		{
+			count += countbits(digitMasks[thread * RADIX_REORDER_MASK_WORDS + i]);
+		}
+		digitStarts[thread] = count;
+		GroupMemoryBarrierWithGroupSync();
+		for(uint offset = 1 ; offset < RADIX_DIGITS ; offset *= 2)
+		{
+			uint s = digitStarts[thread];
+			if(offset <= thread)
+			{
+				s += digitStarts[thread - offset];
+			}
+			GroupMemoryBarrierWithGroupSync();
+			digitStarts[thread] = s;
+			GroupMemoryBarrierWithGroupSync();
+		}
+		uint start = digitStarts[thread] - count; // exclusive
+		GroupMemoryBarrierWithGroupSync();
+		digitStarts[thread] = start;
+		GroupMemoryBarrierWithGroupSync();
 
-		uint indexOnBlock = counters[key];
-		counters[key] = indexOnBlock + 1;
+		// 3. rank, 4. place in digit order
+		if(active)
+		{
+			uint word = thread / 32;
+			uint rank = countbits(digitMasks[digit * RADIX_REORDER_MASK_WORDS + word] & ((1u << (thread % 32)) - 1));
+			for(uint i = 0 ; i < word ; ++i)
+			{
+				rank += countbits(digitMasks[digit * RADIX_REORDER_MASK_WORDS + i]);
+			}
+			uint slot = digitStarts[digit] + rank;
+			if(keyType == RADIX_KEY_UINT64)
+			{
+				tileKeys[slot * 2] = xs0[valueIndex * 2];
+				tileKeys[slot * 2 + 1] = xs0[valueIndex * 2 + 1];
+			}
+			else
+			{
+				tileKeys[slot] = xs0[valueIndex];
+			}
+			if(hasValues)
+			{
+				tileValues[slot] = values0[valueIndex];
+			}
+			tileDigits[slot] = digit;
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		// coalesced store. the thread of the slot is the destination within its digit
+		if(active)
+		{
+			uint d = tileDigits[thread];
+			uint toIndex = digitOffsets[d] + thread - digitStarts[d];
+			if(keyType == RADIX_KEY_UINT64)
+			{
+				xs1[toIndex * 2] = tileKeys[thread * 2];
+				xs1[toIndex * 2 + 1] = tileKeys[thread * 2 + 1];
+			}
+			else
+			{
+				xs1[toIndex] = tileKeys[thread];
+			}
+			if(hasValues)
+			{
+				values1[toIndex] = tileValues[thread];
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
 
-		uint offset = offsetTable[offsetTableIndex];
-		xs1[offset + indexOnBlock] = value;
+		// the next tile
+		digitOffsets[thread] += count;
+		for(int i = 0 ; i < RADIX_REORDER_MASK_WORDS ; ++i)
+		{
+			digitMasks[thread * RADIX_REORDER_MASK_WORDS + i] = 0;
+		}
+		GroupMemoryBarrierWithGroupSync();
 	}
 }
-
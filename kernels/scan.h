@@ -0,0 +1,18 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+// reduce-then-scan of scan_reduce.hlsl and scan_downsweep.hlsl. A group scans SCAN_BLOCK_SIZE elements
+#define SCAN_THREADS 256
+#define SCAN_ELEMENTS_PER_THREAD 4
+#define SCAN_BLOCK_SIZE ( SCAN_THREADS * SCAN_ELEMENTS_PER_THREAD )
+
+// element types. Every type is stored as uint
+#define SCAN_TYPE_UINT 0
+#define SCAN_TYPE_INT 1
+#define SCAN_TYPE_FLOAT 2
+
+#define SCAN_OP_SUM 0
+#define SCAN_OP_MAX 1
+#define SCAN_OP_MIN 2
+
+#endif
@@ -0,0 +1,123 @@
+#include "helper.hlsl"
+
+/*
+ scan of xs in place, one block of SCAN_BLOCK_SIZE elements at a time.
+ useBlockSums != 0 : a group per block, starting from blockSums[block] ( the exclusive scan of the block reductions )
+ useBlockSums == 0 : a single group walks all the blocks carrying the total. used for blockSums itself
+ segmentCount != 0 : segmented. The scan restarts at every bit of segmentHeads, and a block of blockSums restarts when it has any head.
+                     blockSums gets the running value before each block, which doesn't restart at a head
+*/
+cbuffer ScanArgument : register(b0, space0)
+{
+	uint scanCount;
+	uint scanType;
+	uint scanOp;
+	uint inclusive;
+	uint useBlockSums;
+	uint segmentCount;
+};
+
+RWStructuredBuffer<uint> xs : register(u0);
+RWStructuredBuffer<uint> blockSums : register(u1);
+RWStructuredBuffer<uint> segmentHeads : register(u2);
+
+groupshared uint values[SCAN_BLOCK_SIZE];
+groupshared uint totals[SCAN_THREADS];
+groupshared uint totalHeads[SCAN_THREADS];
+
+bool isSegmentHead(uint index)
+{
+	if(segmentCount == 0 || scanCount <= index)
+	{
+		return false;
+	}
+	if(useBlockSums)
+	{
+		return (segmentHeads[index / 32] >> (index % 32)) & 1;
+	}
+
+	uint heads = 0;
+	for(int i = 0 ; i < SCAN_BLOCK_SIZE / 32 ; ++i)
+	{
+		heads |= segmentHeads[index * (SCAN_BLOCK_SIZE / 32) + i];
+	}
+	return heads != 0;
+}
+
+[numthreads(SCAN_THREADS, 1, 1)]
+void main(uint3 blockIndexSV : SV_GroupID, uint3 localID : SV_GroupThreadID)
+{
+	uint identity = scanIdentity(scanType, scanOp);
+
+	uint blockBeg = useBlockSums ? blockIndexSV.x : 0;
+	uint blockEnd = useBlockSums ? blockIndexSV.x + 1 : (scanCount + SCAN_BLOCK_SIZE - 1) / SCAN_BLOCK_SIZE;
+	uint carry = useBlockSums ? blockSums[blockIndexSV.x] : identity;
+
+	for(uint block = blockBeg ; block < blockEnd ; ++block)
+	{
+		// coalesced load
+		for(int i = 0 ; i < SCAN_ELEMENTS_PER_THREAD ; ++i)
+		{
+			uint index = block * SCAN_BLOCK_SIZE + i * SCAN_THREADS + localID.x;
+			values[i * SCAN_THREADS + localID.x] = index < scanCount ? xs[index] : identity;
+		}
+		GroupMemoryBarrierWithGroupSync();
+
+		// each thread reduces its consecutive elements, from its last segment head if any
+		uint head = localID.x * SCAN_ELEMENTS_PER_THREAD;
+		uint s = identity;
+		bool hasHead = false;
+		for(int i = 0 ; i < SCAN_ELEMENTS_PER_THREAD ; ++i)
+		{
+			bool h = isSegmentHead(block * SCAN_BLOCK_SIZE + head + i);
+			s = scanCombine(h ? identity : s, values[head + i], scanType, scanOp);
+			hasHead = hasHead || h;
+		}
+		totals[localID.x] = s;
+		totalHeads[localID.x] = hasHead ? 1 : 0;
+		GroupMemoryBarrierWithGroupSync();
+
+		// inclusive scan of the thread totals. A total with a head doesn't take the ones before it
+		for(uint offset = 1 ; offset < SCAN_THREADS ; offset *= 2)
+		{
+			uint t = totals[localID.x];
+			uint th = totalHeads[localID.x];
+			if(offset <= localID.x)
+			{
+				t = th ? t : scanCombine(totals[localID.x - offset], t, scanType, scanOp);
+				th |= totalHeads[localID.x - offset];
+			}
+			GroupMemoryBarrierWithGroupSync();
+			totals[localID.x] = t;
+			totalHeads[localID.x] = th;
+			GroupMemoryBarrierWithGroupSync();
+		}
+
+		uint prefix = carry;
+		if(localID.x != 0)
+		{
+			prefix = totalHeads[localID.x - 1] ? totals[localID.x - 1] : scanCombine(carry, totals[localID.x - 1], scanType, scanOp);
+		}
+		for(int i = 0 ; i < SCAN_ELEMENTS_PER_THREAD ; ++i)
+		{
+			bool h = isSegmentHead(block * SCAN_BLOCK_SIZE + head + i);
+			uint x = values[head + i];
+			uint next = scanCombine(h ? identity : prefix, x, scanType, scanOp);
+			values[head + i] = inclusive ? next : (h && useBlockSums ? identity : prefix);
+			prefix = next;
+		}
+		carry = totalHeads[SCAN_THREADS - 1] ? totals[SCAN_THREADS - 1] : scanCombine(carry, totals[SCAN_THREADS - 1], scanType, scanOp);
+		GroupMemoryBarrierWithGroupSync();
+
+		// coalesced store
+		for(int i = 0 ; i < SCAN_ELEMENTS_PER_THREAD ; ++i)
+		{
+			uint index = block * SCAN_BLOCK_SIZE + i * SCAN_THREADS + localID.x;
+			if(index < scanCount)
+			{
+				xs[index] = values[i * SCAN_THREADS + localID.x];
+			}
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+}
@@ -0,0 +1,69 @@
+#include "helper.hlsl"
+
+/*
+ the first pass of the scan. blockSums[i] = the reduction of xs in the block i
+ segmentCount != 0 : the reduction after the last segment head in the block ( see scan_segmentHeads.hlsl )
+*/
+cbuffer ScanArgument : register(b0, space0)
+{
+	uint scanCount;
+	uint scanType;
+	uint scanOp;
+	uint inclusive;
+	uint useBlockSums;
+	uint segmentCount;
+};
+
+RWStructuredBuffer<uint> xs : register(u0);
+RWStructuredBuffer<uint> blockSums : register(u1);
+RWStructuredBuffer<uint> segmentHeads : register(u2);
+
+groupshared uint partials[SCAN_THREADS];
+groupshared uint lastHead;
+
+[numthreads(SCAN_THREADS, 1, 1)]
+void main(uint3 blockIndex : SV_GroupID, uint3 localID : SV_GroupThreadID)
+{
+	if(localID.x == 0)
+	{
+		lastHead = 0;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if(segmentCount != 0 && localID.x < SCAN_BLOCK_SIZE / 32)
+	{
+		uint heads = segmentHeads[blockIndex.x * (SCAN_BLOCK_SIZE / 32) + localID.x];
+		if(heads != 0)
+		{
+			InterlockedMax(lastHead, localID.x * 32 + firstbithigh(heads));
+		}
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	// coalesced. The order inside a block doesn't matter as every operator is commutative
+	uint s = scanIdentity(scanType, scanOp);
+	for(int i = 0 ; i < SCAN_ELEMENTS_PER_THREAD ; ++i)
+	{
+		uint index = blockIndex.x * SCAN_BLOCK_SIZE + i * SCAN_THREADS + localID.x;
+		if(index < scanCount && blockIndex.x * SCAN_BLOCK_SIZE + lastHead <= index)
+		{
+			s = scanCombine(s, xs[index], scanType, scanOp);
+		}
+	}
+	partials[localID.x] = s;
+	GroupMemoryBarrierWithGroupSync();
+
+	for(uint stride = SCAN_THREADS / 2 ; 0 < stride ; stride /= 2)
+	{
+		if(localID.x < stride)
+		{
+			partials[localID.x] = scanCombine(partials[localID.x], partials[localID.x + stride], scanType, scanOp);
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if(localID.x == 0)
+	{
+		blockSums[blockIndex.x] = partials[0];
+	}
+}
@@ -0,0 +1,58 @@
+#include "helper.hlsl"
+
+/*
+ bits of the segment heads for a segmented scan. A bit per element, SCAN_BLOCK_SIZE / 32 words per block.
+ segmentOffsets[0, segmentCount) are the first elements of the segments in ascending order
+*/
+cbuffer ScanArgument : register(b0, space0)
+{
+	uint scanCount;
+	uint scanType;
+	uint scanOp;
+	uint inclusive;
+	uint useBlockSums;
+	uint segmentCount;
+};
+
+RWStructuredBuffer<uint> segmentOffsets : register(u0);
+RWStructuredBuffer<uint> segmentHeads : register(u1);
+
+[numthreads(SCAN_THREADS, 1, 1)]
+void main(uint3 gID : SV_DispatchThreadID)
+{
+	uint word = gID.x;
+	uint nWords = (scanCount + SCAN_BLOCK_SIZE - 1) / SCAN_BLOCK_SIZE * (SCAN_BLOCK_SIZE / 32);
+	if(nWords <= word)
+	{
+		return;
+	}
+
+	// the first segment starting in this word or later
+	uint beg = word * 32;
+	uint lower = 0;
+	uint upper = segmentCount;
+	while(lower < upper)
+	{
+		uint mid = (lower + upper) / 2;
+		if(segmentOffsets[mid] < beg)
+		{
+			lower = mid + 1;
+		}
+		else
+		{
+			upper = mid;
+		}
+	}
+
+	uint heads = 0;
+	for(uint i = lower ; i < segmentCount ; ++i)
+	{
+		uint offset = segmentOffsets[i];
+		if(beg + 32 <= offset || scanCount <= offset)
+		{
+			break;
+		}
+		heads |= 1u << (offset - beg);
+	}
+	segmentHeads[word] = heads;
+}
@@ -32,6 +32,9 @@ namespace lwh {
 		std::map<std::string, std::vector<glm::vec3>> pointsVectorAttrib;
 		std::map<std::string, std::vector<glm::vec3>> verticesVectorAttrib;
 		std::map<std::string, std::vector<glm::vec3>> primitivesVectorAttrib;
+		std::map<std::string, std::vector<float>> pointsFloatAttrib;
+		std::map<std::string, std::vector<float>> verticesFloatAttrib;
+		std::map<std::string, std::vector<float>> primitivesFloatAttrib;
 	};
 
 	struct Loaded {
@@ -83,6 +86,23 @@ namespace lwh {
 
 		return std::move(values);
 	}
+	static std::vector<float> GetMemberAsFloats(const rapidjson::Value& o, const char *key)
+	{
+		std::vector<float> values;
+
+		LWH_EXPECT(o.HasMember(key), "missing key");
+		const rapidjson::Value& vs = o[key];
+		LWH_EXPECT(vs.IsArray(), "type mismatch");
+
+		values.reserve(vs.Size());
+		for (rapidjson::SizeType i = 0; i < vs.Size(); i++)
+		{
+			LWH_EXPECT(vs[i].IsNumber(), "");
+			values.push_back(vs[i].GetFloat());
+		}
+
+		return std::move(values);
+	}
 	static std::vector<uint32_t> GetMemberAsUIntegers(const rapidjson::Value& o, const char *key)
 	{
 		std::vector<uint32_t> values;
@@ -134,7 +154,7 @@ namespace lwh {
 				}
 				else if (pointCount == it->value.Size())
 				{
-
+					polygon->pointsFloatAttrib[it->name.GetString()] = GetMemberAsFloats(Points, it->name.GetString());
 				}
 			}
 			polygon->pointCount = pointCount;
@@ -154,7 +174,7 @@ namespace lwh {
 				}
 				else if (vertexCount == it->value.Size())
 				{
-
+					polygon->verticesFloatAttrib[it->name.GetString()] = GetMemberAsFloats(Vertices, it->name.GetString());
 				}
 			}
 			polygon->vertexCount = vertexCount;
@@ -177,7 +197,7 @@ namespace lwh {
 				}
 				else if (primitiveCount == it->value.Size())
 				{
-
+					polygon->primitivesFloatAttrib[it->name.GetString()] = GetMemberAsFloats(Primitives, it->name.GetString());
 				}
 			}
 			polygon->primitiveCount = polygon->indexPerPrim.size();
@@ -186,6 +206,24 @@ namespace lwh {
 	}
 	}
 
+	// xyz: P, w: pscale. pscale is 1 if it is not exported, the same as houdini
+	static std::vector<glm::vec4> pointsAsSpheres( const Polygon* polygon )
+	{
+		std::vector<glm::vec4> spheres;
+		if (polygon == nullptr)
+		{
+			return spheres;
+		}
+		auto pscale = polygon->pointsFloatAttrib.find("pscale");
+		bool hasPscale = pscale != polygon->pointsFloatAttrib.end();
+		spheres.reserve(polygon->P.size());
+		for (size_t i = 0; i < polygon->P.size(); i++)
+		{
+			spheres.push_back(glm::vec4(polygon->P[i], hasPscale ? pscale->second[i] : 1.0f));
+		}
+		return spheres;
+	}
+
 	static Loaded load( const rapidjson::Document& d ) 
 	{
 		Loaded r;
@@ -196,6 +234,11 @@ namespace lwh {
 		{
 			r.polygon = loadPolygon(d);
 		}
+		else if (type == "Points")
+		{
+			// no primitives. P and the point attributes are available
+			r.polygon = loadPolygon(d);
+		}
 		return r;
 	}
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 ﻿#include "EzDx.hpp"
 #include "WinPixEventRuntime/pix3.h"
 #include "pr.hpp"
+#include "CpuGaussian.hpp"
+#include "gaussian.h"
 
 struct Arguments
 {
@@ -10,7 +12,96 @@ struct Arguments
 	int sample_dy;
 };
 
-void run( DeviceObject* deviceObject )
+// gaussian_recursive.hlsl
+struct RecursiveArguments
+{
+	int width;
+	int height;
+	int sample_dx;
+	int sample_dy;
+	float pole[4];
+	float weight[4];
+	float causalEdge[4];
+	float anticausalEdge[4];
+};
+
+// run() takes the recursive filter from this sigma on both GPU and CPU. A thread a line keeps only a few thousand GPU threads busy,
+// so it is larger than CPU_GAUSSIAN_RECURSIVE_MIN_SIGMA of GaussianBlur::blur( ..., sigma )
+#define GPU_GAUSSIAN_RECURSIVE_MIN_SIGMA 32.0f
+
+RecursiveArguments recursiveArguments( const cpu::RecursiveGaussian& filter, int width, int height, int sample_dx, int sample_dy )
+{
+	RecursiveArguments args = {width, height, sample_dx, sample_dy};
+	for ( int i = 0; i < 2; ++i )
+	{
+		args.pole[i * 2] = filter.pRe[i];
+		args.pole[i * 2 + 1] = filter.pIm[i];
+		args.weight[i * 2] = filter.wRe[i];
+		args.weight[i * 2 + 1] = filter.wIm[i];
+		args.causalEdge[i * 2] = filter.causalRe[i];
+		args.causalEdge[i * 2 + 1] = filter.causalIm[i];
+		args.anticausalEdge[i * 2] = filter.anticausalRe[i];
+		args.anticausalEdge[i * 2 + 1] = filter.anticausalIm[i];
+	}
+	return args;
+}
+
+/*
+	the accuracy of cpu::RecursiveGaussian against the direct kernel of cpu::gaussianKernel() on CPU,
+	the differences of the 8 bit levels and the time of the horizontal and vertical passes
+*/
+void reportRecursiveGaussian()
+{
+	using namespace pr;
+
+	Image2DRGBA8 image;
+	image.load( "../image/cat.png" );
+	uint64_t numberOfElement = image.width() * image.height();
+
+	std::vector<glm::u8vec4> direct( numberOfElement );
+	std::vector<glm::u8vec4> recursive( numberOfElement );
+	cpu::GaussianBlur blur;
+	for ( float sigma : {2.0f, 5.0f, 10.0f, 20.0f, 50.0f, 100.0f, 200.0f} )
+	{
+		std::vector<float> kernel = cpu::gaussianKernel( sigma );
+		cpu::RecursiveGaussian filter = cpu::recursiveGaussian( sigma );
+
+		blur.degamma( image.data(), image.width(), image.height() );
+		Stopwatch sw;
+		blur.horizontal( kernel );
+		blur.vertical( kernel );
+		double directMs = 1000.0 * sw.elapsed();
+		blur.gamma( direct.data() );
+
+		blur.degamma( image.data(), image.width(), image.height() );
+		Stopwatch swRecursive;
+		blur.horizontal( filter );
+		blur.vertical( filter );
+		double recursiveMs = 1000.0 * swRecursive.elapsed();
+		blur.gamma( recursive.data() );
+
+		int maxDiff = 0;
+		double sqDiff = 0.0;
+		for ( uint64_t i = 0; i < numberOfElement; ++i )
+		{
+			for ( int c = 0; c < 4; ++c )
+			{
+				int d = std::abs( (int)direct[i][c] - (int)recursive[i][c] );
+				maxDiff = std::max( maxDiff, d );
+				sqDiff += d * d;
+			}
+		}
+		printf( "sigma %.0f -- direct ( %d taps ) %.4f ms, recursive %.4f ms, max difference %d, rms difference %.4f%s\n",
+				sigma, (int)kernel.size() * 2 - 1, directMs, recursiveMs, maxDiff, std::sqrt( sqDiff / ( numberOfElement * 4 ) ),
+				cpu::useRecursiveGaussian( sigma ) ? " ( recursive )" : "" );
+	}
+}
+
+/*
+	fused : degamma -> gaussian H and gaussian V -> gamma by gaussian_fused_h.hlsl and gaussian_fused_v.hlsl on GPU, GaussianBlur::blurFused() on CPU.
+	The recursive filter of a large sigma isn't fused
+*/
+void run( DeviceObject* deviceObject, float sigma, bool fused )
 {
 	using namespace pr;
 
@@ -31,6 +122,10 @@ void run( DeviceObject* deviceObject )
 	std::unique_ptr<ConstantBufferObject> arguments_V( new ConstantBufferObject( deviceObject->device(), sizeof( Arguments ), D3D12_RESOURCE_STATE_COPY_DEST ) );
 	arguments_H->setName( L"arguments_H" );
 	arguments_V->setName( L"arguments_V" );
+	std::unique_ptr<ConstantBufferObject> recursiveArguments_H( new ConstantBufferObject( deviceObject->device(), sizeof( RecursiveArguments ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+	std::unique_ptr<ConstantBufferObject> recursiveArguments_V( new ConstantBufferObject( deviceObject->device(), sizeof( RecursiveArguments ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+	recursiveArguments_H->setName( L"recursiveArguments_H" );
+	recursiveArguments_V->setName( L"recursiveArguments_V" );
 
 	std::unique_ptr<BufferObjectUAV> ioImageBuffer( new BufferObjectUAV( deviceObject->device(), ioImageBytes, sizeof( IOImagePixelType ), D3D12_RESOURCE_STATE_COPY_DEST ) );
 	std::unique_ptr<BufferObjectUAV> valueBuffer0( new BufferObjectUAV( deviceObject->device(), workImageBytes, sizeof( WorkingPixelType ), D3D12_RESOURCE_STATE_COMMON ) );
@@ -39,6 +134,10 @@ void run( DeviceObject* deviceObject )
 	valueBuffer0->setName( L"valueBuffer0" );
 	valueBuffer1->setName( L"valueBuffer1" );
 
+	// RGBA of half floats between gaussian_fused_h.hlsl and gaussian_fused_v.hlsl
+	std::unique_ptr<BufferObjectUAV> halfBuffer( new BufferObjectUAV( deviceObject->device(), sizeof( uint32_t ) * 2 * numberOfElement, sizeof( uint32_t ) * 2, D3D12_RESOURCE_STATE_COMMON ) );
+	halfBuffer->setName( L"halfBuffer" );
+
 	std::unique_ptr<UploaderObject> imageUploader( new UploaderObject( deviceObject->device(), ioImageBytes ) );
 	imageUploader->map( [&]( void* p ) {
 		memcpy( p, image.data(), ioImageBytes );
@@ -47,28 +146,12 @@ void run( DeviceObject* deviceObject )
 	imageUploader->setName( L"imageUploader" );
 	imageDownloader->setName( L"imageDownloader" );
 
-	float sigma = 20.0f;
-
-	float sum = 0.0f;
-	std::vector<float> kernelstore;
-	for ( int i = 0;; ++i )
-	{
-		float g = std::exp( -i * i / ( 2.0f * sigma * sigma ) );
-		sum += g;
-		kernelstore.push_back( g );
-		if ( ( i % 2 == 1 ) && g < ( 1.0f / 512.0f ) )
-		{
-			break;
-		}
-	}
-
-	// -3, -2, -1, 0, 1, 2, 3
-	// ^^^^^^^^^^ are missing and sum x 2 conains overwaped kernelstore[0] == 1.0 so remove 1.0
-	sum = sum * 2.0f - 1.0f;
-	for ( float& w : kernelstore )
-	{
-		w /= sum;
-	}
+	// one choice for both GPU and CPU, so that they run the same algorithm
+	bool recursive = GPU_GAUSSIAN_RECURSIVE_MIN_SIGMA <= sigma;
+	bool useFused = fused && !recursive;
+	cpu::RecursiveGaussian filter = cpu::recursiveGaussian( sigma );
+	std::vector<float> kernelstore = cpu::gaussianKernel( sigma );
+	DX_ASSERT( !useFused || kernelstore.size() - 1 <= GAUSSIAN_FUSED_MAX_RADIUS, "too large kernel for gaussian_fused_h.hlsl" );
 
 	std::unique_ptr<BufferObjectUAV> kernel( new BufferObjectUAV( deviceObject->device(), sizeof( float ) * kernelstore.size(), sizeof( float ), D3D12_RESOURCE_STATE_COPY_DEST ) );
 	std::unique_ptr<UploaderObject> kernelUploader( new UploaderObject( deviceObject->device(), sizeof( float ) * kernelstore.size() ) );
@@ -90,6 +173,26 @@ void run( DeviceObject* deviceObject )
 	gaussianCompute->b( 0 );
 	gaussianCompute->loadShaderAndBuild( deviceObject->device(), GetDataPath( "gaussian.cso" ).c_str() );
 
+	std::unique_ptr<ComputeObject> fusedComputeH( new ComputeObject() );
+	fusedComputeH->u( 0 );
+	fusedComputeH->u( 1 );
+	fusedComputeH->u( 2 );
+	fusedComputeH->b( 0 );
+	fusedComputeH->loadShaderAndBuild( deviceObject->device(), GetDataPath( "gaussian_fused_h.cso" ).c_str() );
+
+	std::unique_ptr<ComputeObject> fusedComputeV( new ComputeObject() );
+	fusedComputeV->u( 0 );
+	fusedComputeV->u( 1 );
+	fusedComputeV->u( 2 );
+	fusedComputeV->b( 0 );
+	fusedComputeV->loadShaderAndBuild( deviceObject->device(), GetDataPath( "gaussian_fused_v.cso" ).c_str() );
+
+	std::unique_ptr<ComputeObject> recursiveCompute( new ComputeObject() );
+	recursiveCompute->u( 0 );
+	recursiveCompute->u( 1 );
+	recursiveCompute->b( 0 );
+	recursiveCompute->loadShaderAndBuild( deviceObject->device(), GetDataPath( "gaussian_recursive.cso" ).c_str() );
+
 	std::unique_ptr<ComputeObject> gammaCompute( new ComputeObject() );
 	gammaCompute->u( 0 );
 	gammaCompute->u( 1 );
@@ -103,6 +206,8 @@ void run( DeviceObject* deviceObject )
 		// upload
 		arguments_H->upload<Arguments>( commandList, {image.width(), image.height(), 1, 0} );
 		arguments_V->upload<Arguments>( commandList, {image.width(), image.height(), 0, 1} );
+		recursiveArguments_H->upload<RecursiveArguments>( commandList, recursiveArguments( filter, image.width(), image.height(), 1, 0 ) );
+		recursiveArguments_V->upload<RecursiveArguments>( commandList, recursiveArguments( filter, image.width(), image.height(), 0, 1 ) );
 		kernel->copyFrom( commandList, kernelUploader.get() );
 		ioImageBuffer->copyFrom( commandList, imageUploader.get() );
 
@@ -110,11 +215,14 @@ void run( DeviceObject* deviceObject )
 		resourceBarrier( commandList, {
 										  arguments_H->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
 										  arguments_V->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
+										  recursiveArguments_H->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
+										  recursiveArguments_V->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
 										  kernel->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
 										  ioImageBuffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
 									  } );
 
 		stumper->stamp( commandList, "degamma" );
+		if ( !useFused )
 		{
 			PIXScopedEvent( commandList, PIX_COLOR_DEFAULT, "Degamma" );
 
@@ -130,6 +238,64 @@ void run( DeviceObject* deviceObject )
 			resourceBarrier( commandList, {valueBuffer0->resourceBarrierUAV()} );
 		}
 		stumper->stamp( commandList, "gaussian H" );
+		if ( useFused )
+		{
+			PIXScopedEvent( commandList, PIX_COLOR_DEFAULT, "Fused Degamma -> Gaussian H, Gaussian V -> Gamma" );
+
+			// Degamma -> Horizontal, a group per GAUSSIAN_FUSED_THREADS pixels of a row
+			fusedComputeH->setPipelineState( commandList );
+			fusedComputeH->setComputeRootSignature( commandList );
+			heap->startNextHeapAndAssign( commandList, fusedComputeH->descriptorMap() );
+			heap->u( deviceObject->device(), 0, ioImageBuffer->resource(), ioImageBuffer->UAVDescription() );
+			heap->u( deviceObject->device(), 1, halfBuffer->resource(), halfBuffer->UAVDescription() );
+			heap->u( deviceObject->device(), 2, kernel->resource(), kernel->UAVDescription() );
+			heap->b( deviceObject->device(), 0, arguments_H->resource() );
+			fusedComputeH->dispatch( commandList, dispatchsize( image.width(), GAUSSIAN_FUSED_THREADS ), image.height(), 1 );
+
+			resourceBarrier( commandList, {halfBuffer->resourceBarrierUAV()} );
+
+			stumper->stamp( commandList, "gaussian V" );
+
+			// Vertical -> Gamma
+			fusedComputeV->setPipelineState( commandList );
+			fusedComputeV->setComputeRootSignature( commandList );
+			heap->startNextHeapAndAssign( commandList, fusedComputeV->descriptorMap() );
+			heap->u( deviceObject->device(), 0, halfBuffer->resource(), halfBuffer->UAVDescription() );
+			heap->u( deviceObject->device(), 1, ioImageBuffer->resource(), ioImageBuffer->UAVDescription() );
+			heap->u( deviceObject->device(), 2, kernel->resource(), kernel->UAVDescription() );
+			heap->b( deviceObject->device(), 0, arguments_V->resource() );
+			fusedComputeV->dispatch( commandList, dispatchsize( numberOfElement, GAUSSIAN_FUSED_THREADS ), 1, 1 );
+
+			resourceBarrier( commandList, {ioImageBuffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE )} );
+		}
+		else if ( recursive )
+		{
+			PIXScopedEvent( commandList, PIX_COLOR_DEFAULT, "Recursive Gaussian H -> V" );
+
+			recursiveCompute->setPipelineState( commandList );
+			recursiveCompute->setComputeRootSignature( commandList );
+
+			// Horizontal, a thread a row
+			heap->startNextHeapAndAssign( commandList, recursiveCompute->descriptorMap() );
+			heap->u( deviceObject->device(), 0, valueBuffer0->resource(), valueBuffer0->UAVDescription() );
+			heap->u( deviceObject->device(), 1, valueBuffer1->resource(), valueBuffer1->UAVDescription() );
+			heap->b( deviceObject->device(), 0, recursiveArguments_H->resource() );
+			recursiveCompute->dispatch( commandList, dispatchsize( image.height(), 64 ), 1, 1 );
+
+			resourceBarrier( commandList, {valueBuffer1->resourceBarrierUAV()} );
+
+			stumper->stamp( commandList, "gaussian V" );
+
+			// Vertical, a thread a column
+			heap->startNextHeapAndAssign( commandList, recursiveCompute->descriptorMap() );
+			heap->u( deviceObject->device(), 0, valueBuffer1->resource(), valueBuffer1->UAVDescription() );
+			heap->u( deviceObject->device(), 1, valueBuffer0->resource(), valueBuffer0->UAVDescription() );
+			heap->b( deviceObject->device(), 0, recursiveArguments_V->resource() );
+			recursiveCompute->dispatch( commandList, dispatchsize( image.width(), 64 ), 1, 1 );
+
+			resourceBarrier( commandList, {valueBuffer0->resourceBarrierUAV()} );
+		}
+		else
 		{
 			PIXScopedEvent( commandList, PIX_COLOR_DEFAULT, "Gaussian H -> V" );
 
@@ -143,7 +309,7 @@ void run( DeviceObject* deviceObject )
 			heap->u( deviceObject->device(), 1, valueBuffer1->resource(), valueBuffer1->UAVDescription() );
 			heap->u( deviceObject->device(), 2, kernel->resource(), kernel->UAVDescription() );
 			heap->b( deviceObject->device(), 0, arguments_H->resource() );
-			gaussianCompute->dispatch( commandList, dispatchsize( numberOfElement, 64 ), 1, 1 );
+			gaussianCompute->dispatch( commandList, dispatchsize( ( ( image.width() + 1 ) / 2 ) * image.height(), 64 ), 1, 1 );
 
 			// Just valueBuffer1 will be modified.
 			resourceBarrier( commandList, {valueBuffer1->resourceBarrierUAV()} );
@@ -156,12 +322,13 @@ void run( DeviceObject* deviceObject )
 			heap->u( deviceObject->device(), 1, valueBuffer0->resource(), valueBuffer0->UAVDescription() );
 			heap->u( deviceObject->device(), 2, kernel->resource(), kernel->UAVDescription() );
 			heap->b( deviceObject->device(), 0, arguments_V->resource() );
-			gaussianCompute->dispatch( commandList, dispatchsize( numberOfElement, 64 ), 1, 1 );
+			gaussianCompute->dispatch( commandList, dispatchsize( image.width() * ( ( image.height() + 1 ) / 2 ), 64 ), 1, 1 );
 
 			// Just valueBuffer0 will be modified.
 			resourceBarrier( commandList, {valueBuffer0->resourceBarrierUAV()} );
 		}
 		stumper->stamp( commandList, "gamma" );
+		if ( !useFused )
 		{
 			PIXScopedEvent( commandList, PIX_COLOR_DEFAULT, "Gamma" );
 
@@ -194,15 +361,71 @@ void run( DeviceObject* deviceObject )
 	}
 
 	auto stumpdata = stumper->download( deviceObject->queueObject()->queue() );
+	double gpuMs = 0.0;
 	for ( auto s : stumpdata )
 	{
 		printf( "%s -- %.4f ms\n", s.label.c_str(), s.durationMS );
+		if ( s.label != "upload" && s.label != "download" && s.label != "end" )
+		{
+			gpuMs += s.durationMS;
+		}
+	}
+	printf( "sigma %.0f, %s%s\n", sigma, recursive ? "recursive" : "direct", useFused ? " fused" : "" );
+	printf( "gpu degamma -> gamma -- %.4f ms, %.1f MPix/s\n", gpuMs, numberOfElement / ( gpuMs * 1.0e3 ) );
+
+	// the same pipeline on CPU
+	std::vector<glm::u8vec4> cpuImage( numberOfElement );
+	cpu::GaussianBlur cpuBlur;
+	for ( int i = 0; useFused && i < 4; ++i )
+	{
+		Stopwatch sw;
+		cpuBlur.blurFused( image.data(), cpuImage.data(), image.width(), image.height(), kernelstore );
+		double ms = 1000.0 * sw.elapsed();
+		printf( "cpu fused degamma -> gamma -- %.4f ms, %.1f MPix/s ( %d threads )\n", ms, numberOfElement / ( ms * 1.0e3 ), cpu::ThreadPool::global().threadCount() );
 	}
+	for ( int i = 0; !useFused && i < 4; ++i )
+	{
+		double ms[4];
+		Stopwatch sw;
+		cpuBlur.degamma( image.data(), image.width(), image.height() );
+		ms[0] = 1000.0 * sw.elapsed();
+		if ( recursive )
+		{
+			cpuBlur.horizontal( filter );
+			ms[1] = 1000.0 * sw.elapsed();
+			cpuBlur.vertical( filter );
+		}
+		else
+		{
+			cpuBlur.horizontal( kernelstore );
+			ms[1] = 1000.0 * sw.elapsed();
+			cpuBlur.vertical( kernelstore );
+		}
+		ms[2] = 1000.0 * sw.elapsed();
+		cpuBlur.gamma( cpuImage.data() );
+		ms[3] = 1000.0 * sw.elapsed();
+		printf( "cpu degamma %.4f ms, gaussian H %.4f ms, gaussian V %.4f ms, gamma %.4f ms -- %.4f ms, %.1f MPix/s ( %d threads )\n",
+				ms[0], ms[1] - ms[0], ms[2] - ms[1], ms[3] - ms[2], ms[3], numberOfElement / ( ms[3] * 1.0e3 ), cpu::ThreadPool::global().threadCount() );
+	}
+
 	imageDownloader->map( [&]( const void* p ) {
 		memcpy( image.data(), p, ioImageBytes );
-		image.save( "out.png" );
+		char path[64];
+		sprintf( path, "out_sigma%.0f.png", sigma );
+		image.save( path );
 	} );
 
+	// the sums run in a different order, so a level may differ by 1
+	int maxDiff = 0;
+	for ( uint64_t i = 0; i < numberOfElement; ++i )
+	{
+		for ( int c = 0; c < 4; ++c )
+		{
+			maxDiff = std::max( maxDiff, std::abs( (int)image.data()[i][c] - (int)cpuImage[i][c] ) );
+		}
+	}
+	printf( "cpu - gpu max difference -- %d\n", maxDiff );
+
 	// for debugger tools.
 	deviceObject->present();
 }
@@ -235,12 +458,19 @@ int main()
 		devices.push_back( std::shared_ptr<DeviceObject>( new DeviceObject( adapter.get() ) ) );
 	}
 
+	reportRecursiveGaussian();
+
 	for ( int i = 0;; ++i )
 	{
 		for ( auto d : devices )
 		{
 			printf( "run : %s\n", wstring_to_string( d->deviceName() ).c_str() );
-			run( d.get() );
+
+			run( d.get(), 20.0f, false );
+			run( d.get(), 20.0f, true );
+
+			// a sigma of a bloom
+			run( d.get(), 100.0f, false );
 		}
 	}
 }
@@ -1,23 +1,56 @@
 ﻿#include "EzDx.hpp"
 #include "WinPixEventRuntime/pix3.h"
 #include "pr.hpp"
+#include "CpuRadixSelect.hpp"
+#include "CpuRadixSort.hpp"
+#include "CpuSortKeys.hpp"
+#include "GpuRadixSelect.hpp"
+#include "GpuScan.hpp"
+#include "radixsort.h"
 #include <intrin.h>
 
 #define ELEMENTS_IN_BLOCK 512
 
-// 4 stages, uint = [8 bit] [8 bit] [8 bit] [8 bit]
+// digits are up to 8 bit
 // so buckets wants 256 counters
 #define COUNTERS_IN_BLOCK 256
-
-#define RADIX_NUMBER_OF_ITERATION 4
+#define RADIX_MAX_BITS 8
 
 struct CountAndReorderArgument
 {
 	uint32_t numberOfBlock;
 	uint32_t elementsInBlock;
-	uint32_t iteration;
+	uint32_t shift;
+	uint32_t keyType;
+	uint32_t hasValues;
+	uint32_t digitMask;
 };
 
+struct KeyBitsArgument
+{
+	uint32_t keyType;
+};
+
+// rand() is 15 bit on MSVC
+static uint32_t rand32()
+{
+	return (uint32_t)rand() << 30 ^ (uint32_t)rand() << 15 ^ (uint32_t)rand();
+}
+
+static const char* keyTypeName( uint32_t keyType )
+{
+	switch ( keyType )
+	{
+	case RADIX_KEY_UINT32:
+		return "uint32";
+	case RADIX_KEY_FLOAT32:
+		return "float32";
+	case RADIX_KEY_UINT64:
+		return "uint64";
+	}
+	return "";
+}
+
 struct ScanGlobalArgument
 {
 	int iteration;
@@ -33,43 +66,70 @@ static uint32_t prefixScanIterationCount( uint32_t n )
 	return index + 1;
 }
 
-void run( DeviceObject* deviceObject )
+// sorts keys with their original indices as values, so the check covers the stability too
+void run( DeviceObject* deviceObject, uint32_t keyType )
 {
 	using namespace pr;
 
+	printf( "key type : %s\n", keyTypeName( keyType ) );
+
+	std::shared_ptr<CommandObject> keyBitsCommandList( new CommandObject( deviceObject->device(), D3D12_COMMAND_LIST_TYPE_DIRECT ) );
+	keyBitsCommandList->setName( L"KeyBits" );
 	std::shared_ptr<CommandObject> computeCommandList( new CommandObject( deviceObject->device(), D3D12_COMMAND_LIST_TYPE_DIRECT ) );
 	computeCommandList->setName( L"Compute" );
 
-	std::vector<uint32_t> input( 10000000 );
+	uint64_t numberOfElement = 10000000;
+	uint32_t wordsPerKey = keyType == RADIX_KEY_UINT64 ? 2 : 1;
+
+	std::vector<uint32_t> input( numberOfElement * wordsPerKey );
 	for ( int i = 0; i < input.size(); ++i )
 	{
-		input[i] = rand();
+		input[i] = rand32();
 		// input[i] = i & 0xFF;
 	}
+	if ( keyType == RADIX_KEY_FLOAT32 )
+	{
+		for ( int i = 0; i < input.size(); ++i )
+		{
+			float f = ( (float)rand() / RAND_MAX - 0.5f ) * 1000.0f;
+			memcpy( &input[i], &f, sizeof( float ) );
+		}
+	}
+	std::vector<uint32_t> inputValues( numberOfElement );
+	for ( int i = 0; i < inputValues.size(); ++i )
+	{
+		inputValues[i] = i;
+	}
 
 	std::shared_ptr<StackDescriptorHeapObject> heap( new StackDescriptorHeapObject( deviceObject->device(), 512 ) );
 
-	uint64_t numberOfElement = input.size();
 	uint64_t ioDataBytes = sizeof( uint32_t ) * input.size();
+	uint64_t valueBytes = sizeof( uint32_t ) * inputValues.size();
 
 	uint64_t numberOfBlock = dispatchsize( numberOfElement, ELEMENTS_IN_BLOCK );
 	uint64_t blockBytes = sizeof( uint32_t ) * numberOfBlock;
 
 	uint64_t numberOfAllCoutner = numberOfBlock * COUNTERS_IN_BLOCK;
 	uint64_t counterBytes = sizeof( uint32_t ) * numberOfAllCoutner;
-	uint64_t globalScanBytes = sizeof( uint32_t ) * numberOfAllCoutner;
 
 	std::unique_ptr<BufferObjectUAV> xs0( new BufferObjectUAV( deviceObject->device(), ioDataBytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
 	xs0->setName( L"xs0" );
 	std::unique_ptr<BufferObjectUAV> xs1( new BufferObjectUAV( deviceObject->device(), ioDataBytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
 	xs1->setName( L"xs1" );
-
-	std::vector<std::unique_ptr<ConstantBufferObject>> countAndReorderArguments;
-	for ( int i = 0; i < RADIX_NUMBER_OF_ITERATION; ++i )
-	{
-		countAndReorderArguments.push_back(
-			std::unique_ptr<ConstantBufferObject>( new ConstantBufferObject( deviceObject->device(), sizeof( CountAndReorderArgument ), D3D12_RESOURCE_STATE_COPY_DEST ) ) );
-	}
+	std::unique_ptr<BufferObjectUAV> values0( new BufferObjectUAV( deviceObject->device(), valueBytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+	values0->setName( L"values0" );
+	std::unique_ptr<BufferObjectUAV> values1( new BufferObjectUAV( deviceObject->device(), valueBytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+	values1->setName( L"values1" );
+
+	// OR, AND of the lower words and OR, AND of the upper words
+	const uint32_t keyBitsClear[4] = {0, 0xFFFFFFFF, 0, 0xFFFFFFFF};
+	std::unique_ptr<BufferObjectUAV> keyBits( new BufferObjectUAV( deviceObject->device(), sizeof( keyBitsClear ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+	keyBits->setName( L"keyBits" );
+	std::unique_ptr<UploaderObject> keyBitsUploader( new UploaderObject( deviceObject->device(), sizeof( keyBitsClear ) ) );
+	keyBitsUploader->map( [&]( void* p ) {
+		memcpy( p, keyBitsClear, sizeof( keyBitsClear ) );
+	} );
+	std::unique_ptr<ConstantBufferObject> keyBitsArgument( new ConstantBufferObject( deviceObject->device(), sizeof( KeyBitsArgument ), D3D12_RESOURCE_STATE_COPY_DEST ) );
 
 	/*
 	column major store
@@ -83,16 +143,23 @@ void run( DeviceObject* deviceObject )
 	std::unique_ptr<BufferObjectUAV> counter( new BufferObjectUAV( deviceObject->device(), counterBytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
 	counter->setName( L"counter" );
 
-	std::unique_ptr<BufferObjectUAV> globalScanTable0( new BufferObjectUAV( deviceObject->device(), globalScanBytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
-	std::unique_ptr<BufferObjectUAV> globalScanTable1( new BufferObjectUAV( deviceObject->device(), globalScanBytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
-	globalScanTable0->setName( L"globalScanTable0" );
-	globalScanTable1->setName( L"globalScanTable1" );
-
 	std::unique_ptr<UploaderObject> uploader( new UploaderObject( deviceObject->device(), ioDataBytes ) );
 	uploader->setName( L"uploader" );
 	uploader->map( [&]( void* p ) {
 		memcpy( p, input.data(), ioDataBytes );
 	} );
+	std::unique_ptr<UploaderObject> valueUploader( new UploaderObject( deviceObject->device(), valueBytes ) );
+	valueUploader->setName( L"valueUploader" );
+	valueUploader->map( [&]( void* p ) {
+		memcpy( p, inputValues.data(), valueBytes );
+	} );
+
+	// Key Bits
+	std::unique_ptr<ComputeObject> keyBitsCompute( new ComputeObject() );
+	keyBitsCompute->u( 0 );
+	keyBitsCompute->u( 1 );
+	keyBitsCompute->b( 0 );
+	keyBitsCompute->loadShaderAndBuild( deviceObject->device(), GetDataPath( "radixsort_keyBits.cso" ).c_str() );
 
 	std::unique_ptr<ComputeObject> countCompute( new ComputeObject() );
 	countCompute->u( 0 );
@@ -100,26 +167,8 @@ void run( DeviceObject* deviceObject )
 	countCompute->b( 0 );
 	countCompute->loadShaderAndBuild( deviceObject->device(), GetDataPath( "radixsort_count.cso" ).c_str() );
 
-	// Scan Prepare
-	std::unique_ptr<ComputeObject> scanPrepareCompute( new ComputeObject() );
-	scanPrepareCompute->u( 0 );
-	scanPrepareCompute->u( 1 );
-	scanPrepareCompute->loadShaderAndBuild( deviceObject->device(), GetDataPath( "radixsort_scanPrepare.cso" ).c_str() );
-
-	// Global Scan
-	std::unique_ptr<ComputeObject> scanglobalCompute( new ComputeObject() );
-	scanglobalCompute->u( 0 );
-	scanglobalCompute->u( 1 );
-	scanglobalCompute->b( 0 );
-	scanglobalCompute->loadShaderAndBuild( deviceObject->device(), GetDataPath( "radixsort_scanglobal.cso" ).c_str() );
-
-	int globalScanIteration = prefixScanIterationCount( numberOfAllCoutner );
-	std::vector<std::unique_ptr<ConstantBufferObject>> scanglobalConstants;
-	for ( int i = 0; i < globalScanIteration; ++i )
-	{
-		std::unique_ptr<ConstantBufferObject> constant( new ConstantBufferObject( deviceObject->device(), sizeof( ScanGlobalArgument ), D3D12_RESOURCE_STATE_COPY_DEST ) );
-		scanglobalConstants.push_back( std::move( constant ) );
-	}
+	// Scan
+	GpuScan scanner( deviceObject->device(), (uint32_t)numberOfAllCoutner );
 
 	// Reorder
 	std::unique_ptr<ComputeObject> reorderCompute( new ComputeObject() );
@@ -127,37 +176,79 @@ void run( DeviceObject* deviceObject )
 	reorderCompute->u( 1 );
 	reorderCompute->u( 2 );
 	reorderCompute->u( 3 );
+	reorderCompute->u( 4 );
 	reorderCompute->b( 0 );
 	reorderCompute->loadShaderAndBuild( deviceObject->device(), GetDataPath( "radixsort_reorder.cso" ).c_str() );
 
 	std::unique_ptr<TimestampObject> stumper( new TimestampObject( deviceObject->device(), 128 ) );
 
-	computeCommandList->storeCommand( [&]( ID3D12GraphicsCommandList* commandList ) {
+	/*
+	the pre-pass. Bits equal in all keys need no pass, so read back OR and AND of the keys
+	and record only the passes over the bits that differ.
+	*/
+	keyBitsCommandList->storeCommand( [&]( ID3D12GraphicsCommandList* commandList ) {
 		// upload
 		std::vector<D3D12_RESOURCE_BARRIER> uploadBarriers;
 
 		xs0->copyFrom( commandList, uploader.get() );
 		uploadBarriers.push_back( xs0->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
+		values0->copyFrom( commandList, valueUploader.get() );
+		uploadBarriers.push_back( values0->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
+		keyBits->copyFrom( commandList, keyBitsUploader.get() );
+		uploadBarriers.push_back( keyBits->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
+		keyBitsArgument->upload<KeyBitsArgument>( commandList, {keyType} );
+		uploadBarriers.push_back( keyBitsArgument->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
+		resourceBarrier( commandList, uploadBarriers );
+
+		stumper->stampBeg( commandList, "KeyBits" );
+		keyBitsCompute->setPipelineState( commandList );
+		keyBitsCompute->setComputeRootSignature( commandList );
+		heap->startNextHeapAndAssign( commandList, keyBitsCompute->descriptorMap() );
+		heap->u( deviceObject->device(), 0, xs0->resource(), xs0->UAVDescription() );
+		heap->u( deviceObject->device(), 1, keyBits->resource(), keyBits->UAVDescription() );
+		heap->b( deviceObject->device(), 0, keyBitsArgument->resource() );
+		keyBitsCompute->dispatch( commandList, dispatchsize( numberOfElement, 64 ), 1, 1 );
+		stumper->stampEnd( commandList );
+
+		resourceBarrier( commandList, {keyBits->resourceBarrierUAV()} );
+	} );
+	deviceObject->queueObject()->execute( keyBitsCommandList.get() );
+
+	std::vector<uint32_t> keyBitsValues = keyBits->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
+	uint64_t varying = (uint64_t)( keyBitsValues[2] ^ keyBitsValues[3] ) << 32 | ( keyBitsValues[0] ^ keyBitsValues[1] );
+
+	cpu::RadixPass passes[16];
+	int numberOfIteration = cpu::planRadixPasses( varying, numberOfElement, RADIX_MAX_BITS, passes );
+	printf( "varying bits %016llx -- %d passes of %d bits\n", varying, numberOfIteration, 0 < numberOfIteration ? passes[0].bits : 0 );
+
+	std::vector<std::unique_ptr<ConstantBufferObject>> countAndReorderArguments;
+	for ( int i = 0; i < numberOfIteration; ++i )
+	{
+		countAndReorderArguments.push_back(
+			std::unique_ptr<ConstantBufferObject>( new ConstantBufferObject( deviceObject->device(), sizeof( CountAndReorderArgument ), D3D12_RESOURCE_STATE_COPY_DEST ) ) );
+	}
+
+	computeCommandList->storeCommand( [&]( ID3D12GraphicsCommandList* commandList ) {
+		// upload
+		std::vector<D3D12_RESOURCE_BARRIER> uploadBarriers;
 
 		//
-		for ( int i = 0; i < RADIX_NUMBER_OF_ITERATION; ++i )
+		for ( int i = 0; i < numberOfIteration; ++i )
 		{
-			countAndReorderArguments[i]->upload<CountAndReorderArgument>( commandList, {(uint32_t)numberOfBlock, (uint32_t)ELEMENTS_IN_BLOCK, (uint32_t)i} );
+			CountAndReorderArgument arg = {};
+			arg.numberOfBlock = (uint32_t)numberOfBlock;
+			arg.elementsInBlock = ELEMENTS_IN_BLOCK;
+			arg.shift = passes[i].shift;
+			arg.keyType = keyType;
+			arg.hasValues = 1;
+			arg.digitMask = ( 1u << passes[i].bits ) - 1;
+			countAndReorderArguments[i]->upload( commandList, arg );
 			uploadBarriers.push_back( countAndReorderArguments[i]->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
 		}
 
-		// Scan Global Upload
-		for ( int i = 0; i < globalScanIteration; ++i )
-		{
-			ScanGlobalArgument arg = {};
-			arg.iteration = i;
-			arg.offset = 1 << i;
-			scanglobalConstants[i]->upload( commandList, arg );
-			uploadBarriers.push_back( scanglobalConstants[i]->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
-		}
 		resourceBarrier( commandList, uploadBarriers );
 
-		for ( int i = 0; i < RADIX_NUMBER_OF_ITERATION; ++i )
+		for ( int i = 0; i < numberOfIteration; ++i )
 		{
 			// clear
 			stumper->stampBeg( commandList, "Count" );
@@ -181,33 +272,8 @@ void run( DeviceObject* deviceObject )
 			{
 				PIXScopedEvent( commandList, PIX_COLOR_DEFAULT, "Scan [%d]", i );
 
-				// Scan Prepare
-				scanPrepareCompute->setPipelineState( commandList );
-				scanPrepareCompute->setComputeRootSignature( commandList );
-				heap->startNextHeapAndAssign( commandList, scanPrepareCompute->descriptorMap() );
-				heap->u( deviceObject->device(), 0, counter->resource(), counter->UAVDescription() );
-				heap->u( deviceObject->device(), 1, globalScanTable0->resource(), globalScanTable0->UAVDescription() );
-				scanPrepareCompute->dispatch( commandList, dispatchsize( numberOfAllCoutner, 128 ), 1, 1 );
-
-				resourceBarrier( commandList, {globalScanTable0->resourceBarrierUAV()} );
-
-				// globalScanTable0 is a always latest one.
-				for ( int j = 0; j < globalScanIteration; ++j )
-				{
-					PIXScopedEvent( commandList, PIX_COLOR_DEFAULT, "Scan-step [%d]", j );
-
-					scanglobalCompute->setPipelineState( commandList );
-					scanglobalCompute->setComputeRootSignature( commandList );
-					heap->startNextHeapAndAssign( commandList, scanglobalCompute->descriptorMap() );
-					heap->b( deviceObject->device(), 0, scanglobalConstants[j]->resource() );
-					heap->u( deviceObject->device(), 0, globalScanTable0->resource(), globalScanTable0->UAVDescription() );
-					heap->u( deviceObject->device(), 1, globalScanTable1->resource(), globalScanTable1->UAVDescription() );
-
-					scanglobalCompute->dispatch( commandList, dispatchsize( numberOfAllCoutner, 64 ), 1, 1 );
-
-					std::swap( globalScanTable0, globalScanTable1 );
-					resourceBarrier( commandList, {globalScanTable0->resourceBarrierUAV()} );
-				}
+				// the counters of digits wider than the pass are all zero and don't change the prefix
+				scanner.exclusiveScan( commandList, deviceObject->device(), heap.get(), counter.get(), (uint32_t)( numberOfBlock << passes[i].bits ) );
 
 				stumper->stampEnd( commandList );
 			}
@@ -222,15 +288,18 @@ void run( DeviceObject* deviceObject )
 				heap->startNextHeapAndAssign( commandList, reorderCompute->descriptorMap() );
 				heap->u( deviceObject->device(), 0, xs0->resource(), xs0->UAVDescription() );
 				heap->u( deviceObject->device(), 1, xs1->resource(), xs1->UAVDescription() );
-				heap->u( deviceObject->device(), 2, globalScanTable0->resource(), globalScanTable0->UAVDescription() );
+				heap->u( deviceObject->device(), 2, counter->resource(), counter->UAVDescription() );
+				heap->u( deviceObject->device(), 3, values0->resource(), values0->UAVDescription() );
+				heap->u( deviceObject->device(), 4, values1->resource(), values1->UAVDescription() );
 				heap->b( deviceObject->device(), 0, countAndReorderArguments[i]->resource() );
 				// reorderCompute->dispatch( commandList, dispatchsize( numberOfBlock, 64 ), 1, 1 );
 
 				reorderCompute->dispatch( commandList, numberOfBlock, 1, 1 );
 
 				std::swap( xs0, xs1 );
+				std::swap( values0, values1 );
 
-				resourceBarrier( commandList, {xs0->resourceBarrierUAV()} );
+				resourceBarrier( commandList, {xs0->resourceBarrierUAV(), values0->resourceBarrierUAV()} );
 			}
 
 			stumper->stampEnd( commandList );
@@ -248,57 +317,42 @@ void run( DeviceObject* deviceObject )
 	}
 
 	auto stumpdata = stumper->download( deviceObject->queueObject()->queue() );
+	double gpuTotal = 0.0;
 	for ( auto s : stumpdata )
 	{
 		printf( "%s -- %.4f ms\n", s.label.c_str(), s.durationMS );
+		gpuTotal += s.durationMS;
 	}
+	printf( "gpu total -- %.4f ms\n", gpuTotal );
 
-	std::vector<uint32_t> counterValues = counter->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
-	std::vector<uint32_t> globalScanTableValues = globalScanTable0->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
-	std::vector<uint32_t> sortedValues = xs0->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
-
-	// this check is RADIX_NUMBER_OF_ITERATION == 1 only
-	//// Check Counter
-	//{
-	//	for ( int i = 0; i < numberOfElement; i += ELEMENTS_IN_BLOCK )
-	//	{
-	//		std::vector<uint32_t> counter( COUNTERS_IN_BLOCK );
-	//		for ( int j = 0; j < ELEMENTS_IN_BLOCK; ++j )
-	//		{
-	//			int src = i + j;
-	//			if ( numberOfElement <= src )
-	//			{
-	//				break;
-	//			}
-	//			uint32_t index = input[src] & 0xFF;
-	//			counter[index]++;
-	//		}
-
-	//		int blockindex = i / ELEMENTS_IN_BLOCK;
-	//		for ( int j = 0; j < COUNTERS_IN_BLOCK; ++j )
-	//		{
-	//			DX_ASSERT( counterValues[numberOfBlock * j + blockindex] == counter[j], "" );
-	//		}
-	//	}
-	//}
-
-	//// Check Prefix Sum
-	//{
-	//	int sum = 0;
-	//	for ( int i = 0; i < counterValues.size(); i++ )
-	//	{
-	//		DX_ASSERT( globalScanTableValues[i] == sum, "" );
-	//		sum += counterValues[i];
-	//	}
-	//}
+	std::vector<uint32_t> sortedKeys = xs0->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
+	std::vector<uint32_t> sortedValues = values0->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
 
 	// Check Sort
 	{
-		std::sort( input.begin(), input.end() );
+		auto sortKey = [&]( uint32_t index ) {
+			if ( keyType == RADIX_KEY_UINT64 )
+			{
+				return (uint64_t)input[index * 2 + 1] << 32 | input[index * 2];
+			}
+			if ( keyType == RADIX_KEY_FLOAT32 )
+			{
+				float f;
+				memcpy( &f, &input[index], sizeof( float ) );
+				return (uint64_t)cpu::RadixKey<float>::bits( f );
+			}
+			return (uint64_t)input[index];
+		};
+		std::vector<uint32_t> expected = inputValues;
+		std::stable_sort( expected.begin(), expected.end(), [&]( uint32_t a, uint32_t b ) { return sortKey( a ) < sortKey( b ); } );
 
 		for ( int i = 0; i < sortedValues.size(); ++i )
 		{
-			DX_ASSERT( sortedValues[i] == input[i], "" );
+			DX_ASSERT( sortedValues[i] == expected[i], "" );
+			for ( uint32_t j = 0; j < wordsPerKey; ++j )
+			{
+				DX_ASSERT( sortedKeys[i * wordsPerKey + j] == input[expected[i] * wordsPerKey + j], "" );
+			}
 		}
 	}
 
@@ -306,11 +360,500 @@ void run( DeviceObject* deviceObject )
 	deviceObject->present();
 }
 
+/*
+	the scan of the counter table of run(), the Hillis-Steele scan it used before against GpuScan.
+	Also a float max scan against cpu::inclusiveScan()
+*/
+void runScan( DeviceObject* deviceObject )
+{
+	using namespace pr;
+
+	uint32_t n = (uint32_t)( dispatchsize( 10000000, ELEMENTS_IN_BLOCK ) * COUNTERS_IN_BLOCK );
+	std::vector<uint32_t> counts( n );
+	std::vector<float> floats( n );
+	for ( uint32_t i = 0; i < n; ++i )
+	{
+		counts[i] = rand() % 4;
+		floats[i] = (float)rand() / RAND_MAX - 0.5f;
+	}
+
+	std::shared_ptr<StackDescriptorHeapObject> heap( new StackDescriptorHeapObject( deviceObject->device(), 512 ) );
+	std::shared_ptr<CommandObject> computeCommandList( new CommandObject( deviceObject->device(), D3D12_COMMAND_LIST_TYPE_DIRECT ) );
+	computeCommandList->setName( L"Scan" );
+
+	uint64_t bytes = sizeof( uint32_t ) * n;
+	std::unique_ptr<BufferObjectUAV> counter( new BufferObjectUAV( deviceObject->device(), bytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+	std::unique_ptr<BufferObjectUAV> scanTable0( new BufferObjectUAV( deviceObject->device(), bytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+	std::unique_ptr<BufferObjectUAV> scanTable1( new BufferObjectUAV( deviceObject->device(), bytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+	std::unique_ptr<BufferObjectUAV> scanned( new BufferObjectUAV( deviceObject->device(), bytes, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+	std::unique_ptr<BufferObjectUAV> maxScanned( new BufferObjectUAV( deviceObject->device(), bytes, sizeof( float ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+
+	std::unique_ptr<UploaderObject> uploader( new UploaderObject( deviceObject->device(), bytes ) );
+	uploader->map( [&]( void* p ) {
+		memcpy( p, counts.data(), bytes );
+	} );
+	std::unique_ptr<UploaderObject> floatUploader( new UploaderObject( deviceObject->device(), bytes ) );
+	floatUploader->map( [&]( void* p ) {
+		memcpy( p, floats.data(), bytes );
+	} );
+
+	std::unique_ptr<ComputeObject> scanPrepareCompute( new ComputeObject() );
+	scanPrepareCompute->u( 0 );
+	scanPrepareCompute->u( 1 );
+	scanPrepareCompute->loadShaderAndBuild( deviceObject->device(), GetDataPath( "radixsort_scanPrepare.cso" ).c_str() );
+
+	std::unique_ptr<ComputeObject> scanglobalCompute( new ComputeObject() );
+	scanglobalCompute->u( 0 );
+	scanglobalCompute->u( 1 );
+	scanglobalCompute->b( 0 );
+	scanglobalCompute->loadShaderAndBuild( deviceObject->device(), GetDataPath( "radixsort_scanglobal.cso" ).c_str() );
+
+	int globalScanIteration = prefixScanIterationCount( n );
+	std::vector<std::unique_ptr<ConstantBufferObject>> scanglobalConstants;
+	for ( int i = 0; i < globalScanIteration; ++i )
+	{
+		std::unique_ptr<ConstantBufferObject> constant( new ConstantBufferObject( deviceObject->device(), sizeof( ScanGlobalArgument ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+		scanglobalConstants.push_back( std::move( constant ) );
+	}
+
+	GpuScan scanner( deviceObject->device(), n );
+
+	std::unique_ptr<TimestampObject> stumper( new TimestampObject( deviceObject->device(), 16 ) );
+
+	computeCommandList->storeCommand( [&]( ID3D12GraphicsCommandList* commandList ) {
+		std::vector<D3D12_RESOURCE_BARRIER> uploadBarriers;
+		counter->copyFrom( commandList, uploader.get() );
+		uploadBarriers.push_back( counter->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
+		scanned->copyFrom( commandList, uploader.get() );
+		uploadBarriers.push_back( scanned->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
+		maxScanned->copyFrom( commandList, floatUploader.get() );
+		uploadBarriers.push_back( maxScanned->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
+		for ( int i = 0; i < globalScanIteration; ++i )
+		{
+			ScanGlobalArgument arg = {};
+			arg.iteration = i;
+			arg.offset = 1 << i;
+			scanglobalConstants[i]->upload( commandList, arg );
+			uploadBarriers.push_back( scanglobalConstants[i]->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ) );
+		}
+		resourceBarrier( commandList, uploadBarriers );
+
+		stumper->stampBeg( commandList, "Hillis-Steele scan" );
+		{
+			scanPrepareCompute->setPipelineState( commandList );
+			scanPrepareCompute->setComputeRootSignature( commandList );
+			heap->startNextHeapAndAssign( commandList, scanPrepareCompute->descriptorMap() );
+			heap->u( deviceObject->device(), 0, counter->resource(), counter->UAVDescription() );
+			heap->u( deviceObject->device(), 1, scanTable0->resource(), scanTable0->UAVDescription() );
+			scanPrepareCompute->dispatch( commandList, dispatchsize( n, 128 ), 1, 1 );
+
+			resourceBarrier( commandList, {scanTable0->resourceBarrierUAV()} );
+
+			for ( int j = 0; j < globalScanIteration; ++j )
+			{
+				scanglobalCompute->setPipelineState( commandList );
+				scanglobalCompute->setComputeRootSignature( commandList );
+				heap->startNextHeapAndAssign( commandList, scanglobalCompute->descriptorMap() );
+				heap->b( deviceObject->device(), 0, scanglobalConstants[j]->resource() );
+				heap->u( deviceObject->device(), 0, scanTable0->resource(), scanTable0->UAVDescription() );
+				heap->u( deviceObject->device(), 1, scanTable1->resource(), scanTable1->UAVDescription() );
+				scanglobalCompute->dispatch( commandList, dispatchsize( n, 64 ), 1, 1 );
+
+				std::swap( scanTable0, scanTable1 );
+				resourceBarrier( commandList, {scanTable0->resourceBarrierUAV()} );
+			}
+		}
+		stumper->stampEnd( commandList );
+
+		stumper->stampBeg( commandList, "GpuScan" );
+		scanner.exclusiveScan( commandList, deviceObject->device(), heap.get(), scanned.get(), n );
+		stumper->stampEnd( commandList );
+
+		stumper->stampBeg( commandList, "GpuScan float max" );
+		scanner.inclusiveScan( commandList, deviceObject->device(), heap.get(), maxScanned.get(), n, SCAN_TYPE_FLOAT, SCAN_OP_MAX );
+		stumper->stampEnd( commandList );
+
+		stumper->resolve( commandList );
+	} );
+
+	deviceObject->queueObject()->execute( computeCommandList.get() );
+	{
+		std::shared_ptr<FenceObject> fence = deviceObject->queueObject()->fence( deviceObject->device() );
+		fence->wait();
+	}
+
+	printf( "scan of %d elements, %d dispatches -> 3 dispatches\n", n, globalScanIteration + 1 );
+	for ( auto s : stumper->download( deviceObject->queueObject()->queue() ) )
+	{
+		printf( "%s -- %.4f ms\n", s.label.c_str(), s.durationMS );
+	}
+
+	std::vector<uint32_t> hillisSteeleValues = scanTable0->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
+	std::vector<uint32_t> scannedValues = scanned->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
+	std::vector<float> maxScannedValues = maxScanned->synchronizedDownload<float>( deviceObject->device(), deviceObject->queueObject() );
+
+	cpu::exclusiveScan( counts.data(), counts.size() );
+	cpu::inclusiveScan( floats.data(), floats.size(), cpu::ScanMax() );
+	for ( uint32_t i = 0; i < n; ++i )
+	{
+		DX_ASSERT( hillisSteeleValues[i] == counts[i], "" );
+		DX_ASSERT( scannedValues[i] == counts[i], "" );
+		DX_ASSERT( maxScannedValues[i] == floats[i], "" );
+	}
+}
+
+/*
+	segment offsets skewed like the tasks of a BVH build: a few segments of a large share of n, and many tiny ones.
+	Every segment starts at its offset and the first is at 0
+*/
+static std::vector<uint32_t> skewedSegments( uint32_t n )
+{
+	std::vector<uint32_t> offsets;
+	uint32_t offset = 0;
+	while ( offset < n )
+	{
+		offsets.push_back( offset );
+		uint32_t size = rand() % 256 == 0 ? 1 + ( (uint32_t)rand() << 15 | rand() ) % ( n / 64 ) : 1 + rand() % 32;
+		offset += size;
+	}
+	return offsets;
+}
+
+// GpuScan::segmentedScan() over skewed segments against cpu::segmentedInclusiveScan()
+void runSegmentedScan( DeviceObject* deviceObject )
+{
+	using namespace pr;
+
+	uint32_t n = 10000000;
+	std::vector<uint32_t> xs( n );
+	for ( uint32_t i = 0; i < n; ++i )
+	{
+		xs[i] = rand() % 4;
+	}
+	std::vector<uint32_t> offsets = skewedSegments( n );
+
+	std::shared_ptr<StackDescriptorHeapObject> heap( new StackDescriptorHeapObject( deviceObject->device(), 512 ) );
+	std::shared_ptr<CommandObject> computeCommandList( new CommandObject( deviceObject->device(), D3D12_COMMAND_LIST_TYPE_DIRECT ) );
+	computeCommandList->setName( L"SegmentedScan" );
+
+	std::unique_ptr<BufferObjectUAV> scanned( new BufferObjectUAV( deviceObject->device(), sizeof( uint32_t ) * n, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+	std::unique_ptr<BufferObjectUAV> segmentOffsets( new BufferObjectUAV( deviceObject->device(), sizeof( uint32_t ) * offsets.size(), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+
+	std::unique_ptr<UploaderObject> uploader( new UploaderObject( deviceObject->device(), sizeof( uint32_t ) * n ) );
+	uploader->map( [&]( void* p ) {
+		memcpy( p, xs.data(), sizeof( uint32_t ) * n );
+	} );
+	std::unique_ptr<UploaderObject> offsetsUploader( new UploaderObject( deviceObject->device(), sizeof( uint32_t ) * offsets.size() ) );
+	offsetsUploader->map( [&]( void* p ) {
+		memcpy( p, offsets.data(), sizeof( uint32_t ) * offsets.size() );
+	} );
+
+	GpuScan scanner( deviceObject->device(), n );
+
+	std::unique_ptr<TimestampObject> stumper( new TimestampObject( deviceObject->device(), 16 ) );
+
+	computeCommandList->storeCommand( [&]( ID3D12GraphicsCommandList* commandList ) {
+		scanned->copyFrom( commandList, uploader.get() );
+		segmentOffsets->copyFrom( commandList, offsetsUploader.get() );
+		resourceBarrier( commandList, {
+										  scanned->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
+										  segmentOffsets->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
+									  } );
+
+		stumper->stampBeg( commandList, "GpuScan segmented" );
+		scanner.segmentedInclusiveScan( commandList, deviceObject->device(), heap.get(), scanned.get(), n, segmentOffsets.get(), (uint32_t)offsets.size() );
+		stumper->stampEnd( commandList );
+
+		stumper->resolve( commandList );
+	} );
+
+	deviceObject->queueObject()->execute( computeCommandList.get() );
+	{
+		std::shared_ptr<FenceObject> fence = deviceObject->queueObject()->fence( deviceObject->device() );
+		fence->wait();
+	}
+
+	printf( "segmented scan of %d elements, %d segments\n", n, (int)offsets.size() );
+	for ( auto s : stumper->download( deviceObject->queueObject()->queue() ) )
+	{
+		printf( "%s -- %.4f ms\n", s.label.c_str(), s.durationMS );
+	}
+
+	std::vector<uint32_t> scannedValues = scanned->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
+	cpu::segmentedInclusiveScan( xs.data(), xs.size(), offsets.data(), offsets.size() );
+	for ( uint32_t i = 0; i < n; ++i )
+	{
+		DX_ASSERT( scannedValues[i] == xs[i], "" );
+	}
+}
+
+// GpuRadixSelect::topK() against cpu::RadixSelect, the top-k of 10M keys
+template <class Key>
+void runTopK( DeviceObject* deviceObject, uint32_t keyType, Key ( *random )() )
+{
+	using namespace pr;
+
+	uint32_t n = 10000000;
+	uint32_t k = 1000;
+	std::vector<Key> keys( n );
+	for ( uint32_t i = 0; i < n; ++i )
+	{
+		keys[i] = random();
+	}
+
+	std::shared_ptr<StackDescriptorHeapObject> heap( new StackDescriptorHeapObject( deviceObject->device(), 512 ) );
+	std::shared_ptr<CommandObject> computeCommandList( new CommandObject( deviceObject->device(), D3D12_COMMAND_LIST_TYPE_DIRECT ) );
+	computeCommandList->setName( L"TopK" );
+
+	std::unique_ptr<BufferObjectUAV> xs( new BufferObjectUAV( deviceObject->device(), sizeof( Key ) * n, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+	std::unique_ptr<BufferObjectUAV> outKeys( new BufferObjectUAV( deviceObject->device(), sizeof( Key ) * k, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+	std::unique_ptr<BufferObjectUAV> outIndices( new BufferObjectUAV( deviceObject->device(), sizeof( uint32_t ) * k, sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+
+	std::unique_ptr<UploaderObject> uploader( new UploaderObject( deviceObject->device(), sizeof( Key ) * n ) );
+	uploader->map( [&]( void* p ) {
+		memcpy( p, keys.data(), sizeof( Key ) * n );
+	} );
+
+	GpuRadixSelect selector( deviceObject->device() );
+
+	std::unique_ptr<TimestampObject> stumper( new TimestampObject( deviceObject->device(), 16 ) );
+
+	computeCommandList->storeCommand( [&]( ID3D12GraphicsCommandList* commandList ) {
+		xs->copyFrom( commandList, uploader.get() );
+		resourceBarrier( commandList, {xs->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON )} );
+
+		stumper->stampBeg( commandList, "GpuRadixSelect topK" );
+		selector.topK( commandList, deviceObject->device(), heap.get(), xs.get(), n, keyType, k, outKeys.get(), outIndices.get() );
+		stumper->stampEnd( commandList );
+
+		stumper->resolve( commandList );
+	} );
+
+	deviceObject->queueObject()->execute( computeCommandList.get() );
+	{
+		std::shared_ptr<FenceObject> fence = deviceObject->queueObject()->fence( deviceObject->device() );
+		fence->wait();
+	}
+
+	printf( "top %d of %d keys ( %s )\n", k, n, keyTypeName( keyType ) );
+	for ( auto s : stumper->download( deviceObject->queueObject()->queue() ) )
+	{
+		printf( "%s -- %.4f ms\n", s.label.c_str(), s.durationMS );
+	}
+
+	std::vector<Key> selectedKeys = outKeys->synchronizedDownload<Key>( deviceObject->device(), deviceObject->queueObject() );
+	std::vector<uint32_t> selectedIndices = outIndices->synchronizedDownload<uint32_t>( deviceObject->device(), deviceObject->queueObject() );
+
+	// the ties may differ from the CPU, so compare the sorted keys
+	std::vector<Key> expectedKeys( k );
+	std::vector<uint32_t> expectedIndices( k );
+	cpu::topK( keys.data(), n, k, expectedKeys.data(), expectedIndices.data() );
+	for ( uint32_t i = 0; i < k; ++i )
+	{
+		DX_ASSERT( keys[selectedIndices[i]] == selectedKeys[i], "" );
+	}
+	std::sort( selectedKeys.begin(), selectedKeys.end() );
+	for ( uint32_t i = 0; i < k; ++i )
+	{
+		DX_ASSERT( selectedKeys[i] == expectedKeys[i], "" );
+	}
+}
+
+// the segmented sort on CPU over skewed segments, against sorting the segments one by one. keys are uniform over the full width of Key
+template <class Key>
+void runCpuSegmented( const char* keyName )
+{
+	using namespace pr;
+
+	std::vector<Key> input( 10000000 );
+	cpu::generateKeys( input.data(), input.size(), cpu::KeyDistribution::Uniform, 1 );
+	std::vector<uint32_t> offsets = skewedSegments( (uint32_t)input.size() );
+
+	cpu::RadixSort<Key> sorter;
+	std::vector<Key> expected;
+	for ( int i = 0; i < 4; ++i )
+	{
+		expected = input;
+		Stopwatch sw;
+		for ( int j = 0; j < offsets.size(); ++j )
+		{
+			uint32_t end = j + 1 < offsets.size() ? offsets[j + 1] : (uint32_t)input.size();
+			sorter.sort( expected.data() + offsets[j], end - offsets[j] );
+		}
+		printf( "[segmented %s] sort per segment -- %.4f ms ( %d segments )\n", keyName, 1000.0 * sw.elapsed(), (int)offsets.size() );
+	}
+
+	std::vector<Key> sortedValues;
+	for ( int i = 0; i < 4; ++i )
+	{
+		sortedValues = input;
+		Stopwatch sw;
+		sorter.sortSegments( sortedValues.data(), sortedValues.size(), offsets.data(), offsets.size() );
+		printf( "[segmented %s] cpu segmented radix sort -- %.4f ms ( %d threads )\n", keyName, 1000.0 * sw.elapsed(), cpu::ThreadPool::global().threadCount() );
+	}
+	for ( int i = 0; i < sortedValues.size(); ++i )
+	{
+		DX_ASSERT( sortedValues[i] == expected[i], "" );
+	}
+}
+
+// the top-k on CPU, against a full sort and std::partial_sort
+void runCpuTopK()
+{
+	using namespace pr;
+
+	std::vector<float> input( 10000000 );
+	for ( int i = 0; i < input.size(); ++i )
+	{
+		input[i] = (float)rand32() / 0xFFFFFFFFu - 0.5f;
+	}
+
+	for ( size_t k : {1, 1000, 100000} )
+	{
+		std::vector<float> topKeys( k );
+		std::vector<uint32_t> topIndices( k );
+		cpu::RadixSelect<float> selector;
+		for ( int i = 0; i < 4; ++i )
+		{
+			Stopwatch sw;
+			selector.topK( input.data(), input.size(), k, topKeys.data(), topIndices.data() );
+			printf( "[top %d] cpu radix select -- %.4f ms ( %d threads )\n", (int)k, 1000.0 * sw.elapsed(), cpu::ThreadPool::global().threadCount() );
+		}
+
+		std::vector<float> sortedValues = input;
+		{
+			cpu::RadixSort<float> sorter;
+			Stopwatch sw;
+			sorter.sort( sortedValues.data(), sortedValues.size() );
+			printf( "[top %d] cpu radix sort -- %.4f ms\n", (int)k, 1000.0 * sw.elapsed() );
+		}
+
+		std::vector<float> expected = input;
+		{
+			Stopwatch sw;
+			std::partial_sort( expected.begin(), expected.begin() + k, expected.end() );
+			printf( "[top %d] std::partial_sort -- %.4f ms\n", (int)k, 1000.0 * sw.elapsed() );
+		}
+
+		for ( int i = 0; i < k; ++i )
+		{
+			DX_ASSERT( topKeys[i] == expected[i], "" );
+			DX_ASSERT( topKeys[i] == sortedValues[i], "" );
+			DX_ASSERT( input[topIndices[i]] == topKeys[i], "" );
+		}
+	}
+}
+
+// the scan of run() on CPU, a single thread loop against cpu::exclusiveScan()
+void runCpuScan()
+{
+	using namespace pr;
+
+	std::vector<uint32_t> counts( dispatchsize( 10000000, ELEMENTS_IN_BLOCK ) * COUNTERS_IN_BLOCK );
+	for ( int i = 0; i < counts.size(); ++i )
+	{
+		counts[i] = rand() % 4;
+	}
+
+	std::vector<uint32_t> expected = counts;
+	{
+		Stopwatch sw;
+		uint32_t sum = 0;
+		for ( uint32_t& x : expected )
+		{
+			uint32_t c = x;
+			x = sum;
+			sum += c;
+		}
+		printf( "[scan] serial -- %.4f ms\n", 1000.0 * sw.elapsed() );
+	}
+
+	std::vector<uint32_t> scanned;
+	for ( int i = 0; i < 4; ++i )
+	{
+		scanned = counts;
+		Stopwatch sw;
+		cpu::exclusiveScan( scanned.data(), scanned.size() );
+		printf( "[scan] cpu::exclusiveScan -- %.4f ms ( %d threads )\n", 1000.0 * sw.elapsed(), cpu::ThreadPool::global().threadCount() );
+	}
+	for ( int i = 0; i < scanned.size(); ++i )
+	{
+		DX_ASSERT( scanned[i] == expected[i], "" );
+	}
+}
+
+// the same input size on CPU, against std::sort
+template <class Key>
+void runCpu( const char* name, Key ( *random )() )
+{
+	using namespace pr;
+
+	std::vector<Key> input( 10000000 );
+	for ( int i = 0; i < input.size(); ++i )
+	{
+		input[i] = random();
+	}
+
+	cpu::RadixSort<Key> sorter;
+	std::vector<Key> sortedValues;
+	for ( int i = 0; i < 4; ++i )
+	{
+		sortedValues = input;
+		Stopwatch sw;
+		sorter.sort( sortedValues.data(), sortedValues.size() );
+		printf( "[%s] cpu radix sort -- %.4f ms ( %d threads )\n", name, 1000.0 * sw.elapsed(), cpu::ThreadPool::global().threadCount() );
+	}
+
+	std::vector<Key> expected = input;
+	Stopwatch sw;
+	std::sort( expected.begin(), expected.end() );
+	printf( "[%s] std::sort -- %.4f ms\n", name, 1000.0 * sw.elapsed() );
+
+	for ( int i = 0; i < sortedValues.size(); ++i )
+	{
+		DX_ASSERT( sortedValues[i] == expected[i], "" );
+	}
+
+	// with the original indices as values
+	std::vector<uint32_t> indices( input.size() );
+	for ( int i = 0; i < 4; ++i )
+	{
+		sortedValues = input;
+		for ( int j = 0; j < indices.size(); ++j )
+		{
+			indices[j] = j;
+		}
+		Stopwatch sw;
+		sorter.sort( sortedValues.data(), indices.data(), sortedValues.size() );
+		printf( "[%s] cpu radix sort key-value -- %.4f ms\n", name, 1000.0 * sw.elapsed() );
+	}
+	for ( int i = 0; i < sortedValues.size(); ++i )
+	{
+		DX_ASSERT( sortedValues[i] == expected[i], "" );
+		DX_ASSERT( input[indices[i]] == sortedValues[i], "" );
+		DX_ASSERT( i == 0 || sortedValues[i - 1] < sortedValues[i] || indices[i - 1] < indices[i], "" );
+	}
+}
+
 int main()
 {
 	using namespace pr;
 	SetDataDir( ExecutableDir() );
 
+	// the thresholds of the hybrid CPU sorts, before anything else runs on the pool
+	cpu::RadixSort<uint32_t>::tune();
+	cpu::RadixSort<uint64_t>::tune();
+	cpu::RadixSort<float>::tune();
+
+	runCpuScan();
+	runCpuSegmented<uint32_t>( "uint32" );
+	runCpuSegmented<uint64_t>( "uint64" );
+	runCpuTopK();
+	runCpu<uint32_t>( "uint32", []() { return rand32(); } );
+	runCpu<uint32_t>( "uint32 12 bit", []() { return (uint32_t)rand() & 0xFFF; } );
+	runCpu<uint64_t>( "uint64", []() { return (uint64_t)rand32() << 32 | rand32(); } );
+	runCpu<float>( "float32", []() { return ( (float)rand() / RAND_MAX - 0.5f ) * 1000.0f; } );
+
 	// Activate Debug Layer
 	enableDebugLayer();
 
@@ -340,7 +883,15 @@ int main()
 		{
 			printf( "run : %s\n", wstring_to_string( d->deviceName() ).c_str() );
 			d->device()->SetStablePowerState( true );
-			run( d.get() );
+			runScan( d.get() );
+			runSegmentedScan( d.get() );
+			runTopK<uint32_t>( d.get(), RADIX_KEY_UINT32, []() { return rand32(); } );
+			runTopK<float>( d.get(), RADIX_KEY_FLOAT32, []() { return ( (float)rand32() / 0xFFFFFFFFu - 0.5f ) * 1000.0f; } );
+			runTopK<uint64_t>( d.get(), RADIX_KEY_UINT64, []() { return (uint64_t)rand32() << 32 | rand32(); } );
+			for ( uint32_t keyType : {RADIX_KEY_UINT32, RADIX_KEY_FLOAT32, RADIX_KEY_UINT64} )
+			{
+				run( d.get(), keyType );
+			}
 		}
 	}
 }
@@ -0,0 +1,591 @@
+﻿#include "pr.hpp"
+#include "lwHoudiniLoader.hpp"
+#include "CpuBvh.hpp"
+#include "CpuBvhStats.hpp"
+#include "CpuBvhClosestPoint.hpp"
+#include "CpuBvhOverlap.hpp"
+#include "CpuBvhFrustum.hpp"
+#include "CpuBvhQuantized.hpp"
+#include "CpuBvhReorder.hpp"
+#include "CpuLinearRt.hpp"
+#include "CpuGBuffer.hpp"
+
+const char* nodeOrderName( cpu::NodeOrder order )
+{
+	switch ( order )
+	{
+	case cpu::NodeOrder::BreadthFirst:
+		return "breadth-first";
+	case cpu::NodeOrder::DepthFirst:
+		return "depth-first";
+	case cpu::NodeOrder::VanEmdeBoas:
+		return "van emde boas";
+	}
+	return "";
+}
+
+const char* triangleLayoutName( cpu::TriangleLayout layout )
+{
+	switch ( layout )
+	{
+	case cpu::TriangleLayout::Indexed:
+		return "indexed";
+	case cpu::TriangleLayout::Woop:
+		return "woop";
+	case cpu::TriangleLayout::Watertight:
+		return "watertight";
+	}
+	return "";
+}
+
+// unit uv sphere of segments x segments / 2 quads
+void uvSphere( int segments, std::vector<glm::vec3>* P, std::vector<uint32_t>* indices )
+{
+	int rings = segments / 2;
+	for ( int j = 0; j <= rings; ++j )
+	{
+		for ( int i = 0; i <= segments; ++i )
+		{
+			float theta = glm::pi<float>() * j / rings;
+			float phi = 2.0f * glm::pi<float>() * i / segments;
+			P->push_back( glm::vec3( std::sin( theta ) * std::cos( phi ), std::cos( theta ), std::sin( theta ) * std::sin( phi ) ) );
+		}
+	}
+	for ( int j = 0; j < rings; ++j )
+	{
+		for ( int i = 0; i < segments; ++i )
+		{
+			uint32_t i00 = j * ( segments + 1 ) + i;
+			uint32_t i10 = i00 + 1;
+			uint32_t i01 = i00 + segments + 1;
+			uint32_t i11 = i01 + 1;
+			uint32_t quad[] = {i00, i11, i10, i00, i01, i11};
+			indices->insert( indices->end(), quad, quad + 6 );
+		}
+	}
+}
+
+/*
+	Rays aimed exactly at shared vertices and edges of a tilted grid.
+	A closed surface can't be missed, so every miss is a leak through a crack.
+*/
+void crackTest()
+{
+	const int N = 128;
+	glm::vec3 axisX = glm::normalize( glm::vec3( 1.0f, 0.3f, 0.1f ) );
+	glm::vec3 axisY = glm::normalize( glm::cross( glm::vec3( 0.2f, 0.1f, 1.0f ), axisX ) );
+	glm::vec3 normal = glm::cross( axisX, axisY );
+
+	std::vector<glm::vec3> P;
+	std::vector<uint32_t> indices;
+	for ( int y = 0; y <= N; ++y )
+	{
+		for ( int x = 0; x <= N; ++x )
+		{
+			P.push_back( axisX * ( (float)x / N * 2.0f - 1.0f ) + axisY * ( (float)y / N * 2.0f - 1.0f ) + glm::vec3( 0.1f, 0.2f, 0.3f ) );
+		}
+	}
+	for ( int y = 0; y < N; ++y )
+	{
+		for ( int x = 0; x < N; ++x )
+		{
+			uint32_t i00 = y * ( N + 1 ) + x;
+			uint32_t i10 = i00 + 1;
+			uint32_t i01 = i00 + N + 1;
+			uint32_t i11 = i01 + 1;
+			uint32_t quad[] = {i00, i10, i11, i00, i11, i01};
+			indices.insert( indices.end(), quad, quad + 6 );
+		}
+	}
+
+	cpu::Bvh bvh;
+	cpu::buildBvh( &bvh, P.data(), (uint32_t)P.size(), indices.data(), (uint32_t)indices.size() / 3 );
+
+	// vertex, horizontal edge, diagonal edge of every inner quad from jittered origins
+	std::vector<cpu::Ray> rays;
+	uint32_t seed = 7;
+	auto random = [&]() {
+		seed = seed * 1664525u + 1013904223u;
+		return (float)( seed >> 8 ) / 16777216.0f * 2.0f - 1.0f;
+	};
+	for ( int y = 1; y < N; ++y )
+	{
+		for ( int x = 1; x < N; ++x )
+		{
+			glm::vec3 p00 = P[y * ( N + 1 ) + x];
+			glm::vec3 p10 = P[y * ( N + 1 ) + x + 1];
+			glm::vec3 p11 = P[( y + 1 ) * ( N + 1 ) + x + 1];
+			for ( glm::vec3 target : {p00, ( p00 + p10 ) * 0.5f, ( p00 + p11 ) * 0.5f} )
+			{
+				cpu::Ray ray;
+				ray.ro = target + normal * 3.0f + glm::vec3( random(), random(), random() );
+				ray.rd = glm::normalize( target - ray.ro );
+				rays.push_back( ray );
+			}
+		}
+	}
+
+	std::vector<cpu::Hit> hits( rays.size() );
+	for ( cpu::TriangleLayout layout : {cpu::TriangleLayout::Indexed, cpu::TriangleLayout::Woop, cpu::TriangleLayout::Watertight} )
+	{
+		cpu::precomputeTriangles( &bvh, layout );
+		cpu::intersect( bvh, rays.data(), hits.data(), rays.size() );
+
+		int leaked = 0;
+		for ( const cpu::Hit& hit : hits )
+		{
+			if ( hit.isHit() == false )
+			{
+				leaked++;
+			}
+		}
+		printf( "[%s] crack test: %d / %d rays leaked\n", triangleLayoutName( layout ), leaked, (int)rays.size() );
+	}
+}
+
+/*
+	Leaf ranges at the limit of the quantized leaf index, on a hand made one node bvh. No primitive is read.
+	A leaf starting at CPU_QBVH_MAX_LEAF_BEG has to decode as it was, and one past it has to fail the encode.
+*/
+void quantizedLeafLimitTest()
+{
+	auto oneNode = []( uint32_t begR, uint32_t endR ) {
+		BvhNode node;
+		for ( int axis = 0; axis < 3; ++axis )
+		{
+			node.lowerL[axis] = 0.0f;
+			node.upperL[axis] = 1.0f;
+			node.lowerR[axis] = 1.0f;
+			node.upperR[axis] = 2.0f;
+		}
+		node.indexL[0] = 0x80000000 | ( CPU_QBVH_MAX_LEAF_BEG - 1 );
+		node.indexL[1] = CPU_QBVH_MAX_LEAF_BEG;
+		node.indexR[0] = 0x80000000 | begR;
+		node.indexR[1] = endR;
+
+		cpu::Bvh bvh;
+		bvh.nodes.push_back( node );
+		return bvh;
+	};
+
+	cpu::QuantizedBvh<uint16_t> qbvh;
+	bool fits = cpu::encodeQuantizedBvh( oneNode( CPU_QBVH_MAX_LEAF_BEG, CPU_QBVH_MAX_LEAF_BEG + CPU_QBVH_MAX_LEAF_COUNT ), &qbvh );
+	bool decoded = fits && qbvh.nodes.size() == 1 &&
+				   cpu::quantizedLeafBeg( qbvh.nodes[0].indexL ) == CPU_QBVH_MAX_LEAF_BEG - 1 && cpu::quantizedLeafEnd( qbvh.nodes[0].indexL ) == CPU_QBVH_MAX_LEAF_BEG &&
+				   cpu::quantizedLeafBeg( qbvh.nodes[0].indexR ) == CPU_QBVH_MAX_LEAF_BEG && cpu::quantizedLeafEnd( qbvh.nodes[0].indexR ) == CPU_QBVH_MAX_LEAF_BEG + CPU_QBVH_MAX_LEAF_COUNT;
+	bool rejected = cpu::encodeQuantizedBvh( oneNode( CPU_QBVH_MAX_LEAF_BEG + 1, CPU_QBVH_MAX_LEAF_BEG + 2 ), &qbvh ) == false && qbvh.nodes.empty();
+	printf( "quantized leaf limit test: %s\n", decoded && rejected ? "ok" : "failed" );
+}
+
+/*
+	overlapPairs() and overlaps() against every pair of primitives, on a small sphere mesh with spheres around it and moved copies of itself.
+	The pairs have to be the same set, and overlaps() has to agree with it.
+*/
+void overlapTest()
+{
+	std::vector<glm::vec3> P;
+	std::vector<uint32_t> indices;
+	uvSphere( 24, &P, &indices );
+	std::vector<glm::vec4> spheres;
+	for ( int i = 0; i < 32; ++i )
+	{
+		float phi = 2.0f * glm::pi<float>() * i / 32;
+		spheres.push_back( glm::vec4( std::cos( phi ) * 1.1f, 0.1f * ( i % 5 ), std::sin( phi ) * 1.1f, 0.15f ) );
+	}
+	cpu::Bvh bvh;
+	cpu::buildBvh( &bvh, P.data(), (uint32_t)P.size(), indices.data(), (uint32_t)indices.size() / 3, spheres.data(), (uint32_t)spheres.size() );
+
+	// B in the space of A is xformB itself, as A stays at the origin
+	glm::mat4 xformA = glm::identity<glm::mat4>();
+	glm::mat4 moved = glm::rotate( glm::translate( glm::identity<glm::mat4>(), glm::vec3( 0.5f, 0.25f, 0.0f ) ), glm::radians( 30.0f ), glm::vec3( 0, 1, 0 ) );
+	glm::mat4 apart = glm::translate( glm::identity<glm::mat4>(), glm::vec3( 4.0f, 0.0f, 0.0f ) );
+	for ( const glm::mat4& xformB : {moved, apart} )
+	{
+		std::vector<uint64_t> expected;
+		for ( uint32_t iPrimA = 0; iPrimA < bvh.primitiveCount(); iPrimA++ )
+		{
+			for ( uint32_t iPrimB = 0; iPrimB < bvh.primitiveCount(); iPrimB++ )
+			{
+				bool isSphereA = bvh.primitiveType( iPrimA ) == BVH_PRIMITIVE_SPHERE;
+				bool isSphereB = bvh.primitiveType( iPrimB ) == BVH_PRIMITIVE_SPHERE;
+				glm::vec3 triA[3];
+				glm::vec3 triB[3];
+				glm::vec4 sA;
+				glm::vec4 sB;
+				if ( isSphereA )
+				{
+					sA = bvh.sphere( iPrimA );
+				}
+				else
+				{
+					bvh.triangle( iPrimA, &triA[0], &triA[1], &triA[2] );
+				}
+				if ( isSphereB )
+				{
+					sB = bvh.sphere( iPrimB );
+					sB = glm::vec4( glm::vec3( xformB * glm::vec4( sB.x, sB.y, sB.z, 1.0f ) ), sB.w );
+				}
+				else
+				{
+					bvh.triangle( iPrimB, &triB[0], &triB[1], &triB[2] );
+					for ( int k = 0; k < 3; ++k )
+					{
+						triB[k] = glm::vec3( xformB * glm::vec4( triB[k], 1.0f ) );
+					}
+				}
+
+				bool overlap;
+				if ( isSphereA && isSphereB )
+				{
+					float r = sA.w + sB.w;
+					glm::vec3 d = glm::vec3( sB ) - glm::vec3( sA );
+					overlap = glm::dot( d, d ) <= r * r;
+				}
+				else if ( isSphereA )
+				{
+					overlap = cpu::overlapSphereTriangle( glm::vec3( sA ), sA.w, triB );
+				}
+				else if ( isSphereB )
+				{
+					overlap = cpu::overlapSphereTriangle( glm::vec3( sB ), sB.w, triA );
+				}
+				else
+				{
+					overlap = cpu::overlapTriangleTriangle( triA, triB );
+				}
+				if ( overlap )
+				{
+					expected.push_back( (uint64_t)iPrimA << 32 | iPrimB );
+				}
+			}
+		}
+
+		std::vector<cpu::OverlapPair> pairs;
+		cpu::overlapPairs( bvh, xformA, bvh, xformB, &pairs );
+		std::vector<uint64_t> found;
+		for ( const cpu::OverlapPair& pair : pairs )
+		{
+			found.push_back( (uint64_t)pair.primA << 32 | pair.primB );
+		}
+		std::sort( found.begin(), found.end() );
+
+		bool hit = cpu::overlaps( bvh, xformA, bvh, xformB );
+		printf( "overlap test: %d pairs, %d by brute force, overlaps() %s\n", (int)found.size(), (int)expected.size(), hit ? "true" : "false" );
+		PR_ASSERT( found == expected );
+		PR_ASSERT( hit == !expected.empty() );
+	}
+}
+
+/*
+	A mesh rebuilt every frame: build + trace of the linear caster against build + trace of the bvh,
+	on uv spheres of growing triangle counts. Reports where the bvh starts to win.
+*/
+void linearBreakEvenTest( const glm::mat4& inverseVP )
+{
+	using namespace pr;
+
+	const int width = 320;
+	const int height = 180;
+	std::vector<cpu::Ray> rays( width * height );
+	for ( int y = 0; y < height; ++y )
+	{
+		for ( int x = 0; x < width; ++x )
+		{
+			cpu::Ray& ray = rays[y * width + x];
+			cpu::shoot( &ray.ro, &ray.rd, width, height, (float)x, (float)y, inverseVP );
+		}
+	}
+	std::vector<cpu::Hit> hits( rays.size() );
+
+	int breakEven = -1;
+	for ( int segments = 4; segments <= 256; segments *= 2 )
+	{
+		std::vector<glm::vec3> P;
+		std::vector<uint32_t> indices;
+		uvSphere( segments, &P, &indices );
+		uint32_t triangleCount = (uint32_t)indices.size() / 3;
+
+		Stopwatch sw;
+		cpu::LinearTriangles linear;
+		cpu::buildLinearTriangles( &linear, P.data(), indices.data(), triangleCount );
+		cpu::intersect( linear, rays.data(), hits.data(), rays.size() );
+		double linearElapsed = sw.elapsed();
+
+		sw = Stopwatch();
+		cpu::Bvh bvh;
+		cpu::buildBvh( &bvh, P.data(), (uint32_t)P.size(), indices.data(), triangleCount );
+		cpu::intersect( bvh, rays.data(), hits.data(), rays.size() );
+		double bvhElapsed = sw.elapsed();
+
+		printf( "[%d triangles] linear %.3f ms, bvh build + intersect %.3f ms\n", triangleCount, 1000.0 * linearElapsed, 1000.0 * bvhElapsed );
+		if ( breakEven < 0 && bvhElapsed < linearElapsed )
+		{
+			breakEven = (int)triangleCount;
+		}
+	}
+	if ( 0 <= breakEven )
+	{
+		printf( "the bvh wins from %d triangles ( %d rays per build )\n", breakEven, width * height );
+	}
+	else
+	{
+		printf( "the linear caster wins at every size ( %d rays per build )\n", width * height );
+	}
+}
+
+void run( const lwh::Polygon* polygon, const std::vector<glm::vec4>& spheres )
+{
+	using namespace pr;
+
+	const int width = 1280;
+	const int height = 720;
+
+	Stopwatch sw;
+	cpu::Bvh bvh;
+	cpu::buildBvh( &bvh, polygon->P.data(), (uint32_t)polygon->P.size(), polygon->indices.data(), polygon->primitiveCount, spheres.data(), (uint32_t)spheres.size() );
+	printf( "cpu bvh build %.3f ms ( %d triangles, %d spheres, %d nodes )\n", 1000.0 * sw.elapsed(), (int)bvh.triangleCount(), (int)bvh.sphereCount(), (int)bvh.nodes.size() );
+
+	glm::mat4 proj = glm::perspective( glm::radians( 45.0f ), (float)width / height, 0.1f, 100.0f );
+	glm::mat4 view = glm::lookAt( glm::vec3( 4, 4, 4 ), glm::vec3( 0, 0, 0 ), glm::vec3( 0, 1, 0 ) );
+	glm::mat4 inverseVP = glm::inverse( proj * view );
+
+	linearBreakEvenTest( inverseVP );
+
+	std::vector<cpu::Ray> rays( width * height );
+	std::vector<cpu::Hit> hits( width * height );
+	for ( int y = 0; y < height; ++y )
+	{
+		for ( int x = 0; x < width; ++x )
+		{
+			cpu::Ray& ray = rays[y * width + x];
+			cpu::shoot( &ray.ro, &ray.rd, width, height, (float)x, (float)y, inverseVP );
+		}
+	}
+
+	for ( cpu::TriangleLayout layout : {cpu::TriangleLayout::Woop, cpu::TriangleLayout::Watertight, cpu::TriangleLayout::Indexed} )
+	{
+		sw = Stopwatch();
+		cpu::precomputeTriangles( &bvh, layout );
+		printf( "[%s] precompute %.3f ms\n", triangleLayoutName( layout ), 1000.0 * sw.elapsed() );
+
+		for ( int i = 0; i < 4; ++i )
+		{
+			sw = Stopwatch();
+			cpu::intersect( bvh, rays.data(), hits.data(), rays.size() );
+			double elapsed = sw.elapsed();
+			printf( "[%s] intersect %.3f ms, %.2f MRays/s ( %d threads )\n", triangleLayoutName( layout ), 1000.0 * elapsed, rays.size() / elapsed * 1.0e-6, cpu::ThreadPool::global().threadCount() );
+		}
+	}
+
+	// the same primary rays with the bvh culled once per tile
+	std::vector<cpu::Hit> tileHits( width * height );
+	for ( int tileSize : {8, 16, 32} )
+	{
+		sw = Stopwatch();
+		cpu::intersectPrimaryRays( bvh, width, height, inverseVP, tileHits.data(), tileSize );
+		double elapsed = sw.elapsed();
+
+		int mismatches = 0;
+		for ( int i = 0; i < width * height; ++i )
+		{
+			if ( hits[i].primID != tileHits[i].primID )
+			{
+				mismatches++;
+			}
+		}
+		printf( "[tile %d] intersect %.3f ms, %.2f MRays/s ( %d mismatches )\n", tileSize, 1000.0 * elapsed, rays.size() / elapsed * 1.0e-6, mismatches );
+	}
+
+	// compressed nodes
+	auto quantizedBenchmark = [&]( auto qbvh, const char* name ) {
+		sw = Stopwatch();
+		if ( cpu::encodeQuantizedBvh( bvh, &qbvh ) == false )
+		{
+			printf( "[%s] can't encode, too many primitives or too deep\n", name );
+			return;
+		}
+		printf( "[%s] encode %.3f ms, %d bytes ( %.2fx smaller )\n", name, 1000.0 * sw.elapsed(), (int)qbvh.bytes(), (double)( bvh.nodes.size() * sizeof( BvhNode ) ) / qbvh.bytes() );
+
+		sw = Stopwatch();
+		cpu::intersect( qbvh, bvh, rays.data(), tileHits.data(), rays.size() );
+		double elapsed = sw.elapsed();
+
+		int mismatches = 0;
+		for ( int i = 0; i < width * height; ++i )
+		{
+			if ( hits[i].primID != tileHits[i].primID )
+			{
+				mismatches++;
+			}
+		}
+		printf( "[%s] intersect %.3f ms, %.2f MRays/s ( %d mismatches )\n", name, 1000.0 * elapsed, rays.size() / elapsed * 1.0e-6, mismatches );
+	};
+	quantizedBenchmark( cpu::QuantizedBvh<uint16_t>(), "quantized 16bit" );
+	quantizedBenchmark( cpu::QuantizedBvh<uint8_t>(), "quantized 8bit" );
+
+	// node orders. the best of a few runs each, against the order the builder emitted
+	auto bestOf = [&]( const cpu::Bvh& ordered ) {
+		double best = DBL_MAX;
+		for ( int i = 0; i < 4; ++i )
+		{
+			sw = Stopwatch();
+			cpu::intersect( ordered, rays.data(), tileHits.data(), rays.size() );
+			best = std::min( best, sw.elapsed() );
+		}
+		return best;
+	};
+	double baseline = bestOf( bvh );
+	printf( "[builder order] intersect %.3f ms, %.2f MRays/s\n", 1000.0 * baseline, rays.size() / baseline * 1.0e-6 );
+	for ( cpu::NodeOrder order : {cpu::NodeOrder::BreadthFirst, cpu::NodeOrder::DepthFirst, cpu::NodeOrder::VanEmdeBoas} )
+	{
+		cpu::Bvh ordered = bvh;
+		sw = Stopwatch();
+		cpu::reorderNodes( &ordered, order );
+		double reorder = sw.elapsed();
+
+		double elapsed = bestOf( ordered );
+		printf( "[%s] reorder %.3f ms, intersect %.3f ms, %.2f MRays/s ( %+.1f%% )\n", nodeOrderName( order ), 1000.0 * reorder, 1000.0 * elapsed, rays.size() / elapsed * 1.0e-6, ( baseline / elapsed - 1.0 ) * 100.0 );
+	}
+
+	Image2DRGBA8 image;
+	image.allocate( width, height );
+	for ( int i = 0; i < width * height; ++i )
+	{
+		glm::vec4 color = glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f );
+		if ( hits[i].isHit() )
+		{
+			color = glm::vec4( ( hits[i].Ng + glm::vec3( 1.0f ) ) * 0.5f, 1.0f );
+		}
+		glm::ivec4 quantized = glm::ivec4( color * 255.0f + glm::vec4( 0.5f ) );
+		quantized = glm::clamp( quantized, glm::ivec4( 0 ), glm::ivec4( 255 ) );
+		image.data()[i] = glm::u8vec4( quantized );
+	}
+	image.save( "out_cpu.png" );
+
+	// g-buffer of the same frame, each view is a pass over it without tracing
+	std::vector<GBufferTexel> gbuffer( width * height );
+	cpu::writeGBuffer( hits.data(), gbuffer.data(), gbuffer.size() );
+	for ( cpu::GBufferChannel channel : {cpu::GBufferChannel::Depth, cpu::GBufferChannel::Normal, cpu::GBufferChannel::PrimID, cpu::GBufferChannel::Barycentrics} )
+	{
+		cpu::visualizeGBuffer( gbuffer.data(), gbuffer.size(), channel, image.data() );
+		image.save( ( std::string( "gbuffer_" ) + cpu::gbufferChannelName( channel ) + ".png" ).c_str() );
+	}
+
+	// traversal statistics
+	std::vector<cpu::TraversalStats> stats( width * height );
+	sw = Stopwatch();
+	cpu::intersect( bvh, rays.data(), hits.data(), stats.data(), rays.size() );
+	printf( "intersect with stats %.3f ms\n", 1000.0 * sw.elapsed() );
+
+	for ( cpu::TraversalCounter counter : {cpu::TraversalCounter::NodeVisits, cpu::TraversalCounter::BoxTests, cpu::TraversalCounter::TriangleTests, cpu::TraversalCounter::SphereTests} )
+	{
+		cpu::heatmap( stats.data(), stats.size(), counter, 0, image.data() );
+		image.save( ( std::string( "heat_" ) + cpu::counterName( counter ) + ".png" ).c_str() );
+	}
+
+	std::string json = cpu::traversalStatsJson( stats.data(), stats.size() );
+	FILE* fp = fopen( "traversal_stats.json", "wb" );
+	if ( fp )
+	{
+		fwrite( json.data(), 1, json.size(), fp );
+		fclose( fp );
+	}
+
+	// closest point queries around the mesh
+	std::vector<glm::vec3> points( 1 << 18 );
+	std::vector<cpu::ClosestPoint> closests( points.size() );
+	uint32_t seed = 1;
+	for ( glm::vec3& p : points )
+	{
+		for ( int i = 0; i < 3; ++i )
+		{
+			seed = seed * 1664525u + 1013904223u;
+			p[i] = ( (float)( seed >> 8 ) / 16777216.0f * 2.0f - 1.0f ) * 4.0f;
+		}
+	}
+	sw = Stopwatch();
+	cpu::closestPoint( bvh, points.data(), closests.data(), points.size() );
+	double elapsed = sw.elapsed();
+	printf( "closest point %.3f ms, %.2f MQueries/s\n", 1000.0 * elapsed, points.size() / elapsed * 1.0e-6 );
+
+	// a sample of the queries against every primitive
+	float closestError = 0.0f;
+	for ( size_t i = 0; i < points.size(); i += points.size() / 256 )
+	{
+		float best = FLT_MAX;
+		for ( uint32_t iPrim = 0; iPrim < bvh.primitiveCount(); iPrim++ )
+		{
+			glm::vec3 p;
+			if ( bvh.primitiveType( iPrim ) == BVH_PRIMITIVE_SPHERE )
+			{
+				glm::vec4 s = bvh.sphere( iPrim );
+				p = cpu::closestPointOnSphere( points[i], glm::vec3( s.x, s.y, s.z ), s.w );
+			}
+			else
+			{
+				glm::vec3 v0, v1, v2;
+				float u, v;
+				bvh.triangle( iPrim, &v0, &v1, &v2 );
+				p = cpu::closestPointOnTriangle( points[i], v0, v1, v2, &u, &v );
+			}
+			best = std::min( best, glm::distance( p, points[i] ) );
+		}
+		closestError = std::max( closestError, std::fabs( closests[i].distance - best ) );
+	}
+	printf( "closest point max error against brute force %.6f\n", closestError );
+	PR_ASSERT( closestError < 1.0e-4f );
+
+	// interference between the mesh and a moved copy of itself
+	glm::mat4 xformA = glm::identity<glm::mat4>();
+	glm::mat4 xformB = glm::rotate( glm::translate( glm::identity<glm::mat4>(), glm::vec3( 0.5f, 0.25f, 0.0f ) ), glm::radians( 30.0f ), glm::vec3( 0, 1, 0 ) );
+	std::vector<cpu::OverlapPair> pairs;
+	sw = Stopwatch();
+	cpu::overlapPairs( bvh, xformA, bvh, xformB, &pairs );
+	printf( "overlap pairs %.3f ms ( %d pairs )\n", 1000.0 * sw.elapsed(), (int)pairs.size() );
+
+	sw = Stopwatch();
+	bool hit = cpu::overlaps( bvh, xformA, bvh, xformB );
+	printf( "overlaps %.3f ms ( %s )\n", 1000.0 * sw.elapsed(), hit ? "true" : "false" );
+	PR_ASSERT( hit == !pairs.empty() );
+}
+
+int main()
+{
+	using namespace pr;
+	SetDataDir( ExecutableDir() );
+
+	BinaryLoader loader;
+	loader.load( "../prim/out/box.json" );
+	loader.push_back( '\0' );
+
+	rapidjson::Document d;
+	d.ParseInsitu( (char*)loader.data() );
+	PR_ASSERT( d.HasParseError() == false );
+
+	auto lwhPolygon = lwh::load( d );
+
+	// optional particles rendered as spheres
+	std::vector<glm::vec4> spheres;
+	const char* particlesPath = "../prim/out/particles.json";
+	if ( FILE* fp = fopen( GetDataPath( particlesPath ).c_str(), "rb" ) )
+	{
+		fclose( fp );
+
+		BinaryLoader particlesLoader;
+		particlesLoader.load( particlesPath );
+		particlesLoader.push_back( '\0' );
+
+		rapidjson::Document particlesDocument;
+		particlesDocument.ParseInsitu( (char*)particlesLoader.data() );
+		PR_ASSERT( particlesDocument.HasParseError() == false );
+
+		auto lwhParticles = lwh::load( particlesDocument );
+		spheres = lwh::pointsAsSpheres( lwhParticles.polygon );
+		delete lwhParticles.polygon;
+	}
+
+	crackTest();
+	quantizedLeafLimitTest();
+	overlapTest();
+	run( lwhPolygon.polygon, spheres );
+}
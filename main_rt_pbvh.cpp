@@ -3,6 +3,8 @@
 #include "lwHoudiniLoader.hpp"
 #include "WinPixEventRuntime/pix3.h"
 #include "bvh.h"
+#include "CpuGBuffer.hpp"
+#include "GpuScan.hpp"
 
 #include <future>
 
@@ -10,11 +12,25 @@ struct Arguments
 {
 	int cb_width;
 	int cb_height;
-	int cb_pad0;
-	int cb_pad1;
+	int cb_triangleCount;
+	int cb_outputMode;
 	float cb_inverseVP[16];
 };
 
+// bvh_pathtrace.hlsl
+struct PathTraceArguments
+{
+	int cb_width;
+	int cb_height;
+	int cb_sampleIndex;
+	int cb_minSamples;
+	float cb_inverseVP[16];
+	float cb_threshold;
+	int cb_tileStop;
+	int cb_maxDepth;
+	int cb_triangleCount;
+};
+
 inline uint32_t as_uint32(float f) {
 	return *reinterpret_cast<uint32_t*>(&f);
 }
@@ -35,36 +51,6 @@ inline float from_ordered(int32_t ordered) {
 	return as_float(ordered);
 }
 
-inline uint32_t prefixScanIterationCount(uint32_t n)
-{
-	if (n <= 1) { return 0; }
-
-	unsigned long index;
-	_BitScanReverse(&index, n - 1);
-	return index + 1;
-}
-inline uint32_t prefixScanIterationCountNaive(uint32_t n)
-{
-	int iteration = 0;
-	uint32_t offset = 1;
-	while (offset < n)
-	{
-		offset *= 2;
-		iteration++;
-	}
-	return iteration;
-}
-//Check
-//for (int i = 1; i < 32; ++i)
-//{
-//	printf("%d, %d[%d]\n", i, prefixScanIterationCount(i), prefixScanIterationCountNaive(i));
-//}
-
-struct BvhScanArgument
-{
-	int nElement;
-	int offset;
-};
 struct BinningArgument
 {
 	int consumeTaskCount;
@@ -80,16 +66,24 @@ uint32_t ringBufferCount(uint32_t beg, uint32_t end, uint32_t n)
 
 struct GPUBvhBuilder
 {
-	GPUBvhBuilder( DeviceObject* deviceObject, const lwh::Polygon* polygon )
+	/*
+		triangles of polygon and spheres are put in the same bvh.
+		primitive ids of spheres start from polygon->primitiveCount
+	*/
+	GPUBvhBuilder( DeviceObject* deviceObject, const lwh::Polygon* polygon, const std::vector<glm::vec4>& spheres )
 	{
 		pr::Stopwatch sw;
 
+		int triangleCount = polygon->primitiveCount;
+		uint32_t elementCount = polygon->primitiveCount + (uint32_t)spheres.size();
+
 		auto compute_bvh_firstTask = std::unique_ptr<ComputeObject>(new ComputeObject());
 		compute_bvh_firstTask->uRange(0, 3);
 		compute_bvh_firstTask->loadShaderAndBuild( deviceObject->device(), pr::GetDataPath( "bvh_firstTask.cso" ).c_str() );
 
 		auto compute_bvh_element = std::unique_ptr<ComputeObject>( new ComputeObject() );
-		compute_bvh_element->uRange(0, 3);
+		compute_bvh_element->uRange(0, 4);
+		compute_bvh_element->bRootConstant32( 0, 1 );
 		compute_bvh_element->loadShaderAndBuild( deviceObject->device(), pr::GetDataPath( "bvh_element.cso" ).c_str() );
 
 		auto compute_bvh_executionCount = std::unique_ptr<ComputeObject>( new ComputeObject() );
@@ -97,12 +91,6 @@ struct GPUBvhBuilder
 		compute_bvh_executionCount->u( 1 );
 		compute_bvh_executionCount->loadShaderAndBuild( deviceObject->device(), pr::GetDataPath( "bvh_executionCount.cso" ).c_str() );
 
-		auto compute_bvh_scan = std::unique_ptr<ComputeObject>( new ComputeObject() );
-		compute_bvh_scan->uRange(0, 2);
-		compute_bvh_scan->bRootConstant32( 0, 1 );
-		compute_bvh_scan->bRootConstant32( 1, 1 );
-		compute_bvh_scan->loadShaderAndBuild( deviceObject->device(), pr::GetDataPath( "bvh_scan.cso" ).c_str() );
-
 		auto compute_bvh_clearBin = std::unique_ptr<ComputeObject>( new ComputeObject() );
 		compute_bvh_clearBin->b( 0 );
 		compute_bvh_clearBin->uRange(0, 3);
@@ -159,14 +147,25 @@ struct GPUBvhBuilder
 			memcpy( p, polygon->indices.data(), iBytes );
 		} );
 
+		// at least one element to keep the UAV valid
+		uint32_t sBytes = std::max( (uint32_t)spheres.size(), 1u ) * sizeof( glm::vec4 );
+		sphereBuffer = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), sBytes, sizeof( glm::vec4 ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+		UploaderObject *s_uploader = new UploaderObject( deviceObject->device(), sBytes );
+		s_uploader->map( [&]( void* p ) {
+			memset( p, 0, sBytes );
+			memcpy( p, spheres.data(), spheres.size() * sizeof( glm::vec4 ) );
+		} );
+
 		auto computeCommandList = std::unique_ptr<CommandObject>( new CommandObject( deviceObject->device(), D3D12_COMMAND_LIST_TYPE_DIRECT ) );
 		computeCommandList->storeCommand( [&]( ID3D12GraphicsCommandList* commandList ) {
 			vertexBuffer->copyFrom( commandList, v_uploader );
 			indexBuffer->copyFrom( commandList, i_uploader );
+			sphereBuffer->copyFrom( commandList, s_uploader );
 
 			resourceBarrier( commandList, {
 											  vertexBuffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
 											  indexBuffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
+											  sphereBuffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
 										  } );
 		} );
 		deviceObject->queueObject()->execute( computeCommandList.get() );
@@ -174,14 +173,16 @@ struct GPUBvhBuilder
 		{
 			std::shared_ptr<FenceObject> fence = deviceObject->queueObject()->fence(deviceObject->device());
 			asyncWaiter.emplace_back(
-				std::async(std::launch::async, [fence, v_uploader, i_uploader]() {
+				std::async(std::launch::async, [fence, v_uploader, i_uploader, s_uploader]() {
 					fence->wait();
 					delete v_uploader;
 					delete i_uploader;
+					delete s_uploader;
 				})
 			);
 			v_uploader = nullptr;
 			i_uploader = nullptr;
+			s_uploader = nullptr;
 		}
 
 		int nProcessBlocks = 1024 * 64;
@@ -193,7 +194,7 @@ struct GPUBvhBuilder
 		firstTaskUploader->map( [&]( void* p ) {
 			BuildTask task;
 			task.geomBeg = 0;
-			task.geomEnd = polygon->primitiveCount;
+			task.geomEnd = elementCount;
 			for ( int i = 0; i < 3; ++i )
 			{
 				task.lower[i] = to_ordered( +FLT_MAX );
@@ -203,8 +204,8 @@ struct GPUBvhBuilder
 			memcpy( p, &task, sizeof( BuildTask ) );
 		} );
 
-		uint32_t taskBufferCount = std::max( (uint32_t)2, polygon->primitiveCount );
-		std::unique_ptr<BufferObjectUAV> bvhElementBuffer( new BufferObjectUAV( deviceObject->device(), polygon->primitiveCount * sizeof( BvhElement ), sizeof( BvhElement ), D3D12_RESOURCE_STATE_COMMON ) );
+		uint32_t taskBufferCount = std::max( (uint32_t)2, elementCount );
+		std::unique_ptr<BufferObjectUAV> bvhElementBuffer( new BufferObjectUAV( deviceObject->device(), elementCount * sizeof( BvhElement ), sizeof( BvhElement ), D3D12_RESOURCE_STATE_COMMON ) );
 		std::unique_ptr<BufferObjectUAV> bvhBuildTaskBuffer( new BufferObjectUAV( deviceObject->device(), taskBufferCount * sizeof( BuildTask ), sizeof( BuildTask ), D3D12_RESOURCE_STATE_COPY_DEST ) );
 
 		std::unique_ptr<BufferObjectUAV> bvhBuildTaskRingRanges[2];
@@ -216,19 +217,18 @@ struct GPUBvhBuilder
 			memcpy( p, values, sizeof( uint32_t ) * 4 );
 		} );
 
-		bvhElementIndicesBuffers[0] = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), polygon->primitiveCount * sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
-		bvhElementIndicesBuffers[1] = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), polygon->primitiveCount * sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+		bvhElementIndicesBuffers[0] = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), elementCount * sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+		bvhElementIndicesBuffers[1] = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), elementCount * sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
 
 		std::unique_ptr<BufferObjectUAV> executionCountBuffer( new BufferObjectUAV( deviceObject->device(), nProcessBlocks * sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
-		std::unique_ptr<BufferObjectUAV> executionTableBuffers[2];
-		executionTableBuffers[0] = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), nProcessBlocks * sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
-		executionTableBuffers[1] = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), nProcessBlocks * sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+		std::unique_ptr<BufferObjectUAV> executionTableBuffer( new BufferObjectUAV( deviceObject->device(), nProcessBlocks * sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
+		GpuScan scanner( deviceObject->device(), nProcessBlocks );
 
 		std::unique_ptr<BufferObjectUAV> binningBuffer( new BufferObjectUAV( deviceObject->device(), nProcessBlocks * sizeof( BinningBuffer ), sizeof( BinningBuffer ), D3D12_RESOURCE_STATE_COMMON ) );
 		std::unique_ptr<BufferObjectUAV> executionIterator( new BufferObjectUAV( deviceObject->device(), sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
 
 		// NodeBuffer geombeg, geomend are stored to indexL, indexR
-		int maxNodes = std::max( (int)polygon->primitiveCount - 1, 1 );
+		int maxNodes = std::max( (int)elementCount - 1, 1 );
 		bvhNodeBuffer = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), maxNodes * sizeof( BvhNode ), sizeof( BvhNode ), D3D12_RESOURCE_STATE_COMMON ) );
 		std::unique_ptr<BufferObjectUAV> bvhNodeCounterBuffer = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COPY_DEST ) );
 
@@ -242,7 +242,9 @@ struct GPUBvhBuilder
 			heap->u( deviceObject->device(), 0, vertexBuffer->resource(), vertexBuffer->UAVDescription() );
 			heap->u( deviceObject->device(), 1, indexBuffer->resource(), indexBuffer->UAVDescription() );
 			heap->u( deviceObject->device(), 2, bvhElementBuffer->resource(), bvhElementBuffer->UAVDescription() );
-			compute_bvh_element->dispatch( commandList, dispatchsize( polygon->primitiveCount, 64 ), 1, 1 );
+			heap->u( deviceObject->device(), 3, sphereBuffer->resource(), sphereBuffer->UAVDescription() );
+			heap->bRootConstant32( commandList, 0, 1, &triangleCount );
+			compute_bvh_element->dispatch( commandList, dispatchsize( elementCount, 64 ), 1, 1 );
 
 			// Task Counter Initialize
 			bvhBuildTaskRingRanges[0]->copyFrom( commandList, ringBufferRangeDefault.resource(), 0, 0, sizeof( uint32_t ) * 2 );
@@ -269,7 +271,7 @@ struct GPUBvhBuilder
 			heap->u( deviceObject->device(), 0, bvhBuildTaskBuffer->resource(), bvhBuildTaskBuffer->UAVDescription() );
 			heap->u( deviceObject->device(), 1, bvhElementBuffer->resource(), bvhElementBuffer->UAVDescription() );
 			heap->u( deviceObject->device(), 2, bvhElementIndicesBuffers[0]->resource(), bvhElementIndicesBuffers[0]->UAVDescription() );
-			compute_bvh_firstTask->dispatch( commandList, dispatchsize( polygon->primitiveCount, 64 ), 1, 1 );
+			compute_bvh_firstTask->dispatch( commandList, dispatchsize( elementCount, 64 ), 1, 1 );
 
 			resourceBarrier( commandList, {
 											  bvhBuildTaskBuffer->resourceBarrierUAV(),
@@ -286,9 +288,6 @@ struct GPUBvhBuilder
 		{
 			int consumeTaskCount = std::min( taskCount, nProcessBlocks );
 
-			// Scan
-			int nScanIteration = prefixScanIterationCount( consumeTaskCount );
-
 			computeCommandList->storeCommand( [&]( ID3D12GraphicsCommandList* commandList ) {
 				// Binning argument
 				resourceBarrier( commandList, {binningArgument.resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST )} );
@@ -330,31 +329,14 @@ struct GPUBvhBuilder
 												  executionCountBuffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE ),
 											  } );
 
-				// Scan Preapre for exclusive scan
-				executionTableBuffers[0]->copyFrom( commandList, zeroU32.resource(), 0, 0, sizeof( uint32_t ) );
-				executionTableBuffers[0]->copyFrom( commandList, executionCountBuffer->resource(), sizeof( uint32_t ), 0, sizeof( uint32_t ) * ( consumeTaskCount - 1 ) );
+				// Scan
+				executionTableBuffer->copyFrom( commandList, executionCountBuffer->resource(), 0, 0, sizeof( uint32_t ) * consumeTaskCount );
 
 				resourceBarrier( commandList, {executionCountBuffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COMMON )} );
 
 				PIXBeginEvent( commandList, PIX_COLOR_DEFAULT, "Scan" );
 
-				for ( int i = 0; i < nScanIteration; ++i )
-				{
-					compute_bvh_scan->setPipelineState( commandList );
-					compute_bvh_scan->setComputeRootSignature( commandList );
-					heap->startNextHeapAndAssign( commandList, compute_bvh_scan->descriptorMap() );
-
-					int offset = 1 << i;
-					heap->bRootConstant32( commandList, 0, 1, &consumeTaskCount );
-					heap->bRootConstant32( commandList, 1, 1, &offset );
-
-					heap->u( deviceObject->device(), 0, executionTableBuffers[0]->resource(), executionTableBuffers[0]->UAVDescription() );
-					heap->u( deviceObject->device(), 1, executionTableBuffers[1]->resource(), executionTableBuffers[1]->UAVDescription() );
-					compute_bvh_scan->dispatch( commandList, dispatchsize( consumeTaskCount, 64 ), 1, 1 );
-
-					std::swap( executionTableBuffers[0], executionTableBuffers[1] );
-					resourceBarrier( commandList, {executionTableBuffers[0]->resourceBarrierUAV()} );
-				}
+				scanner.exclusiveScan( commandList, deviceObject->device(), heap.get(), executionTableBuffer.get(), consumeTaskCount );
 
 				PIXEndEvent( commandList );
 
@@ -370,7 +352,7 @@ struct GPUBvhBuilder
 				heap->startNextHeapAndAssign( commandList, compute_bvh_binning->descriptorMap() );
 				heap->b( deviceObject->device(), 0, binningArgument.resource() );
 				heap->u( deviceObject->device(), 0, executionCountBuffer->resource(), executionCountBuffer->UAVDescription() );
-				heap->u( deviceObject->device(), 1, executionTableBuffers[0]->resource(), executionTableBuffers[0]->UAVDescription() );
+				heap->u( deviceObject->device(), 1, executionTableBuffer->resource(), executionTableBuffer->UAVDescription() );
 				heap->u( deviceObject->device(), 2, executionIterator->resource(), executionIterator->UAVDescription() );
 				heap->u( deviceObject->device(), 3, binningBuffer->resource(), binningBuffer->UAVDescription() );
 				heap->u( deviceObject->device(), 4, bvhElementIndicesBuffers[0]->resource(), bvhElementIndicesBuffers[0]->UAVDescription() );
@@ -417,7 +399,7 @@ struct GPUBvhBuilder
 				heap->startNextHeapAndAssign( commandList, compute_bvh_reorder->descriptorMap() );
 				heap->b( deviceObject->device(), 0, binningArgument.resource() );
 				heap->u( deviceObject->device(), 0, executionCountBuffer->resource(), executionCountBuffer->UAVDescription() );
-				heap->u( deviceObject->device(), 1, executionTableBuffers[0]->resource(), executionTableBuffers[0]->UAVDescription() );
+				heap->u( deviceObject->device(), 1, executionTableBuffer->resource(), executionTableBuffer->UAVDescription() );
 				heap->u( deviceObject->device(), 2, executionIterator->resource(), executionIterator->UAVDescription() );
 				heap->u( deviceObject->device(), 3, binningBuffer->resource(), binningBuffer->UAVDescription() );
 				heap->u( deviceObject->device(), 4, bvhElementIndicesBuffers[0]->resource(), bvhElementIndicesBuffers[0]->UAVDescription() );
@@ -460,7 +442,7 @@ struct GPUBvhBuilder
 
 			// auto RingRanges = bvhBuildTaskRingRanges[0]->synchronizedDownload<uint32_t>(deviceObject->device(), deviceObject->queueObject());
 			//auto executionCount = executionCountBuffer->synchronizedDownload<uint32_t>(deviceObject->device(), deviceObject->queueObject());
-			//auto executionTable = executionTableBuffers[0]->synchronizedDownload<uint32_t>(deviceObject->device(), deviceObject->queueObject());
+			//auto executionTable = executionTableBuffer->synchronizedDownload<uint32_t>(deviceObject->device(), deviceObject->queueObject());
 			//auto binningBufferValue = binningBuffer->synchronizedDownload<BinningBuffer>(deviceObject->device(), deviceObject->queueObject());
 			//auto taks = bvhBuildTaskBuffer->synchronizedDownload<BuildTask>(deviceObject->device(), deviceObject->queueObject());
 			//auto idx = bvhElementIndicesBuffers[1]->synchronizedDownload<uint32_t>(deviceObject->device(), deviceObject->queueObject());
@@ -526,6 +508,7 @@ struct GPUBvhBuilder
 
 	std::unique_ptr<BufferObjectUAV> vertexBuffer;
 	std::unique_ptr<BufferObjectUAV> indexBuffer;
+	std::unique_ptr<BufferObjectUAV> sphereBuffer;
 	std::unique_ptr<BufferObjectUAV> bvhNodeBuffer;
 	std::unique_ptr<BufferObjectUAV> bvhElementIndicesBuffers[2];
 };
@@ -533,8 +516,8 @@ struct GPUBvhBuilder
 class Rt
 {
 public:
-	Rt( DeviceObject* deviceObject, const lwh::Polygon* polygon, int width, int height ) 
-		: _width( width ), _height( height ), _deviceObject( deviceObject ), _polygon(polygon)
+	Rt( DeviceObject* deviceObject, const lwh::Polygon* polygon, const std::vector<glm::vec4>& spheres, int width, int height ) 
+		: _width( width ), _height( height ), _deviceObject( deviceObject ), _polygon(polygon), _spheres(spheres)
 	{
 		pr::Stopwatch sw;
 
@@ -546,9 +529,16 @@ public:
 		compute_bvh_traverse->u(2);
 		compute_bvh_traverse->u(3);
 		compute_bvh_traverse->u(4);
+		compute_bvh_traverse->u(5);
+		compute_bvh_traverse->u(6);
 		compute_bvh_traverse->b(0);
 		compute_bvh_traverse->loadShaderAndBuild(deviceObject->device(), pr::GetDataPath("bvh_traverse.cso").c_str());
 
+		compute_bvh_pathtrace = std::unique_ptr<ComputeObject>(new ComputeObject());
+		compute_bvh_pathtrace->uRange(0, 9);
+		compute_bvh_pathtrace->b(0);
+		compute_bvh_pathtrace->loadShaderAndBuild(deviceObject->device(), pr::GetDataPath("bvh_pathtrace.cso").c_str());
+
 		computeCommandList = std::unique_ptr<CommandObject>( new CommandObject( deviceObject->device(), D3D12_COMMAND_LIST_TYPE_DIRECT ) );
 		computeCommandList->setName( L"Compute" );
 		heap = std::unique_ptr<StackDescriptorHeapObject>( new StackDescriptorHeapObject( deviceObject->device(), 128 ) );
@@ -556,11 +546,26 @@ public:
 		colorRGBX8Buffer = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), _width * _height * sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
 		downloader = std::unique_ptr<DownloaderObject>( new DownloaderObject( deviceObject->device(), _width * _height * sizeof( uint32_t ) ) );
 
+		// g-buffer
+		gbufferBuffer = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), _width * _height * sizeof( GBufferTexel ), sizeof( GBufferTexel ), D3D12_RESOURCE_STATE_COMMON ) );
+		gbufferDownloader = std::unique_ptr<DownloaderObject>( new DownloaderObject( deviceObject->device(), _width * _height * sizeof( GBufferTexel ) ) );
+		_gbuffer.resize( _width * _height );
+		_gbufferImage.resize( _width * _height );
+
+		// progressive
+		accumulationBuffer = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), _width * _height * sizeof( glm::vec4 ), sizeof( glm::vec4 ), D3D12_RESOURCE_STATE_COMMON ) );
+		luminanceSqBuffer = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), _width * _height * sizeof( float ), sizeof( float ), D3D12_RESOURCE_STATE_COMMON ) );
+		activePixelCounter = std::unique_ptr<BufferObjectUAV>( new BufferObjectUAV( deviceObject->device(), sizeof( uint32_t ), sizeof( uint32_t ), D3D12_RESOURCE_STATE_COMMON ) );
+		activePixelDownloader = std::unique_ptr<DownloaderObject>( new DownloaderObject( deviceObject->device(), sizeof( uint32_t ) ) );
+		zeroU32 = std::unique_ptr<UploaderObject>( new UploaderObject( deviceObject->device(), sizeof( uint32_t ) ) );
+		zeroU32->map( []( void* p ) { memset( p, 0, sizeof( uint32_t ) ); } );
+
 		_argument = std::unique_ptr<ConstantBufferObject>(new ConstantBufferObject(deviceObject->device(), sizeof(Arguments), D3D12_RESOURCE_STATE_COMMON));
+		_pathTraceArgument = std::unique_ptr<ConstantBufferObject>(new ConstantBufferObject(deviceObject->device(), sizeof(PathTraceArguments), D3D12_RESOURCE_STATE_COMMON));
 
 		texture = std::unique_ptr<pr::ITexture>(pr::CreateTexture());
 
-		builder = std::unique_ptr<GPUBvhBuilder>(new GPUBvhBuilder( deviceObject, polygon ));
+		builder = std::unique_ptr<GPUBvhBuilder>(new GPUBvhBuilder( deviceObject, polygon, _spheres ));
 
 		//printf("setup vertex and indices %.3f ( %lld bytes, %lld bytes )ms\n", 1000.0 * sw.elapsed(), vertexBuffer->bytes(), indexBuffer->bytes() );
 		//printf("");
@@ -571,11 +576,27 @@ public:
 	void rebuild()
 	{
 		builder = std::unique_ptr<GPUBvhBuilder>();
-		builder = std::unique_ptr<GPUBvhBuilder>(new GPUBvhBuilder(_deviceObject, _polygon));
+		builder = std::unique_ptr<GPUBvhBuilder>(new GPUBvhBuilder(_deviceObject, _polygon, _spheres));
+
+		// the scene is changed
+		resetAccumulation();
+	}
+
+	// restart the accumulation from the next step()
+	void resetAccumulation()
+	{
+		_sampleIndex = 0;
+		_activePixels = _width * _height;
 	}
 
 	void step()
 	{
+		if ( _progressive )
+		{
+			stepProgressive();
+			return;
+		}
+
 		// nodes = bvhNodeBuffer->synchronizedDownload<BvhNode>(deviceObject->device(), deviceObject->queueObject());
 		_timestamp->clear();
 
@@ -585,6 +606,8 @@ public:
 			Arguments arg = {};
 			arg.cb_width = _width;
 			arg.cb_height = _height;
+			arg.cb_triangleCount = _polygon->primitiveCount;
+			arg.cb_outputMode = _outputMode;
 			memcpy( arg.cb_inverseVP, glm::value_ptr( glm::transpose( _inverseVP ) ), sizeof( _inverseVP ) );
 
 			_argument->upload( commandList, arg );
@@ -603,15 +626,26 @@ public:
 			heap->u( _deviceObject->device(), 2, builder->indexBuffer->resource(), builder->indexBuffer->UAVDescription() );
 			heap->u( _deviceObject->device(), 3, builder->bvhNodeBuffer->resource(), builder->bvhNodeBuffer->UAVDescription() );
 			heap->u( _deviceObject->device(), 4, builder->bvhElementIndicesBuffers[0]->resource(), builder->bvhElementIndicesBuffers[0]->UAVDescription() );
+			heap->u( _deviceObject->device(), 5, builder->sphereBuffer->resource(), builder->sphereBuffer->UAVDescription() );
+			heap->u( _deviceObject->device(), 6, gbufferBuffer->resource(), gbufferBuffer->UAVDescription() );
 			
 			heap->b(_deviceObject->device(), 0, _argument->resource() );
 			compute_bvh_traverse->dispatch( commandList, dispatchsize( _width * _height, 64 ), 1, 1 );
 
 			_timestamp->stampEnd( commandList );
 
-			resourceBarrier( commandList, {colorRGBX8Buffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE )} );
-			colorRGBX8Buffer->copyTo( commandList, downloader.get() );
-			resourceBarrier( commandList, {colorRGBX8Buffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COMMON )} );
+			if ( _outputMode == BVH_OUTPUT_GBUFFER )
+			{
+				resourceBarrier( commandList, {gbufferBuffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE )} );
+				gbufferBuffer->copyTo( commandList, gbufferDownloader.get() );
+				resourceBarrier( commandList, {gbufferBuffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COMMON )} );
+			}
+			else
+			{
+				resourceBarrier( commandList, {colorRGBX8Buffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE )} );
+				colorRGBX8Buffer->copyTo( commandList, downloader.get() );
+				resourceBarrier( commandList, {colorRGBX8Buffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COMMON )} );
+			}
 
 			_timestamp->resolve( commandList );
 		});
@@ -624,10 +658,111 @@ public:
 		}
 		heap->clear();
 
+		if ( _outputMode == BVH_OUTPUT_GBUFFER )
+		{
+			// later passes read the hit buffer instead of tracing again
+			gbufferDownloader->map( [&]( const void* p ) {
+				memcpy( _gbuffer.data(), p, _gbuffer.size() * sizeof( GBufferTexel ) );
+			} );
+			cpu::visualizeGBuffer( _gbuffer.data(), _gbuffer.size(), (cpu::GBufferChannel)_gbufferChannel, _gbufferImage.data() );
+			texture->uploadAsRGBA8( (const uint8_t*)_gbufferImage.data(), _width, _height );
+		}
+		else
+		{
+			downloader->map( [&]( const void* p ) {
+				texture->uploadAsRGBA8( (const uint8_t*)p, _width, _height );
+			} );
+		}
+		timestampSpans = _timestamp->download(_deviceObject->queueObject()->queue() );
+
+		_deviceObject->present();
+	}
+	void stepProgressive()
+	{
+		// every pixel has converged. keep the last image
+		if ( _sampleIndex != 0 && _activePixels == 0 )
+		{
+			_deviceObject->present();
+			return;
+		}
+
+		_timestamp->clear();
+
+		computeCommandList->storeCommand( [&]( ID3D12GraphicsCommandList* commandList ) {
+			// Update Argument
+			resourceBarrier( commandList, {
+											  _pathTraceArgument->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST ),
+											  activePixelCounter->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST ),
+										  } );
+			PathTraceArguments arg = {};
+			arg.cb_width = _width;
+			arg.cb_height = _height;
+			arg.cb_sampleIndex = _sampleIndex;
+			arg.cb_minSamples = _minSamples;
+			memcpy( arg.cb_inverseVP, glm::value_ptr( glm::transpose( _inverseVP ) ), sizeof( _inverseVP ) );
+			arg.cb_threshold = _adaptive ? _threshold : 0.0f;
+			arg.cb_tileStop = _tileStop ? 1 : 0;
+			arg.cb_maxDepth = _maxDepth;
+			arg.cb_triangleCount = _polygon->primitiveCount;
+
+			_pathTraceArgument->upload( commandList, arg );
+			activePixelCounter->copyFrom( commandList, zeroU32.get() );
+
+			resourceBarrier( commandList, {
+											  _pathTraceArgument->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
+											  activePixelCounter->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON ),
+										  } );
+			_timestamp->stampBeg( commandList, "Path Trace" );
+
+			// Execute
+			compute_bvh_pathtrace->setPipelineState( commandList );
+			compute_bvh_pathtrace->setComputeRootSignature( commandList );
+			heap->startNextHeapAndAssign( commandList, compute_bvh_pathtrace->descriptorMap() );
+			heap->u( _deviceObject->device(), 0, colorRGBX8Buffer->resource(), colorRGBX8Buffer->UAVDescription() );
+			heap->u( _deviceObject->device(), 1, builder->vertexBuffer->resource(), builder->vertexBuffer->UAVDescription() );
+			heap->u( _deviceObject->device(), 2, builder->indexBuffer->resource(), builder->indexBuffer->UAVDescription() );
+			heap->u( _deviceObject->device(), 3, builder->bvhNodeBuffer->resource(), builder->bvhNodeBuffer->UAVDescription() );
+			heap->u( _deviceObject->device(), 4, builder->bvhElementIndicesBuffers[0]->resource(), builder->bvhElementIndicesBuffers[0]->UAVDescription() );
+			heap->u( _deviceObject->device(), 5, accumulationBuffer->resource(), accumulationBuffer->UAVDescription() );
+			heap->u( _deviceObject->device(), 6, luminanceSqBuffer->resource(), luminanceSqBuffer->UAVDescription() );
+			heap->u( _deviceObject->device(), 7, activePixelCounter->resource(), activePixelCounter->UAVDescription() );
+			heap->u( _deviceObject->device(), 8, builder->sphereBuffer->resource(), builder->sphereBuffer->UAVDescription() );
+			heap->b( _deviceObject->device(), 0, _pathTraceArgument->resource() );
+			compute_bvh_pathtrace->dispatch( commandList, dispatchsize( _width * _height, 64 ), 1, 1 );
+
+			_timestamp->stampEnd( commandList );
+
+			resourceBarrier( commandList, {
+											  colorRGBX8Buffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE ),
+											  activePixelCounter->resourceBarrierTransition( D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_SOURCE ),
+										  } );
+			colorRGBX8Buffer->copyTo( commandList, downloader.get() );
+			activePixelCounter->copyTo( commandList, activePixelDownloader.get() );
+			resourceBarrier( commandList, {
+											  colorRGBX8Buffer->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COMMON ),
+											  activePixelCounter->resourceBarrierTransition( D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COMMON ),
+										  } );
+
+			_timestamp->resolve( commandList );
+		} );
+		_deviceObject->queueObject()->execute( computeCommandList.get() );
+
+		// wait for CPU read.
+		{
+			std::shared_ptr<FenceObject> fence = _deviceObject->queueObject()->fence( _deviceObject->device() );
+			fence->wait();
+		}
+		heap->clear();
+
 		downloader->map( [&]( const void* p ) {
 			texture->uploadAsRGBA8( (const uint8_t*)p, _width, _height );
 		} );
-		timestampSpans = _timestamp->download(_deviceObject->queueObject()->queue() );
+		activePixelDownloader->map( [&]( const void* p ) {
+			memcpy( &_activePixels, p, sizeof( uint32_t ) );
+		} );
+		timestampSpans = _timestamp->download( _deviceObject->queueObject()->queue() );
+
+		_sampleIndex++;
 
 		_deviceObject->present();
 	}
@@ -637,10 +772,59 @@ public:
 	}
 	void setMatrixProjViewMatrix( glm::mat4 proj, glm::mat4 view )
 	{
-		_inverseVP = glm::inverse( proj * view );
+		glm::mat4 inverseVP = glm::inverse( proj * view );
+		if ( inverseVP != _inverseVP )
+		{
+			resetAccumulation();
+		}
+		_inverseVP = inverseVP;
 	}
 	void OnImGUI()
 	{
+		bool reset = false;
+		reset |= ImGui::Checkbox( "progressive", &_progressive );
+		if ( _progressive )
+		{
+			reset |= ImGui::SliderInt( "max depth", &_maxDepth, 1, 8 );
+			reset |= ImGui::Checkbox( "adaptive stop", &_adaptive );
+			reset |= ImGui::Checkbox( "stop per tile", &_tileStop );
+			reset |= ImGui::SliderFloat( "threshold", &_threshold, 0.001f, 0.2f );
+			reset |= ImGui::SliderInt( "min samples", &_minSamples, 2, 64 );
+			ImGui::Text( "samples %d, active pixels %d ( %.1f%% )", _sampleIndex, _activePixels, 100.0 * _activePixels / ( _width * _height ) );
+		}
+		else
+		{
+			ImGui::RadioButton( "color", &_outputMode, BVH_OUTPUT_COLOR );
+			ImGui::SameLine();
+			ImGui::RadioButton( "g-buffer", &_outputMode, BVH_OUTPUT_GBUFFER );
+			if ( _outputMode == BVH_OUTPUT_GBUFFER )
+			{
+				for ( cpu::GBufferChannel channel : {cpu::GBufferChannel::Depth, cpu::GBufferChannel::Normal, cpu::GBufferChannel::PrimID, cpu::GBufferChannel::Barycentrics} )
+				{
+					if ( channel != cpu::GBufferChannel::Depth )
+					{
+						ImGui::SameLine();
+					}
+					ImGui::RadioButton( cpu::gbufferChannelName( channel ), &_gbufferChannel, (int)channel );
+				}
+
+				// picking from the previous frame
+				const GBufferTexel& center = _gbuffer[( _height / 2 ) * _width + _width / 2];
+				if ( cpu::isHit( center ) )
+				{
+					ImGui::Text( "center: primID %u, depth %.3f", center.primID, center.depth );
+				}
+				else
+				{
+					ImGui::Text( "center: no hit" );
+				}
+			}
+		}
+		if ( reset )
+		{
+			resetAccumulation();
+		}
+
 		for (int i = 0; i < timestampSpans.size(); ++i)
 		{
 			ImGui::Text("%s, %.3f ms", timestampSpans[i].label.c_str(), timestampSpans[i].durationMS);
@@ -650,7 +834,7 @@ public:
 	std::vector<BvhNode> nodes;
 private:
 	int _width = 0, _height = 0;
-	glm::mat4 _inverseVP;
+	glm::mat4 _inverseVP = glm::mat4( 0.0f );
 	DeviceObject* _deviceObject;
 
 	std::unique_ptr<GPUBvhBuilder> builder;
@@ -659,18 +843,43 @@ private:
 	std::unique_ptr<StackDescriptorHeapObject> heap;
 	
 	std::unique_ptr<ComputeObject> compute_bvh_traverse;
+	std::unique_ptr<ComputeObject> compute_bvh_pathtrace;
 
 	std::unique_ptr<BufferObjectUAV> accumulationBuffer;
+	std::unique_ptr<BufferObjectUAV> luminanceSqBuffer;
+	std::unique_ptr<BufferObjectUAV> activePixelCounter;
+	std::unique_ptr<DownloaderObject> activePixelDownloader;
+	std::unique_ptr<UploaderObject> zeroU32;
 	std::unique_ptr<BufferObjectUAV> colorRGBX8Buffer;
 	std::unique_ptr<DownloaderObject> downloader;
 	std::unique_ptr<pr::ITexture> texture;
 
+	// g-buffer
+	int _outputMode = BVH_OUTPUT_COLOR;
+	int _gbufferChannel = (int)cpu::GBufferChannel::Normal;
+	std::unique_ptr<BufferObjectUAV> gbufferBuffer;
+	std::unique_ptr<DownloaderObject> gbufferDownloader;
+	std::vector<GBufferTexel> _gbuffer;
+	std::vector<glm::u8vec4> _gbufferImage;
+
 	std::unique_ptr<ConstantBufferObject> _argument;
+	std::unique_ptr<ConstantBufferObject> _pathTraceArgument;
+
+	// progressive
+	bool _progressive = false;
+	bool _adaptive = true;
+	bool _tileStop = false;
+	float _threshold = 0.02f;
+	int _minSamples = 16;
+	int _maxDepth = 4;
+	int _sampleIndex = 0;
+	uint32_t _activePixels = 0;
 
 	std::unique_ptr<TimestampObject> _timestamp;
 	std::vector<TimestampSpan> timestampSpans;
 
 	const lwh::Polygon* _polygon;
+	std::vector<glm::vec4> _spheres;
 };
 void drawNode( const std::vector<BvhNode>& nodes, int node, int depth = 0 )
 {
@@ -756,6 +965,27 @@ int main()
 
 	auto lwhPolygon = lwh::load( d );
 
+	// optional particles rendered as spheres
+	std::vector<glm::vec4> spheres;
+	const char* particlesPath = "../prim/out/particles.json";
+	if ( FILE* fp = fopen( GetDataPath( particlesPath ).c_str(), "rb" ) )
+	{
+		fclose( fp );
+
+		BinaryLoader particlesLoader;
+		particlesLoader.load( particlesPath );
+		particlesLoader.push_back( '\0' );
+
+		rapidjson::Document particlesDocument;
+		particlesDocument.ParseInsitu( (char*)particlesLoader.data() );
+		PR_ASSERT( particlesDocument.HasParseError() == false );
+
+		auto lwhParticles = lwh::load( particlesDocument );
+		spheres = lwh::pointsAsSpheres( lwhParticles.polygon );
+		delete lwhParticles.polygon;
+		printf( "%d spheres\n", (int)spheres.size() );
+	}
+
 	Config config;
 	config.ScreenWidth = 1280;
 	config.ScreenHeight = 720;
@@ -791,7 +1021,7 @@ int main()
 		if (rt == nullptr || rt->width() != GetScreenWidth() || rt->height() != GetScreenHeight())
 		{
 			rt = std::shared_ptr<Rt>();
-			rt = std::shared_ptr<Rt>(new Rt(devices[0].get(), lwhPolygon.polygon, GetScreenWidth(), GetScreenHeight()));
+			rt = std::shared_ptr<Rt>(new Rt(devices[0].get(), lwhPolygon.polygon, spheres, GetScreenWidth(), GetScreenHeight()));
 		}
 		if (reBuild)
 		{
@@ -0,0 +1,302 @@
+﻿#include "pr.hpp"
+#include "CpuRadixSort.hpp"
+#include "CpuSortKeys.hpp"
+#include "CpuRadixReorderEmulation.hpp"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+
+/*
+	Sort benchmark over key types, distributions, sizes and thread counts. Results go to stdout and a json file for regression tracking.
+	SortBenchmark [max log2 size, 26] [json path, sort_benchmark.json]
+	The sizes are 1K, 4K, .. up to the max. 1G keys ( 30 ) needs about 4 times the keys of memory
+*/
+
+// std::sort is the reference up to this size, as it takes seconds beyond
+#define STD_SORT_MAX_LOG2_SIZE 24
+
+// the thread scaling is measured at this size or the max size if smaller
+#define SCALING_LOG2_SIZE 24
+
+struct SortResult
+{
+	const char* key;
+	const char* distribution;
+	const char* algorithm;
+	uint64_t n;
+	int threads;
+	double ms;		// median
+	int passes;		// 0 for std::sort
+	uint64_t bytes; // estimated memory traffic, 0 for std::sort
+};
+
+/*
+	bytes of keys read and written by cpu::RadixSort: the OR / AND pre-pass, count ( read ) and reorder ( read and write ) in each pass,
+	and the copy back after an odd number of passes. Write allocation and the counters are not included.
+	The hybrid paths count an in-cache sort as a pass, so this is only a rough figure for them
+*/
+template <class Key>
+uint64_t radixSortBytes( uint64_t n, int passes )
+{
+	uint64_t keyBytes = n * sizeof( Key );
+	return keyBytes * ( 1 + 3 * passes + ( passes % 2 ) * 2 );
+}
+
+// median of repeated runs. Repeats for 0.2 seconds, at least 3 and at most 31 times. The copy of the input is not timed
+template <class Key, class F>
+double medianMs( std::vector<Key>& keys, const std::vector<Key>& input, F sort )
+{
+	using namespace pr;
+
+	std::vector<double> ms;
+	Stopwatch total;
+	while ( ms.size() < 3 || ( ms.size() < 31 && total.elapsed() < 0.2 ) )
+	{
+		keys = input;
+		Stopwatch sw;
+		sort( keys );
+		ms.push_back( 1000.0 * sw.elapsed() );
+	}
+	std::nth_element( ms.begin(), ms.begin() + ms.size() / 2, ms.end() );
+	return ms[ms.size() / 2];
+}
+
+void printResult( const SortResult& r )
+{
+	double seconds = r.ms / 1000.0;
+	printf( "[%s %s] n=%llu %s ( %d threads ) -- %.4f ms, %.1f Mkeys/s", r.key, r.distribution, (unsigned long long)r.n, r.algorithm, r.threads, r.ms, r.n / seconds / 1.0e6 );
+	if ( r.bytes )
+	{
+		printf( ", %d passes, %.2f GB/s", r.passes, r.bytes / seconds / 1.0e9 );
+	}
+	printf( "\n" );
+}
+
+template <class Key>
+void runKey( const char* keyName, int maxLog2Size, std::vector<cpu::ThreadPool*>& pools, std::vector<SortResult>& results )
+{
+	using namespace pr;
+
+	cpu::ThreadPool& pool = cpu::ThreadPool::global();
+	cpu::RadixSort<Key> sorter;
+
+	// measured once here on the pool of the benchmark, so it is not in the timings
+	const cpu::RadixHybrid& hybrid = cpu::RadixSort<Key>::tune( pool );
+	printf( "[%s] in-cache sort up to %d keys, merge sort up to %d keys\n", keyName, (int)hybrid.inCacheElements, (int)hybrid.mergeSortElements );
+
+	for ( cpu::KeyDistribution distribution : {cpu::KeyDistribution::Uniform, cpu::KeyDistribution::Sorted, cpu::KeyDistribution::ReverseSorted, cpu::KeyDistribution::AllEqual, cpu::KeyDistribution::FewUnique, cpu::KeyDistribution::Zipf, cpu::KeyDistribution::Morton} )
+	{
+		const char* distributionName = cpu::keyDistributionName( distribution );
+
+		for ( int log2Size = 10; log2Size <= maxLog2Size; log2Size += 2 )
+		{
+			uint64_t n = 1ull << log2Size;
+			std::vector<Key> input( n );
+			cpu::generateKeys( input.data(), n, distribution, log2Size );
+
+			std::vector<Key> keys;
+			SortResult radix = {keyName, distributionName, "cpu::RadixSort", n, pool.threadCount(), 0.0, 0, 0};
+			radix.ms = medianMs( keys, input, [&]( std::vector<Key>& xs ) { sorter.sort( xs.data(), xs.size(), pool ); } );
+			radix.passes = sorter.passCount();
+			radix.bytes = radixSortBytes<Key>( n, radix.passes );
+			printResult( radix );
+			results.push_back( radix );
+
+			PR_ASSERT( std::is_sorted( keys.begin(), keys.end() ) );
+
+			if ( log2Size <= STD_SORT_MAX_LOG2_SIZE )
+			{
+				std::vector<Key> expected;
+				SortResult reference = {keyName, distributionName, "std::sort", n, 1, 0.0, 0, 0};
+				reference.ms = medianMs( expected, input, []( std::vector<Key>& xs ) { std::sort( xs.begin(), xs.end() ); } );
+				printResult( reference );
+				results.push_back( reference );
+
+				PR_ASSERT( keys == expected );
+			}
+		}
+
+		// thread scaling
+		int log2Size = std::min( SCALING_LOG2_SIZE, maxLog2Size );
+		uint64_t n = 1ull << log2Size;
+		std::vector<Key> input( n );
+		cpu::generateKeys( input.data(), n, distribution, log2Size );
+		std::vector<Key> keys;
+		for ( cpu::ThreadPool* p : pools )
+		{
+			SortResult r = {keyName, distributionName, "cpu::RadixSort scaling", n, p->threadCount(), 0.0, 0, 0};
+			r.ms = medianMs( keys, input, [&]( std::vector<Key>& xs ) { sorter.sort( xs.data(), xs.size(), *p ); } );
+			r.passes = sorter.passCount();
+			r.bytes = radixSortBytes<Key>( n, r.passes );
+			printResult( r );
+			results.push_back( r );
+		}
+	}
+}
+
+/*
+	The GPU sort of main_radixsort.cpp on CPU with cpu::emulateRadixPass(), with the serial and the stably ranked radixsort_reorder.hlsl.
+	Checks that both give the same output in every pass and a stable sort in the end, and compares their cost in the lane model
+*/
+template <class Key>
+void runReorderEmulation( const char* keyName, uint32_t keyType, cpu::KeyDistribution distribution )
+{
+	using namespace pr;
+
+	uint32_t n = 1 << 20;
+	std::vector<typename cpu::RadixKey<Key>::Bits> keys( n );
+	cpu::generateKeys( keys.data(), n, distribution, 1 );
+	if ( keyType == RADIX_KEY_FLOAT32 )
+	{
+		for ( uint32_t i = 0; i < n; ++i )
+		{
+			float f = ( ( keys[i] >> 8 ) / (float)( 1 << 24 ) - 0.5f ) * 1000.0f;
+			memcpy( &keys[i], &f, sizeof( float ) );
+		}
+	}
+
+	// as the GPU buffers
+	std::vector<uint32_t> xs( n * sizeof( Key ) / 4 );
+	memcpy( xs.data(), keys.data(), n * sizeof( Key ) );
+	std::vector<uint32_t> values( n );
+	for ( uint32_t i = 0; i < n; ++i )
+	{
+		values[i] = i;
+	}
+
+	// bits of the sort order, the same as the keyBits pre-pass
+	auto sortBits = [&]( uint32_t i ) {
+		if ( keyType == RADIX_KEY_FLOAT32 )
+		{
+			float f;
+			memcpy( &f, &xs[i], 4 );
+			return (uint64_t)cpu::RadixKey<float>::bits( f );
+		}
+		return keyType == RADIX_KEY_UINT64 ? (uint64_t)xs[i * 2 + 1] << 32 | xs[i * 2] : (uint64_t)xs[i];
+	};
+	uint64_t orBits = 0;
+	uint64_t andBits = ~0ull;
+	for ( uint32_t i = 0; i < n; ++i )
+	{
+		orBits |= sortBits( i );
+		andBits &= sortBits( i );
+	}
+	cpu::RadixPass passes[16];
+	int nPasses = cpu::planRadixPasses( orBits ^ andBits, n, 8, passes );
+
+	std::vector<uint32_t> serialXs;
+	std::vector<uint32_t> serialValues;
+	std::vector<uint32_t> rankedXs;
+	std::vector<uint32_t> rankedValues;
+	cpu::ReorderEmulationStats serialStats;
+	cpu::ReorderEmulationStats rankedStats;
+	double serialMs = 0.0;
+	double rankedMs = 0.0;
+	for ( int i = 0; i < nPasses; ++i )
+	{
+		Stopwatch sw;
+		serialStats += cpu::emulateRadixPass( xs, serialXs, values, serialValues, keyType, passes[i], false );
+		serialMs += 1000.0 * sw.elapsed();
+
+		sw = Stopwatch();
+		rankedStats += cpu::emulateRadixPass( xs, rankedXs, values, rankedValues, keyType, passes[i], true );
+		rankedMs += 1000.0 * sw.elapsed();
+
+		PR_ASSERT( serialXs == rankedXs );
+		PR_ASSERT( serialValues == rankedValues );
+		std::swap( xs, rankedXs );
+		std::swap( values, rankedValues );
+	}
+
+	for ( uint32_t i = 1; i < n; ++i )
+	{
+		PR_ASSERT( sortBits( i - 1 ) < sortBits( i ) || ( sortBits( i - 1 ) == sortBits( i ) && values[i - 1] < values[i] ) );
+	}
+
+	printf( "[reorder emulation %s %s] %d passes, steps %llu -> %llu ( %.1fx ), store transactions %llu -> %llu ( %.1fx ), emulation %.2f ms -> %.2f ms\n",
+			keyName, cpu::keyDistributionName( distribution ), nPasses,
+			(unsigned long long)serialStats.steps, (unsigned long long)rankedStats.steps, (double)serialStats.steps / std::max( rankedStats.steps, (uint64_t)1 ),
+			(unsigned long long)serialStats.transactions, (unsigned long long)rankedStats.transactions, (double)serialStats.transactions / std::max( rankedStats.transactions, (uint64_t)1 ),
+			serialMs, rankedMs );
+}
+
+std::string resultsJson( const std::vector<SortResult>& results )
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer( buffer );
+
+	writer.StartObject();
+	writer.Key( "hardwareThreads" );
+	writer.Int( cpu::ThreadPool::global().threadCount() );
+	writer.Key( "results" );
+	writer.StartArray();
+	for ( const SortResult& r : results )
+	{
+		double seconds = r.ms / 1000.0;
+		writer.StartObject();
+		writer.Key( "key" );
+		writer.String( r.key );
+		writer.Key( "distribution" );
+		writer.String( r.distribution );
+		writer.Key( "algorithm" );
+		writer.String( r.algorithm );
+		writer.Key( "n" );
+		writer.Uint64( r.n );
+		writer.Key( "threads" );
+		writer.Int( r.threads );
+		writer.Key( "ms" );
+		writer.Double( r.ms );
+		writer.Key( "keysPerSecond" );
+		writer.Double( r.n / seconds );
+		writer.Key( "passes" );
+		writer.Int( r.passes );
+		writer.Key( "estimatedBytes" );
+		writer.Uint64( r.bytes );
+		writer.Key( "estimatedBytesPerSecond" );
+		writer.Double( r.bytes / seconds );
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	return buffer.GetString();
+}
+
+int main( int argc, char* argv[] )
+{
+	using namespace pr;
+	SetDataDir( ExecutableDir() );
+
+	int maxLog2Size = 2 <= argc ? atoi( argv[1] ) : 26;
+	const char* jsonPath = 3 <= argc ? argv[2] : "sort_benchmark.json";
+
+	// 1, 2, 4, .. threads and all of them
+	std::vector<std::unique_ptr<cpu::ThreadPool>> ownedPools;
+	std::vector<cpu::ThreadPool*> pools;
+	int hardwareThreads = cpu::ThreadPool::global().threadCount();
+	for ( int nThreads = 1; nThreads < hardwareThreads; nThreads *= 2 )
+	{
+		ownedPools.push_back( std::unique_ptr<cpu::ThreadPool>( new cpu::ThreadPool( nThreads ) ) );
+		pools.push_back( ownedPools.back().get() );
+	}
+	pools.push_back( &cpu::ThreadPool::global() );
+
+	for ( cpu::KeyDistribution distribution : {cpu::KeyDistribution::Uniform, cpu::KeyDistribution::Sorted, cpu::KeyDistribution::FewUnique, cpu::KeyDistribution::Morton} )
+	{
+		runReorderEmulation<uint32_t>( "uint32", RADIX_KEY_UINT32, distribution );
+		runReorderEmulation<float>( "float32", RADIX_KEY_FLOAT32, distribution );
+		runReorderEmulation<uint64_t>( "uint64", RADIX_KEY_UINT64, distribution );
+	}
+
+	std::vector<SortResult> results;
+	runKey<uint32_t>( "uint32", maxLog2Size, pools, results );
+	runKey<uint64_t>( "uint64", maxLog2Size, pools, results );
+
+	std::string json = resultsJson( results );
+	FILE* fp = fopen( jsonPath, "wb" );
+	if ( fp )
+	{
+		fwrite( json.data(), 1, json.size(), fp );
+		fclose( fp );
+	}
+	printf( "%s\n", jsonPath );
+}
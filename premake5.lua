@@ -55,7 +55,8 @@ project "Gaussian"
     flags { "MultiProcessorCompile", "NoPCH" }
 
     -- Src
-    files { "main_gaussian.cpp", "EzDx.hpp" }
+    includedirs { "kernels/" }
+    files { "main_gaussian.cpp", "EzDx.hpp", "CpuGaussian.hpp", "CpuParallel.hpp", "kernels/gaussian.h" }
 
     -- directx
     dx()
@@ -125,7 +126,8 @@ project "RadixSort"
     flags { "MultiProcessorCompile", "NoPCH" }
 
     -- Src
-    files { "main_radixsort.cpp", "EzDx.hpp" }
+    includedirs { "kernels/" }
+    files { "main_radixsort.cpp", "EzDx.hpp", "CpuRadixSort.hpp", "CpuRadixSelect.hpp", "CpuScan.hpp", "GpuRadixSelect.hpp", "GpuScan.hpp", "CpuParallel.hpp", "kernels/radixsort.h", "kernels/scan.h" }
 
     -- directx
     dx()
@@ -152,6 +154,36 @@ project "RadixSort"
         optimize "Full"
     filter{}
 
+project "SortBenchmark"
+    kind "ConsoleApp"
+    language "C++"
+    targetdir "bin/"
+    systemversion "latest"
+    flags { "MultiProcessorCompile", "NoPCH" }
+
+    -- Src
+    includedirs { "kernels/" }
+    files { "main_sortbench.cpp", "CpuRadixSort.hpp", "CpuScan.hpp", "CpuSortKeys.hpp", "CpuRadixReorderEmulation.hpp", "CpuParallel.hpp", "kernels/radixsort.h" }
+
+    -- rapidjson
+    includedirs { "libs/rapidjson/include" }
+    files { "libs/rapidjson/include/**.h" }
+
+    -- prlib
+    prlib()
+
+    symbols "On"
+
+    filter {"Debug"}
+        runtime "Debug"
+        targetname ("SortBenchmark_Debug")
+        optimize "Off"
+    filter {"Release"}
+        runtime "Release"
+        targetname ("SortBenchmark")
+        optimize "Full"
+    filter{}
+
 project "LinearRayCaster"
     kind "ConsoleApp"
     language "C++"
@@ -200,7 +232,7 @@ project "ParallelBvhRayCaster"
 
     -- Src
     includedirs { "kernels/" }
-    files { "main_rt_pbvh.cpp", "EzDx.hpp", "lwHoudiniLoader.hpp", "kernels/bvh.h" }
+    files { "main_rt_pbvh.cpp", "EzDx.hpp", "lwHoudiniLoader.hpp", "kernels/bvh.h", "CpuGBuffer.hpp", "CpuBvh.hpp", "CpuParallel.hpp", "GpuScan.hpp", "kernels/scan.h" }
 
     -- directx
     dx()
@@ -229,4 +261,33 @@ project "ParallelBvhRayCaster"
         runtime "Release"
         targetname ("ParallelBvhRayCaster")
         optimize "Full"
-    filter{}
\ No newline at end of file
+    filter{}
+project "CpuRayCaster"
+    kind "ConsoleApp"
+    language "C++"
+    targetdir "bin/"
+    systemversion "latest"
+    flags { "MultiProcessorCompile", "NoPCH" }
+
+    -- Src
+    includedirs { "kernels/" }
+    files { "main_rt_cpu.cpp", "CpuBvh.hpp", "CpuBvhStats.hpp", "CpuBvhClosestPoint.hpp", "CpuBvhOverlap.hpp", "CpuBvhFrustum.hpp", "CpuBvhQuantized.hpp", "CpuBvhReorder.hpp", "CpuLinearRt.hpp", "CpuGBuffer.hpp", "CpuParallel.hpp", "lwHoudiniLoader.hpp", "kernels/bvh.h" }
+
+    -- rapidjson
+    includedirs { "libs/rapidjson/include" }
+    files { "libs/rapidjson/include/**.h" }
+
+    -- prlib
+    prlib()
+
+    symbols "On"
+
+    filter {"Debug"}
+        runtime "Debug"
+        targetname ("CpuRayCaster_Debug")
+        optimize "Off"
+    filter {"Release"}
+        runtime "Release"
+        targetname ("CpuRayCaster")
+        optimize "Full"
+    filter{}
@@ -24,6 +24,10 @@ def exportObjGeometry(node):
             primitiveType = 'Polygon'
             break
 
+    # particles such as a point cache. rendered as spheres with pscale
+    if primitiveType == '' and 0 < rGeom.intrinsicValue('pointcount'):
+        primitiveType = 'Points'
+
     data = {
         'type' : primitiveType,
         'xform' : node.worldTransform().asTuple(),